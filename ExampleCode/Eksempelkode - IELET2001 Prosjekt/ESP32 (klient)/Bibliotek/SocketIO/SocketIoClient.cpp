@@ -1,17 +1,302 @@
 #include "SocketIoClient.h"
+#include <limits.h>
 
-const String getEventName(const String msg) {
-	return msg.substring(4, msg.indexOf("\"",4));
+/**
+ * skip a JSON string
+ * @param p char *    ptr to the opening quote
+ * @param end char *  end of the message
+ * @return ptr behind the closing quote or NULL if the string is not terminated
+ */
+static char * skipJsonString(char * p, char * end) {
+	p++;
+	while(p < end) {
+		if(*p == '\\') {
+			p += 2;
+		} else if(*p == '"') {
+			return p + 1;
+		} else {
+			p++;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * skip one JSON value (string, number, literal, array or object)
+ * @param p char *    ptr to the first char of the value
+ * @param end char *  end of the message
+ * @return ptr behind the value or NULL if the value is not terminated
+ */
+static char * skipJsonValue(char * p, char * end) {
+	int depth = 0;
+	while(p < end) {
+		switch(*p) {
+			case '"':
+				p = skipJsonString(p, end);
+				if(!p || depth == 0) {
+					return p;
+				}
+				continue;
+			case '[':
+			case '{':
+				depth++;
+				break;
+			case ']':
+			case '}':
+				if(depth == 0) {
+					return p;
+				}
+				if(--depth == 0) {
+					return p + 1;
+				}
+				break;
+			case ',':
+				if(depth == 0) {
+					return p;
+				}
+				break;
+		}
+		p++;
+	}
+	return depth == 0 ? p : NULL;
+}
+
+static char * skipSpace(char * p, char * end) {
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
 }
 
-const String getEventPayload(const String msg) {
-	String result = msg.substring(msg.indexOf("\"",4)+2,msg.length()-1);
-	if(result.startsWith("\"")) {
-		result.remove(0,1);
+/**
+ * parse a Engine.IO / Socket.IO text packet in one pass without copying it
+ * <eio type>[<sio type>][<attachments>-][/<nsp>,][<ack id>][<json data>]
+ * the event name and the data are terminated in place so msg must be writable
+ * @param msg char *                    the received text, modified!
+ * @param length size_t                 length of msg
+ * @param packet SocketIOPacket_t *     filled with views into msg
+ * @return true if the packet is valid, false also if its ack id does not fit in 32 bits as the ack ids of the client
+ */
+bool socketIoParsePacket(char * msg, size_t length, SocketIOPacket_t * packet) {
+	packet->eioType = 0;
+	packet->sioType = 0;
+	packet->nsp = NULL;
+	packet->nspLength = 0;
+	packet->hasAckId = false;
+	packet->ackId = 0;
+	packet->event = NULL;
+	packet->eventLength = 0;
+	packet->data = NULL;
+	packet->dataLength = 0;
+
+	if(!msg || length == 0) {
+		return false;
+	}
+
+	char * p = msg;
+	char * end = msg + length;
+
+	packet->eioType = *p++;
+	if(packet->eioType != '4') {
+		// ping, pong, open, ... the rest is Engine.IO data
+		packet->data = p;
+		packet->dataLength = end - p;
+		return true;
+	}
+
+	if(p == end) {
+		return false;
+	}
+	packet->sioType = *p++;
+
+	if(packet->sioType == '5' || packet->sioType == '6') {
+		// binary packets announce their attachment count with "<n>-"
+		while(p < end && isdigit((unsigned char) *p)) {
+			p++;
+		}
+		if(p == end || *p != '-') {
+			return false;
+		}
+		p++;
+	}
+
+	if(p < end && *p == '/') {
+		packet->nsp = ++p;
+		while(p < end && *p != ',') {
+			p++;
+		}
+		packet->nspLength = p - packet->nsp;
+		if(p < end) {
+			p++;
+		}
+	}
+
+	if(p < end && isdigit((unsigned char) *p)) {
+		packet->hasAckId = true;
+		while(p < end && isdigit((unsigned char) *p)) {
+			uint32_t digit = *p - '0';
+			// an ack id that does not fit can not be answered, so the packet is invalid
+			if(packet->ackId > (UINT32_MAX - digit) / 10) {
+				packet->hasAckId = false;
+				packet->ackId = 0;
+				return false;
+			}
+			packet->ackId = packet->ackId * 10 + digit;
+			p++;
+		}
+	}
+
+	p = skipSpace(p, end);
+	if(p == end) {
+		return (packet->sioType != '2' && packet->sioType != '5');
+	}
+
+	if(*p != '[') {
+		// CONNECT and ERROR carry an object instead of an argument array
+		packet->data = p;
+		packet->dataLength = end - p;
+		return true;
+	}
+	p = skipSpace(p + 1, end);
+
+	if(packet->sioType == '2' || packet->sioType == '5') {
+		if(p == end || *p != '"') {
+			return false;
+		}
+		char * eventEnd = skipJsonString(p, end);
+		if(!eventEnd) {
+			return false;
+		}
+		packet->event = p + 1;
+		packet->eventLength = eventEnd - p - 2;
+		p = skipSpace(eventEnd, end);
+		if(p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		}
+		eventEnd[-1] = 0x00;
+	}
+
+	// all remaining arguments up to the closing bracket
+	char * args = p;
+	char * argsEnd = p;
+	size_t count = 0;
+	while(p < end && *p != ']') {
+		char * next = skipJsonValue(p, end);
+		if(!next || next == p) {
+			return false;
+		}
+		count++;
+		argsEnd = next;
+		p = skipSpace(next, end);
+		if(p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		}
+	}
+	if(p == end) {
+		return false;
+	}
+
+	if(count == 0) {
+		return true;
+	}
+
+	if(count == 1 && *args == '"') {
+		args++;
+		argsEnd--;
 	}
-	if(result.endsWith("\"")) {
-		result.remove(result.length()-1);
+	*argsEnd = 0x00;
+	packet->data = args;
+	packet->dataLength = argsEnd - args;
+	return true;
+}
+
+/**
+ * read the ping interval and timeout from the data of a Engine.IO open packet
+ * {"sid":"<id>","upgrades":[],"pingInterval":25000,"pingTimeout":20000}
+ * a value that is missing, 0 or too large for an unsigned long is left unchanged
+ * @param data char *                   the JSON object
+ * @param length size_t                 length of data
+ * @param pingInterval unsigned long *  set to the ping interval in ms
+ * @param pingTimeout unsigned long *   set to the ping timeout in ms
+ * @return true if the object is valid
+ */
+bool socketIoParseOpen(char * data, size_t length, unsigned long * pingInterval, unsigned long * pingTimeout) {
+	if(!data) {
+		return false;
 	}
+	char * end = data + length;
+	char * p = skipSpace(data, end);
+	if(p == end || *p != '{') {
+		return false;
+	}
+	p = skipSpace(p + 1, end);
+
+	while(p < end && *p != '}') {
+		if(*p != '"') {
+			return false;
+		}
+		char * key = p + 1;
+		char * keyEnd = skipJsonString(p, end);
+		if(!keyEnd) {
+			return false;
+		}
+		size_t keyLength = keyEnd - key - 1;
+		p = skipSpace(keyEnd, end);
+		if(p == end || *p != ':') {
+			return false;
+		}
+		char * value = skipSpace(p + 1, end);
+		p = skipJsonValue(value, end);
+		if(!p || p == value) {
+			return false;
+		}
+
+		unsigned long * target = NULL;
+		if(keyLength == 12 && memcmp(key, "pingInterval", 12) == 0) {
+			target = pingInterval;
+		} else if(keyLength == 11 && memcmp(key, "pingTimeout", 11) == 0) {
+			target = pingTimeout;
+		}
+		if(target) {
+			unsigned long number = 0;
+			while(value < p && isdigit((unsigned char) *value)) {
+				unsigned long digit = *value - '0';
+				// a number that does not fit would wrap around to a short interval
+				if(number > (ULONG_MAX - digit) / 10) {
+					number = 0;
+					break;
+				}
+				number = number * 10 + digit;
+				value++;
+			}
+			if(number > 0) {
+				*target = number;
+			}
+		}
+
+		p = skipSpace(p, end);
+		if(p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		}
+	}
+	return p < end;
+}
+
+/**
+ * add the Engine.IO version to the url, unless it already asks for one
+ * @param url const char *  url of the socket.io endpoint
+ * @param eio uint8_t *     version to add, set to the one in the url if it has one
+ * @return url with the EIO parameter
+ */
+static String engineIoUrl(const char * url, uint8_t * eio) {
+	const char * param = strstr(url, "EIO=");
+	if(param && isdigit((unsigned char) param[4])) {
+		*eio = param[4] - '0';
+		return String(url);
+	}
+	String result(url);
+	result += strchr(url, '?') ? "&EIO=" : "?EIO=";
+	result += (int) *eio;
 	return result;
 }
 
@@ -25,108 +310,674 @@ static void hexdump(const uint32_t* src, size_t count) {
     }
 }
 
+static constexpr uint32_t EVENT_CONNECT = socketIoEventId("connect");
+static constexpr uint32_t EVENT_DISCONNECT = socketIoEventId("disconnect");
+
+/**
+ * hash a event name that is not NUL terminated, same result as the constexpr version
+ * @param name const char *  event name
+ * @param length size_t      length of the name
+ * @return event id
+ */
+uint32_t socketIoEventId(const char * name, size_t length) {
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+	}
+	return hash;
+}
+
+SocketIoClient::SocketIoClient() {
+	memset(_events, 0, sizeof(_events));
+	_eventCount = 0;
+	_ackHead = 0;
+	_ackCount = 0;
+	_nextAckId = 0;
+	_retransmitCount = 0;
+	_txRead = 0;
+	_txWrite = 0;
+	_txPackets = 0;
+	_eio = SOCKETIOCLIENT_EIO_VERSION;
+	_open = false;
+	_connected = false;
+	_pingPending = false;
+	_pingInterval = PING_INTERVAL;
+	_pingTimeout = PING_TIMEOUT;
+	_lastPing = 0;
+	_lastReceive = 0;
+	_linkUp = false;
+	_connectPending = false;
+	_connectStart = 0;
+	_connectTime = 0;
+	_connectCount = 0;
+}
+
+/**
+ * reserve room for one packet at the end of the ring
+ * every packet is stored as a 2 byte length followed by the data, the top bit of the length marks a binary packet,
+ * a length of 0xFFFF marks that the rest of the buffer is unused and the next packet starts at 0
+ * @param length size_t  packet length
+ * @param binary bool  send the packet as a binary frame
+ * @return ptr to the packet data or NULL if the ring is full
+ */
+uint8_t * SocketIoClient::txReserve(size_t length, bool binary) {
+	size_t needed = length + 2;
+	if(length >= 0x7FFF || needed > SOCKETIOCLIENT_TX_BUFFER_SIZE) {
+		return NULL;
+	}
+
+	if(_txPackets == 0) {
+		_txRead = 0;
+		_txWrite = 0;
+	} else if(_txWrite == _txRead) {
+		return NULL;
+	}
+
+	if(_txWrite >= _txRead) {
+		if(SOCKETIOCLIENT_TX_BUFFER_SIZE - _txWrite < needed) {
+			// not enough room at the end, wrap around if the front is free
+			if(needed > _txRead) {
+				return NULL;
+			}
+			if(SOCKETIOCLIENT_TX_BUFFER_SIZE - _txWrite >= 2) {
+				_txBuffer[_txWrite] = 0xFF;
+				_txBuffer[_txWrite + 1] = 0xFF;
+			}
+			_txWrite = 0;
+		}
+	} else if(_txRead - _txWrite < needed) {
+		return NULL;
+	}
+
+	uint8_t * slot = &_txBuffer[_txWrite];
+	slot[0] = ((length >> 8) & 0x7F) | (binary ? 0x80 : 0x00);
+	slot[1] = length & 0xFF;
+	_txWrite += needed;
+	_txPackets++;
+	return slot + 2;
+}
+
+/**
+ * get the oldest packet in the ring without removing it
+ * @param length size_t *  set to the packet length
+ * @param binary bool *  set if the packet is sent as a binary frame
+ * @return ptr to the packet data or NULL if the ring is empty
+ */
+uint8_t * SocketIoClient::txPeek(size_t * length, bool * binary) {
+	if(_txPackets == 0) {
+		return NULL;
+	}
+
+	if(SOCKETIOCLIENT_TX_BUFFER_SIZE - _txRead < 2 || (_txBuffer[_txRead] == 0xFF && _txBuffer[_txRead + 1] == 0xFF)) {
+		_txRead = 0;
+	}
+
+	*length = ((_txBuffer[_txRead] & 0x7F) << 8) | _txBuffer[_txRead + 1];
+	*binary = (_txBuffer[_txRead] & 0x80) != 0;
+	return &_txBuffer[_txRead + 2];
+}
+
+/**
+ * remove the packet returned by txPeek
+ * @param length size_t  packet length
+ */
+void SocketIoClient::txPop(size_t length) {
+	_txRead += length + 2;
+	_txPackets--;
+	if(_txPackets == 0) {
+		_txRead = 0;
+		_txWrite = 0;
+	}
+}
+
 void SocketIoClient::webSocketEvent(WStype_t type, uint8_t * payload, size_t length) {
-	String msg;
+	SocketIOPacket_t packet;
 	switch(type) {
 		case WStype_DISCONNECTED:
 			SOCKETIOCLIENT_DEBUG("[SOCKETIO] Disconnected from NTNU servers.\n");
+			_open = false;
+			_pingPending = false;
+			// packets without ack are sent again on the next connection
+			for(size_t i = 0; i < _ackCount; i++) {
+				_acks[(_ackHead + i) % SOCKETIOCLIENT_MAX_PENDING_ACKS].sent = false;
+			}
+			if(!_connectPending) {
+				_connectPending = true;
+				_connectStart = millis();
+			}
+			// the server is gone without a socket.io disconnect, tell the program as if it had sent one
+			if(_connected) {
+				_connected = false;
+				trigger(EVENT_DISCONNECT, NULL, 0);
+			}
 			break;
 		case WStype_CONNECTED:
 			//SOCKETIOCLIENT_DEBUG("[SOCKETIO] Connected to NTNU servers. \n");
+			_open = false;
+			_pingPending = false;
+			_lastReceive = millis();
 			break;
 		case WStype_TEXT:
-			msg = String((char*)payload);
-			if(msg.startsWith("42")) {
-				trigger(getEventName(msg).c_str(), getEventPayload(msg).c_str(), length);
-			} else if(msg.startsWith("2")) {
-				_webSocket.sendTXT("3");
-			} else if(msg.startsWith("40")) {
-				trigger("connect", NULL, 0);
-			} else if(msg.startsWith("41")) {
-				trigger("disconnect", NULL, 0);
+			_lastReceive = millis();
+			_pingPending = false;
+			if(!socketIoParsePacket((char *) payload, length, &packet)) {
+				SOCKETIOCLIENT_DEBUG("[SOCKETIO] invalid packet dropped\n");
+				break;
+			}
+			if(packet.eioType != '4') {
+				engineIoPacket(&packet);
+			} else {
+				switch(packet.sioType) {
+					case '0':
+						if(_connectPending) {
+							_connectPending = false;
+							_connectTime = millis() - _connectStart;
+							_connectCount++;
+							DIAGNOSTICS_RECORD(STAGE_RECONNECT, _connectTime * 1000);
+							SOCKETIOCLIENT_DEBUG("[SOCKETIO] connected after %lu ms (%u connects)\n", _connectTime, (unsigned) _connectCount);
+						}
+						_connected = true;
+						trigger(EVENT_CONNECT, NULL, 0);
+						break;
+					case '1':
+						_connected = false;
+						trigger(EVENT_DISCONNECT, NULL, 0);
+						break;
+					case '2':
+						trigger(socketIoEventId(packet.event, packet.eventLength), packet.data, packet.dataLength);
+						// the server asked for an ack, it is sent in the namespace of the event when the handler has run
+						if(packet.hasAckId) {
+							char ack[64];
+							int ackLength;
+							if(packet.nspLength > 0) {
+								ackLength = snprintf(ack, sizeof(ack), "43/%.*s,%u[]", (int) packet.nspLength, packet.nsp, (unsigned) packet.ackId);
+							} else {
+								ackLength = snprintf(ack, sizeof(ack), "43%u[]", (unsigned) packet.ackId);
+							}
+							if(ackLength > 0 && (size_t) ackLength < sizeof(ack)) {
+								_webSocket.sendTXT(ack, ackLength);
+							} else {
+								SOCKETIOCLIENT_DEBUG("[SOCKETIO] namespace too long to ack\n");
+							}
+						}
+						break;
+					case '3':
+						if(packet.hasAckId) {
+							ackReceived(packet.ackId);
+						}
+						break;
+				}
 			}
 			break;
 		case WStype_BIN:
-			SOCKETIOCLIENT_DEBUG("[SOCKETIO] get binary length: %u\n", length);
+			_lastReceive = millis();
+			_pingPending = false;
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] get binary length: %u\n", (unsigned) length);
 			hexdump((uint32_t*) payload, length);
 		break;
+		default:
+			// the socket.io server does not fragment its messages, fragments and errors are ignored
+			break;
+	}
+}
+
+/**
+ * handle the Engine.IO packets that carry no socket.io message
+ * the server sends its ping interval and timeout in the open packet. With EIO3 the client pings the server, with
+ * EIO4 the server pings the client, and socket.io 3 and later wait for the client to connect to the namespace.
+ * @param packet const SocketIOPacket_t *  parsed packet
+ */
+void SocketIoClient::engineIoPacket(const SocketIOPacket_t * packet) {
+	switch(packet->eioType) {
+		case '0':
+			_pingInterval = PING_INTERVAL;
+			_pingTimeout = PING_TIMEOUT;
+			if(!socketIoParseOpen((char *) packet->data, packet->dataLength, &_pingInterval, &_pingTimeout)) {
+				SOCKETIOCLIENT_DEBUG("[SOCKETIO] invalid open packet, default ping used\n");
+			}
+			_open = true;
+			_lastPing = millis();
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] EIO%u open, ping interval %lu ms, timeout %lu ms\n", (unsigned) _eio, _pingInterval, _pingTimeout);
+			if(_eio >= 4) {
+				_webSocket.sendTXT("40");
+			}
+			break;
+		case '1':
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] closed by the server\n");
+			_webSocket.disconnect();
+			break;
+		case '2':
+			// a ping with data, like a probe, is answered with the same data of any length. The type is right before the
+			// data in the received message, so it is changed to a pong in place and the message is sent back
+			if(packet->dataLength == 0) {
+				_webSocket.sendTXT("3");
+			} else {
+				char * pong = (char *) packet->data - 1;
+				pong[0] = '3';
+				_webSocket.sendTXT(pong, packet->dataLength + 1);
+			}
+			break;
 	}
 }
 
+/**
+ * check that the server is still there, both versions give up when the server has been silent for the timeout
+ * EIO3: no packet within the ping timeout after a ping of the client
+ * EIO4: no packet, so no ping of the server, within the ping interval and the ping timeout
+ * @return false if the server is taken as lost
+ */
+bool SocketIoClient::peerAlive() {
+	if(!_open) {
+		return true;
+	}
+	if(_eio >= 4) {
+		return millis() - _lastReceive < _pingInterval + _pingTimeout;
+	}
+	return !_pingPending || millis() - _lastPing < _pingTimeout;
+}
+
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
 void SocketIoClient::beginSSL(const char* host, const int port, const char* url, const char* fingerprint) {
-	_webSocket.beginSSL(host, port, url, fingerprint);
+	_webSocket.beginSSL(host, port, engineIoUrl(url, &_eio).c_str(), fingerprint);
     initialize();
 }
+#endif
 
 void SocketIoClient::begin(const char* host, const int port, const char* url) {
-	_webSocket.begin(host, port, url);
+	_webSocket.begin(host, port, engineIoUrl(url, &_eio).c_str());
     initialize();
 }
 
+/**
+ * choose the Engine.IO version, call before begin
+ * the server has to support it, socket.io 2 speaks 3 only, socket.io 3 and later speak 4 and 3 with allowEIO3
+ * @param version uint8_t  3 or 4, SOCKETIOCLIENT_EIO_VERSION by default
+ */
+void SocketIoClient::setEngineIoVersion(uint8_t version) {
+	_eio = version;
+}
+
 void SocketIoClient::initialize() {
     _webSocket.onEvent(std::bind(&SocketIoClient::webSocketEvent, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 	_lastPing = millis();
+	_connectPending = true;
+	_connectStart = millis();
 }
 
 void SocketIoClient::loop() {
+#if defined(ESP8266) || defined(ESP32)
+	// the connect time is measured from the moment Wi-Fi is up
+	bool linkUp = (WiFi.status() == WL_CONNECTED);
+	if(linkUp && !_linkUp) {
+		_connectPending = true;
+		_connectStart = millis();
+	}
+	_linkUp = linkUp;
+#endif
 	_webSocket.loop();
-	for(auto packet=_packets.begin(); packet != _packets.end();) {
-		if(_webSocket.sendTXT(*packet)) {
-			SOCKETIOCLIENT_DEBUG("[SOCKETIO] packet \"%s\" emitted\n", packet->c_str());
-			packet = _packets.erase(packet);
+	size_t length;
+	bool binary;
+	uint8_t * packet;
+	// packets leave in the order they were emitted, stop at the first one the socket refuses
+	while((packet = txPeek(&length, &binary)) != NULL) {
+		if(binary) {
+			if(!_webSocket.sendBIN(packet, length)) {
+				break;
+			}
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] binary packet of %u bytes emitted\n", (unsigned) length);
 		} else {
-			++packet;
+			if(!_webSocket.sendTXT(packet, length)) {
+				break;
+			}
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] packet \"%.*s\" emitted\n", (int) length, (const char *) packet);
 		}
+		txPop(length);
 	}
 
-	if(millis() - _lastPing > PING_INTERVAL) {
+	if(!peerAlive()) {
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] nothing from the server for %lu ms, server lost\n", millis() - _lastReceive);
+		_webSocket.disconnect();
+		return;
+	}
+
+	sendPendingAcks();
+
+	// elapsed time is compared, so the ping keeps going when millis() wraps
+	if(_open && _eio < 4 && !_pingPending && millis() - _lastPing >= _pingInterval) {
 		_webSocket.sendTXT("2");
 		_lastPing = millis();
+		_pingPending = true;
+	}
+}
+
+/**
+ * send the packets that wait for an ack and were not sent on this connection, or got no ack within
+ * SOCKETIOCLIENT_ACK_TIMEOUT. Only after the socket.io connect, so packets the connect handler emits, like a
+ * authentication, go first.
+ */
+void SocketIoClient::sendPendingAcks() {
+	if(!_connected) {
+		return;
+	}
+	for(size_t i = 0; i < _ackCount; i++) {
+		SocketIOPendingAck_t * slot = &_acks[(_ackHead + i) % SOCKETIOCLIENT_MAX_PENDING_ACKS];
+		if(slot->acked || (slot->sent && millis() - slot->sentTime < SOCKETIOCLIENT_ACK_TIMEOUT)) {
+			continue;
+		}
+		if(!_webSocket.sendTXT((uint8_t *) slot->packet, slot->length)) {
+			break;
+		}
+		if(slot->sends > 0) {
+			_retransmitCount++;
+			SOCKETIOCLIENT_DEBUG("[SOCKETIO] packet %u sent again\n", (unsigned) slot->ackId);
+		}
+		slot->sent = true;
+		slot->sends++;
+		slot->sentTime = millis();
+	}
+}
+
+/**
+ * mark the packet with the ack id as delivered, and free the slots from the oldest up to the first without ack
+ * an ack for a packet that is no longer waiting, because it was sent twice, is ignored
+ * @param ackId uint32_t  ack id from the server
+ */
+void SocketIoClient::ackReceived(uint32_t ackId) {
+	for(size_t i = 0; i < _ackCount; i++) {
+		SocketIOPendingAck_t * slot = &_acks[(_ackHead + i) % SOCKETIOCLIENT_MAX_PENDING_ACKS];
+		if(!slot->acked && slot->ackId == ackId) {
+			slot->acked = true;
+			break;
+		}
+	}
+	while(_ackCount > 0 && _acks[_ackHead].acked) {
+		_ackHead = (_ackHead + 1) % SOCKETIOCLIENT_MAX_PENDING_ACKS;
+		_ackCount--;
+	}
+}
+
+/**
+ * look up the slot of a event, linear probing from the hash
+ * @param id uint32_t  event id
+ * @return slot or NULL if no handler is registered
+ */
+SocketIOEventSlot_t * SocketIoClient::findEvent(uint32_t id) {
+	for(size_t i = 0; i < SOCKETIOCLIENT_MAX_EVENTS; i++) {
+		SocketIOEventSlot_t * slot = &_events[(id + i) & (SOCKETIOCLIENT_MAX_EVENTS - 1)];
+		if(slot->used && slot->id == id) {
+			return slot;
+		}
+		if(!slot->used && !slot->deleted) {
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * get the slot for a event, reusing the existing one or taking the first free one
+ * @param id uint32_t  event id
+ * @return slot or NULL if the table is full
+ */
+SocketIOEventSlot_t * SocketIoClient::addEvent(uint32_t id) {
+	SocketIOEventSlot_t * slot = findEvent(id);
+	if(slot) {
+		return slot;
+	}
+	for(size_t i = 0; i < SOCKETIOCLIENT_MAX_EVENTS; i++) {
+		slot = &_events[(id + i) & (SOCKETIOCLIENT_MAX_EVENTS - 1)];
+		if(!slot->used) {
+			slot->id = id;
+			slot->used = true;
+			slot->deleted = false;
+			_eventCount++;
+			return slot;
+		}
 	}
+	SOCKETIOCLIENT_DEBUG("[SOCKETIO] event table full, %08x not added\n", id);
+	return NULL;
 }
 
-void SocketIoClient::on(const char* event, std::function<void (const char * payload, size_t length)> func) {
-	_events[event] = func;
+bool SocketIoClient::on(const char* event, SocketIoEvent func) {
+	return on(socketIoEventId(event, strlen(event)), func);
+}
+
+bool SocketIoClient::on(uint32_t eventId, SocketIoEvent func) {
+	SocketIOEventSlot_t * slot = addEvent(eventId);
+	if(!slot) {
+		return false;
+	}
+	slot->cb = func;
+	slot->ctxCb = NULL;
+	slot->context = NULL;
+	return true;
+}
+
+bool SocketIoClient::on(uint32_t eventId, SocketIoContextEvent func, void * context) {
+	SocketIOEventSlot_t * slot = addEvent(eventId);
+	if(!slot) {
+		return false;
+	}
+	slot->cb = NULL;
+	slot->ctxCb = func;
+	slot->context = context;
+	return true;
 }
 
 void SocketIoClient::emit(const char* event, const char * payload) {
-	String msg = String("42[\"");
-	msg += event;
-	msg += "\"";
+	DIAGNOSTICS_SCOPE(STAGE_EMIT);
+	size_t eventLength = strlen(event);
+	size_t payloadLength = payload ? strlen(payload) : 0;
+	// 42["<event>"] plus ,<payload> when there is one
+	size_t length = 6 + eventLength + (payload ? payloadLength + 1 : 0);
+
+	uint8_t * msg = txReserve(length);
+	if(!msg) {
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] packet buffer full, event %s dropped\n", event);
+		return;
+	}
+
+	memcpy(msg, "42[\"", 4);
+	msg += 4;
+	memcpy(msg, event, eventLength);
+	msg += eventLength;
+	*msg++ = '"';
 	if(payload) {
-		msg += ",";
-		msg += payload;
+		*msg++ = ',';
+		memcpy(msg, payload, payloadLength);
+		msg += payloadLength;
+	}
+	*msg = ']';
+	SOCKETIOCLIENT_DEBUG("[SOCKETIO] add packet %.*s\n", (int) length, (const char *) (msg + 1 - length));
+}
+
+/**
+ * emit a event with one binary argument, sent as a Socket.IO BINARY_EVENT
+ * a text packet with a placeholder followed by the data in a binary frame,
+ * both are queued or neither if the ring is full
+ * @param event const char *  event name
+ * @param data const uint8_t *  argument
+ * @param length size_t  length of data
+ */
+void SocketIoClient::emitBinary(const char* event, const uint8_t * data, size_t length) {
+	DIAGNOSTICS_SCOPE(STAGE_EMIT);
+	static const char PREFIX[] = "451-[\"";
+	static const char PLACEHOLDER[] = "\",{\"_placeholder\":true,\"num\":0}]";
+	size_t eventLength = strlen(event);
+	size_t headerLength = (sizeof(PREFIX) - 1) + eventLength + (sizeof(PLACEHOLDER) - 1);
+
+	size_t txRead = _txRead;
+	size_t txWrite = _txWrite;
+	size_t txPackets = _txPackets;
+	// binary Engine.IO 3 messages over websocket start with the packet type, Engine.IO 4 sends the data as it is
+	size_t typeLength = _eio < 4 ? 1 : 0;
+	uint8_t * header = txReserve(headerLength);
+	uint8_t * msg = header ? txReserve(length + typeLength, true) : NULL;
+	if(!msg) {
+		_txRead = txRead;
+		_txWrite = txWrite;
+		_txPackets = txPackets;
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] packet buffer full, event %s dropped\n", event);
+		return;
+	}
+
+	memcpy(header, PREFIX, sizeof(PREFIX) - 1);
+	header += sizeof(PREFIX) - 1;
+	memcpy(header, event, eventLength);
+	header += eventLength;
+	memcpy(header, PLACEHOLDER, sizeof(PLACEHOLDER) - 1);
+
+	if(typeLength) {
+		msg[0] = 0x04;
 	}
-	msg += "]";
-	SOCKETIOCLIENT_DEBUG("[SOCKETIO] add packet %s\n", msg.c_str());
-	_packets.push_back(msg);
+	memcpy(msg + typeLength, data, length);
+	SOCKETIOCLIENT_DEBUG("[SOCKETIO] add binary packet %s of %u bytes\n", event, (unsigned) length);
+}
+
+/**
+ * emit a event with a ack id, 42<id>["<event>",<payload>], that is sent again until the server acks it with
+ * 43<id>[...]. After a reconnect it is sent again on the new connection, so it arrives at least once.
+ * at most SOCKETIOCLIENT_MAX_PENDING_ACKS packets wait for an ack, the caller keeps the event while the window is full
+ * @param event const char *    event name
+ * @param payload const char *  JSON argument, NULL for none
+ * @param ackId uint32_t *      set to the ack id of the packet, for isAcked. NULL if not needed
+ * @return false if the window is full or the packet is longer than SOCKETIOCLIENT_ACK_PACKET_SIZE
+ */
+bool SocketIoClient::emitWithAck(const char* event, const char * payload, uint32_t * ackId) {
+	DIAGNOSTICS_SCOPE(STAGE_EMIT);
+	if(_ackCount == SOCKETIOCLIENT_MAX_PENDING_ACKS) {
+		return false;
+	}
+
+	SocketIOPendingAck_t * slot = &_acks[(_ackHead + _ackCount) % SOCKETIOCLIENT_MAX_PENDING_ACKS];
+	int length;
+	if(payload) {
+		length = snprintf(slot->packet, sizeof(slot->packet), "42%u[\"%s\",%s]", (unsigned) _nextAckId, event, payload);
+	} else {
+		length = snprintf(slot->packet, sizeof(slot->packet), "42%u[\"%s\"]", (unsigned) _nextAckId, event);
+	}
+	if(length < 0 || (size_t) length >= sizeof(slot->packet)) {
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] event %s too long to be sent with ack\n", event);
+		return false;
+	}
+
+	slot->ackId = _nextAckId++;
+	slot->acked = false;
+	slot->sent = false;
+	slot->sends = 0;
+	slot->sentTime = 0;
+	slot->length = length;
+	_ackCount++;
+	if(ackId) {
+		*ackId = slot->ackId;
+	}
+	SOCKETIOCLIENT_DEBUG("[SOCKETIO] add packet %s\n", slot->packet);
+	return true;
 }
 
 void SocketIoClient::remove(const char* event) {
-	auto e = _events.find(event);
-	if(e != _events.end()) {
-		_events.erase(e);
+	remove(socketIoEventId(event, strlen(event)));
+}
+
+void SocketIoClient::remove(uint32_t eventId) {
+	SocketIOEventSlot_t * slot = findEvent(eventId);
+	if(slot) {
+		slot->used = false;
+		slot->deleted = true;
+		slot->cb = NULL;
+		slot->ctxCb = NULL;
+		_eventCount--;
 	} else {
-		SOCKETIOCLIENT_DEBUG("[SOCKETIO] event %s not found, can not be removed", event);
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] event %08x not found, can not be removed", eventId);
 	}
 }
 
-void SocketIoClient::trigger(const char* event, const char * payload, size_t length) {
-	auto e = _events.find(event);
-	if(e != _events.end()) {
-		SOCKETIOCLIENT_DEBUG("[SOCKETIO] trigger event %s\n", event);
-		e->second(payload, length);
+void SocketIoClient::trigger(uint32_t id, const char * payload, size_t length) {
+	SocketIOEventSlot_t * slot = findEvent(id);
+	if(slot) {
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] trigger event %08x\n", id);
+		if(slot->ctxCb) {
+			slot->ctxCb(slot->context, payload, length);
+		} else if(slot->cb) {
+			slot->cb(payload, length);
+		}
 	} else {
-		SOCKETIOCLIENT_DEBUG("[SOCKETIO] event %s not found. %d events available\n", event, _events.size());
+		SOCKETIOCLIENT_DEBUG("[SOCKETIO] event %08x not found. %u events available\n", id, (unsigned) _eventCount);
 	}
 }
 
 void SocketIoClient::disconnect()
 {
+	// the disconnect is triggered here, not again by the closed websocket
+	_connected = false;
 	_webSocket.disconnect();
-	trigger("disconnect", NULL, 0);
+	trigger(EVENT_DISCONNECT, NULL, 0);
 }
 
 void SocketIoClient::setAuthorization(const char * user, const char * password) {
     _webSocket.setAuthorization(user, password);
 }
+
+/**
+ * time from Wi-Fi up, or from losing the server while Wi-Fi stayed up, to the socket.io connect
+ * @return duration of the last (re)connect in ms, 0 before the first connect
+ */
+unsigned long SocketIoClient::getConnectTime() const {
+	return _connectTime;
+}
+
+/**
+ * @return number of socket.io connects since begin, the first one included
+ */
+uint32_t SocketIoClient::getConnectCount() const {
+	return _connectCount;
+}
+
+/**
+ * @return Engine.IO version asked for in the url
+ */
+uint8_t SocketIoClient::getEngineIoVersion() const {
+	return _eio;
+}
+
+/**
+ * @return ping interval in ms, from the open packet of the server
+ */
+unsigned long SocketIoClient::getPingInterval() const {
+	return _pingInterval;
+}
+
+/**
+ * @return ping timeout in ms, from the open packet of the server
+ */
+unsigned long SocketIoClient::getPingTimeout() const {
+	return _pingTimeout;
+}
+
+/**
+ * @return packets sent with emitWithAck that wait for the ack of the server
+ */
+size_t SocketIoClient::getPendingAcks() const {
+	return _ackCount;
+}
+
+/**
+ * @param ackId uint32_t  ack id given by emitWithAck
+ * @return true if the server has acked the packet, it is no longer in the ack window or is marked as acked in it
+ */
+bool SocketIoClient::isAcked(uint32_t ackId) const {
+	for(size_t i = 0; i < _ackCount; i++) {
+		const SocketIOPendingAck_t * slot = &_acks[(_ackHead + i) % SOCKETIOCLIENT_MAX_PENDING_ACKS];
+		if(slot->ackId == ackId) {
+			return slot->acked;
+		}
+	}
+	return true;
+}
+
+/**
+ * @return number of times a packet was sent again, after a timeout or a reconnect
+ */
+uint32_t SocketIoClient::getRetransmitCount() const {
+	return _retransmitCount;
+}
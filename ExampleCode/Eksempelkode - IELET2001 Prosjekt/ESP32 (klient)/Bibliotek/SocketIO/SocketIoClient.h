@@ -2,14 +2,28 @@
 #define __SOCKET_IO_CLIENT_H__
 
 #include <Arduino.h>
-#include <map>
-#include <vector>
 #include "WebSocketsClient.h"
 
+// define NODEBUG_SOCKETIOCLIENT to leave out the debug output, as the benchmark does
+#ifndef NODEBUG_SOCKETIOCLIENT
 #define SOCKETIOCLIENT_DEBUG(...) Serial.printf(__VA_ARGS__);
-//#define SOCKETIOCLIENT_DEBUG(...)
+#else
+#define SOCKETIOCLIENT_DEBUG(...)
+#endif
+
+// Engine.IO version asked for in the url, 3 for socket.io 2 servers and 4 for socket.io 3 and later
+#ifndef SOCKETIOCLIENT_EIO_VERSION
+#define SOCKETIOCLIENT_EIO_VERSION 3
+#endif
+
+// ping interval and timeout in ms, used until the server sends its own in the open packet
+#define PING_INTERVAL 25000
+#define PING_TIMEOUT 20000
 
-#define PING_INTERVAL 10000
+// size of the outgoing packet ring, every packet takes its length + 2 bytes
+#ifndef SOCKETIOCLIENT_TX_BUFFER_SIZE
+#define SOCKETIOCLIENT_TX_BUFFER_SIZE 2048
+#endif
 
 //#define SOCKETIOCLIENT_USE_SSL
 #ifdef SOCKETIOCLIENT_USE_SSL
@@ -17,29 +31,144 @@
 #else
 	#define DEFAULT_PORT 80
 #endif
+// slots in the event table, must be a power of two
+#ifndef SOCKETIOCLIENT_MAX_EVENTS
+#define SOCKETIOCLIENT_MAX_EVENTS 16
+#endif
+
+// packets sent with emitWithAck that can wait for the ack of the server, and the longest such packet
+#ifndef SOCKETIOCLIENT_MAX_PENDING_ACKS
+#define SOCKETIOCLIENT_MAX_PENDING_ACKS 8
+#endif
+#ifndef SOCKETIOCLIENT_ACK_PACKET_SIZE
+#define SOCKETIOCLIENT_ACK_PACKET_SIZE 256
+#endif
+
+// time in ms before a packet without ack is sent again
+#ifndef SOCKETIOCLIENT_ACK_TIMEOUT
+#define SOCKETIOCLIENT_ACK_TIMEOUT 5000
+#endif
+
 #define DEFAULT_URL "/socket.io/?transport=websocket"
 #define DEFAULT_FINGERPRINT ""
 
+typedef struct {
+	char eioType;        ///< Engine.IO packet type, '4' is a message
+	char sioType;        ///< Socket.IO packet type, 0 if the message has none
+	const char * nsp;    ///< namespace without the leading '/', NULL for the default one
+	size_t nspLength;
+	bool hasAckId;       ///< the packet has an ack id
+	uint32_t ackId;      ///< ack id of the packet, 0 if none
+	const char * event;  ///< event name (EVENT packets only)
+	size_t eventLength;
+	const char * data;   ///< arguments, a single string argument is given without its quotes
+	size_t dataLength;
+} SocketIOPacket_t;
+
+bool socketIoParsePacket(char * msg, size_t length, SocketIOPacket_t * packet);
+bool socketIoParseOpen(char * data, size_t length, unsigned long * pingInterval, unsigned long * pingTimeout);
+
+// FNV-1a hash of the event name, usable as a compile time constant
+constexpr uint32_t socketIoEventIdStep(const char * name, uint32_t hash) {
+	return *name ? socketIoEventIdStep(name + 1, (hash ^ (uint8_t) *name) * 16777619u) : hash;
+}
+
+constexpr uint32_t socketIoEventId(const char * name) {
+	return socketIoEventIdStep(name, 2166136261u);
+}
+
+uint32_t socketIoEventId(const char * name, size_t length);
+
+typedef void (*SocketIoEvent)(const char * payload, size_t length);
+typedef void (*SocketIoContextEvent)(void * context, const char * payload, size_t length);
+
+typedef struct {
+	uint32_t id;                 ///< socketIoEventId of the event name
+	bool used;                   ///< slot holds a handler
+	bool deleted;                ///< slot was removed, keep probing past it
+	SocketIoEvent cb;
+	SocketIoContextEvent ctxCb;
+	void * context;
+} SocketIOEventSlot_t;
+
+typedef struct {
+	uint32_t ackId;
+	bool acked;                  ///< the ack arrived, the slot is freed when the older ones are acked too
+	bool sent;                   ///< sent on the current connection
+	uint16_t sends;              ///< times the packet was sent
+	unsigned long sentTime;      ///< millis() of the last send
+	uint16_t length;
+	char packet[SOCKETIOCLIENT_ACK_PACKET_SIZE];
+} SocketIOPendingAck_t;
 
 class SocketIoClient {
+	friend class SocketIoClientTest;  ///< the native tests look into the packet ring and the ack window
 private:
-	std::vector<String> _packets;
+	uint8_t _txBuffer[SOCKETIOCLIENT_TX_BUFFER_SIZE];
+	size_t _txRead;
+	size_t _txWrite;
+	size_t _txPackets;
 	WebSocketsClient _webSocket;
-	int _lastPing;
-	std::map<String, std::function<void (const char * payload, size_t length)>> _events;
+	uint8_t _eio;                   ///< Engine.IO version, 3 or 4
+	bool _open;                     ///< the open packet was received on this connection
+	bool _connected;                ///< the socket.io connect was received on this connection
+	bool _pingPending;              ///< EIO3: a ping was sent and nothing was received since
+	unsigned long _pingInterval;    ///< ms, from the open packet
+	unsigned long _pingTimeout;     ///< ms, from the open packet
+	unsigned long _lastPing;        ///< millis() of the last ping sent by the client (EIO3)
+	unsigned long _lastReceive;     ///< millis() of the last packet from the server
+	SocketIOEventSlot_t _events[SOCKETIOCLIENT_MAX_EVENTS];
+	size_t _eventCount;
+	SocketIOPendingAck_t _acks[SOCKETIOCLIENT_MAX_PENDING_ACKS];  ///< oldest at _ackHead
+	size_t _ackHead;
+	size_t _ackCount;
+	uint32_t _nextAckId;
+	uint32_t _retransmitCount;
+	bool _linkUp;                   ///< Wi-Fi was up on the last loop
+	bool _connectPending;           ///< waiting for the socket.io connect
+	unsigned long _connectStart;    ///< millis() when Wi-Fi came up or the server was lost
+	unsigned long _connectTime;     ///< duration of the last (re)connect in ms
+	uint32_t _connectCount;
 
-	void trigger(const char* event, const char * payload, size_t length);
+	uint8_t * txReserve(size_t length, bool binary = false);
+	uint8_t * txPeek(size_t * length, bool * binary);
+	void txPop(size_t length);
+
+	SocketIOEventSlot_t * findEvent(uint32_t id);
+	SocketIOEventSlot_t * addEvent(uint32_t id);
+	void trigger(uint32_t id, const char * payload, size_t length);
 	void webSocketEvent(WStype_t type, uint8_t * payload, size_t length);
+	void engineIoPacket(const SocketIOPacket_t * packet);
+	void sendPendingAcks();
+	void ackReceived(uint32_t ackId);
+	bool peerAlive();
     void initialize();
 public:
+	SocketIoClient();
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
     void beginSSL(const char* host, const int port = DEFAULT_PORT, const char* url = DEFAULT_URL, const char* fingerprint = DEFAULT_FINGERPRINT);
+#endif
 	void begin(const char* host, const int port = DEFAULT_PORT, const char* url = DEFAULT_URL);
+	void setEngineIoVersion(uint8_t version);
 	void loop();
-	void on(const char* event, std::function<void (const char * payload, size_t length)>);
+	bool on(const char* event, SocketIoEvent func);
+	bool on(uint32_t eventId, SocketIoEvent func);
+	bool on(uint32_t eventId, SocketIoContextEvent func, void * context);
 	void emit(const char* event, const char * payload = NULL);
+	void emitBinary(const char* event, const uint8_t * data, size_t length);
+	bool emitWithAck(const char* event, const char * payload = NULL, uint32_t * ackId = NULL);
 	void remove(const char* event);
+	void remove(uint32_t eventId);
 	void disconnect();
 	void setAuthorization(const char * user, const char * password);
+	unsigned long getConnectTime() const;
+	uint32_t getConnectCount() const;
+	uint8_t getEngineIoVersion() const;
+	unsigned long getPingInterval() const;
+	unsigned long getPingTimeout() const;
+	size_t getPendingAcks() const;
+	bool isAcked(uint32_t ackId) const;
+	uint32_t getRetransmitCount() const;
 };
 
 #endif
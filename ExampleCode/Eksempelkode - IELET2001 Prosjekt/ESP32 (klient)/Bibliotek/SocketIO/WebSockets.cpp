@@ -83,6 +83,7 @@ void WebSockets::clientDisconnect(WSclient_t * client, uint16_t code, char * rea
  * @return true if ok
  */
 bool WebSockets::sendFrame(WSclient_t * client, WSopcode_t opcode, uint8_t * payload, size_t length, bool mask, bool fin, bool headerToPayload) {
+    DIAGNOSTICS_SCOPE(STAGE_FRAME_TX);
 
     if(client->tcp && !client->tcp->connected()) {
         DEBUG_WEBSOCKETS("[WS][%d][sendFrame] not Connected!?\n", client->num);
@@ -124,17 +125,14 @@ bool WebSockets::sendFrame(WSclient_t * client, WSopcode_t opcode, uint8_t * pay
     }
 
 #ifdef WEBSOCKETS_USE_BIG_MEM
-    // only for ESP since AVR has less HEAP
-    // try to send data in one TCP package (only if some free Heap is there)
-    if(!headerToPayload && ((length > 0) && (length < 1400)) && (GET_FREE_HEAP > 6000)) {
+    // only for ESP since AVR has less RAM
+    // send data in one TCP package, header and payload are staged in the per client buffer
+    if(!headerToPayload && ((length > 0) && (length < WEBSOCKETS_TX_BUFFER_SIZE))) {
         DEBUG_WEBSOCKETS("[WS][%d][sendFrame] pack to one TCP package...\n", client->num);
-        uint8_t * dataPtr = (uint8_t *) malloc(length + WEBSOCKETS_MAX_HEADER_SIZE);
-        if(dataPtr) {
-            memcpy((dataPtr + WEBSOCKETS_MAX_HEADER_SIZE), payload, length);
-            headerToPayload = true;
-            useInternBuffer = true;
-            payloadPtr = dataPtr;
-        }
+        memcpy(&client->cWsTxBuffer[WEBSOCKETS_MAX_HEADER_SIZE], payload, length);
+        headerToPayload = true;
+        useInternBuffer = true;
+        payloadPtr = &client->cWsTxBuffer[0];
     }
 #endif
 
@@ -212,9 +210,7 @@ bool WebSockets::sendFrame(WSclient_t * client, WSopcode_t opcode, uint8_t * pay
                 dataMaskPtr = payloadPtr;
             }
 
-            for(size_t x = 0; x < length; x++) {
-                dataMaskPtr[x] = (dataMaskPtr[x] ^ maskKey[x % 4]);
-            }
+            maskPayload(dataMaskPtr, length, maskKey);
 
         } else {
             *headerPtr = maskKey[0];
@@ -255,12 +251,6 @@ bool WebSockets::sendFrame(WSclient_t * client, WSopcode_t opcode, uint8_t * pay
 
     DEBUG_WEBSOCKETS("[WS][%d][sendFrame] sending Frame Done (%luus).\n", client->num, (micros() - start));
 
-#ifdef WEBSOCKETS_USE_BIG_MEM
-    if(useInternBuffer && payloadPtr) {
-        free(payloadPtr);
-    }
-#endif
-
     return ret;
 }
 
@@ -269,8 +259,13 @@ bool WebSockets::sendFrame(WSclient_t * client, WSopcode_t opcode, uint8_t * pay
  * @param client WSclient_t *  ptr to the client struct
  */
 void WebSockets::headerDone(WSclient_t * client) {
+    DIAGNOSTICS_RECORD(STAGE_HANDSHAKE, micros() - client->cHandshakeStart);
     client->status = WSC_CONNECTED;
     client->cWsRXsize = 0;
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    client->cWsPayload = NULL;
+    client->cWsPayloadRXsize = 0;
+#endif
     DEBUG_WEBSOCKETS("[WS][%d][headerDone] Header Handling Done.\n", client->num);
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
     client->cHttpLine = "";
@@ -283,9 +278,20 @@ void WebSockets::headerDone(WSclient_t * client) {
  * @param client WSclient_t *  ptr to the client struct
  */
 void WebSockets::handleWebsocket(WSclient_t * client) {
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
     if(client->cWsRXsize == 0) {
         handleWebsocketCb(client);
     }
+#else
+    DIAGNOSTICS_SCOPE(STAGE_FRAME_RX);
+    // a frame is in progress, drop the connection if the rest does not arrive in time
+    if((client->cWsRXsize > 0 || client->cWsPayload) && (millis() - client->cWsRXtime) > WEBSOCKETS_TCP_TIMEOUT) {
+        DEBUG_WEBSOCKETS("[WS][%d][handleWebsocket] receive TIMEOUT! %lu\n", client->num, (millis() - client->cWsRXtime));
+        clientDisconnect(client, 1002);
+        return;
+    }
+    handleWebsocketCb(client);
+#endif
 }
 
 /**
@@ -308,6 +314,17 @@ bool WebSockets::handleWebsocketWaitFor(WSclient_t * client, size_t size) {
     }
 
     DEBUG_WEBSOCKETS("[WS][%d][handleWebsocketWaitFor] size: %d cWsRXsize: %d\n", client->num, size, client->cWsRXsize);
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    // take what is there without waiting, the header is decoded again when more arrives
+    if(client->tcp->available()) {
+        int len = client->tcp->read(&client->cWsHeader[client->cWsRXsize], (size - client->cWsRXsize));
+        if(len > 0) {
+            client->cWsRXsize += len;
+            client->cWsRXtime = millis();
+        }
+    }
+    return (client->cWsRXsize >= size);
+#else
     readCb(client, &client->cWsHeader[client->cWsRXsize], (size - client->cWsRXsize), std::bind([](WebSockets * server, size_t size, WSclient_t * client, bool ok) {
         DEBUG_WEBSOCKETS("[WS][%d][handleWebsocketWaitFor][readCb] size: %d ok: %d\n", client->num, size, ok);
         if(ok) {
@@ -321,6 +338,7 @@ bool WebSockets::handleWebsocketWaitFor(WSclient_t * client, size_t size) {
         }
     }, this, size, std::placeholders::_1, std::placeholders::_2));
     return false;
+#endif
 }
 
 void WebSockets::handleWebsocketCb(WSclient_t * client) {
@@ -395,8 +413,38 @@ void WebSockets::handleWebsocketCb(WSclient_t * client) {
     }
 
     if(header->payloadLen > 0) {
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+        if(!client->cWsPayload) {
+            // if text data we need one more
+            client->cWsPayload = rxBuffer(client, header->payloadLen + 1);
+            client->cWsPayloadRXsize = 0;
+
+            if(!client->cWsPayload) {
+                DEBUG_WEBSOCKETS("[WS][%d][handleWebsocket] to less memory to handle payload %d!\n", client->num, header->payloadLen);
+                clientDisconnect(client, 1011);
+                return;
+            }
+        }
+
+        // take what is there without waiting, continue on the next call
+        if(client->tcp->available()) {
+            int len = client->tcp->read(&client->cWsPayload[client->cWsPayloadRXsize], (header->payloadLen - client->cWsPayloadRXsize));
+            if(len > 0) {
+                client->cWsPayloadRXsize += len;
+                client->cWsRXtime = millis();
+            }
+        }
+
+        if(client->cWsPayloadRXsize < header->payloadLen) {
+            return;
+        }
+
+        payload = client->cWsPayload;
+        client->cWsPayload = NULL;
+        handleWebsocketPayloadCb(client, true, payload);
+#else
         // if text data we need one more
-        payload = (uint8_t *) malloc(header->payloadLen + 1);
+        payload = rxBuffer(client, header->payloadLen + 1);
 
         if(!payload) {
             DEBUG_WEBSOCKETS("[WS][%d][handleWebsocket] to less memory to handle payload %d!\n", client->num, header->payloadLen);
@@ -404,6 +452,7 @@ void WebSockets::handleWebsocketCb(WSclient_t * client) {
             return;
         }
         readCb(client, payload, header->payloadLen, std::bind(&WebSockets::handleWebsocketPayloadCb, this, std::placeholders::_1, std::placeholders::_2, payload));
+#endif
     } else {
         handleWebsocketPayloadCb(client, true, NULL);
     }
@@ -418,9 +467,7 @@ void WebSockets::handleWebsocketPayloadCb(WSclient_t * client, bool ok, uint8_t
 
             if(header->mask) {
                 //decode XOR
-                for(size_t i = 0; i < header->payloadLen; i++) {
-                    payload[i] = (payload[i] ^ header->maskKey[i % 4]);
-                }
+                maskPayload(payload, header->payloadLen, header->maskKey);
             }
         }
 
@@ -460,10 +507,6 @@ void WebSockets::handleWebsocketPayloadCb(WSclient_t * client, bool ok, uint8_t
                 break;
         }
 
-        if(payload) {
-            free(payload);
-        }
-
         // reset input
         client->cWsRXsize = 0;
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
@@ -473,35 +516,142 @@ void WebSockets::handleWebsocketPayloadCb(WSclient_t * client, bool ok, uint8_t
 
     } else {
         DEBUG_WEBSOCKETS("[WS][%d][handleWebsocket] missing data!\n", client->num);
-        free(payload);
         clientDisconnect(client, 1002);
     }
 }
 
+/**
+ * get the RX payload buffer of the client with room for at least size bytes
+ * the buffer is kept after the frame is handled so it is only allocated when a bigger frame arrives
+ * @param client WSclient_t *  ptr to the client struct
+ * @param size size_t          bytes needed
+ * @return ptr to the buffer or NULL if there is not enough memory
+ */
+uint8_t * WebSockets::rxBuffer(WSclient_t * client, size_t size) {
+#ifdef WEBSOCKETS_STATIC_RX_BUFFER
+    if(size > sizeof(client->cWsRXBuffer)) {
+        return NULL;
+    }
+    return &client->cWsRXBuffer[0];
+#else
+    if(size > client->cWsRXBufferSize) {
+        uint8_t * buffer = (uint8_t *) realloc(client->cWsRXBuffer, size);
+        if(!buffer) {
+            return NULL;
+        }
+        DEBUG_WEBSOCKETS("[WS][%d][rxBuffer] grow %u -> %u\n", client->num, client->cWsRXBufferSize, size);
+        client->cWsRXBuffer = buffer;
+        client->cWsRXBufferSize = size;
+    }
+    return client->cWsRXBuffer;
+#endif
+}
+
+/**
+ * release the RX payload buffer of the client
+ * @param client WSclient_t *  ptr to the client struct
+ */
+void WebSockets::rxBufferFree(WSclient_t * client) {
+#ifndef WEBSOCKETS_STATIC_RX_BUFFER
+    if(client->cWsRXBuffer) {
+        free(client->cWsRXBuffer);
+    }
+    client->cWsRXBuffer = NULL;
+    client->cWsRXBufferSize = 0;
+#else
+    UNUSED(client);
+#endif
+}
+
+/**
+ * XOR the payload with the 4 byte mask key (RFC 6455 5.3)
+ * the unaligned head and tail are done byte by byte, the middle one word at a time
+ * @param payload uint8_t *        data to (un)mask in place
+ * @param length size_t            length of the data
+ * @param maskKey const uint8_t *  4 byte mask key
+ */
+void WebSockets::maskPayload(uint8_t * payload, size_t length, const uint8_t * maskKey) {
+    typedef uint32_t __attribute__((__may_alias__)) maskWord_t;
+
+    size_t i = 0;
+    while(i < length && ((uintptr_t) (payload + i) & (sizeof(maskWord_t) - 1))) {
+        payload[i] ^= maskKey[i & 3];
+        i++;
+    }
+
+    size_t words = (length - i) / sizeof(maskWord_t);
+    if(words > 0) {
+        // key rotated to line up with the first aligned byte
+        uint8_t key[4] = { maskKey[i & 3], maskKey[(i + 1) & 3], maskKey[(i + 2) & 3], maskKey[(i + 3) & 3] };
+        maskWord_t key32;
+        memcpy(&key32, key, sizeof(key32));
+
+        maskWord_t * data = (maskWord_t *) (payload + i);
+        for(size_t w = 0; w < words; w++) {
+            data[w] ^= key32;
+        }
+        i += words * sizeof(maskWord_t);
+    }
+
+    while(i < length) {
+        payload[i] ^= maskKey[i & 3];
+        i++;
+    }
+}
+
 /**
  * generate the key for Sec-WebSocket-Accept
- * @param clientKey String
- * @return String Accept Key
+ * @param clientKey const String &  Sec-WebSocket-Key sent to the server
+ * @param out char *  WEBSOCKETS_ACCEPT_KEY_LENGTH bytes, not NUL terminated
  */
-String WebSockets::acceptKey(String & clientKey) {
+void WebSockets::acceptKey(const String & clientKey, char * out) {
+    static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     uint8_t sha1HashBin[20] = { 0 };
+#if defined(ESP8266) || defined(ESP32)
+    // the key is 24 chars, a stack buffer keeps the hash input off the heap
+    uint8_t data[64];
+    size_t length = clientKey.length();
+    if(length > sizeof(data) - (sizeof(GUID) - 1)) {
+        length = sizeof(data) - (sizeof(GUID) - 1);
+    }
+    memcpy(&data[0], clientKey.c_str(), length);
+    memcpy(&data[length], GUID, sizeof(GUID) - 1);
+    length += sizeof(GUID) - 1;
 #ifdef ESP8266
-    sha1(clientKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", &sha1HashBin[0]);
-#elif defined(ESP32)
-    String data = clientKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-    esp_sha(SHA1, (unsigned char*)data.c_str(), data.length(), &sha1HashBin[0]);
+    sha1(&data[0], length, &sha1HashBin[0]);
+#else
+    esp_sha(SHA1, &data[0], length, &sha1HashBin[0]);
+#endif
 #else
-    clientKey += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     SHA1_CTX ctx;
     SHA1Init(&ctx);
     SHA1Update(&ctx, (const unsigned char*)clientKey.c_str(), clientKey.length());
+    SHA1Update(&ctx, (const unsigned char*)GUID, sizeof(GUID) - 1);
     SHA1Final(&sha1HashBin[0], &ctx);
 #endif
 
-    String key = base64_encode(sha1HashBin, 20);
-    key.trim();
+    char key[WEBSOCKETS_ACCEPT_KEY_LENGTH + 1];
+    base64_encode(&sha1HashBin[0], sizeof(sha1HashBin), key, sizeof(key));
+    memcpy(out, key, WEBSOCKETS_ACCEPT_KEY_LENGTH);
+}
 
-    return key;
+/**
+ * compare a generated accept key with the one from the server,
+ * the time taken does not depend on where the keys differ
+ * @param key const char *  WEBSOCKETS_ACCEPT_KEY_LENGTH bytes from acceptKey()
+ * @param accept const String &  Sec-WebSocket-Accept header value
+ * @return true if equal
+ */
+bool WebSockets::acceptKeyEquals(const char * key, const String & accept) {
+    if(accept.length() != WEBSOCKETS_ACCEPT_KEY_LENGTH) {
+        return false;
+    }
+    const char * value = accept.c_str();
+    uint8_t diff = 0;
+    for(size_t i = 0; i < WEBSOCKETS_ACCEPT_KEY_LENGTH; i++) {
+        diff |= (uint8_t) (key[i] ^ value[i]);
+    }
+    return (diff == 0);
 }
 
 /**
@@ -526,6 +676,32 @@ String WebSockets::base64_encode(uint8_t * data, size_t length) {
     return String("-FAIL-");
 }
 
+/**
+ * base64_encode into a caller provided buffer
+ * @param data const uint8_t *
+ * @param length size_t
+ * @param out char *  output, NUL terminated
+ * @param size size_t  size of out, at least ((length + 2) / 3) * 4 + 1 for short input
+ * @return length of the encoded string or 0 if out is to small
+ */
+size_t WebSockets::base64_encode(const uint8_t * data, size_t length, char * out, size_t size) {
+    // libb64 breaks the line every 72 chars
+    if(size < (((length + 2) / 3) * 4) + (length / 54) + 1) {
+        return 0;
+    }
+    base64_encodestate _state;
+    base64_init_encodestate(&_state);
+    int len = base64_encode_block((const char *) &data[0], length, &out[0], &_state);
+    base64_encode_blockend((out + len), &_state);
+
+    // some libb64 versions count the NUL or end with a newline
+    len = strlen(out);
+    while(len > 0 && out[len - 1] == '\n') {
+        out[--len] = 0x00;
+    }
+    return len;
+}
+
 /**
  * read x byte from tcp or get timeout
  * @param client WSclient_t *
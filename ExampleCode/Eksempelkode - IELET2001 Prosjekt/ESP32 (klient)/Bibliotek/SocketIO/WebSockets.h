@@ -55,6 +55,14 @@
 #define NODEBUG_WEBSOCKETS
 #endif
 
+// timing of the frames and the handshake, see Diagnostics.h in the include folder of the robot client
+#ifdef ENABLE_DIAGNOSTICS
+#include <Diagnostics.h>
+#else
+#define DIAGNOSTICS_SCOPE(stage)
+#define DIAGNOSTICS_RECORD(stage, duration)
+#endif
+
 #if defined(ESP8266) || defined(ESP32)
 
 #define WEBSOCKETS_MAX_DATA_SIZE  (15*1024)
@@ -62,6 +70,8 @@
 #define GET_FREE_HEAP ESP.getFreeHeap()
 // moves all Header strings to Flash (~300 Byte)
 //#define WEBSOCKETS_SAVE_RAM
+// reserve the RX payload buffer statically instead of growing it on the heap
+//#define WEBSOCKETS_STATIC_RX_BUFFER
 
 #elif defined(STM32_DEVICE)
 
@@ -69,6 +79,12 @@
 #define WEBSOCKETS_USE_BIG_MEM
 #define GET_FREE_HEAP System.freeMemory()
 
+#elif defined(__linux__) || defined(__APPLE__)
+
+// host build with the Arduino shim in native/
+#define WEBSOCKETS_MAX_DATA_SIZE  (15*1024)
+#define WEBSOCKETS_USE_BIG_MEM
+
 #else
 
 //atmega328p has only 2KB ram!
@@ -86,10 +102,29 @@
 #define NETWORK_W5100           (2)
 #define NETWORK_ENC28J60        (3)
 #define NETWORK_ESP32           (4)
+#define NETWORK_POSIX           (5)
 
 // max size of the WS Message Header
 #define WEBSOCKETS_MAX_HEADER_SIZE  (14)
 
+// longest HTTP header line kept during the handshake, longer lines are cut
+#ifndef WEBSOCKETS_HTTP_LINE_SIZE
+#define WEBSOCKETS_HTTP_LINE_SIZE  (256)
+#endif
+
+// longest HTTP upgrade request that is sent in one write from the stack, longer requests are sent in parts
+#ifndef WEBSOCKETS_HTTP_REQUEST_SIZE
+#define WEBSOCKETS_HTTP_REQUEST_SIZE  (512)
+#endif
+
+// length of a Sec-WebSocket-Accept value, base64 of a SHA-1 hash
+#define WEBSOCKETS_ACCEPT_KEY_LENGTH  (28)
+
+// frames with less payload are sent as one TCP package from the client staging buffer
+#ifndef WEBSOCKETS_TX_BUFFER_SIZE
+#define WEBSOCKETS_TX_BUFFER_SIZE  (1400)
+#endif
+
 #if !defined(WEBSOCKETS_NETWORK_TYPE)
 // select Network type based
 #if defined(ESP8266) || defined(ESP31B)
@@ -100,6 +135,9 @@
 #elif defined(ESP32)
 #define WEBSOCKETS_NETWORK_TYPE NETWORK_ESP32
 
+#elif defined(__linux__) || defined(__APPLE__)
+#define WEBSOCKETS_NETWORK_TYPE NETWORK_POSIX
+
 #else
 #define WEBSOCKETS_NETWORK_TYPE NETWORK_W5100
 
@@ -169,6 +207,11 @@
 #define WEBSOCKETS_NETWORK_CLASS WiFiClient
 #define WEBSOCKETS_NETWORK_SERVER_CLASS WiFiServer
 
+#elif (WEBSOCKETS_NETWORK_TYPE == NETWORK_POSIX)
+
+#include <PosixClient.h>
+#define WEBSOCKETS_NETWORK_CLASS PosixClient
+
 #else
 #error "no network type selected!"
 #endif
@@ -255,6 +298,27 @@ typedef struct {
         uint8_t cWsHeader[WEBSOCKETS_MAX_HEADER_SIZE]; ///< RX WS Message buffer
         WSMessageHeader_t cWsHeaderDecode;
 
+#ifdef WEBSOCKETS_STATIC_RX_BUFFER
+        uint8_t cWsRXBuffer[WEBSOCKETS_MAX_DATA_SIZE + 1]; ///< RX payload buffer
+#else
+        uint8_t * cWsRXBuffer;      ///< RX payload buffer, grows to the largest frame seen and is reused
+        size_t cWsRXBufferSize;
+#endif
+
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+        uint8_t * cWsPayload;       ///< RX payload of the frame in progress, NULL while reading the header
+        size_t cWsPayloadRXsize;    ///< RX payload bytes received so far
+        unsigned long cWsRXtime;    ///< millis() of the last RX progress, for the frame timeout
+#endif
+
+#ifdef ENABLE_DIAGNOSTICS
+        unsigned long cHandshakeStart; ///< micros() when the TCP connection was made
+#endif
+
+#ifdef WEBSOCKETS_USE_BIG_MEM
+        uint8_t cWsTxBuffer[WEBSOCKETS_MAX_HEADER_SIZE + WEBSOCKETS_TX_BUFFER_SIZE]; ///< TX staging buffer, header + masked payload
+#endif
+
         String base64Authorization; ///< Base64 encoded Auth request
         String plainAuthorization; ///< Base64 encoded Auth request
 
@@ -265,6 +329,9 @@ typedef struct {
 
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
         String cHttpLine;   ///< HTTP header lines
+#else
+        char cHttpLine[WEBSOCKETS_HTTP_LINE_SIZE]; ///< HTTP header line in progress
+        size_t cHttpLineLen;
 #endif
 
 } WSclient_t;
@@ -295,8 +362,15 @@ class WebSockets {
         void handleWebsocketCb(WSclient_t * client);
         void handleWebsocketPayloadCb(WSclient_t * client, bool ok, uint8_t * payload);
 
-        String acceptKey(String & clientKey);
+        uint8_t * rxBuffer(WSclient_t * client, size_t size);
+        void rxBufferFree(WSclient_t * client);
+
+        static void maskPayload(uint8_t * payload, size_t length, const uint8_t * maskKey);
+
+        void acceptKey(const String & clientKey, char * out);
+        static bool acceptKeyEquals(const char * key, const String & accept);
         String base64_encode(uint8_t * data, size_t length);
+        size_t base64_encode(const uint8_t * data, size_t length, char * out, size_t size);
 
         bool readCb(WSclient_t * client, uint8_t *out, size_t n, WSreadWaitCb cb);
         virtual size_t write(WSclient_t * client, uint8_t *out, size_t n);
@@ -28,11 +28,31 @@
 WebSocketsClient::WebSocketsClient() {
     _cbEvent = NULL;
     _client.num = 0;
+    // a client that is destroyed before begin is not connected
+    _client.status = WSC_NOT_CONNECTED;
+    _client.tcp = NULL;
     _client.extraHeaders = WEBSOCKETS_STRING("Origin: file://");
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    _tcp = NULL;
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
+    _ssl = NULL;
+#endif
+#endif
+#ifndef WEBSOCKETS_STATIC_RX_BUFFER
+    _client.cWsRXBuffer = NULL;
+    _client.cWsRXBufferSize = 0;
+#endif
 }
 
 WebSocketsClient::~WebSocketsClient() {
     disconnect();
+    rxBufferFree(&_client);
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    delete _tcp;
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
+    delete _ssl;
+#endif
+#endif
 }
 
 /**
@@ -64,6 +84,12 @@ void WebSocketsClient::begin(const char *host, uint16_t port, const char * url,
     _client.base64Authorization = "";
     _client.plainAuthorization = "";
     _client.isSocketIO = false;
+    _client.cWsRXsize = 0;
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    _client.cWsPayload = NULL;
+    _client.cWsPayloadRXsize = 0;
+#endif
+    _handshake = "";
 
 #ifdef ESP8266
     randomSeed(RANDOM_REG32);
@@ -135,23 +161,23 @@ void WebSocketsClient::loop(void) {
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
         if(_client.isSSL) {
             DEBUG_WEBSOCKETS("[WS-Client] connect wss...\n");
-            if(_client.ssl) {
-                delete _client.ssl;
-                _client.ssl = NULL;
-                _client.tcp = NULL;
+            if(!_ssl) {
+                _ssl = new WiFiClientSecure();
             }
-            _client.ssl = new WiFiClientSecure();
-            _client.tcp = _client.ssl;
+            _client.ssl = _ssl;
+            _client.tcp = _ssl;
         } else {
             DEBUG_WEBSOCKETS("[WS-Client] connect ws...\n");
-            if(_client.tcp) {
-                delete _client.tcp;
-                _client.tcp = NULL;
+            if(!_tcp) {
+                _tcp = new WiFiClient();
             }
-            _client.tcp = new WiFiClient();
+            _client.tcp = _tcp;
         }
 #else
-        _client.tcp = new WEBSOCKETS_NETWORK_CLASS();
+        if(!_tcp) {
+            _tcp = new WEBSOCKETS_NETWORK_CLASS();
+        }
+        _client.tcp = _tcp;
 #endif
 
         if(!_client.tcp) {
@@ -272,6 +298,7 @@ void WebSocketsClient::setAuthorization(const char * user, const char * password
         auth += ":";
         auth += password;
         _client.base64Authorization = base64_encode((uint8_t *) auth.c_str(), auth.length());
+        _handshake = "";
     }
 }
 
@@ -283,6 +310,7 @@ void WebSocketsClient::setAuthorization(const char * auth) {
     if(auth) {
         //_client.base64Authorization = auth;
         _client.plainAuthorization = auth;
+        _handshake = "";
     }
 }
 
@@ -293,6 +321,7 @@ void WebSocketsClient::setAuthorization(const char * auth) {
  */
 void WebSocketsClient::setExtraHeaders(const char * extraHeaders) {
     _client.extraHeaders = extraHeaders;
+    _handshake = "";
 }
 
 /**
@@ -356,7 +385,7 @@ void WebSocketsClient::clientDisconnect(WSclient_t * client) {
             client->ssl->stop();
         }
         event = true;
-        delete client->ssl;
+        // the WiFiClientSecure is owned by _ssl and reused on reconnect
         client->ssl = NULL;
         client->tcp = NULL;
     }
@@ -372,8 +401,6 @@ void WebSocketsClient::clientDisconnect(WSclient_t * client) {
         event = true;
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
         client->status = WSC_NOT_CONNECTED;
-#else
-        delete client->tcp;
 #endif
         client->tcp = NULL;
     }
@@ -386,6 +413,13 @@ void WebSocketsClient::clientDisconnect(WSclient_t * client) {
     client->cIsWebsocket = false;
     client->cSessionId = "";
 
+    // drop a partly received frame, the RX buffer is kept for the next connection
+    client->cWsRXsize = 0;
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    client->cWsPayload = NULL;
+    client->cWsPayloadRXsize = 0;
+#endif
+
     client->status = WSC_NOT_CONNECTED;
 
     DEBUG_WEBSOCKETS("[WS-Client] client disconnected.\n");
@@ -433,10 +467,22 @@ void WebSocketsClient::handleClientData(void) {
     int len = _client.tcp->available();
     if(len > 0) {
         switch(_client.status) {
-            case WSC_HEADER: {
-                String headerLine = _client.tcp->readStringUntil('\n');
-                handleHeader(&_client, &headerLine);
-            }
+            case WSC_HEADER:
+                // byte by byte so nothing behind the header is consumed, a line may span several calls
+                while(_client.tcp && _client.status == WSC_HEADER && _client.tcp->available()) {
+                    int c = _client.tcp->read();
+                    if(c < 0) {
+                        break;
+                    }
+                    if(c == '\n') {
+                        _client.cHttpLine[_client.cHttpLineLen] = 0x00;
+                        size_t length = _client.cHttpLineLen;
+                        _client.cHttpLineLen = 0;
+                        handleHeaderLine(&_client, _client.cHttpLine, length);
+                    } else if(_client.cHttpLineLen < (sizeof(_client.cHttpLine) - 1)) {
+                        _client.cHttpLine[_client.cHttpLineLen++] = c;
+                    }
+                }
                 break;
             case WSC_CONNECTED:
                 WebSockets::handleWebsocket(&_client);
@@ -445,6 +491,9 @@ void WebSocketsClient::handleClientData(void) {
                 WebSockets::clientDisconnect(&_client, 1002);
                 break;
         }
+    } else if(_client.status == WSC_CONNECTED && (_client.cWsRXsize > 0 || _client.cWsPayload)) {
+        // nothing new, but check the frame in progress for timeout
+        WebSockets::handleWebsocket(&_client);
     }
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
     delay(0);
@@ -453,13 +502,68 @@ void WebSocketsClient::handleClientData(void) {
 #endif
 
 /**
- * send the WebSocket header to Server
+ * build the static part of the http request once,
+ * sendHeader only patches in the key and the socket.io session
  * @param client WSclient_t *  ptr to the client struct
  */
-void WebSocketsClient::sendHeader(WSclient_t * client) {
+void WebSocketsClient::buildHandshake(WSclient_t * client) {
 
     static const char * NEW_LINE = "\r\n";
 
+    _handshake = WEBSOCKETS_STRING("GET ");
+    _handshake += client->cUrl;
+    _handshakeUrlEnd = _handshake.length();
+
+    _handshake += WEBSOCKETS_STRING(" HTTP/1.1\r\n"
+            "Host: ");
+    _handshake += _host + ":" + _port + NEW_LINE;
+    _handshakeWsStart = _handshake.length();
+
+    _handshake += WEBSOCKETS_STRING("Connection: Upgrade\r\n"
+            "Upgrade: websocket\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Sec-WebSocket-Key: ");
+    _handshakeKeyPos = _handshake.length();
+    // placeholder for the 24 char base64 key
+    _handshake += WEBSOCKETS_STRING("========================\r\n");
+
+    if(client->cProtocol.length() > 0) {
+        _handshake += WEBSOCKETS_STRING("Sec-WebSocket-Protocol: ");
+        _handshake += client->cProtocol + NEW_LINE;
+    }
+
+    if(client->cExtensions.length() > 0) {
+        _handshake += WEBSOCKETS_STRING("Sec-WebSocket-Extensions: ");
+        _handshake += client->cExtensions + NEW_LINE;
+    }
+    _handshakeWsEnd = _handshake.length();
+
+    // add extra headers; by default this includes "Origin: file://"
+    if(client->extraHeaders) {
+        _handshake += client->extraHeaders + NEW_LINE;
+    }
+
+    _handshake += WEBSOCKETS_STRING("User-Agent: arduino-WebSocket-Client\r\n");
+
+    if(client->base64Authorization.length() > 0) {
+        _handshake += WEBSOCKETS_STRING("Authorization: Basic ");
+        _handshake += client->base64Authorization + NEW_LINE;
+    }
+
+    if(client->plainAuthorization.length() > 0) {
+        _handshake += WEBSOCKETS_STRING("Authorization: ");
+        _handshake += client->plainAuthorization + NEW_LINE;
+    }
+
+    _handshake += NEW_LINE;
+}
+
+/**
+ * send the WebSocket header to Server
+ * @param client WSclient_t *  ptr to the client struct
+ */
+void WebSocketsClient::sendHeader(WSclient_t * client) {
+
     DEBUG_WEBSOCKETS("[WS-Client][sendHeader] sending header...\n");
 
     uint8_t randomKey[16] = { 0 };
@@ -468,73 +572,68 @@ void WebSocketsClient::sendHeader(WSclient_t * client) {
         randomKey[i] = random(0xFF);
     }
 
-    client->cKey = base64_encode(&randomKey[0], 16);
+    char key[25];
+    base64_encode(&randomKey[0], sizeof(randomKey), key, sizeof(key));
+    client->cKey = key;
 
 #ifndef NODEBUG_WEBSOCKETS
     unsigned long start = micros();
 #endif
 
-    String handshake;
-    bool ws_header = true;
-    String url = client->cUrl;
-
-    if(client->isSocketIO) {
-        if(client->cSessionId.length() == 0) {
-            url += WEBSOCKETS_STRING("&transport=polling");
-            ws_header = false;
-        } else {
-            url += WEBSOCKETS_STRING("&transport=websocket&sid=");
-            url += client->cSessionId;
-        }
+    if(_handshake.length() == 0) {
+        buildHandshake(client);
     }
-
-    handshake = WEBSOCKETS_STRING("GET ");
-    handshake += url + WEBSOCKETS_STRING(" HTTP/1.1\r\n"
-            "Host: ");
-    handshake += _host + ":" + _port + NEW_LINE;
-
-    if(ws_header) {
-        handshake += WEBSOCKETS_STRING("Connection: Upgrade\r\n"
-                "Upgrade: websocket\r\n"
-                "Sec-WebSocket-Version: 13\r\n"
-                "Sec-WebSocket-Key: ");
-        handshake += client->cKey + NEW_LINE;
-
-        if(client->cProtocol.length() > 0) {
-            handshake += WEBSOCKETS_STRING("Sec-WebSocket-Protocol: ");
-            handshake += client->cProtocol + NEW_LINE;
-        }
-
-        if(client->cExtensions.length() > 0) {
-            handshake += WEBSOCKETS_STRING("Sec-WebSocket-Extensions: ");
-            handshake += client->cExtensions + NEW_LINE;
-        }
+    memcpy(&_handshake[_handshakeKeyPos], key, 24);
+
+    uint8_t * handshake = (uint8_t *) _handshake.c_str();
+    size_t length = _handshake.length();
+
+    // the request is the template with the transport and the socket.io session patched in
+    struct {
+        const char * data;
+        size_t length;
+    } parts[5];
+    size_t partCount = 0;
+    const char * base = (const char *) handshake;
+
+    if(!client->isSocketIO) {
+        parts[partCount++] = { base, length };
+    } else if(client->cSessionId.length() == 0) {
+        // socket.io starts with a polling request, without the upgrade headers
+        parts[partCount++] = { base, _handshakeUrlEnd };
+        parts[partCount++] = { "&transport=polling", 18 };
+        parts[partCount++] = { base + _handshakeUrlEnd, _handshakeWsStart - _handshakeUrlEnd };
+        parts[partCount++] = { "Connection: keep-alive\r\n", 24 };
+        parts[partCount++] = { base + _handshakeWsEnd, length - _handshakeWsEnd };
     } else {
-        handshake += WEBSOCKETS_STRING("Connection: keep-alive\r\n");
+        parts[partCount++] = { base, _handshakeUrlEnd };
+        parts[partCount++] = { "&transport=websocket&sid=", 25 };
+        parts[partCount++] = { client->cSessionId.c_str(), client->cSessionId.length() };
+        parts[partCount++] = { base + _handshakeUrlEnd, length - _handshakeUrlEnd };
     }
 
-    // add extra headers; by default this includes "Origin: file://"
-    if(client->extraHeaders) {
-        handshake += client->extraHeaders + NEW_LINE;
+    // the parts are put together on the stack and sent with one write, so the request goes out in one TCP segment
+    uint8_t request[WEBSOCKETS_HTTP_REQUEST_SIZE];
+    size_t requestLength = 0;
+    for(size_t i = 0; i < partCount; i++) {
+        requestLength += parts[i].length;
     }
-
-    handshake += WEBSOCKETS_STRING("User-Agent: arduino-WebSocket-Client\r\n");
-
-    if(client->base64Authorization.length() > 0) {
-        handshake += WEBSOCKETS_STRING("Authorization: Basic ");
-        handshake += client->base64Authorization + NEW_LINE;
-    }
-
-    if(client->plainAuthorization.length() > 0) {
-        handshake += WEBSOCKETS_STRING("Authorization: ");
-        handshake += client->plainAuthorization + NEW_LINE;
+    if(requestLength <= sizeof(request)) {
+        requestLength = 0;
+        for(size_t i = 0; i < partCount; i++) {
+            memcpy(&request[requestLength], parts[i].data, parts[i].length);
+            requestLength += parts[i].length;
+        }
+        DEBUG_WEBSOCKETS("[WS-Client][sendHeader] handshake %.*s", (int) requestLength, (const char *) request);
+        write(client, request, requestLength);
+    } else {
+        for(size_t i = 0; i < partCount; i++) {
+            DEBUG_WEBSOCKETS("[WS-Client][sendHeader] handshake part %u: %.*s\n", (unsigned) i, (int) parts[i].length,
+                parts[i].data);
+            write(client, (uint8_t *) parts[i].data, parts[i].length);
+        }
     }
 
-    handshake += NEW_LINE;
-
-    DEBUG_WEBSOCKETS("[WS-Client][sendHeader] handshake %s", (uint8_t* )handshake.c_str());
-    write(client, (uint8_t*) handshake.c_str(), handshake.length());
-
 #if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
     client->tcp->readStringUntil('\n', &(client->cHttpLine), std::bind(&WebSocketsClient::handleHeader, this, client, &(client->cHttpLine)));
 #endif
@@ -543,62 +642,98 @@ void WebSocketsClient::sendHeader(WSclient_t * client) {
 
 }
 
+/**
+ * compare a header name case insensitive
+ * @param name const char *  header name, not terminated
+ * @param length size_t      length of name
+ * @param key const char *   known header name
+ * @return true if equal
+ */
+static bool headerNameIs(const char * name, size_t length, const char * key) {
+    return (strlen(key) == length) && (strncasecmp(name, key, length) == 0);
+}
+
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
 /**
  * handle the WebSocket header reading
  * @param client WSclient_t *  ptr to the client struct
  */
 void WebSocketsClient::handleHeader(WSclient_t * client, String * headerLine) {
+    if(handleHeaderLine(client, (char *) headerLine->c_str(), headerLine->length())) {
+        (*headerLine) = "";
+        client->tcp->readStringUntil('\n', &(client->cHttpLine), std::bind(&WebSocketsClient::handleHeader, this, client, &(client->cHttpLine)));
+    }
+}
+#endif
+
+/**
+ * handle one line of the HTTP response, the line is parsed in place
+ * @param client WSclient_t *  ptr to the client struct
+ * @param headerLine char *    line without the \n, NUL terminated, modified!
+ * @param length size_t        length of the line
+ * @return true if more header lines are expected
+ */
+bool WebSocketsClient::handleHeaderLine(WSclient_t * client, char * headerLine, size_t length) {
+
+    // remove \r and surrounding white space
+    while(length > 0 && isspace((unsigned char) headerLine[length - 1])) {
+        length--;
+    }
+    headerLine[length] = 0x00;
+    while(length > 0 && isspace((unsigned char) *headerLine)) {
+        headerLine++;
+        length--;
+    }
 
-    headerLine->trim(); // remove \r
+    if(length > 0) {
+        DEBUG_WEBSOCKETS("[WS-Client][handleHeader] RX: %s\n", headerLine);
 
-    if(headerLine->length() > 0) {
-        DEBUG_WEBSOCKETS("[WS-Client][handleHeader] RX: %s\n", headerLine->c_str());
+        char * colon = (char *) memchr(headerLine, ':', length);
 
-        if(headerLine->startsWith(WEBSOCKETS_STRING("HTTP/1."))) {
+        if(strncmp(headerLine, "HTTP/1.", 7) == 0) {
             // "HTTP/1.1 101 Switching Protocols"
-            client->cCode = headerLine->substring(9, headerLine->indexOf(' ', 9)).toInt();
-        } else if(headerLine->indexOf(':')) {
-            String headerName = headerLine->substring(0, headerLine->indexOf(':'));
-            String headerValue = headerLine->substring(headerLine->indexOf(':') + 1);
+            client->cCode = (length > 9) ? atoi(&headerLine[9]) : 0;
+        } else if(colon && colon != headerLine) {
+            const char * headerName = headerLine;
+            size_t nameLength = colon - headerLine;
+            char * headerValue = colon + 1;
 
             // remove space in the beginning  (RFC2616)
-            if(headerValue[0] == ' ') {
-                headerValue.remove(0, 1);
+            while(*headerValue == ' ' || *headerValue == '\t') {
+                headerValue++;
             }
 
-            if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Connection"))) {
-                if(headerValue.equalsIgnoreCase(WEBSOCKETS_STRING("upgrade"))) {
+            if(headerNameIs(headerName, nameLength, "Connection")) {
+                if(strcasecmp(headerValue, "upgrade") == 0) {
                     client->cIsUpgrade = true;
                 }
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Upgrade"))) {
-                if(headerValue.equalsIgnoreCase(WEBSOCKETS_STRING("websocket"))) {
+            } else if(headerNameIs(headerName, nameLength, "Upgrade")) {
+                if(strcasecmp(headerValue, "websocket") == 0) {
                     client->cIsWebsocket = true;
                 }
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Sec-WebSocket-Accept"))) {
+            } else if(headerNameIs(headerName, nameLength, "Sec-WebSocket-Accept")) {
                 client->cAccept = headerValue;
-                client->cAccept.trim(); // see rfc6455
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Sec-WebSocket-Protocol"))) {
+            } else if(headerNameIs(headerName, nameLength, "Sec-WebSocket-Protocol")) {
                 client->cProtocol = headerValue;
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Sec-WebSocket-Extensions"))) {
+            } else if(headerNameIs(headerName, nameLength, "Sec-WebSocket-Extensions")) {
                 client->cExtensions = headerValue;
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Sec-WebSocket-Version"))) {
-                client->cVersion = headerValue.toInt();
-            } else if(headerName.equalsIgnoreCase(WEBSOCKETS_STRING("Set-Cookie"))) {
-                if(headerValue.indexOf(WEBSOCKETS_STRING("HttpOnly")) > -1) {
-                    client->cSessionId = headerValue.substring(headerValue.indexOf('=') + 1, headerValue.indexOf(";"));
-                } else {
-                    client->cSessionId = headerValue.substring(headerValue.indexOf('=') + 1);
+            } else if(headerNameIs(headerName, nameLength, "Sec-WebSocket-Version")) {
+                client->cVersion = atoi(headerValue);
+            } else if(headerNameIs(headerName, nameLength, "Set-Cookie")) {
+                // "io=<sid>; Path=/; HttpOnly"
+                char * sid = strchr(headerValue, '=');
+                sid = sid ? sid + 1 : headerValue;
+                char * end = strchr(sid, ';');
+                if(end) {
+                    *end = 0x00;
                 }
+                client->cSessionId = sid;
             }
         } else {
-            DEBUG_WEBSOCKETS("[WS-Client][handleHeader] Header error (%s)\n", headerLine->c_str());
+            DEBUG_WEBSOCKETS("[WS-Client][handleHeader] Header error (%s)\n", headerLine);
         }
 
-        (*headerLine) = "";
-#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
-        client->tcp->readStringUntil('\n', &(client->cHttpLine), std::bind(&WebSocketsClient::handleHeader, this, client, &(client->cHttpLine)));
-#endif
-
+        return true;
     } else {
         DEBUG_WEBSOCKETS("[WS-Client][handleHeader] Header read fin.\n");
         DEBUG_WEBSOCKETS("[WS-Client][handleHeader] Client settings:\n");
@@ -627,6 +762,7 @@ void WebSocketsClient::handleHeader(WSclient_t * client, String * headerLine) {
                     if(client->isSocketIO) {
                         break;
                     }
+                    // fall through
                 case 403: ///< Forbidden
                     // todo handle login
                 default:   ///< Server dont unterstand requrst
@@ -644,8 +780,9 @@ void WebSocketsClient::handleHeader(WSclient_t * client, String * headerLine) {
                 ok = false;
             } else {
                 // generate Sec-WebSocket-Accept key for check
-                String sKey = acceptKey(client->cKey);
-                if(sKey != client->cAccept) {
+                char sKey[WEBSOCKETS_ACCEPT_KEY_LENGTH];
+                acceptKey(client->cKey, sKey);
+                if(!acceptKeyEquals(sKey, client->cAccept)) {
                     DEBUG_WEBSOCKETS("[WS-Client][handleHeader] Sec-WebSocket-Accept is wrong\n");
                     ok = false;
                 }
@@ -670,6 +807,8 @@ void WebSocketsClient::handleHeader(WSclient_t * client, String * headerLine) {
             clientDisconnect(client);
         }
     }
+
+    return false;
 }
 
 void WebSocketsClient::connectedCb() {
@@ -692,6 +831,8 @@ void WebSocketsClient::connectedCb() {
     _client.status = WSC_HEADER;
 
 #if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+    _client.cHttpLineLen = 0;
+
     // set Timeout for readBytesUntil and readStringUntil
     _client.tcp->setTimeout(WEBSOCKETS_TCP_TIMEOUT);
 #endif
@@ -708,6 +849,10 @@ void WebSocketsClient::connectedCb() {
     }
 #endif
 
+#ifdef ENABLE_DIAGNOSTICS
+    _client.cHandshakeStart = micros();
+#endif
+
     // send Header to Server
     sendHeader(&_client);
 
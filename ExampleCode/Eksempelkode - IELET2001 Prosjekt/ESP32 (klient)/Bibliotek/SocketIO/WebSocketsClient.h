@@ -100,6 +100,20 @@ class WebSocketsClient: private WebSockets {
         unsigned long _lastConnectionFail;
         unsigned long _reconnectInterval;
 
+#if (WEBSOCKETS_NETWORK_TYPE != NETWORK_ESP8266_ASYNC)
+        // network objects are kept over reconnects
+        WEBSOCKETS_NETWORK_CLASS * _tcp;
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266) || (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP32)
+        WiFiClientSecure * _ssl;
+#endif
+#endif
+
+        String _handshake;          ///< prebuilt http request, see buildHandshake()
+        size_t _handshakeUrlEnd;    ///< offset behind the url
+        size_t _handshakeWsStart;   ///< offset of the upgrade headers
+        size_t _handshakeKeyPos;    ///< offset of the Sec-WebSocket-Key value
+        size_t _handshakeWsEnd;     ///< offset behind the upgrade headers
+
         void messageReceived(WSclient_t * client, WSopcode_t opcode, uint8_t * payload, size_t length, bool fin);
 
         void clientDisconnect(WSclient_t * client);
@@ -109,8 +123,12 @@ class WebSocketsClient: private WebSockets {
         void handleClientData(void);
 #endif
 
+        void buildHandshake(WSclient_t * client);
         void sendHeader(WSclient_t * client);
+        bool handleHeaderLine(WSclient_t * client, char * headerLine, size_t length);
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266_ASYNC)
         void handleHeader(WSclient_t * client, String * headerLine);
+#endif
 
         void connectedCb();
         void connectFailedCb();
@@ -0,0 +1,96 @@
+/***********************************************************************************************************************
+ * ALLOCATION COUNTER FOR THE NATIVE TESTS AND THE BENCHMARK
+ * REPLACES MALLOC, CALLOC, REALLOC AND FREE OF GLIBC TO COUNT THE ALLOCATIONS OF ONE THREAD AND THE HIGH-WATER MARK OF
+ * THE HEAP. INCLUDED BY ONE FILE OF A PROGRAM ONLY. THE SANITIZERS REPLACE THE SAME FUNCTIONS, SO WITH THEM NOTHING IS
+ * COUNTED AND ALLOCATION_COUNTING IS NOT DEFINED
+ ***********************************************************************************************************************/
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define ALLOCATION_COUNTING
+#endif
+
+// Only the allocations of a thread that sets countAllocations are counted, not those of the server thread
+static thread_local bool countAllocations = false;
+static std::atomic<uint32_t> allocations(0);
+
+// Bytes in use on the heap by all threads, and the most since resetHeapPeak
+static std::atomic<size_t> heapInUse(0);
+static std::atomic<size_t> heapPeak(0);
+
+/**
+ * Function that starts a new high-water mark from the bytes in use now.
+ * @return the bytes in use now
+ */
+static inline size_t resetHeapPeak() {
+    size_t inUse = heapInUse.load(std::memory_order_relaxed);
+    heapPeak.store(inUse, std::memory_order_relaxed);
+    return inUse;
+}
+
+#ifdef ALLOCATION_COUNTING
+#include <malloc.h>
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * pointer, size_t size);
+extern "C" void __libc_free(void * pointer);
+
+static inline void countAllocation() {
+    if (countAllocations) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static inline void * heapAdd(void * pointer) {
+    if (pointer != NULL) {
+        size_t inUse = heapInUse.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed) +
+                       malloc_usable_size(pointer);
+        size_t peak = heapPeak.load(std::memory_order_relaxed);
+        while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+        }
+    }
+    return pointer;
+}
+
+static inline void heapRemove(void * pointer) {
+    if (pointer != NULL) {
+        heapInUse.fetch_sub(malloc_usable_size(pointer), std::memory_order_relaxed);
+    }
+}
+
+// The operators new and delete of libstdc++ call these, so they are counted too
+extern "C" void * malloc(size_t size) {
+    countAllocation();
+    return heapAdd(__libc_malloc(size));
+}
+
+extern "C" void * calloc(size_t count, size_t size) {
+    countAllocation();
+    return heapAdd(__libc_calloc(count, size));
+}
+
+extern "C" void * realloc(void * pointer, size_t size) {
+    countAllocation();
+    size_t before = pointer != NULL ? malloc_usable_size(pointer) : 0;
+    void * result = __libc_realloc(pointer, size);
+    // A failed realloc keeps the old block
+    if (result != NULL || size == 0) {
+        heapInUse.fetch_sub(before, std::memory_order_relaxed);
+        heapAdd(result);
+    }
+    return result;
+}
+
+extern "C" void free(void * pointer) {
+    heapRemove(pointer);
+    __libc_free(pointer);
+}
+#endif
+
+#endif
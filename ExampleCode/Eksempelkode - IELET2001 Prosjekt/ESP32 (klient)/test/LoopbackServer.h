@@ -0,0 +1,501 @@
+/***********************************************************************************************************************
+ * LOOPBACK SOCKET.IO SERVER FOR THE NATIVE TESTS AND THE BENCHMARK
+ * STAND-IN FOR SERVER_NO_ENCRYPT.JS ON 127.0.0.1 THAT SPEAKS ENGINE.IO 3 OR 4. IT TAKES ONE CONNECTION AT A TIME, AND
+ * CAN DROP THE CONNECTION OR STOP ANSWERING, SO RECONNECTS AND TIMEOUTS OF THE CLIENT CAN BE TESTED
+ ***********************************************************************************************************************/
+#ifndef LOOPBACK_SERVER_H
+#define LOOPBACK_SERVER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+extern "C" {
+#include "libsha1/libsha1.h"
+#include "libb64/cencode_inc.h"
+}
+
+/**
+ * Makes the WebSocket handshake, opens the Engine.IO session and the Socket.IO namespace, answers the pings of an
+ * Engine.IO 3 client and pings an Engine.IO 4 client, acks the events that ask for it and counts what the client sends.
+ * Runs in its own thread with blocking sockets, while the client runs in the thread of the test as it does in loop() on
+ * the ESP32. A test that needs other answers overrides textReceived.
+ */
+class LoopbackServer {
+public:
+    /**
+     * @param engineIoVersion   3 as socket.io 2, 4 as socket.io 3 and later
+     * @param pingInterval      ping interval in ms sent in the open packet
+     * @param pingTimeout       ping timeout in ms sent in the open packet
+     */
+    explicit LoopbackServer(uint8_t engineIoVersion = 3, unsigned long pingInterval = 25000,
+                            unsigned long pingTimeout = 60000)
+        : port(0), connections(0), events(0), frames(0), bytes(0), acks(0), pings(0), pongs(0), lastEventTime(0),
+          lastAckTime(0), engineIoVersion(engineIoVersion), pingInterval(pingInterval), pingTimeout(pingTimeout),
+          silent(false), recordMessages(false), stopping(false), listenFd(-1), clientFd(-1), binaryPending(false),
+          handshakeChunk(0) {}
+
+    virtual ~LoopbackServer() {
+        stop();
+    }
+
+    bool start() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+            listen(listenFd, 4) != 0 || getsockname(listenFd, (struct sockaddr *) &address, &length) != 0) {
+            return false;
+        }
+        port = ntohs(address.sin_port);
+        thread = std::thread(&LoopbackServer::run, this);
+        return true;
+    }
+
+    /**
+     * Function that closes the connection and the server, and waits for its thread. Has to be called before an object
+     * of a derived class is destroyed, as the thread calls its functions.
+     */
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        stopping = true;
+        shutdown(listenFd, SHUT_RDWR);
+        drop();
+        thread.join();
+        close(listenFd);
+        listenFd = -1;
+    }
+
+    /**
+     * Function that closes the connection as if the network was lost, the server takes the next one.
+     */
+    void drop() {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (clientFd >= 0) {
+            shutdown(clientFd, SHUT_RDWR);
+        }
+    }
+
+    /**
+     * Function that makes the server stop answering and sending pings, as a server that hangs. Frames are still read.
+     * @param value         true to stop answering, false to answer again
+     */
+    void setSilent(bool value) {
+        silent = value;
+    }
+
+    /**
+     * Function that adds header lines to the handshake response of the next connections.
+     * @param headers       the lines, each ending with \r\n
+     */
+    void setExtraHeaders(const std::string& headers) {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        extraHeaders = headers;
+    }
+
+    /**
+     * Function that sends the handshake response in chunks with a pause between them, so its lines are split over
+     * several reads of the client.
+     * @param size          bytes per chunk, 0 to send it at once
+     */
+    void setHandshakeChunk(size_t size) {
+        handshakeChunk = size;
+    }
+
+    /**
+     * Function that keeps every Socket.IO message the client sends, see messages.
+     * @param value         true to keep them
+     */
+    void setRecordMessages(bool value) {
+        recordMessages = value;
+    }
+
+    /**
+     * @return the Socket.IO messages received since setRecordMessages, in the order they arrived
+     */
+    std::vector<std::string> messages() {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        return recorded;
+    }
+
+    /**
+     * @return the HTTP request of the last connection
+     */
+    std::string request() {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        return lastRequest;
+    }
+
+    /**
+     * Function that sends a text frame to the client, can be called from the thread of the test.
+     * @param text          the frame, NUL terminated
+     */
+    void push(const char * text) {
+        sendFrame(0x1, (const uint8_t *) text, strlen(text));
+    }
+
+    /**
+     * Function that sends bytes to the client as they are, for frames that are cut up or broken.
+     * @param data          the bytes
+     * @param length        number of bytes
+     */
+    void sendRaw(const uint8_t * data, size_t length) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (clientFd >= 0) {
+            send(clientFd, data, length, MSG_NOSIGNAL);
+        }
+    }
+
+    /**
+     * Function that builds an unmasked frame from the server.
+     * @param opcode        opcode of the frame
+     * @param payload       payload of the frame
+     * @param length        length of the payload
+     * @param fin           false for a fragment that is followed by more
+     * @return the frame
+     */
+    static std::vector<uint8_t> frame(uint8_t opcode, const uint8_t * payload, size_t length, bool fin = true) {
+        std::vector<uint8_t> result;
+        result.push_back((fin ? 0x80 : 0x00) | opcode);
+        if (length < 126) {
+            result.push_back(length);
+        } else if (length <= 0xFFFF) {
+            result.push_back(126);
+            result.push_back(length >> 8);
+            result.push_back(length & 0xFF);
+        } else {
+            result.push_back(127);
+            for (int i = 7; i >= 0; i--) {
+                result.push_back((uint8_t) ((uint64_t) length >> (i * 8)));
+            }
+        }
+        result.insert(result.end(), payload, payload + length);
+        return result;
+    }
+
+    uint16_t port;
+    std::atomic<uint32_t> connections;        // Connections that made the WebSocket handshake
+    std::atomic<uint32_t> events;             // Events "bench", "benchBinary" and telemetry without ack received
+    std::atomic<uint32_t> frames;             // WebSocket frames received
+    std::atomic<uint64_t> bytes;              // Bytes received after the handshake, with the frame headers
+    std::atomic<uint32_t> acks;               // Events "setpointsAck" received
+    std::atomic<uint32_t> pings;              // Engine.IO pings, received with EIO3 and sent with EIO4
+    std::atomic<uint32_t> pongs;              // Engine.IO pongs received, EIO4 only
+    std::atomic<unsigned long> lastEventTime; // micros() when the last event was received
+    std::atomic<unsigned long> lastAckTime;   // micros() when the last "setpointsAck" was received
+
+protected:
+    /**
+     * Function that is called when the client has made the handshake, sends the open packet and with Engine.IO 3 the
+     * Socket.IO connect.
+     */
+    virtual void opened() {
+        char open[128];
+        snprintf(open, sizeof(open), "0{\"sid\":\"loopback\",\"upgrades\":[],\"pingInterval\":%lu,\"pingTimeout\":%lu}",
+                 pingInterval, pingTimeout);
+        push(open);
+        if (engineIoVersion < 4) {
+            push("40");
+        }
+    }
+
+    /**
+     * Function that handles a text frame like server_no_encrypt.js does with the events of the benchmark. Events with
+     * an ack id, 42<ack id>["event",...], are acked with 43<ack id>[].
+     * @param text          payload of the frame
+     */
+    virtual void textReceived(const std::string& text) {
+        if (text == "2") {
+            pings.fetch_add(1, std::memory_order_relaxed);
+            if (!silent) {
+                push("3");
+            }
+        } else if (text == "3") {
+            pongs.fetch_add(1, std::memory_order_relaxed);
+        } else if (text == "40") {
+            push("40{\"sid\":\"loopback\"}");
+        } else if (text.compare(0, 10, "42[\"bench\"") == 0 || text.compare(0, 15, "42[\"sensorData\"") == 0 ||
+                   text.compare(0, 20, "42[\"sensorDataBatch\"") == 0) {
+            eventReceived();
+        } else if (text.compare(0, 18, "451-[\"benchBinary\"") == 0 ||
+                   text.compare(0, 23, "451-[\"sensorDataBinary\"") == 0) {
+            binaryPending = true;
+        } else if (text.compare(0, 17, "42[\"setpointsAck\"") == 0) {
+            lastAckTime.store(micros(), std::memory_order_relaxed);
+            acks.fetch_add(1, std::memory_order_release);
+        } else if (text.size() > 2 && text.compare(0, 2, "42") == 0 && isdigit((unsigned char) text[2]) && !silent) {
+            std::string ack = "43" + text.substr(2, text.find('[') - 2) + "[]";
+            push(ack.c_str());
+        }
+    }
+
+    /**
+     * Function that handles a binary frame, the attachment of a binary event.
+     * @param payload       payload of the frame
+     */
+    virtual void binaryReceived(const std::vector<uint8_t>& payload) {
+        (void) payload;
+        if (binaryPending) {
+            binaryPending = false;
+            eventReceived();
+        }
+    }
+
+    void eventReceived() {
+        lastEventTime.store(micros(), std::memory_order_relaxed);
+        events.fetch_add(1, std::memory_order_release);
+    }
+
+    const uint8_t engineIoVersion;
+    const unsigned long pingInterval;
+    const unsigned long pingTimeout;
+    std::atomic<bool> silent;
+
+private:
+    void run() {
+        while (!stopping) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(sendMutex);
+                clientFd = fd;
+            }
+            if (handshake()) {
+                connections.fetch_add(1, std::memory_order_release);
+                serve();
+            }
+            std::lock_guard<std::mutex> lock(sendMutex);
+            close(clientFd);
+            clientFd = -1;
+        }
+    }
+
+    /**
+     * Function that reads the frames of the client until the connection is closed, and pings an Engine.IO 4 client
+     * every ping interval.
+     */
+    void serve() {
+        binaryPending = false;
+        opened();
+        unsigned long lastPing = millis();
+        std::vector<uint8_t> payload;
+        uint8_t opcode;
+        for (;;) {
+            if (engineIoVersion >= 4 && !silent && millis() - lastPing >= pingInterval) {
+                push("2");
+                pings.fetch_add(1, std::memory_order_relaxed);
+                lastPing = millis();
+            }
+            struct pollfd request = {clientFd, POLLIN, 0};
+            int ready = poll(&request, 1, 10);
+            if (ready < 0 || stopping) {
+                return;
+            }
+            if (ready == 0) {
+                continue;
+            }
+            if (!readFrame(opcode, payload)) {
+                return;
+            }
+            frames.fetch_add(1, std::memory_order_relaxed);
+            handleFrame(opcode, payload);
+        }
+    }
+
+    /**
+     * Function that reads the HTTP upgrade request and answers with the Sec-WebSocket-Accept of its key.
+     * @return true if the request was read
+     */
+    bool handshake() {
+        std::string request;
+        char c;
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            if (recv(clientFd, &c, 1, 0) != 1) {
+                return false;
+            }
+            request += c;
+        }
+        {
+            std::lock_guard<std::mutex> lock(recordMutex);
+            lastRequest = request;
+        }
+        const char KEY_HEADER[] = "Sec-WebSocket-Key: ";
+        size_t start = request.find(KEY_HEADER);
+        if (start == std::string::npos) {
+            return false;
+        }
+        start += sizeof(KEY_HEADER) - 1;
+        std::string key = request.substr(start, request.find("\r\n", start) - start);
+        key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        SHA1_CTX context;
+        unsigned char digest[20];
+        SHA1Init(&context);
+        SHA1Update(&context, (const unsigned char *) key.c_str(), key.size());
+        SHA1Final(digest, &context);
+        char accept[32];
+        base64_encodestate state;
+        base64_init_encodestate(&state);
+        int length = base64_encode_block((const char *) digest, sizeof(digest), accept, &state);
+        length += base64_encode_blockend(&accept[length], &state);
+        accept[length] = '\0';
+
+        std::string response = "HTTP/1.1 101 Switching Protocols\r\n";
+        {
+            std::lock_guard<std::mutex> lock(recordMutex);
+            response += extraHeaders;
+        }
+        response += "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+        response += accept;
+        response += "\r\n\r\n";
+        size_t chunk = handshakeChunk > 0 ? handshakeChunk.load() : response.size();
+        for (size_t sent = 0; sent < response.size(); sent += chunk) {
+            size_t length = min(chunk, response.size() - sent);
+            if (send(clientFd, response.data() + sent, length, MSG_NOSIGNAL) != (ssize_t) length) {
+                return false;
+            }
+            if (chunk < response.size()) {
+                delayMicroseconds(200);
+            }
+        }
+        return true;
+    }
+
+    bool readExact(uint8_t * buffer, size_t length) {
+        while (length > 0) {
+            ssize_t received = recv(clientFd, buffer, length, 0);
+            if (received <= 0) {
+                return false;
+            }
+            buffer += received;
+            length -= received;
+        }
+        return true;
+    }
+
+    /**
+     * Function that reads a frame from the client and removes the mask.
+     * @param opcode        is set to the opcode of the frame
+     * @param payload       is set to the payload
+     * @return false if the connection was closed
+     */
+    bool readFrame(uint8_t& opcode, std::vector<uint8_t>& payload) {
+        uint8_t header[14];
+        if (!readExact(header, 2)) {
+            return false;
+        }
+        size_t headerLength = 2;
+        uint64_t length = header[1] & 0x7F;
+        if (length == 126) {
+            if (!readExact(&header[2], 2)) {
+                return false;
+            }
+            length = (header[2] << 8) | header[3];
+            headerLength += 2;
+        } else if (length == 127) {
+            if (!readExact(&header[2], 8)) {
+                return false;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | header[2 + i];
+            }
+            headerLength += 8;
+        }
+        uint8_t mask[4] = {0, 0, 0, 0};
+        if ((header[1] & 0x80) && !readExact(mask, 4)) {
+            return false;
+        }
+        if (header[1] & 0x80) {
+            headerLength += 4;
+        }
+        payload.resize(length);
+        if (length > 0 && !readExact(payload.data(), length)) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            payload[i] ^= mask[i & 3];
+        }
+        opcode = header[0] & 0x0F;
+        bytes.fetch_add(headerLength + length, std::memory_order_relaxed);
+        return true;
+    }
+
+    void handleFrame(uint8_t opcode, const std::vector<uint8_t>& payload) {
+        if (opcode == 0x1) {
+            std::string text(payload.begin(), payload.end());
+            if (recordMessages && text.compare(0, 1, "4") == 0) {
+                std::lock_guard<std::mutex> lock(recordMutex);
+                recorded.push_back(text);
+            }
+            textReceived(text);
+        } else if (opcode == 0x2) {
+            binaryReceived(payload);
+        } else if (opcode == 0x8) {
+            drop();
+        } else if (opcode == 0x9 && !silent) {
+            sendFrame(0xA, payload.data(), payload.size());
+        }
+    }
+
+    /**
+     * Function that sends a frame in one write, so Nagle's algorithm does not hold back the payload. Nothing is
+     * allocated, as it is also called from the client thread while its allocations are counted.
+     * @param opcode        opcode of the frame
+     * @param payload       payload of the frame, at most 65535 bytes
+     * @param length        length of the payload
+     */
+    void sendFrame(uint8_t opcode, const uint8_t * payload, size_t length) {
+        uint8_t header[4] = {(uint8_t) (0x80 | opcode), 0, 0, 0};
+        size_t headerLength = 2;
+        if (length < 126) {
+            header[1] = length;
+        } else {
+            header[1] = 126;
+            header[2] = length >> 8;
+            header[3] = length & 0xFF;
+            headerLength = 4;
+        }
+        struct iovec parts[2] = {{header, headerLength}, {(void *) payload, length}};
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (clientFd >= 0) {
+            sendmsg(clientFd, &message, MSG_NOSIGNAL);
+        }
+    }
+
+    std::atomic<bool> recordMessages;
+    std::atomic<bool> stopping;
+    int listenFd;
+    int clientFd;             // Changed by the server thread with sendMutex held
+    bool binaryPending;
+    std::atomic<size_t> handshakeChunk;
+    std::thread thread;
+    std::mutex sendMutex;
+    std::mutex recordMutex;
+    std::vector<std::string> recorded;
+    std::string lastRequest;
+    std::string extraHeaders;
+};
+
+#endif
@@ -0,0 +1,63 @@
+/***********************************************************************************************************************
+ * CHECKS FOR THE NATIVE TESTS
+ * EVERY TEST IS ITS OWN PROGRAM RUN BY CTEST, A FAILED CHECK IS PRINTED AND MAKES THE PROGRAM RETURN 1
+ ***********************************************************************************************************************/
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * @return the number of checks that have failed in the program
+ */
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+/**
+ * Function that counts a failed check and prints where it is.
+ * @param ok            result of the check
+ * @param text          the checked expression
+ * @param file          file of the check
+ * @param line          line of the check
+ * @return ok
+ */
+inline bool testCheck(bool ok, const char * text, const char * file, int line) {
+    if (!ok) {
+        testFailures()++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+    }
+    return ok;
+}
+
+// Checks a condition, the test goes on when it fails so every failure is printed
+#define CHECK(condition) testCheck((condition), #condition, __FILE__, __LINE__)
+
+// Checks two numbers, and prints both when they differ
+#define CHECK_EQUAL(expected, actual)                                                                             \
+    (testCheck((expected) == (actual), #expected " == " #actual, __FILE__, __LINE__) ||                            \
+     (fprintf(stderr, "    expected %lld, got %lld\n", (long long) (expected), (long long) (actual)), false))
+
+// Checks that two decimal numbers differ by at most tolerance, and prints both when they do not
+#define CHECK_NEAR(expected, actual, tolerance)                                                                   \
+    (testCheck(fabs((double) (expected) - (double) (actual)) <= (tolerance),                                      \
+               #expected " == " #actual " +- " #tolerance, __FILE__, __LINE__) ||                                 \
+     (fprintf(stderr, "    expected %g, got %g\n", (double) (expected), (double) (actual)), false))
+
+/**
+ * Function that ends the test.
+ * @param name          name of the test, printed with the result
+ * @return the exit code of the program, 0 if every check passed
+ */
+inline int testResult(const char * name) {
+    if (testFailures() > 0) {
+        printf("%s: %d checks failed\n", name, testFailures());
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/***********************************************************************************************************************
+ * WEBSOCKETSCLIENT FOR THE NATIVE TESTS
+ * A WEBSOCKETSCLIENT THAT CONNECTS TO THE LOOPBACK SERVER, KEEPS WHAT IT RECEIVES AND GIVES THE TESTS ITS PROTECTED
+ * CLIENT STATE AND HEADER PARSER
+ ***********************************************************************************************************************/
+#ifndef WEBSOCKETS_CLIENT_TEST_H
+#define WEBSOCKETS_CLIENT_TEST_H
+
+#include <Arduino.h>
+#include <WebSocketsClient.h>
+#include <string>
+#include "LoopbackServer.h"
+
+class WebSocketsClientTest : public WebSocketsClient {
+public:
+    WebSocketsClientTest() : connected(false), connects(0), disconnects(0), texts(0), textHash(2166136261u), textLength(0) {
+        onEvent([this](WStype_t type, uint8_t * payload, size_t length) { event(type, payload, length); });
+    }
+
+    /**
+     * Function that connects to the loopback server, with the url of an Engine.IO 3 client.
+     * @param server        the started server
+     * @param timeout       time in ms to wait for the handshake
+     * @return true if the client is connected
+     */
+    bool connectTo(LoopbackServer& server, unsigned long timeout = 5000) {
+        begin("127.0.0.1", server.port, "/socket.io/?EIO=3&transport=websocket");
+        return runUntil([this]() { return connected; }, timeout);
+    }
+
+    /**
+     * Function that runs loop() until the condition is true.
+     * @param condition     function that returns true when done
+     * @param timeout       time in ms before giving up
+     * @return the last result of the condition
+     */
+    template <typename Condition>
+    bool runUntil(Condition condition, unsigned long timeout = 5000) {
+        unsigned long start = millis();
+        while (!condition()) {
+            if (millis() - start > timeout) {
+                return false;
+            }
+            loop();
+        }
+        return true;
+    }
+
+    WSclient_t& state() {
+        return _client;
+    }
+
+    bool headerLine(char * line, size_t length) {
+        return handleHeaderLine(&_client, line, length);
+    }
+
+    bool connected;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t texts;           // Text messages received
+    uint32_t textHash;        // FNV-1a hash over the bytes of all of them, see hashText
+    size_t textLength;        // Length of the last one, it is kept in lastText without allocating
+    char lastText[256];
+
+    /**
+     * @return the last text message, cut at the size of lastText
+     */
+    std::string text() const {
+        return std::string(lastText, min(textLength, sizeof(lastText)));
+    }
+
+    /**
+     * Function that adds a text to a hash the way the client adds the texts it receives to textHash.
+     * @param hash          the hash so far, 2166136261 to start
+     * @return the new hash
+     */
+    static uint32_t hashText(uint32_t hash, const uint8_t * data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+private:
+    void event(WStype_t type, uint8_t * payload, size_t length) {
+        switch (type) {
+            case WStype_CONNECTED:
+                connected = true;
+                connects++;
+                break;
+            case WStype_DISCONNECTED:
+                connected = false;
+                disconnects++;
+                break;
+            case WStype_TEXT:
+                texts++;
+                textHash = hashText(textHash, payload, length);
+                textLength = length;
+                memcpy(lastText, payload, min(length, sizeof(lastText)));
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,424 @@
+/***********************************************************************************************************************
+ * SOCKET.IO CLIENT BENCHMARK
+ * RUNS SOCKETIOCLIENT AND WEBSOCKETSCLIENT ON LINUX AGAINST A LOOPBACK STAND-IN OF SERVER_NO_ENCRYPT.JS, AND WRITES THE
+ * LATENCY, THROUGHPUT, BYTES AND ALLOCATIONS PER EVENT TO A JSON FILE SO CHANGES TO THE HOT PATHS CAN BE COMPARED
+ *
+ * Built with the native build: cmake -S native -B build-native -DNATIVE_BENCHMARK=ON && cmake --build build-native
+ * Run: ./build-native/robot_benchmark [output file, default benchmark.json]
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <atomic>
+#include <vector>
+#include "AllocationCounter.h"
+#include "LoopbackServer.h"
+#include "TelemetryFormat.h"
+
+/// Benchmark Settings ///
+// Sizes in bytes of the data of the events
+const size_t PAYLOAD_SIZES[] = {16, 64, 256, 1024};
+const size_t PAYLOAD_SIZE_COUNT = sizeof(PAYLOAD_SIZES) / sizeof(PAYLOAD_SIZES[0]);
+
+// Events sent one at a time for the latency, and back to back for the throughput
+const uint32_t LATENCY_EVENTS = 2000;
+const uint32_t THROUGHPUT_EVENTS = 10000;
+
+// Set-points pushed by the server for the round-trip time
+const uint32_t SETPOINT_EVENTS = 2000;
+
+// Events sent with emitWithAck for the time until the ack of the server has arrived
+const uint32_t ACK_EVENTS = 2000;
+
+// Report ticks of the robot sent for the telemetry, with the readings of one tick
+const uint32_t TELEMETRY_TICKS = 5000;
+const char * const TICK_READINGS[] = {
+    "{\"ControlledItemID\":\"001\",\"value\":0.42}",
+    "{\"SensorID\":\"001\",\"value\":21.40}",
+    "{\"SensorID\":\"002\",\"value\":912.30}",
+};
+const size_t TICK_READING_COUNT = sizeof(TICK_READINGS) / sizeof(TICK_READINGS[0]);
+
+// The readings of TICK_READINGS in the binary format
+const DataType TICK_TYPES[] = {DATA_OUTPUT_LEVEL, DATA_SENSOR_VALUE, DATA_SENSOR_VALUE};
+const char * const TICK_IDS[] = {"001", "001", "002"};
+const float TICK_VALUES[] = {0.42, 21.40, 912.30};
+
+// Records encoded for the throughput of the encoder of the binary format
+const uint32_t ENCODE_RECORDS = 10000000;
+
+// Time in ms to wait for the server before the benchmark fails
+const unsigned long WAIT_TIMEOUT = 5000;
+
+
+/// Client ///
+SocketIoClient webSocket;
+LoopbackServer server;
+bool socketConnected = false;
+
+void connected(const char * payload, size_t length) {
+    (void) payload;
+    (void) length;
+    socketConnected = true;
+}
+
+/**
+ * Function that answers a set-point pushed by the server with event "setpointsAck", as the robot would answer with
+ * its new output state.
+ * @param payload       the set-points
+ * @param length        length of the payload
+ */
+void setpointsReceived(const char * payload, size_t length) {
+    char data[64];
+    length = min(length, sizeof(data) - 1);
+    memcpy(data, payload, length);
+    data[length] = '\0';
+    webSocket.emit("setpointsAck", data);
+}
+
+/**
+ * Function that runs the client until the server has received the wanted number of events.
+ * @param counter       counter of the server
+ * @param target        number the counter has to reach
+ * @return false if the server did not get them within WAIT_TIMEOUT
+ */
+bool waitFor(const std::atomic<uint32_t>& counter, uint32_t target) {
+    unsigned long start = millis();
+    while (counter.load(std::memory_order_acquire) < target) {
+        if (millis() - start > WAIT_TIMEOUT) {
+            return false;
+        }
+        webSocket.loop();
+    }
+    return true;
+}
+
+
+/// Results ///
+struct Percentiles {
+    unsigned long p50;
+    unsigned long p90;
+    unsigned long p99;
+    unsigned long max;
+};
+
+Percentiles percentiles(std::vector<unsigned long>& samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t last = samples.size() - 1;
+    Percentiles result = {samples[last * 50 / 100], samples[last * 90 / 100], samples[last * 99 / 100],
+                          samples[last]};
+    return result;
+}
+
+struct Result {
+    const char * name;
+    size_t payloadSize;
+    Percentiles latency;
+    double eventsPerSecond;
+    double framesPerSecond;
+    double bytesPerEvent;
+    double allocationsPerEvent;
+};
+
+std::vector<Result> results;
+
+void emitEvent(bool binary, const char * text, const uint8_t * data, size_t size) {
+    if (binary) {
+        webSocket.emitBinary("benchBinary", data, size);
+    } else {
+        webSocket.emit("bench", text);
+    }
+}
+
+/**
+ * Function that measures events of one kind and size. The latency is from the emit to the server receiving the event,
+ * with one event at a time. The throughput is measured with the events sent back to back, one loop() after each emit,
+ * as the network task sends them.
+ * @param binary        if true the events are sent with emitBinary, else with emit as a JSON string
+ * @param size          size of the data of the events in bytes
+ * @return false if the server stopped receiving
+ */
+bool benchmarkEvents(bool binary, size_t size) {
+    // A JSON string of the size, and the same number of bytes as binary data
+    std::vector<char> text(size + 3, 'x');
+    text[0] = '"';
+    text[size + 1] = '"';
+    text[size + 2] = '\0';
+    std::vector<uint8_t> data(size, 0xA5);
+
+    std::vector<unsigned long> latencies;
+    latencies.reserve(LATENCY_EVENTS);
+    for (uint32_t i = 0; i < LATENCY_EVENTS; i++) {
+        uint32_t target = server.events.load() + 1;
+        unsigned long start = micros();
+        emitEvent(binary, text.data(), data.data(), size);
+        if (!waitFor(server.events, target)) {
+            return false;
+        }
+        latencies.push_back(server.lastEventTime.load(std::memory_order_relaxed) - start);
+    }
+
+    uint32_t target = server.events.load() + THROUGHPUT_EVENTS;
+    uint32_t frames = server.frames.load();
+    uint64_t bytes = server.bytes.load();
+    allocations = 0;
+    countAllocations = true;
+    unsigned long start = micros();
+    for (uint32_t i = 0; i < THROUGHPUT_EVENTS; i++) {
+        emitEvent(binary, text.data(), data.data(), size);
+        webSocket.loop();
+    }
+    bool ok = waitFor(server.events, target);
+    unsigned long elapsed = micros() - start;
+    countAllocations = false;
+    if (!ok) {
+        return false;
+    }
+
+    Result result = {binary ? "emit_binary" : "emit_text", size, percentiles(latencies),
+                     THROUGHPUT_EVENTS * 1e6 / elapsed, (server.frames.load() - frames) * 1e6 / elapsed,
+                     (double) (server.bytes.load() - bytes) / THROUGHPUT_EVENTS,
+                     (double) allocations.load() / THROUGHPUT_EVENTS};
+    results.push_back(result);
+    return true;
+}
+
+/**
+ * Function that measures the telemetry of the robot: the readings of one report tick sent one by one with event
+ * "sensorData", or together as one array with event "sensorDataBatch" as with TELEMETRY_BATCHING. The latency is from
+ * the first emit of a tick to the server receiving the last event of it. The events, frames and wire bytes are given
+ * per reading.
+ * @param batched       if true the readings of a tick are sent as one event
+ * @return false if the server stopped receiving
+ */
+bool benchmarkTelemetry(bool batched) {
+    char batch[256];
+    size_t length = 0;
+    batch[length++] = '[';
+    for (size_t i = 0; i < TICK_READING_COUNT; i++) {
+        length += snprintf(&batch[length], sizeof(batch) - length, "%s%s", i > 0 ? "," : "", TICK_READINGS[i]);
+    }
+    snprintf(&batch[length], sizeof(batch) - length, "]");
+
+    std::vector<unsigned long> latencies;
+    latencies.reserve(TELEMETRY_TICKS);
+    uint32_t frames = server.frames.load();
+    uint64_t bytes = server.bytes.load();
+    allocations = 0;
+    countAllocations = true;
+    unsigned long start = micros();
+    for (uint32_t tick = 0; tick < TELEMETRY_TICKS; tick++) {
+        uint32_t target = server.events.load() + (batched ? 1 : TICK_READING_COUNT);
+        unsigned long tickStart = micros();
+        if (batched) {
+            webSocket.emit("sensorDataBatch", batch);
+        } else {
+            for (size_t i = 0; i < TICK_READING_COUNT; i++) {
+                webSocket.emit("sensorData", TICK_READINGS[i]);
+            }
+        }
+        if (!waitFor(server.events, target)) {
+            countAllocations = false;
+            return false;
+        }
+        latencies.push_back(server.lastEventTime.load(std::memory_order_relaxed) - tickStart);
+    }
+    unsigned long elapsed = micros() - start;
+    countAllocations = false;
+
+    uint32_t readings = TELEMETRY_TICKS * TICK_READING_COUNT;
+    Result result = {batched ? "tick_batch" : "tick_single", strlen(batch), percentiles(latencies),
+                     readings * 1e6 / elapsed, (server.frames.load() - frames) * 1e6 / elapsed,
+                     (double) (server.bytes.load() - bytes) / readings, (double) allocations.load() / readings};
+    results.push_back(result);
+    return true;
+}
+
+/**
+ * Function that measures the telemetry of the robot in the binary format: the readings of one report tick encoded and
+ * sent as one "sensorDataBinary" event, as with TELEMETRY_BINARY. The events, frames and wire bytes are given per reading.
+ * @return false if the server stopped receiving
+ */
+bool benchmarkBinaryTelemetry() {
+    uint8_t batch[TELEMETRY_HEADER_SIZE + TICK_READING_COUNT * TELEMETRY_RECORD_SIZE];
+    std::vector<unsigned long> latencies;
+    latencies.reserve(TELEMETRY_TICKS);
+    uint32_t frames = server.frames.load();
+    uint64_t bytes = server.bytes.load();
+    allocations = 0;
+    countAllocations = true;
+    unsigned long start = micros();
+    for (uint32_t tick = 0; tick < TELEMETRY_TICKS; tick++) {
+        uint32_t target = server.events.load() + 1;
+        unsigned long tickStart = micros();
+        encodeTelemetryHeader(batch, TICK_READING_COUNT, millis());
+        for (size_t i = 0; i < TICK_READING_COUNT; i++) {
+            encodeTelemetryRecord(&batch[TELEMETRY_HEADER_SIZE + i * TELEMETRY_RECORD_SIZE], TICK_TYPES[i],
+                                  TICK_IDS[i], 0, TICK_VALUES[i]);
+        }
+        webSocket.emitBinary("sensorDataBinary", batch, sizeof(batch));
+        if (!waitFor(server.events, target)) {
+            countAllocations = false;
+            return false;
+        }
+        latencies.push_back(server.lastEventTime.load(std::memory_order_relaxed) - tickStart);
+    }
+    unsigned long elapsed = micros() - start;
+    countAllocations = false;
+
+    uint32_t readings = TELEMETRY_TICKS * TICK_READING_COUNT;
+    Result result = {"tick_binary", sizeof(batch), percentiles(latencies), readings * 1e6 / elapsed,
+                     (server.frames.load() - frames) * 1e6 / elapsed, (double) (server.bytes.load() - bytes) / readings,
+                     (double) allocations.load() / readings};
+    results.push_back(result);
+    return true;
+}
+
+/**
+ * Function that measures the encoder of the binary format alone, the events per second are records encoded per second.
+ */
+void benchmarkEncoder() {
+    uint8_t batch[TELEMETRY_HEADER_SIZE + 64 * TELEMETRY_RECORD_SIZE];
+    uint32_t checksum = 0;
+    unsigned long start = micros();
+    for (uint32_t i = 0; i < ENCODE_RECORDS; i++) {
+        uint8_t * record = &batch[TELEMETRY_HEADER_SIZE + (i % 64) * TELEMETRY_RECORD_SIZE];
+        encodeTelemetryRecord(record, DATA_SENSOR_VALUE, "001", i % 64, 21.0 + (i & 0xFF) / 10.0);
+        checksum += record[5];
+    }
+    unsigned long elapsed = micros() - start;
+    // Keeps the compiler from leaving out the records that are not read
+    if (checksum == 0) {
+        printf("\n");
+    }
+    Result result = {"encode_record", TELEMETRY_RECORD_SIZE, {0, 0, 0, 0}, ENCODE_RECORDS * 1e6 / elapsed, 0.0, 0.0,
+                     0.0};
+    results.push_back(result);
+}
+
+/**
+ * Function that measures the time from the server pushing event "setpoints" to it receiving the answer of the client.
+ * @return false if the server stopped receiving
+ */
+bool benchmarkSetpoints() {
+    std::vector<unsigned long> latencies;
+    latencies.reserve(SETPOINT_EVENTS);
+    allocations = 0;
+    countAllocations = true;
+    for (uint32_t i = 0; i < SETPOINT_EVENTS; i++) {
+        char text[96];
+        snprintf(text, sizeof(text), "42[\"setpoints\",{\"001\":{\"setpoint\":21.5,\"seq\":%u}}]", (unsigned) i);
+        uint32_t target = server.acks.load() + 1;
+        unsigned long start = micros();
+        server.push(text);
+        if (!waitFor(server.acks, target)) {
+            countAllocations = false;
+            return false;
+        }
+        latencies.push_back(server.lastAckTime.load(std::memory_order_relaxed) - start);
+    }
+    countAllocations = false;
+    Result result = {"setpoints_rtt", 0, percentiles(latencies), 0.0, 0.0, 0.0,
+                     (double) allocations.load() / SETPOINT_EVENTS};
+    results.push_back(result);
+    return true;
+}
+
+/**
+ * Function that measures the time from emitWithAck to the ack of the server being handled by the client.
+ * @return false if the server did not ack
+ */
+bool benchmarkAcks() {
+    std::vector<unsigned long> latencies;
+    latencies.reserve(ACK_EVENTS);
+    allocations = 0;
+    countAllocations = true;
+    for (uint32_t i = 0; i < ACK_EVENTS; i++) {
+        unsigned long start = micros();
+        webSocket.emitWithAck("benchAck", "{\"ControlledItemID\":\"001\",\"value\":1}");
+        while (webSocket.getPendingAcks() > 0) {
+            if (micros() - start > WAIT_TIMEOUT * 1000) {
+                countAllocations = false;
+                return false;
+            }
+            webSocket.loop();
+        }
+        latencies.push_back(micros() - start);
+    }
+    countAllocations = false;
+    Result result = {"emit_ack_rtt", 0, percentiles(latencies), 0.0, 0.0, 0.0,
+                     (double) allocations.load() / ACK_EVENTS};
+    results.push_back(result);
+    return true;
+}
+
+/**
+ * Function that writes the results as JSON, one object per benchmark. Latencies are in microseconds.
+ * @param path          the file
+ * @return false if the file could not be written
+ */
+bool writeResults(const char * path) {
+    FILE * file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\n  \"latencyEvents\": %u,\n  \"throughputEvents\": %u,\n  \"results\": [\n",
+            (unsigned) LATENCY_EVENTS, (unsigned) THROUGHPUT_EVENTS);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"payloadBytes\": %u, \"latencyUs\": {\"p50\": %lu, \"p90\": %lu, "
+                "\"p99\": %lu, \"max\": %lu}, \"eventsPerSecond\": %.0f, \"framesPerSecond\": %.0f, "
+                "\"wireBytesPerEvent\": %.1f, \"allocationsPerEvent\": %.2f}%s\n",
+                result.name, (unsigned) result.payloadSize, result.latency.p50, result.latency.p90,
+                result.latency.p99, result.latency.max, result.eventsPerSecond, result.framesPerSecond,
+                result.bytesPerEvent, result.allocationsPerEvent, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char ** argv) {
+    const char * path = argc > 1 ? argv[1] : "benchmark.json";
+    if (!server.start()) {
+        fprintf(stderr, "Could not start the loopback server\n");
+        return 1;
+    }
+    webSocket.on("connect", connected);
+    webSocket.on("setpoints", setpointsReceived);
+    webSocket.begin("127.0.0.1", server.port, DEFAULT_URL);
+
+    unsigned long start = millis();
+    while (!socketConnected && millis() - start < WAIT_TIMEOUT) {
+        webSocket.loop();
+    }
+    if (!socketConnected) {
+        fprintf(stderr, "Could not connect to the loopback server\n");
+        return 1;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < PAYLOAD_SIZE_COUNT && ok; i++) {
+        ok = benchmarkEvents(false, PAYLOAD_SIZES[i]) && benchmarkEvents(true, PAYLOAD_SIZES[i]);
+    }
+    ok = ok && benchmarkTelemetry(false) && benchmarkTelemetry(true) && benchmarkBinaryTelemetry() &&
+         benchmarkSetpoints() && benchmarkAcks();
+    if (!ok) {
+        fprintf(stderr, "The loopback server stopped receiving\n");
+        return 1;
+    }
+    benchmarkEncoder();
+
+    printf("%-14s %6s %8s %8s %8s %8s %10s %10s %8s %8s\n", "benchmark", "bytes", "p50 us", "p90 us", "p99 us",
+           "max us", "events/s", "frames/s", "wire B", "allocs");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        printf("%-14s %6u %8lu %8lu %8lu %8lu %10.0f %10.0f %8.1f %8.2f\n", result.name,
+               (unsigned) result.payloadSize, result.latency.p50, result.latency.p90, result.latency.p99,
+               result.latency.max, result.eventsPerSecond, result.framesPerSecond, result.bytesPerEvent,
+               result.allocationsPerEvent);
+    }
+    if (!writeResults(path)) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+/***********************************************************************************************************************
+ * TEST OF THE ACK WINDOW OF SOCKETIOCLIENT
+ * CHECKS THAT THE CLIENT ACKS THE EVENTS OF THE SERVER IN THEIR NAMESPACE. THEN EMITS EVENTS WITH EMITWITHACK TO A
+ * LOOPBACK SERVER THAT WITHHOLDS RANDOM ACKS AND DROPS THE CONNECTION AT RANDOM, AND CHECKS THAT EVERY EVENT ARRIVES
+ * WHOLE, THAT THE WINDOW DRAINS, THAT NEW EVENTS GO OUT IN THE ORDER OF THEIR ACK IDS AND THAT THE EVENTS WAITING FOR AN
+ * ACK ARE SENT AGAIN IN ORDER AT THE START OF EACH NEW CONNECTION, AND THAT ISACKED TELLS WHEN THE ACK OF AN ACK ID HAS
+ * ARRIVED. BUILT WITH SOCKETIOCLIENT_ACK_TIMEOUT OF 200 MS
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "LoopbackServer.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const uint32_t WINDOW_EVENTS = 400;
+const uint32_t WITHHELD_ACK_ONE_IN = 6;        // The server keeps back the ack of about one in this many events
+const uint32_t DROP_MIN_EVENTS = 20;           // The server drops the connection after 20 - 60 events
+const uint32_t DROP_MAX_EVENTS = 60;
+const unsigned long WINDOW_TIMEOUT = 60000;
+
+// An event "ackTest" as the server received it
+struct ReceivedEvent {
+    uint32_t connection;      // Number of the connection it came on, from 1
+    uint32_t ackId;
+    uint32_t number;          // The argument of the event, the number it was emitted with
+};
+
+/**
+ * Loopback server that records the events "ackTest", keeps back random acks and drops the connection at random.
+ */
+class AckWindowServer : public LoopbackServer {
+public:
+    AckWindowServer() : withheld(0), drops(0), dropping(false), acking(true), random(24), untilDrop(DROP_MAX_EVENTS) {}
+
+    ~AckWindowServer() {
+        stop();
+    }
+
+    /**
+     * @return the events received so far, in the order they arrived
+     */
+    std::vector<ReceivedEvent> received() {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        return events;
+    }
+
+    /**
+     * Function that starts or stops the random drops and withheld acks.
+     */
+    void setDropping(bool value) {
+        dropping = value;
+    }
+
+    /**
+     * Function that makes the server keep back the acks of every event, or ack them again.
+     */
+    void setAcking(bool value) {
+        acking = value;
+    }
+
+    std::atomic<uint32_t> withheld;           // Acks kept back
+    std::atomic<uint32_t> drops;              // Connections dropped
+
+protected:
+    void textReceived(const std::string& text) {
+        unsigned ackId;
+        unsigned number;
+        if (sscanf(text.c_str(), "42%u[\"ackTest\",%u]", &ackId, &number) != 2) {
+            LoopbackServer::textReceived(text);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(eventMutex);
+            ReceivedEvent event = {connections.load(), ackId, number};
+            events.push_back(event);
+        }
+        if (dropping && --untilDrop == 0) {
+            untilDrop = DROP_MIN_EVENTS + random() % (DROP_MAX_EVENTS - DROP_MIN_EVENTS + 1);
+            drops++;
+            drop();
+            return;
+        }
+        if (!acking || (dropping && random() % WITHHELD_ACK_ONE_IN == 0)) {
+            withheld++;
+            return;
+        }
+        char ack[24];
+        snprintf(ack, sizeof(ack), "43%u[]", ackId);
+        push(ack);
+    }
+
+private:
+    std::atomic<bool> dropping;
+    std::atomic<bool> acking;
+    std::mt19937 random;      // Used by the server thread only
+    uint32_t untilDrop;
+    std::mutex eventMutex;
+    std::vector<ReceivedEvent> events;
+};
+
+/**
+ * Function that runs loop() of the client until the condition is true.
+ * @return true if it was within the timeout
+ */
+template <typename Condition>
+bool runUntil(SocketIoClient& client, Condition condition, unsigned long timeout = 5000) {
+    unsigned long start = millis();
+    while (!condition()) {
+        if (millis() - start > timeout) {
+            return false;
+        }
+        client.loop();
+    }
+    return true;
+}
+
+/**
+ * Function that pushes an event with an ack id to the client, and checks the ack it answers with.
+ * @param event         the packet from the server
+ * @param ack           the ack the client should answer with
+ */
+void checkAckReply(AckWindowServer& server, SocketIoClient& client, const char * event, const char * ack) {
+    size_t before = server.messages().size();
+    server.push(event);
+    if (CHECK(runUntil(client, [&]() { return server.messages().size() > before; }))) {
+        std::string reply = server.messages()[before];
+        if (!CHECK(reply == ack)) {
+            fprintf(stderr, "    %s was acked with %s, not %s\n", event, reply.c_str(), ack);
+        }
+    }
+}
+
+void testAckReply() {
+    AckWindowServer server;
+    SocketIoClient client;
+    CHECK(server.start());
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        client.disconnect();
+        server.stop();
+        return;
+    }
+    server.setRecordMessages(true);
+    checkAckReply(server, client, "425[\"setpoints\",{}]", "435[]");
+    checkAckReply(server, client, "42/robots,7[\"setpoints\",{}]", "43/robots,7[]");
+    checkAckReply(server, client, "42/,0[\"setpoints\"]", "430[]");
+    checkAckReply(server, client, "424294967295[\"setpoints\"]", "434294967295[]");
+    client.disconnect();
+    server.stop();
+}
+
+/**
+ * Function that keeps back the ack of one event, and checks that isAcked follows the ack of each ack id on its own.
+ */
+void testIsAcked() {
+    AckWindowServer server;
+    SocketIoClient client;
+    CHECK(server.start());
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        client.disconnect();
+        server.stop();
+        return;
+    }
+    uint32_t first = 0;
+    uint32_t second = 0;
+    CHECK(client.emitWithAck("ackTest", "0", &first));
+    CHECK(!client.isAcked(first));
+    CHECK(runUntil(client, [&]() { return client.isAcked(first); }));
+    CHECK_EQUAL(0, client.getPendingAcks());
+
+    // The ack of the second event is kept back, so it is sent again until it is acked
+    server.setAcking(false);
+    CHECK(client.emitWithAck("ackTest", "1", &second));
+    CHECK_EQUAL(first + 1, second);
+    unsigned long start = millis();
+    while (millis() - start < 100) {
+        client.loop();
+    }
+    CHECK(!client.isAcked(second));
+    CHECK(client.isAcked(first));
+    server.setAcking(true);
+    CHECK(runUntil(client, [&]() { return client.isAcked(second); }));
+    client.disconnect();
+    server.stop();
+}
+
+void testWindow() {
+    AckWindowServer server;
+    SocketIoClient client;
+    CHECK(server.start());
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        client.disconnect();
+        server.stop();
+        return;
+    }
+    server.setDropping(true);
+
+    // The events are emitted as fast as the window takes them
+    uint32_t emitted = 0;
+    uint32_t windowFull = 0;
+    bool drained = runUntil(client, [&]() {
+        while (emitted < WINDOW_EVENTS) {
+            if (!client.emitWithAck("ackTest", std::to_string(emitted).c_str())) {
+                windowFull++;
+                break;
+            }
+            emitted++;
+        }
+        return emitted == WINDOW_EVENTS && client.getPendingAcks() == 0;
+    }, WINDOW_TIMEOUT);
+    server.setDropping(false);
+    CHECK(drained);
+    CHECK_EQUAL(WINDOW_EVENTS, emitted);
+    CHECK_EQUAL(0, client.getPendingAcks());
+    CHECK(windowFull > 0);
+    CHECK(server.drops > 0);
+    CHECK(server.withheld > 0);
+    CHECK(client.getRetransmitCount() > 0);
+
+    // Every event arrived at least once, with the argument it was emitted with. Ack ids count from 0 as the events
+    std::vector<ReceivedEvent> received = server.received();
+    std::vector<uint32_t> arrivals(WINDOW_EVENTS, 0);
+    uint32_t wrong = 0;
+    for (size_t i = 0; i < received.size(); i++) {
+        if (received[i].ackId != received[i].number || received[i].number >= WINDOW_EVENTS) {
+            wrong++;
+            continue;
+        }
+        arrivals[received[i].number]++;
+    }
+    CHECK_EQUAL(0, wrong);
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < WINDOW_EVENTS; i++) {
+        missing += (arrivals[i] == 0);
+    }
+    CHECK_EQUAL(0, missing);
+
+    // An event that is sent for the first time has a higher ack id than every event before it. On a new connection the
+    // events still waiting for an ack are sent again first, in the order of their ack ids, until the first new event or
+    // an event that times out again on this connection
+    std::vector<bool> seen(WINDOW_EVENTS, false);
+    std::vector<uint32_t> seenOnConnection(WINDOW_EVENTS, 0);
+    uint32_t newOutOfOrder = 0;
+    uint32_t resentOutOfOrder = 0;
+    uint32_t resentOnConnect = 0;
+    long highest = -1;
+    uint32_t connection = 0;
+    bool atStart = false;
+    long lastResent = -1;
+    for (size_t i = 0; i < received.size() && wrong == 0; i++) {
+        const ReceivedEvent& event = received[i];
+        if (event.connection != connection) {
+            connection = event.connection;
+            atStart = true;
+            lastResent = -1;
+        }
+        if (seenOnConnection[event.ackId] == connection) {
+            atStart = false;
+        }
+        seenOnConnection[event.ackId] = connection;
+        if (!seen[event.ackId]) {
+            seen[event.ackId] = true;
+            newOutOfOrder += ((long) event.ackId <= highest);
+            highest = event.ackId;
+            atStart = false;
+        } else if (atStart) {
+            resentOutOfOrder += ((long) event.ackId <= lastResent);
+            lastResent = event.ackId;
+            resentOnConnect++;
+        }
+    }
+    CHECK_EQUAL(0, newOutOfOrder);
+    CHECK_EQUAL(0, resentOutOfOrder);
+    CHECK(resentOnConnect > 0);
+    printf("ack window: %u events over %u connections, %u received, %u sent again, %u acks withheld\n",
+           (unsigned) WINDOW_EVENTS, (unsigned) server.connections, (unsigned) received.size(),
+           (unsigned) client.getRetransmitCount(), (unsigned) server.withheld);
+    client.disconnect();
+    server.stop();
+}
+
+int main() {
+    testAckReply();
+    testIsAcked();
+    testWindow();
+    return testResult("test_ack_window");
+}
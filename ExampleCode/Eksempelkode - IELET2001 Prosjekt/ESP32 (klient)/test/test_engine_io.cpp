@@ -0,0 +1,300 @@
+/***********************************************************************************************************************
+ * TEST OF THE ENGINE.IO 3 AND 4 SESSION OF SOCKETIOCLIENT
+ * CHECKS THAT SOCKETIOPARSEOPEN READS THE PING INTERVAL AND TIMEOUT OF THE OPEN PACKET, AND LEAVES VALUES THAT ARE
+ * MISSING, 0 OR TOO LARGE UNCHANGED. THEN CONNECTS TO THE LOOPBACK SERVER WITH EACH VERSION, AND CHECKS THAT THE CLIENT
+ * PINGS THE SERVER WITH EIO3 AND ANSWERS THE PINGS OF THE SERVER WITH EIO4, AND THAT A SERVER THAT STOPS ANSWERING IS
+ * FOUND LOST AFTER THE PING TIMEOUT AND THE CLIENT CONNECTS AGAIN. LAST CHECKS THAT A PING WITH DATA OF ANY LENGTH IS
+ * ANSWERED WITH A PONG OF THE SAME DATA
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <limits.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "LoopbackServer.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const unsigned long TEST_PING_INTERVAL = 100;
+const unsigned long TEST_PING_TIMEOUT = 400;
+const unsigned long PING_RUN_TIME = 1000;      // Time in ms the client runs while the pings are counted
+
+/**
+ * Loopback server that counts the pings of the client apart from its own, and can send another open packet.
+ */
+class EngineIoServer : public LoopbackServer {
+public:
+    EngineIoServer(uint8_t engineIoVersion, const std::string& open = "")
+        : LoopbackServer(engineIoVersion, TEST_PING_INTERVAL, TEST_PING_TIMEOUT), clientPings(0), open(open) {}
+
+    ~EngineIoServer() {
+        stop();
+    }
+
+    /**
+     * @return the pongs with data the client has sent, in the order they arrived
+     */
+    std::vector<std::string> dataPongs() {
+        std::lock_guard<std::mutex> lock(pongMutex);
+        return pongsWithData;
+    }
+
+    std::atomic<uint32_t> clientPings;        // Engine.IO pings sent by the client
+
+protected:
+    void opened() {
+        if (open.empty()) {
+            LoopbackServer::opened();
+            return;
+        }
+        push(open.c_str());
+        if (engineIoVersion < 4) {
+            push("40");
+        }
+    }
+
+    void textReceived(const std::string& text) {
+        if (text == "2") {
+            clientPings.fetch_add(1, std::memory_order_relaxed);
+        } else if (text.size() > 1 && text[0] == '3') {
+            std::lock_guard<std::mutex> lock(pongMutex);
+            pongsWithData.push_back(text);
+        }
+        LoopbackServer::textReceived(text);
+    }
+
+private:
+    const std::string open;
+    std::mutex pongMutex;
+    std::vector<std::string> pongsWithData;
+};
+
+/**
+ * Function that parses a copy of the data of an open packet, starting from the default ping.
+ * @return the result of socketIoParseOpen
+ */
+bool parseOpen(const std::string& data, unsigned long& pingInterval, unsigned long& pingTimeout) {
+    std::string copy = data;
+    pingInterval = PING_INTERVAL;
+    pingTimeout = PING_TIMEOUT;
+    return socketIoParseOpen(&copy[0], copy.size(), &pingInterval, &pingTimeout);
+}
+
+void testParseOpen() {
+    unsigned long pingInterval;
+    unsigned long pingTimeout;
+
+    CHECK(parseOpen("{\"sid\":\"abc\",\"upgrades\":[],\"pingInterval\":25000,\"pingTimeout\":60000}", pingInterval,
+                    pingTimeout));
+    CHECK_EQUAL(25000UL, pingInterval);
+    CHECK_EQUAL(60000UL, pingTimeout);
+
+    CHECK(parseOpen(" { \"pingTimeout\" : 5000 , \"pingInterval\" : 1000 } ", pingInterval, pingTimeout));
+    CHECK_EQUAL(1000UL, pingInterval);
+    CHECK_EQUAL(5000UL, pingTimeout);
+
+    // Values that are missing, 0, negative or not numbers are left unchanged
+    CHECK(parseOpen("{\"sid\":\"abc\",\"pingInterval\":0}", pingInterval, pingTimeout));
+    CHECK_EQUAL((unsigned long) PING_INTERVAL, pingInterval);
+    CHECK_EQUAL((unsigned long) PING_TIMEOUT, pingTimeout);
+    CHECK(parseOpen("{\"pingInterval\":-5,\"pingTimeout\":\"5000\"}", pingInterval, pingTimeout));
+    CHECK_EQUAL((unsigned long) PING_INTERVAL, pingInterval);
+    CHECK_EQUAL((unsigned long) PING_TIMEOUT, pingTimeout);
+    // A byte above 0x7F is not a digit, whether char is signed or not
+    CHECK(parseOpen("{\"pingInterval\":\"\xB2\xB3\"}", pingInterval, pingTimeout));
+    CHECK_EQUAL((unsigned long) PING_INTERVAL, pingInterval);
+
+    // The largest unsigned long is read, a larger number would wrap around and is left unchanged
+    char number[32];
+    snprintf(number, sizeof(number), "%lu", ULONG_MAX);
+    CHECK(parseOpen(std::string("{\"pingTimeout\":") + number + "}", pingInterval, pingTimeout));
+    CHECK_EQUAL(ULONG_MAX, pingTimeout);
+    std::string tooLarge = number;
+    tooLarge[tooLarge.size() - 1]++;
+    CHECK(parseOpen("{\"pingTimeout\":" + tooLarge + "}", pingInterval, pingTimeout));
+    CHECK_EQUAL((unsigned long) PING_TIMEOUT, pingTimeout);
+    CHECK(parseOpen("{\"pingInterval\":" + std::string(40, '9') + ",\"pingTimeout\":7}", pingInterval, pingTimeout));
+    CHECK_EQUAL((unsigned long) PING_INTERVAL, pingInterval);
+    CHECK_EQUAL(7UL, pingTimeout);
+
+    CHECK(!parseOpen("", pingInterval, pingTimeout));
+    CHECK(!parseOpen("[]", pingInterval, pingTimeout));
+    CHECK(!parseOpen("{\"pingInterval\":1000", pingInterval, pingTimeout));
+    CHECK(!parseOpen("{\"pingInterval\" 1000}", pingInterval, pingTimeout));
+}
+
+/**
+ * Function that runs loop() of the client until the condition is true.
+ * @return true if it was within 5 s
+ */
+template <typename Condition>
+bool runUntil(SocketIoClient& client, Condition condition) {
+    unsigned long start = millis();
+    while (!condition()) {
+        if (millis() - start > 5000) {
+            return false;
+        }
+        client.loop();
+    }
+    return true;
+}
+
+/**
+ * Function that runs loop() of the client for a time.
+ * @param ms            time in ms
+ */
+void runFor(SocketIoClient& client, unsigned long ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        client.loop();
+    }
+}
+
+/**
+ * Function that connects with the given Engine.IO version, and checks that the client takes the ping of the open packet
+ * and that only the side the version gives pings.
+ */
+void testPingDirection(uint8_t version) {
+    EngineIoServer server(version);
+    SocketIoClient client;
+    CHECK(server.start());
+    client.setEngineIoVersion(version);
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        fprintf(stderr, "    EIO%u client did not connect\n", (unsigned) version);
+        client.disconnect();
+        server.stop();
+        return;
+    }
+    CHECK_EQUAL(version, client.getEngineIoVersion());
+    CHECK_EQUAL(TEST_PING_INTERVAL, client.getPingInterval());
+    CHECK_EQUAL(TEST_PING_TIMEOUT, client.getPingTimeout());
+    CHECK(server.request().find("EIO=" + std::to_string(version)) != std::string::npos);
+
+    runFor(client, PING_RUN_TIME);
+    uint32_t expected = PING_RUN_TIME / TEST_PING_INTERVAL;
+    if (version < 4) {
+        // The client pings and the server answers
+        CHECK(server.clientPings >= expected - 2 && server.clientPings <= expected + 1);
+        CHECK_EQUAL(server.clientPings.load(), server.pings.load());
+        CHECK_EQUAL(0, server.pongs.load());
+    } else {
+        // The server pings and the client answers every ping
+        CHECK_EQUAL(0, server.clientPings.load());
+        CHECK(server.pings >= expected - 2);
+        CHECK(server.pongs + 1 >= server.pings);
+    }
+    // The pings keep the connection
+    CHECK_EQUAL(1, client.getConnectCount());
+    CHECK_EQUAL(1, server.connections.load());
+    printf("EIO%u: %u pings from the client, %u from the server, %u pongs in %lu ms\n", (unsigned) version,
+           (unsigned) server.clientPings, (unsigned) (server.pings - server.clientPings), (unsigned) server.pongs,
+           PING_RUN_TIME);
+    client.disconnect();
+    server.stop();
+}
+
+/**
+ * Function that makes the server stop answering, and checks that the client finds it lost after the ping timeout and
+ * connects again. EIO3 waits the ping timeout after its unanswered ping, EIO4 the ping interval and the timeout after
+ * the last ping of the server.
+ */
+void testTimeoutReconnect(uint8_t version) {
+    EngineIoServer server(version);
+    SocketIoClient client;
+    CHECK(server.start());
+    client.setEngineIoVersion(version);
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        client.disconnect();
+        server.stop();
+        return;
+    }
+
+    for (uint32_t reconnect = 2; reconnect <= 3; reconnect++) {
+        server.setSilent(true);
+        unsigned long start = millis();
+        if (!CHECK(runUntil(client, [&]() { return server.connections == reconnect; }))) {
+            break;
+        }
+        unsigned long lost = millis() - start;
+        server.setSilent(false);
+        if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == reconnect; }))) {
+            break;
+        }
+        // Not before the timeout, and not later than a ping interval and the reconnect interval of 500 ms after it
+        unsigned long latest = TEST_PING_TIMEOUT + 2 * TEST_PING_INTERVAL + 500 + 250;
+        if (!CHECK(lost >= TEST_PING_TIMEOUT) || !CHECK(lost <= latest)) {
+            fprintf(stderr, "    EIO%u server found lost after %lu ms\n", (unsigned) version, lost);
+        }
+    }
+    client.disconnect();
+    server.stop();
+}
+
+/**
+ * Function that connects to a server that sends a ping interval that does not fit, and checks that the client keeps the
+ * default interval and the timeout of the packet.
+ */
+void testOverflowingOpen() {
+    EngineIoServer server(3, "0{\"sid\":\"loopback\",\"upgrades\":[],\"pingInterval\":" + std::string(25, '9') +
+                                 ",\"pingTimeout\":" + std::to_string(TEST_PING_TIMEOUT) + "}");
+    SocketIoClient client;
+    CHECK(server.start());
+    client.setEngineIoVersion(3);
+    client.begin("127.0.0.1", server.port);
+    if (CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        CHECK_EQUAL((unsigned long) PING_INTERVAL, client.getPingInterval());
+        CHECK_EQUAL(TEST_PING_TIMEOUT, client.getPingTimeout());
+    }
+    client.disconnect();
+    server.stop();
+}
+
+/**
+ * Function that pings the client with data as a server probing the transport does, and checks that every pong holds the
+ * whole data, also when it is longer than a short probe.
+ */
+void testPingData() {
+    EngineIoServer server(4);
+    SocketIoClient client;
+    CHECK(server.start());
+    client.setEngineIoVersion(4);
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntil(client, [&]() { return client.getConnectCount() == 1; }))) {
+        client.disconnect();
+        server.stop();
+        return;
+    }
+    std::vector<std::string> pings;
+    pings.push_back("2probe");
+    pings.push_back("2" + std::string(15, 'a'));
+    pings.push_back("2" + std::string(1000, 'b') + "end");
+    for (size_t i = 0; i < pings.size(); i++) {
+        server.push(pings[i].c_str());
+    }
+    if (CHECK(runUntil(client, [&]() { return server.dataPongs().size() == pings.size(); }))) {
+        std::vector<std::string> pongs = server.dataPongs();
+        for (size_t i = 0; i < pings.size(); i++) {
+            if (!CHECK(pongs[i] == "3" + pings[i].substr(1))) {
+                fprintf(stderr, "    ping of %u bytes answered with %u bytes\n", (unsigned) pings[i].size(),
+                        (unsigned) pongs[i].size());
+            }
+        }
+    }
+    CHECK_EQUAL(1, client.getConnectCount());
+    client.disconnect();
+    server.stop();
+}
+
+int main() {
+    testParseOpen();
+    testPingDirection(3);
+    testPingDirection(4);
+    testTimeoutReconnect(3);
+    testTimeoutReconnect(4);
+    testOverflowingOpen();
+    testPingData();
+    return testResult("test_engine_io");
+}
@@ -0,0 +1,160 @@
+/***********************************************************************************************************************
+ * TEST OF THE EVENT TABLE OF SOCKETIOCLIENT
+ * CHECKS REGISTERING, COLLIDING, REMOVING AND A FULL TABLE, THEN MEASURES THE DISPATCH OF A RECEIVED EVENT NAME TO ITS
+ * HANDLER AGAINST THE STD::MAP OF STRING TO STD::FUNCTION THE LIBRARY USED BEFORE
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include "AllocationCounter.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const uint32_t BENCHMARK_DISPATCHES = 5000000;
+
+/**
+ * Reaches the event table of a client, which is private.
+ */
+class SocketIoClientTest {
+public:
+    explicit SocketIoClientTest(SocketIoClient& client) : client(client) {}
+
+    void trigger(uint32_t id, const char * payload, size_t length) { client.trigger(id, payload, length); }
+    size_t events() const { return client._eventCount; }
+
+private:
+    SocketIoClient& client;
+};
+
+// Handler calls, and the last context a handler got
+static uint32_t calls = 0;
+static void * lastContext = NULL;
+
+void countCall(const char * payload, size_t length) {
+    (void) payload;
+    (void) length;
+    calls++;
+}
+
+void countContextCall(void * context, const char * payload, size_t length) {
+    (void) payload;
+    (void) length;
+    calls++;
+    lastContext = context;
+}
+
+void testTable() {
+    SocketIoClient client;
+    SocketIoClientTest table(client);
+
+    CHECK(client.on("setpoints", countCall));
+    CHECK(client.on("authentication", countCall));
+    CHECK_EQUAL(2, table.events());
+    calls = 0;
+    table.trigger(socketIoEventId("setpoints"), "{}", 2);
+    table.trigger(socketIoEventId("unknown"), "{}", 2);
+    CHECK_EQUAL(1, calls);
+
+    // Registering again replaces the handler and keeps one slot
+    int context = 0;
+    CHECK(client.on(socketIoEventId("setpoints"), countContextCall, &context));
+    CHECK_EQUAL(2, table.events());
+    table.trigger(socketIoEventId("setpoints"), "{}", 2);
+    CHECK(lastContext == &context);
+
+    // Ids that hash to the same slot probe past each other, also past a removed one
+    const uint32_t first = 3;
+    const uint32_t second = first + SOCKETIOCLIENT_MAX_EVENTS;
+    const uint32_t third = first + 2 * SOCKETIOCLIENT_MAX_EVENTS;
+    CHECK(client.on(first, countCall));
+    CHECK(client.on(second, countCall));
+    CHECK(client.on(third, countCall));
+    client.remove(second);
+    calls = 0;
+    table.trigger(first, NULL, 0);
+    table.trigger(second, NULL, 0);
+    table.trigger(third, NULL, 0);
+    CHECK_EQUAL(2, calls);
+    CHECK(client.on(second, countCall));
+    CHECK_EQUAL(5, table.events());
+
+    // Removing an event that is not there changes nothing
+    client.remove("unknown");
+    CHECK_EQUAL(5, table.events());
+
+    // The table takes SOCKETIOCLIENT_MAX_EVENTS handlers and refuses the next one
+    uint32_t id = 100;
+    while (table.events() < SOCKETIOCLIENT_MAX_EVENTS) {
+        CHECK(client.on(id++, countCall));
+    }
+    CHECK(!client.on(id, countCall));
+    calls = 0;
+    table.trigger(id - 1, NULL, 0);
+    table.trigger(id, NULL, 0);
+    CHECK_EQUAL(1, calls);
+}
+
+/**
+ * Function that measures a dispatch from the received event name: hashing the name and calling the handler through
+ * the table, against building a key and looking it up in a std::map as before. Both are given the same names, the
+ * events of the robot and one that has no handler.
+ */
+void benchmarkDispatch() {
+    static const char * names[] = {"setpoints", "authentication", "connect", "disconnect", "noHandler"};
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    size_t lengths[count];
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = strlen(names[i]);
+    }
+
+    SocketIoClient client;
+    SocketIoClientTest table(client);
+    std::map<std::string, std::function<void(const char *, size_t)>> map;
+    for (size_t i = 0; i + 1 < count; i++) {
+        client.on(names[i], countCall);
+        map[names[i]] = countCall;
+    }
+
+    calls = 0;
+    allocations = 0;
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_DISPATCHES; i++) {
+        size_t n = i % count;
+        table.trigger(socketIoEventId(names[n], lengths[n]), "{}", 2);
+    }
+    double tableSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint32_t tableAllocations = allocations.load();
+    uint32_t tableCalls = calls;
+
+    calls = 0;
+    allocations = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_DISPATCHES; i++) {
+        size_t n = i % count;
+        auto handler = map.find(std::string(names[n], lengths[n]));
+        if (handler != map.end()) {
+            handler->second("{}", 2);
+        }
+    }
+    double mapSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+    uint32_t mapAllocations = allocations.load();
+
+    CHECK_EQUAL(calls, tableCalls);
+    printf("dispatch: table %.1f ns, %.2f allocations; std::map %.1f ns, %.2f allocations\n",
+           tableSeconds * 1e9 / BENCHMARK_DISPATCHES, (double) tableAllocations / BENCHMARK_DISPATCHES,
+           mapSeconds * 1e9 / BENCHMARK_DISPATCHES, (double) mapAllocations / BENCHMARK_DISPATCHES);
+#ifdef ALLOCATION_COUNTING
+    CHECK_EQUAL(0, tableAllocations);
+#endif
+}
+
+int main() {
+    testTable();
+    benchmarkDispatch();
+    return testResult("test_event_dispatch");
+}
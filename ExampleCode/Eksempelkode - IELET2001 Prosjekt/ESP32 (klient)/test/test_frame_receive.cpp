@@ -0,0 +1,142 @@
+/***********************************************************************************************************************
+ * TEST OF THE WEBSOCKET FRAME RECEIVE
+ * THE LOOPBACK SERVER SENDS FRAMES OF EVERY HEADER SIZE, PINGS AND A FRAGMENTED MESSAGE ONE BYTE AT A TIME, IN RANDOM
+ * CHUNKS AND WITH A FRAME THAT STOPS HALF WAY FOR A WHILE. THE CLIENT HAS TO GET EVERY MESSAGE WHOLE, AND LOOP() MUST
+ * NEVER WAIT FOR THE REST OF A FRAME. THE WORST LOOP() TIME IS REPORTED FOR EACH WAY OF FEEDING
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <random>
+#include <thread>
+#include <vector>
+#include "TestCheck.h"
+#include "WebSocketsClientTest.h"
+
+/// Test Settings ///
+// Longest loop() allowed while a frame is on its way, the blocking receive waited up to WEBSOCKETS_TCP_TIMEOUT
+const unsigned long MAX_LOOP_TIME = 50000;
+
+// Time in us the server stops half way through a frame, shorter than WEBSOCKETS_TCP_TIMEOUT
+const unsigned long STALL_TIME = 300000;
+
+/**
+ * The frames the server sends, and the texts the client has to get from them.
+ */
+struct Stream {
+    std::vector<uint8_t> bytes;
+    uint32_t texts;
+    uint32_t textHash;
+    size_t stallAt;           // Byte where the server stops for STALL_TIME, half way through the largest frame
+};
+
+void addText(Stream& stream, const std::string& text) {
+    std::vector<uint8_t> frame = LoopbackServer::frame(0x1, (const uint8_t *) text.data(), text.size());
+    stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+    stream.texts++;
+    stream.textHash = WebSocketsClientTest::hashText(stream.textHash, (const uint8_t *) text.data(), text.size());
+}
+
+Stream buildStream() {
+    Stream stream;
+    stream.texts = 0;
+    stream.textHash = 2166136261u;
+    static const size_t sizes[] = {0, 1, 5, 125, 126, 300, 5000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::string text;
+        for (size_t n = 0; n < sizes[i]; n++) {
+            text += (char) ('a' + (n + i) % 26);
+        }
+        if (sizes[i] == 5000) {
+            stream.stallAt = stream.bytes.size() + 2500;
+        }
+        addText(stream, text);
+
+        // A ping between the messages, the client answers it with a pong
+        const uint8_t ping[] = "ping";
+        std::vector<uint8_t> frame = LoopbackServer::frame(0x9, ping, sizeof(ping) - 1);
+        stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+    }
+    // A text in two fragments, given to the application as fragments and not counted as a text
+    const uint8_t first[] = "frag";
+    const uint8_t last[] = "ment";
+    std::vector<uint8_t> frame = LoopbackServer::frame(0x1, first, 4, false);
+    stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+    frame = LoopbackServer::frame(0x0, last, 4);
+    stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+    addText(stream, "42[\"after fragments\"]");
+    return stream;
+}
+
+/**
+ * Function that lets the server send the stream in chunks from its own thread, while the client runs loop() and
+ * measures it.
+ * @param name          name of the way of feeding, printed with the result
+ * @param minChunk      smallest chunk in bytes
+ * @param maxChunk      largest chunk in bytes
+ * @param gap           most time in us between chunks
+ */
+void feed(WebSocketsClientTest& client, LoopbackServer& server, const char * name, size_t minChunk, size_t maxChunk,
+          unsigned long gap) {
+    Stream stream = buildStream();
+    client.texts = 0;
+    client.textHash = 2166136261u;
+
+    std::thread feeder([&]() {
+        std::mt19937 random(99);
+        size_t position = 0;
+        bool stalled = false;
+        while (position < stream.bytes.size()) {
+            size_t chunk = minChunk + random() % (maxChunk - minChunk + 1);
+            chunk = min(chunk, stream.bytes.size() - position);
+            if (!stalled && position + chunk > stream.stallAt) {
+                chunk = stream.stallAt - position;
+                stalled = true;
+                server.sendRaw(&stream.bytes[position], chunk);
+                position += chunk;
+                delayMicroseconds(STALL_TIME);
+                continue;
+            }
+            server.sendRaw(&stream.bytes[position], chunk);
+            position += chunk;
+            if (gap > 0) {
+                delayMicroseconds(random() % (gap + 1));
+            }
+        }
+    });
+
+    unsigned long worst = 0;
+    unsigned long start = millis();
+    while (client.texts < stream.texts && millis() - start < 20000) {
+        unsigned long before = micros();
+        client.loop();
+        worst = max(worst, micros() - before);
+    }
+    feeder.join();
+
+    CHECK(client.connected);
+    CHECK_EQUAL(stream.texts, client.texts);
+    CHECK_EQUAL(stream.textHash, client.textHash);
+    CHECK(worst < MAX_LOOP_TIME);
+    printf("%-14s %6u bytes, worst loop() %lu us\n", name, (unsigned) stream.bytes.size(), worst);
+}
+
+int main() {
+    LoopbackServer server;
+    WebSocketsClientTest client;
+    if (!CHECK(server.start()) || !CHECK(client.connectTo(server)) ||
+        !CHECK(client.runUntil([&]() { return client.texts >= 2; }))) {
+        return testResult("test_frame_receive");
+    }
+    uint32_t frames = server.frames.load();
+    feed(client, server, "byte by byte", 1, 1, 20);
+    feed(client, server, "random chunks", 1, 700, 500);
+    feed(client, server, "whole", 1 << 16, 1 << 16, 0);
+
+    // The client answered the 7 pings of each stream with a pong, and never reconnected
+    uint32_t pongs = frames + 3 * 7;
+    CHECK(client.runUntil([&]() { return server.frames.load() >= pongs; }));
+    CHECK_EQUAL(pongs, server.frames.load());
+    CHECK_EQUAL(1, client.connects);
+    client.disconnect();
+    server.stop();
+    return testResult("test_frame_receive");
+}
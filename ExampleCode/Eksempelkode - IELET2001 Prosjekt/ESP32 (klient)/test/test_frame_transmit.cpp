@@ -0,0 +1,90 @@
+/***********************************************************************************************************************
+ * TEST OF THE WEBSOCKET FRAME TRANSMIT
+ * SENDS TEXT FRAMES OF EVERY HEADER SIZE THROUGH WEBSOCKETSCLIENT TO THE LOOPBACK SERVER AND CHECKS THAT THEY ARRIVE
+ * WHOLE, THEN MEASURES FRAMES PER SECOND, ALLOCATIONS PER FRAME AND THE HIGH-WATER MARK OF THE HEAP FOR EACH SIZE.
+ * FRAMES THAT FIT THE STAGING BUFFER OF THE CLIENT MUST NOT ALLOCATE
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <chrono>
+#include <string>
+#include "AllocationCounter.h"
+#include "TestCheck.h"
+#include "WebSocketsClientTest.h"
+
+/// Test Settings ///
+// Payload sizes: 7 bit length, the last 7 bit one, 16 bit lengths, the staging buffer edge and a frame larger than it
+const size_t FRAME_SIZES[] = {16, 125, 126, 1024, WEBSOCKETS_TX_BUFFER_SIZE - 1, WEBSOCKETS_TX_BUFFER_SIZE, 4000};
+const size_t FRAME_SIZE_COUNT = sizeof(FRAME_SIZES) / sizeof(FRAME_SIZES[0]);
+const uint32_t BENCHMARK_FRAMES = 20000;
+
+/**
+ * @return an event "bench" of the size, which the server counts
+ */
+std::string benchFrame(size_t size, char fill) {
+    std::string text = "42[\"bench\",\"";
+    text.append(size - text.size() - 2, fill);
+    text += "\"]";
+    return text;
+}
+
+void testFramesArrive(WebSocketsClientTest& client, LoopbackServer& server) {
+    server.setRecordMessages(true);
+    std::vector<std::string> sent;
+    for (size_t i = 0; i < FRAME_SIZE_COUNT; i++) {
+        sent.push_back(benchFrame(FRAME_SIZES[i], 'a' + i));
+        CHECK(client.sendTXT(sent.back().c_str(), sent.back().size()));
+    }
+    uint32_t target = FRAME_SIZE_COUNT;
+    CHECK(client.runUntil([&]() { return server.events.load() >= target; }));
+    std::vector<std::string> received = server.messages();
+    server.setRecordMessages(false);
+    if (CHECK_EQUAL(sent.size(), received.size())) {
+        for (size_t i = 0; i < sent.size(); i++) {
+            CHECK(sent[i] == received[i]);
+        }
+    }
+}
+
+/**
+ * Function that sends frames of one size back to back, as the Socket.IO client does when its ring is full. The heap
+ * peak is of the whole program, so it includes the copy of each frame the server thread makes.
+ */
+void benchmarkSize(WebSocketsClientTest& client, LoopbackServer& server, size_t size) {
+    std::string text = benchFrame(size, 'x');
+    uint32_t target = server.events.load() + BENCHMARK_FRAMES;
+    size_t baseline = resetHeapPeak();
+    allocations = 0;
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_FRAMES; i++) {
+        client.sendTXT(text.c_str(), text.size());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+    uint32_t frameAllocations = allocations.load();
+    CHECK(client.runUntil([&]() { return server.events.load() >= target; }, 20000));
+
+    printf("send %5u bytes: %9.0f frames/s, %.2f allocations per frame, heap peak +%u bytes\n", (unsigned) size,
+           BENCHMARK_FRAMES / seconds, (double) frameAllocations / BENCHMARK_FRAMES,
+           (unsigned) (heapPeak.load() - baseline));
+#ifdef ALLOCATION_COUNTING
+    if (size < WEBSOCKETS_TX_BUFFER_SIZE) {
+        CHECK_EQUAL(0, frameAllocations);
+    }
+#endif
+}
+
+int main() {
+    LoopbackServer server;
+    WebSocketsClientTest client;
+    if (!CHECK(server.start()) || !CHECK(client.connectTo(server))) {
+        return testResult("test_frame_transmit");
+    }
+    testFramesArrive(client, server);
+    for (size_t i = 0; i < FRAME_SIZE_COUNT; i++) {
+        benchmarkSize(client, server, FRAME_SIZES[i]);
+    }
+    client.disconnect();
+    server.stop();
+    return testResult("test_frame_transmit");
+}
@@ -0,0 +1,419 @@
+/***********************************************************************************************************************
+ * TEST OF THE HTTP UPGRADE HANDSHAKE OF WEBSOCKETSCLIENT
+ * CHECKS THE HEADER LINE PARSER ON MIXED CASE NAMES AND VALUES, WHITE SPACE, NAMES THAT ONLY START LIKE A KNOWN ONE AND
+ * LINES WITHOUT A COLON, THEN CONNECTS TO THE LOOPBACK SERVER WITH LINES LONGER THAN WEBSOCKETS_HTTP_LINE_SIZE AND
+ * WITH THE RESPONSE SPLIT INTO SMALL READS. CHECKS THAT EVERY KIND OF REQUEST IS SENT WITH ONE WRITE, AND THE CONNECT
+ * TIME AND COUNT OF SOCKETIOCLIENT OVER DROPPED CONNECTIONS. THE SEC-WEBSOCKET-ACCEPT KEY IS CHECKED AGAINST THE
+ * EXAMPLE OF RFC 6455 1.3 AND THE STRING BASED BASE64 AND COMPARE. LAST IT MEASURES THE ACCEPT CHECK AND THE TIME FROM
+ * A DROPPED CONNECTION TO CONNECTED AGAIN
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <SocketIoClient.h>
+#include "AllocationCounter.h"
+#include "TestCheck.h"
+#include "WebSocketsClientTest.h"
+
+/// Test Settings ///
+const uint32_t RECONNECTS = 200;
+const uint32_t CONNECT_TIME_DROPS = 5;
+const uint32_t ACCEPT_KEY_ROUNDS = 200000;
+
+// Longest time in ms from the drop of the server to the moment the client finds the connection lost
+const unsigned long DROP_DETECTION_TIME = 250;
+
+/**
+ * Reaches the accept key and base64 functions of WebSockets, which are protected.
+ */
+class WebSocketsTest : public WebSockets {
+public:
+    using WebSockets::acceptKey;
+    using WebSockets::acceptKeyEquals;
+    using WebSockets::base64_encode;
+
+protected:
+    void clientDisconnect(WSclient_t * client) { (void) client; }
+    bool clientIsConnected(WSclient_t * client) { (void) client; return false; }
+    void messageReceived(WSclient_t * client, WSopcode_t opcode, uint8_t * payload, size_t length, bool fin) {
+        (void) client;
+        (void) opcode;
+        (void) payload;
+        (void) length;
+        (void) fin;
+    }
+};
+
+/**
+ * Function that clears what the header parser sets.
+ */
+void resetHeader(WSclient_t& state) {
+    state.cCode = 0;
+    state.cIsUpgrade = false;
+    state.cIsWebsocket = false;
+    state.cAccept = "";
+    state.cProtocol = "";
+    state.cExtensions = "";
+    state.cVersion = 0;
+    state.cSessionId = "";
+}
+
+/**
+ * Function that gives one line to the header parser, from a writable copy as the parser changes it.
+ * @return the result of handleHeaderLine
+ */
+bool line(WebSocketsClientTest& client, const std::string& text) {
+    std::vector<char> copy(text.begin(), text.end());
+    copy.push_back('\0');
+    return client.headerLine(copy.data(), text.size());
+}
+
+void testHeaderLines() {
+    WebSocketsClientTest client;
+    WSclient_t& state = client.state();
+    resetHeader(state);
+
+    CHECK(line(client, "HTTP/1.1 101 Switching Protocols\r"));
+    CHECK_EQUAL(101, state.cCode);
+
+    // Names and the values that are tokens are matched without case
+    CHECK(line(client, "cONNECTION: UPGRADE\r"));
+    CHECK(line(client, "upgrade: WebSocket\r"));
+    CHECK(state.cIsUpgrade);
+    CHECK(state.cIsWebsocket);
+
+    // White space around the value is removed, a tab as well
+    CHECK(line(client, "sec-websocket-accept: \t s3pPLMBiTxaQ9kYGzzhZRbK+xOo=  \r"));
+    CHECK(state.cAccept == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    CHECK(line(client, "SEC-WEBSOCKET-VERSION:13\r"));
+    CHECK_EQUAL(13, state.cVersion);
+
+    // The session id is the cookie value up to the first attribute
+    CHECK(line(client, "Set-Cookie: io=Zx8_aBc-123; Path=/; HttpOnly\r"));
+    CHECK(state.cSessionId == "Zx8_aBc-123");
+
+    // Names that only start like a known one, and values that only contain the token, are not taken
+    resetHeader(state);
+    CHECK(line(client, "Upgrade-Insecure-Requests: websocket\r"));
+    CHECK(line(client, "Connectionx: upgrade\r"));
+    CHECK(line(client, "Connection: upgrades\r"));
+    CHECK(line(client, "X-Upgrade: websocket\r"));
+    CHECK(!state.cIsUpgrade);
+    CHECK(!state.cIsWebsocket);
+
+    // Lines without a name are skipped
+    CHECK(line(client, "no colon here\r"));
+    CHECK(line(client, ": no name\r"));
+    CHECK_EQUAL(0, state.cCode);
+
+    // Characters above 127 are not white space
+    CHECK(line(client, "Sec-WebSocket-Protocol: \xC3\xA6\xC3\xB8\r"));
+    CHECK(state.cProtocol == "\xC3\xA6\xC3\xB8");
+}
+
+/**
+ * Function that connects through the byte by byte reading of the header, with the server adding headers.
+ * @param headers       extra header lines of the response
+ * @param chunk         bytes per read of the response, 0 for all at once
+ */
+void testConnect(const char * name, const std::string& headers, size_t chunk) {
+    LoopbackServer server;
+    WebSocketsClientTest client;
+    server.setExtraHeaders(headers);
+    server.setHandshakeChunk(chunk);
+    CHECK(server.start());
+    if (!CHECK(client.connectTo(server))) {
+        fprintf(stderr, "    %s\n", name);
+    }
+    client.disconnect();
+    server.stop();
+}
+
+void testLongLines() {
+    std::string padding(600, 'p');
+    // A long line before the known ones must not cut into them
+    testConnect("long unknown line", "X-Padding: " + padding + "\r\n", 0);
+    // A known header longer than the line buffer is cut, the handshake still works
+    testConnect("long cookie", "Set-Cookie: io=" + padding + "; Path=/\r\n", 0);
+    // A line with its \r that fills the buffer, and one byte less
+    testConnect("line at the buffer size", "X-A: " + std::string(WEBSOCKETS_HTTP_LINE_SIZE - 7, 'a') + "\r\n", 0);
+    testConnect("line under the buffer size", "X-A: " + std::string(WEBSOCKETS_HTTP_LINE_SIZE - 8, 'a') + "\r\n", 0);
+    // Lines split over reads, at every byte and across the \r\n
+    testConnect("split lines", "Server: loopback\r\nSet-Cookie: io=abc; Path=/\r\n", 1);
+    testConnect("split lines 3", "Server: loopback\r\n", 3);
+}
+
+/**
+ * Function that checks that the request of a connection was sent with one write, so it goes out in one TCP segment.
+ * @param client        the client, connected or refused by the server
+ * @param server        the server, has the request
+ * @param part          text the request has to contain
+ */
+void checkRequest(WebSocketsClientTest& client, LoopbackServer& server, const char * part) {
+    std::string request = server.request();
+    if (!CHECK(request.find(part) != std::string::npos)) {
+        fprintf(stderr, "    no %s in\n%s", part, request.c_str());
+    }
+    CHECK(request.find("\r\n\r\n") == request.size() - 4);
+    CHECK_EQUAL(1, client.state().tcp->writeCount());
+}
+
+void testRequestWrites() {
+    // The plain WebSocket request
+    {
+        LoopbackServer server;
+        WebSocketsClientTest client;
+        CHECK(server.start());
+        if (CHECK(client.connectTo(server))) {
+            checkRequest(client, server, "Sec-WebSocket-Key: ");
+        }
+        client.disconnect();
+        server.stop();
+    }
+    // The upgrade of a socket.io session, with the session id patched into the url
+    {
+        LoopbackServer server;
+        WebSocketsClientTest client;
+        CHECK(server.start());
+        client.beginSocketIO("127.0.0.1", server.port);
+        client.state().cSessionId = "loopback";
+        if (CHECK(client.runUntil([&]() { return client.connected; }))) {
+            checkRequest(client, server, "/socket.io/?EIO=3&transport=websocket&sid=loopback HTTP/1.1\r\n");
+        }
+        client.disconnect();
+        server.stop();
+    }
+    // The polling request that starts a socket.io session, the server refuses it as it has no upgrade headers
+    {
+        LoopbackServer server;
+        WebSocketsClientTest client;
+        CHECK(server.start());
+        client.beginSocketIO("127.0.0.1", server.port);
+        if (CHECK(client.runUntil([&]() { return !server.request().empty(); }))) {
+            checkRequest(client, server, "/socket.io/?EIO=3&transport=polling HTTP/1.1\r\n");
+            checkRequest(client, server, "Connection: keep-alive\r\n");
+            CHECK(server.request().find("Sec-WebSocket-Key") == std::string::npos);
+        }
+        client.disconnect();
+        server.stop();
+    }
+}
+
+/**
+ * Function that runs loop() of a Socket.IO client until it has connected a number of times.
+ * @return true if it did within 5 s
+ */
+bool runUntilConnects(SocketIoClient& client, uint32_t connects) {
+    unsigned long start = millis();
+    while (client.getConnectCount() < connects) {
+        if (millis() - start > 5000) {
+            return false;
+        }
+        client.loop();
+    }
+    return true;
+}
+
+/**
+ * Function that checks the connect time and count of SocketIoClient. The connect time of a reconnect is measured from
+ * when the client finds the connection lost, so it is at most the time from the drop of the server.
+ */
+void testConnectTime() {
+    LoopbackServer server;
+    SocketIoClient client;
+    CHECK(server.start());
+    CHECK_EQUAL(0, client.getConnectCount());
+    unsigned long start = millis();
+    client.begin("127.0.0.1", server.port);
+    if (!CHECK(runUntilConnects(client, 1))) {
+        server.stop();
+        return;
+    }
+    CHECK_EQUAL(1, client.getConnectCount());
+    CHECK(client.getConnectTime() <= millis() - start);
+
+    for (uint32_t i = 1; i <= CONNECT_TIME_DROPS; i++) {
+        start = millis();
+        server.drop();
+        if (!CHECK(runUntilConnects(client, i + 1))) {
+            break;
+        }
+        unsigned long elapsed = millis() - start;
+        CHECK_EQUAL(i + 1, client.getConnectCount());
+        CHECK(client.getConnectTime() <= elapsed);
+        CHECK(elapsed - client.getConnectTime() <= DROP_DETECTION_TIME);
+        CHECK_EQUAL(i + 1, server.connections.load());
+    }
+    client.disconnect();
+    server.stop();
+}
+
+/**
+ * The accept key as the library made it before, hashed in parts and base64 encoded into a String.
+ */
+String referenceAcceptKey(WebSocketsTest& webSockets, const String& clientKey) {
+    static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t hash[20];
+    SHA1_CTX context;
+    SHA1Init(&context);
+    SHA1Update(&context, (const unsigned char *) clientKey.c_str(), clientKey.length());
+    SHA1Update(&context, (const unsigned char *) GUID, sizeof(GUID) - 1);
+    SHA1Final(hash, &context);
+    return webSockets.base64_encode(hash, sizeof(hash));
+}
+
+/**
+ * @return the accept key of a client key
+ */
+std::string acceptKey(WebSocketsTest& webSockets, const char * clientKey) {
+    char key[WEBSOCKETS_ACCEPT_KEY_LENGTH];
+    webSockets.acceptKey(String(clientKey), key);
+    return std::string(key, sizeof(key));
+}
+
+void testAcceptKey() {
+    WebSocketsTest webSockets;
+    // The example of RFC 6455 1.3
+    const char * ACCEPT = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+    std::string key = acceptKey(webSockets, "dGhlIHNhbXBsZSBub25jZQ==");
+    CHECK(key == ACCEPT);
+    CHECK(WebSocketsTest::acceptKeyEquals(key.c_str(), String(ACCEPT)));
+
+    // A value that differs in any character, or has another length, is refused
+    for (size_t i = 0; i < WEBSOCKETS_ACCEPT_KEY_LENGTH; i++) {
+        std::string wrong = ACCEPT;
+        wrong[i] ^= 0x01;
+        CHECK(!WebSocketsTest::acceptKeyEquals(key.c_str(), String(wrong)));
+    }
+    CHECK(!WebSocketsTest::acceptKeyEquals(key.c_str(), String("s3pPLMBiTxaQ9kYGzzhZRbK+xOo")));
+    CHECK(!WebSocketsTest::acceptKeyEquals(key.c_str(), String("s3pPLMBiTxaQ9kYGzzhZRbK+xOo==")));
+    CHECK(!WebSocketsTest::acceptKeyEquals(key.c_str(), String("")));
+
+    // Random client keys as sendHeader makes them
+    std::mt19937 random(10);
+    for (int i = 0; i < 100; i++) {
+        uint8_t nonce[16];
+        for (size_t j = 0; j < sizeof(nonce); j++) {
+            nonce[j] = (uint8_t) random();
+        }
+        String clientKey = webSockets.base64_encode(nonce, sizeof(nonce));
+        CHECK(acceptKey(webSockets, clientKey.c_str()) == referenceAcceptKey(webSockets, clientKey).c_str());
+    }
+
+    // base64 into a buffer gives the same as the String version, and refuses a buffer that is too small. Up to one
+    // line of libb64, longer input gets a line break
+    for (size_t length = 0; length < 54; length++) {
+        std::vector<uint8_t> data(length + 1);
+        for (size_t i = 0; i < length; i++) {
+            data[i] = (uint8_t) random();
+        }
+        size_t size = ((length + 2) / 3) * 4 + 1;
+        std::vector<char> out(size + 1, 'x');
+        size_t encoded = webSockets.base64_encode(data.data(), length, out.data(), size);
+        String expected = webSockets.base64_encode(data.data(), length);
+        if (!CHECK_EQUAL(expected.length(), encoded) || !CHECK(strcmp(out.data(), expected.c_str()) == 0)) {
+            fprintf(stderr, "    length %u\n", (unsigned) length);
+        }
+        CHECK_EQUAL('x', out[size]);
+        if (length > 0) {
+            CHECK_EQUAL(0, webSockets.base64_encode(data.data(), length, out.data(), size - 1));
+        }
+    }
+}
+
+/**
+ * Function that measures the accept check of a handshake: the accept key of the client key and the compare with the
+ * header value. The version of the library before, base64 into a String and ==, is measured next to it.
+ */
+void benchmarkAcceptKey() {
+    WebSocketsTest webSockets;
+    String clientKey("dGhlIHNhbXBsZSBub25jZQ==");
+    String accept("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    uint32_t matches = 0;
+
+    allocations = 0;
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ACCEPT_KEY_ROUNDS; i++) {
+        char key[WEBSOCKETS_ACCEPT_KEY_LENGTH];
+        webSockets.acceptKey(clientKey, key);
+        matches += WebSocketsTest::acceptKeyEquals(key, accept);
+    }
+    double fixedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+    uint32_t fixedAllocations = allocations.load();
+
+    allocations = 0;
+    countAllocations = true;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ACCEPT_KEY_ROUNDS; i++) {
+        matches += referenceAcceptKey(webSockets, clientKey) == accept;
+    }
+    double stringSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+    uint32_t stringAllocations = allocations.load();
+
+    CHECK_EQUAL(2 * ACCEPT_KEY_ROUNDS, matches);
+#ifdef ALLOCATION_COUNTING
+    CHECK_EQUAL(0, fixedAllocations);
+#endif
+    printf("accept key: %.0f ns %.1f allocations fixed buffer, %.0f ns %.1f allocations with String\n",
+           fixedSeconds * 1e9 / ACCEPT_KEY_ROUNDS, (double) fixedAllocations / ACCEPT_KEY_ROUNDS,
+           stringSeconds * 1e9 / ACCEPT_KEY_ROUNDS, (double) stringAllocations / ACCEPT_KEY_ROUNDS);
+}
+
+/**
+ * Function that drops the connection from the server side and measures the time until the client is connected again,
+ * with the reconnect interval at 0 so only the reconnect itself is measured. The handshake is read from the socket of
+ * a local server, so the time is that of the client and not of a network.
+ */
+void benchmarkReconnect() {
+    LoopbackServer server;
+    WebSocketsClientTest client;
+    client.setReconnectInterval(0);
+    if (!CHECK(server.start()) || !CHECK(client.connectTo(server))) {
+        return;
+    }
+    std::vector<unsigned long> times;
+    uint32_t reconnectAllocations = 0;
+    for (uint32_t i = 0; i < RECONNECTS; i++) {
+        server.drop();
+        if (!CHECK(client.runUntil([&]() { return !client.connected; }))) {
+            break;
+        }
+        allocations = 0;
+        countAllocations = true;
+        unsigned long start = micros();
+        bool ok = client.runUntil([&]() { return client.connected; });
+        unsigned long time = micros() - start;
+        countAllocations = false;
+        if (!CHECK(ok)) {
+            break;
+        }
+        reconnectAllocations += allocations.load();
+        times.push_back(time);
+    }
+    client.disconnect();
+    server.stop();
+    if (times.empty()) {
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    size_t last = times.size() - 1;
+    printf("reconnect: p50 %lu us, p90 %lu us, max %lu us, %.1f allocations per reconnect\n", times[last / 2],
+           times[last * 9 / 10], times[last], (double) reconnectAllocations / times.size());
+}
+
+int main() {
+    testHeaderLines();
+    testLongLines();
+    testRequestWrites();
+    testConnectTime();
+    testAcceptKey();
+    benchmarkAcceptKey();
+    benchmarkReconnect();
+    return testResult("test_handshake");
+}
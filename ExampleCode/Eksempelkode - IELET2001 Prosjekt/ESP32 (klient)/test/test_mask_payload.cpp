@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+ * TEST OF THE WEBSOCKET PAYLOAD MASKING
+ * COMPARES WEBSOCKETS::MASKPAYLOAD WITH THE BYTE BY BYTE XOR OF RFC 6455 5.3 FOR EVERY ALIGNMENT OF THE PAYLOAD AND
+ * LENGTHS THAT LEAVE A HEAD, A TAIL OR BOTH, AND CHECKS THAT THE BYTES AROUND THE PAYLOAD ARE NOT TOUCHED. THEN
+ * MEASURES BOTH OVER A SWEEP OF SIZES UP TO WEBSOCKETS_MAX_DATA_SIZE
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <WebSockets.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "TestCheck.h"
+
+/// Test Settings ///
+const size_t GUARD_SIZE = 8;
+const size_t BENCHMARK_BYTES = 64 * 1024 * 1024;
+
+/**
+ * Reaches the masking of WebSockets, which is protected.
+ */
+class WebSocketsTest : public WebSockets {
+public:
+    using WebSockets::maskPayload;
+};
+
+/**
+ * The byte by byte masking the word at a time version has to match.
+ */
+void referenceMask(uint8_t * payload, size_t length, const uint8_t * maskKey) {
+    for (size_t i = 0; i < length; i++) {
+        payload[i] ^= maskKey[i & 3];
+    }
+}
+
+/**
+ * Function that masks random data at an offset in a buffer and compares it with the reference.
+ * @return false if the masking was wrong
+ */
+bool checkMask(std::mt19937& random, size_t offset, size_t length) {
+    std::vector<uint8_t> buffer(GUARD_SIZE + offset + length + GUARD_SIZE);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (uint8_t) random();
+    }
+    uint8_t maskKey[4];
+    for (size_t i = 0; i < sizeof(maskKey); i++) {
+        maskKey[i] = (uint8_t) random();
+    }
+    std::vector<uint8_t> expected = buffer;
+    referenceMask(&expected[GUARD_SIZE + offset], length, maskKey);
+    WebSocketsTest::maskPayload(&buffer[GUARD_SIZE + offset], length, maskKey);
+    if (buffer != expected) {
+        fprintf(stderr, "    offset %u, length %u\n", (unsigned) offset, (unsigned) length);
+        return false;
+    }
+    return true;
+}
+
+void testAlignments() {
+    std::mt19937 random(7);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length <= 64; length++) {
+            if (!CHECK(checkMask(random, offset, length))) {
+                return;
+            }
+        }
+    }
+    for (size_t length = 65; length <= WEBSOCKETS_MAX_DATA_SIZE; length = length * 3 / 2 + 1) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            CHECK(checkMask(random, offset, length));
+        }
+    }
+    for (size_t offset = 0; offset < 4; offset++) {
+        CHECK(checkMask(random, offset, WEBSOCKETS_MAX_DATA_SIZE));
+    }
+
+    // Masking twice gives the data back
+    uint8_t data[37];
+    uint8_t copy[37];
+    const uint8_t maskKey[4] = {0x12, 0x34, 0x56, 0x78};
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) i;
+    }
+    memcpy(copy, data, sizeof(data));
+    WebSocketsTest::maskPayload(data + 1, sizeof(data) - 1, maskKey);
+    WebSocketsTest::maskPayload(data + 1, sizeof(data) - 1, maskKey);
+    CHECK(memcmp(data, copy, sizeof(data)) == 0);
+}
+
+/**
+ * Function that measures both versions on sizes from a small frame to the largest one, one byte past an aligned
+ * address as a payload behind a 2 byte frame header is.
+ */
+void benchmarkSweep() {
+    std::vector<uint8_t> buffer(WEBSOCKETS_MAX_DATA_SIZE + 1);
+    const uint8_t maskKey[4] = {0xA5, 0x5A, 0x3C, 0xC3};
+    static const size_t sizes[] = {16, 64, 256, 1024, 4096, WEBSOCKETS_MAX_DATA_SIZE};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        size_t rounds = BENCHMARK_BYTES / size;
+        uint8_t * payload = &buffer[1];
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++) {
+            WebSocketsTest::maskPayload(payload, size, maskKey);
+        }
+        double wordSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++) {
+            referenceMask(payload, size, maskKey);
+            // keeps the compiler from folding the rounds of the reference together
+            __asm__ __volatile__("" : : "r"(payload) : "memory");
+        }
+        double byteSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("mask %5u bytes: %8.1f MB/s word, %8.1f MB/s byte\n", (unsigned) size,
+               rounds * size / wordSeconds / 1e6, rounds * size / byteSeconds / 1e6);
+    }
+}
+
+int main() {
+    testAlignments();
+    benchmarkSweep();
+    return testResult("test_mask_payload");
+}
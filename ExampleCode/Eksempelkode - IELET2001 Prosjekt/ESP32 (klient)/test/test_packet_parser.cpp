@@ -0,0 +1,264 @@
+/***********************************************************************************************************************
+ * TEST OF THE SOCKET.IO PACKET PARSER
+ * CHECKS KNOWN PACKETS, THEN FEEDS THE CORPUS IN CORPUS/PACKET AND RANDOM MUTATIONS OF IT TO SOCKETIOPARSEPACKET AND
+ * SOCKETIOPARSEOPEN. EVERY INPUT IS COPIED TO A BUFFER OF ITS EXACT SIZE, SO WITH NATIVE_SANITIZE A READ OR WRITE OUTSIDE
+ * THE PACKET STOPS THE TEST. LAST IT MEASURES THE PARSER THROUGHPUT ON THE PACKETS THE ROBOT RECEIVES
+ *
+ * Run by ctest as: test_packet_parser <corpus directory>
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <chrono>
+#include <dirent.h>
+#include <limits.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "TestCheck.h"
+
+/// Test Settings ///
+const uint32_t FUZZ_MUTATIONS = 200000;
+const uint32_t BENCHMARK_PACKETS = 2000000;
+
+/**
+ * Function that parses a copy of text, which the parser may change.
+ * @return the result of socketIoParsePacket
+ */
+bool parse(const std::string& text, SocketIOPacket_t * packet, std::string& copy) {
+    copy = text;
+    return socketIoParsePacket(&copy[0], copy.size(), packet);
+}
+
+/**
+ * @return the data of the packet as a string, empty if it has none
+ */
+std::string dataOf(const SocketIOPacket_t& packet) {
+    return packet.data ? std::string(packet.data, packet.dataLength) : std::string();
+}
+
+void testKnownPackets() {
+    SocketIOPacket_t packet;
+    std::string copy;
+
+    CHECK(parse("42[\"setpoints\",{\"001\":{\"setpoint\":21.5}}]", &packet, copy));
+    CHECK_EQUAL('4', packet.eioType);
+    CHECK_EQUAL('2', packet.sioType);
+    CHECK(!packet.hasAckId);
+    CHECK(std::string(packet.event, packet.eventLength) == "setpoints");
+    CHECK(dataOf(packet) == "{\"001\":{\"setpoint\":21.5}}");
+
+    // A single string argument is given without its quotes
+    CHECK(parse("42[\"authentication\",\"ok\"]", &packet, copy));
+    CHECK(dataOf(packet) == "ok");
+
+    CHECK(parse("42/robots,17[\"move\",1,[2,3]]", &packet, copy));
+    CHECK(std::string(packet.nsp, packet.nspLength) == "robots");
+    CHECK(packet.hasAckId);
+    CHECK_EQUAL(17, packet.ackId);
+    CHECK(dataOf(packet) == "1,[2,3]");
+
+    CHECK(parse("4312[]", &packet, copy));
+    CHECK_EQUAL('3', packet.sioType);
+    CHECK(packet.hasAckId);
+    CHECK_EQUAL(12, packet.ackId);
+
+    // Ack id 0 is an ack id
+    CHECK(parse("430[]", &packet, copy));
+    CHECK(packet.hasAckId);
+    CHECK_EQUAL(0, packet.ackId);
+
+    CHECK(parse("451-[\"sensorDataBinary\",{\"_placeholder\":true,\"num\":0}]", &packet, copy));
+    CHECK_EQUAL('5', packet.sioType);
+
+    CHECK(parse("2", &packet, copy));
+    CHECK_EQUAL('2', packet.eioType);
+    CHECK(parse("40", &packet, copy));
+    CHECK(!parse("", &packet, copy));
+    CHECK(!parse("4", &packet, copy));
+    CHECK(!parse("42", &packet, copy));
+    CHECK(!parse("42[\"unterminated", &packet, copy));
+    CHECK(!parse("42[\"event\",1", &packet, copy));
+    CHECK(!parse("451[\"event\"]", &packet, copy));
+}
+
+void testAckIdLimit() {
+    SocketIOPacket_t packet;
+    std::string copy;
+    char number[32];
+
+    // The largest ack id of the client is taken, one more is refused instead of overflowing
+    snprintf(number, sizeof(number), "%u", (unsigned) UINT32_MAX);
+    CHECK(parse(std::string("43") + number + "[]", &packet, copy));
+    CHECK_EQUAL(UINT32_MAX, packet.ackId);
+    std::string tooLarge = number;
+    tooLarge[tooLarge.size() - 1]++;
+    CHECK(!parse("43" + tooLarge + "[]", &packet, copy));
+    CHECK(!packet.hasAckId);
+    CHECK_EQUAL(0, packet.ackId);
+    CHECK(!parse("42" + std::string(40, '9') + "[\"event\"]", &packet, copy));
+    CHECK(!parse("43/robots," + std::string(40, '9') + "[]", &packet, copy));
+}
+
+/**
+ * Function that checks that every view the parser gives points into the packet.
+ */
+void checkViews(const SocketIOPacket_t& packet, const char * message, size_t length) {
+    const char * end = message + length;
+    if (packet.nsp) {
+        CHECK(packet.nsp >= message && packet.nsp + packet.nspLength <= end);
+    }
+    if (packet.event) {
+        CHECK(packet.event >= message && packet.event + packet.eventLength <= end);
+    }
+    if (packet.data) {
+        CHECK(packet.data >= message && packet.data + packet.dataLength <= end);
+    }
+    CHECK(packet.hasAckId || packet.ackId == 0);
+}
+
+/**
+ * Function that parses one input from a buffer of its exact size.
+ */
+void fuzzOne(const std::string& input) {
+    if (input.empty()) {
+        return;
+    }
+    std::vector<char> buffer(input.begin(), input.end());
+    SocketIOPacket_t packet;
+    if (socketIoParsePacket(buffer.data(), buffer.size(), &packet)) {
+        checkViews(packet, buffer.data(), buffer.size());
+        if (packet.eioType == '0' && packet.data) {
+            unsigned long pingInterval = 0;
+            unsigned long pingTimeout = 0;
+            socketIoParseOpen((char *) packet.data, packet.dataLength, &pingInterval, &pingTimeout);
+        }
+    }
+}
+
+/**
+ * Function that reads every file of the corpus directory.
+ * @return the contents of the files
+ */
+std::vector<std::string> readCorpus(const char * directory) {
+    std::vector<std::string> corpus;
+    DIR * dir = opendir(directory);
+    if (dir == NULL) {
+        return corpus;
+    }
+    while (struct dirent * entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = std::string(directory) + "/" + entry->d_name;
+        FILE * file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            continue;
+        }
+        std::string content;
+        char chunk[256];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            content.append(chunk, read);
+        }
+        fclose(file);
+        corpus.push_back(content);
+    }
+    closedir(dir);
+    return corpus;
+}
+
+/**
+ * Function that mutates the corpus the way a fuzzer does: flips, inserts, removes and splices bytes, with a bias to
+ * the characters the parser looks at.
+ */
+void testFuzz(const std::vector<std::string>& corpus) {
+    static const char interesting[] = "0123456789[]{}\",/-\\ 4";
+    std::mt19937 random(42);
+    for (size_t i = 0; i < corpus.size(); i++) {
+        fuzzOne(corpus[i]);
+    }
+    for (uint32_t i = 0; i < FUZZ_MUTATIONS; i++) {
+        std::string input = corpus[random() % corpus.size()];
+        uint32_t mutations = 1 + random() % 4;
+        for (uint32_t m = 0; m < mutations; m++) {
+            size_t position = input.empty() ? 0 : random() % (input.size() + 1);
+            switch (random() % 5) {
+                case 0:
+                    if (position < input.size()) {
+                        input[position] ^= (char) (1 << (random() % 8));
+                    }
+                    break;
+                case 1:
+                    input.insert(position, 1, interesting[random() % (sizeof(interesting) - 1)]);
+                    break;
+                case 2:
+                    if (position < input.size()) {
+                        input.erase(position, 1 + random() % 8);
+                    }
+                    break;
+                case 3:
+                    input.insert(position, std::string(1 + random() % 30, '9'));
+                    break;
+                default: {
+                    const std::string& other = corpus[random() % corpus.size()];
+                    input = input.substr(0, position) + other.substr(random() % (other.size() + 1));
+                    break;
+                }
+            }
+        }
+        fuzzOne(input);
+        if (testFailures() > 0) {
+            fprintf(stderr, "failed on input: %s\n", input.c_str());
+            return;
+        }
+    }
+    printf("fuzz: %u seeds, %u mutations\n", (unsigned) corpus.size(), (unsigned) FUZZ_MUTATIONS);
+}
+
+/**
+ * Function that measures the parser on the packets the robot receives, including the copy of the packet the parser
+ * needs as it terminates the strings in place.
+ */
+void benchmarkParse() {
+    static const char * packets[] = {
+        "42[\"setpoints\",{\"001\":{\"setpoint\":21.5,\"mode\":\"pwm\"},\"002\":\"none\"}]",
+        "42[\"authentication\",true]",
+        "4312[]",
+        "2",
+    };
+    const size_t count = sizeof(packets) / sizeof(packets[0]);
+    char buffer[128];
+    size_t lengths[count];
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = strlen(packets[i]);
+    }
+    SocketIOPacket_t packet;
+    uint32_t valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_PACKETS; i++) {
+        size_t n = i % count;
+        memcpy(buffer, packets[n], lengths[n]);
+        valid += socketIoParsePacket(buffer, lengths[n], &packet);
+        bytes += lengths[n];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQUAL(BENCHMARK_PACKETS, valid);
+    printf("parse: %.0f packets/s, %.1f MB/s\n", BENCHMARK_PACKETS / seconds, bytes / seconds / 1e6);
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: test_packet_parser <corpus directory>\n");
+        return 2;
+    }
+    std::vector<std::string> corpus = readCorpus(argv[1]);
+    if (!CHECK(!corpus.empty())) {
+        return testResult("test_packet_parser");
+    }
+    testKnownPackets();
+    testAckIdLimit();
+    testFuzz(corpus);
+    benchmarkParse();
+    return testResult("test_packet_parser");
+}
@@ -0,0 +1,118 @@
+/***********************************************************************************************************************
+ * SOAK TEST OF THE WEBSOCKET RECEIVE BUFFER
+ * THE LOOPBACK SERVER SENDS THE FRAMES OF 24 HOURS OF A ROBOT AS FAST AS THE CLIENT TAKES THEM: AN ENGINE.IO PING EVERY
+ * 25 S, AN ACK FOR EVERY REPORT OF AN OUTPUT STATE EVERY 5 S, SET-POINTS OF RANDOM SIZE EVERY MINUTE AND A LARGE ONE
+ * EVERY HOUR. THE TRAFFIC IS MODELED, NOT RECORDED. IT COUNTS THE ALLOCATIONS PER FRAME OF THE CLIENT, AND REPORTS THE
+ * HEAP IN USE AND THE FREE MEMORY MALLOC HOLDS BEFORE AND AFTER AS A MEASURE OF FRAGMENTATION
+ *
+ * Built twice, test_rx_soak grows the receive buffer on the heap and test_rx_soak_static uses WEBSOCKETS_STATIC_RX_BUFFER
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <random>
+#include "AllocationCounter.h"
+#include "TestCheck.h"
+#include "WebSocketsClientTest.h"
+
+/// Test Settings ///
+const unsigned long SOAK_TIME = 24UL * 3600;     // Simulated time in s
+const unsigned long PING_PERIOD = 25;
+const unsigned long ACK_PERIOD = 5;
+const unsigned long SETPOINT_PERIOD = 60;
+const unsigned long LARGE_SETPOINT_PERIOD = 3600;
+const size_t LARGE_SETPOINT_SIZE = 4000;
+
+// Frames sent before the client has to catch up, less than the socket buffers hold
+const uint32_t BURST_FRAMES = 64;
+
+/**
+ * @return the free bytes malloc holds, 0 where it can not be read
+ */
+size_t mallocFreeBytes() {
+#ifdef ALLOCATION_COUNTING
+    return mallinfo2().fordblks;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Function that sends a set-points event with an object of the size, the setpoint values change each time.
+ */
+void pushSetpoints(LoopbackServer& server, std::mt19937& random, size_t size) {
+    static char text[LARGE_SETPOINT_SIZE + 64];
+    int length = snprintf(text, sizeof(text), "42[\"setpoints\",{\"001\":{\"setpoint\":%u.%u,\"pad\":\"",
+                          (unsigned) (15 + random() % 10), (unsigned) (random() % 10));
+    while ((size_t) length < size && (size_t) length < sizeof(text) - 8) {
+        text[length++] = 'p';
+    }
+    strcpy(&text[length], "\"}}]");
+    server.push(text);
+}
+
+int main() {
+    LoopbackServer server;
+    WebSocketsClientTest client;
+    if (!CHECK(server.start()) || !CHECK(client.connectTo(server)) ||
+        !CHECK(client.runUntil([&]() { return client.texts >= 2; }))) {
+        return testResult("test_rx_soak");
+    }
+
+    // One frame of the largest size first, so the buffer has grown before the counting starts
+    std::mt19937 random(24);
+    uint32_t expected = client.texts + 1;
+    pushSetpoints(server, random, LARGE_SETPOINT_SIZE);
+    CHECK(client.runUntil([&]() { return client.texts >= expected; }));
+
+    uint32_t textsBefore = client.texts;
+    size_t heapBefore = heapInUse.load();
+    size_t freeBefore = mallocFreeBytes();
+    allocations = 0;
+    countAllocations = true;
+    uint32_t frames = 0;
+    uint32_t ackId = 0;
+    for (unsigned long second = 0; second < SOAK_TIME; second++) {
+        if (second % PING_PERIOD == 0) {
+            server.push("2");
+            frames++;
+        }
+        if (second % ACK_PERIOD == 0) {
+            char ack[24];
+            snprintf(ack, sizeof(ack), "43%u[]", (unsigned) ackId++);
+            server.push(ack);
+            frames++;
+        }
+        if (second % SETPOINT_PERIOD == 0) {
+            pushSetpoints(server, random, 80 + random() % 520);
+            frames++;
+        }
+        if (second % LARGE_SETPOINT_PERIOD == 0) {
+            pushSetpoints(server, random, 1000 + random() % (LARGE_SETPOINT_SIZE - 1000));
+            frames++;
+        }
+        if (frames >= BURST_FRAMES || second + 1 == SOAK_TIME) {
+            expected += frames;
+            frames = 0;
+            if (!CHECK(client.runUntil([&]() { return client.texts >= expected; }))) {
+                break;
+            }
+        }
+    }
+    countAllocations = false;
+    uint32_t received = client.texts - textsBefore;
+    size_t heapAfter = heapInUse.load();
+    size_t freeAfter = mallocFreeBytes();
+
+    CHECK(client.connected);
+    CHECK_EQUAL(1, client.connects);
+    printf("soak: %u frames in 24 h, %.4f allocations per frame, heap in use %+ld bytes, malloc free %u -> %u bytes\n",
+           (unsigned) received, (double) allocations.load() / received, (long) (heapAfter - heapBefore),
+           (unsigned) freeBefore, (unsigned) freeAfter);
+#ifdef ALLOCATION_COUNTING
+    // The buffer has its high-water mark already, no frame of the soak may allocate
+    CHECK_EQUAL(0, allocations.load());
+    CHECK_EQUAL(heapBefore, heapAfter);
+#endif
+    client.disconnect();
+    server.stop();
+    return testResult("test_rx_soak");
+}
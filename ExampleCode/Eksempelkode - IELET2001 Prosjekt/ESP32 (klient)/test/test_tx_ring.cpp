@@ -0,0 +1,240 @@
+/***********************************************************************************************************************
+ * TEST OF THE PACKET RING OF SOCKETIOCLIENT
+ * FILLS, WRAPS AND EMPTIES THE RING WITH KNOWN AND RANDOM PACKETS AND CHECKS THAT EVERY PACKET COMES OUT WHOLE AND IN
+ * ORDER, THEN MEASURES EMITS PER SECOND AND ALLOCATIONS PER EMIT WITHOUT A NETWORK
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <SocketIoClient.h>
+#include <chrono>
+#include <deque>
+#include <random>
+#include "AllocationCounter.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const uint32_t RANDOM_OPERATIONS = 200000;
+const uint32_t BENCHMARK_EMITS = 1000000;
+
+/**
+ * Reaches the packet ring of a client, which is private.
+ */
+class SocketIoClientTest {
+public:
+    explicit SocketIoClientTest(SocketIoClient& client) : client(client) {}
+
+    uint8_t * reserve(size_t length, bool binary = false) { return client.txReserve(length, binary); }
+    uint8_t * peek(size_t * length, bool * binary) { return client.txPeek(length, binary); }
+    void pop(size_t length) { client.txPop(length); }
+    size_t packets() const { return client._txPackets; }
+    size_t readPosition() const { return client._txRead; }
+    size_t writePosition() const { return client._txWrite; }
+
+private:
+    SocketIoClient& client;
+};
+
+// A packet as the test expects it back, every byte is the low byte of its number
+struct ExpectedPacket {
+    uint32_t number;
+    size_t length;
+    bool binary;
+};
+
+/**
+ * Function that reserves a packet and fills it with its number.
+ * @return false if the ring was full
+ */
+bool put(SocketIoClientTest& ring, std::deque<ExpectedPacket>& expected, uint32_t number, size_t length,
+         bool binary = false) {
+    uint8_t * data = ring.reserve(length, binary);
+    if (data == NULL) {
+        return false;
+    }
+    memset(data, number & 0xFF, length);
+    ExpectedPacket packet = {number, length, binary};
+    expected.push_back(packet);
+    return true;
+}
+
+/**
+ * Function that takes the oldest packet out of the ring and checks it against the oldest expected packet.
+ * @return false if the packet was wrong
+ */
+bool take(SocketIoClientTest& ring, std::deque<ExpectedPacket>& expected) {
+    size_t length;
+    bool binary;
+    uint8_t * data = ring.peek(&length, &binary);
+    if (!CHECK(data != NULL) || !CHECK(!expected.empty())) {
+        return false;
+    }
+    ExpectedPacket packet = expected.front();
+    expected.pop_front();
+    bool ok = CHECK_EQUAL(packet.length, length) && CHECK(packet.binary == binary);
+    for (size_t i = 0; ok && i < length; i++) {
+        ok = CHECK_EQUAL(packet.number & 0xFF, data[i]);
+    }
+    ring.pop(length);
+    return ok;
+}
+
+void testFull() {
+    SocketIoClient client;
+    SocketIoClientTest ring(client);
+    std::deque<ExpectedPacket> expected;
+    size_t length = 100;
+    uint32_t count = 0;
+    while (put(ring, expected, count, length)) {
+        count++;
+    }
+    CHECK_EQUAL(SOCKETIOCLIENT_TX_BUFFER_SIZE / (length + 2), count);
+    CHECK_EQUAL(count, ring.packets());
+    while (!expected.empty() && take(ring, expected)) {
+    }
+    CHECK_EQUAL(0, ring.packets());
+    CHECK_EQUAL(0, ring.readPosition());
+    CHECK_EQUAL(0, ring.writePosition());
+
+    // Packets that can never fit are refused also in an empty ring
+    CHECK(ring.reserve(SOCKETIOCLIENT_TX_BUFFER_SIZE - 1) == NULL);
+    CHECK(ring.reserve(0x7FFF) == NULL);
+    CHECK(put(ring, expected, 1, SOCKETIOCLIENT_TX_BUFFER_SIZE - 2));
+    CHECK(ring.reserve(0) == NULL);
+    CHECK(take(ring, expected));
+}
+
+void testWrap() {
+    SocketIoClient client;
+    SocketIoClientTest ring(client);
+    std::deque<ExpectedPacket> expected;
+
+    // The packet does not fit behind the last one, so the wrap marker is written and it starts at 0
+    CHECK(put(ring, expected, 1, 1000));
+    CHECK(put(ring, expected, 2, 900));
+    CHECK(take(ring, expected));
+    CHECK(put(ring, expected, 3, 500));
+    CHECK_EQUAL(502, ring.writePosition());
+    CHECK(take(ring, expected));
+    CHECK(take(ring, expected));
+    CHECK_EQUAL(0, ring.packets());
+
+    // One byte is left at the end, too little for the marker, the reader has to wrap by itself
+    CHECK(put(ring, expected, 4, 998));
+    CHECK(put(ring, expected, 5, 1045));
+    CHECK_EQUAL(SOCKETIOCLIENT_TX_BUFFER_SIZE - 1, ring.writePosition());
+    CHECK(take(ring, expected));
+    CHECK(put(ring, expected, 6, 10));
+    CHECK(take(ring, expected));
+    CHECK(take(ring, expected));
+
+    // A packet that ends exactly at the end of the buffer does not wrap
+    CHECK(put(ring, expected, 7, 1000));
+    CHECK(put(ring, expected, 8, SOCKETIOCLIENT_TX_BUFFER_SIZE - 1002 - 2));
+    CHECK_EQUAL(SOCKETIOCLIENT_TX_BUFFER_SIZE, ring.writePosition());
+    CHECK(take(ring, expected));
+    // The front is free now, the next one wraps without a marker
+    CHECK(put(ring, expected, 9, 100, true));
+    CHECK_EQUAL(102, ring.writePosition());
+    // Writing up to the reader fills the ring
+    CHECK(put(ring, expected, 10, 1002 - 102 - 2));
+    CHECK(ring.reserve(0) == NULL);
+    while (!expected.empty() && take(ring, expected)) {
+    }
+
+    // A packet that fits neither at the end nor at the front is refused without changing the ring
+    CHECK(put(ring, expected, 11, 600));
+    CHECK(put(ring, expected, 12, 1000));
+    CHECK(take(ring, expected));
+    size_t write = ring.writePosition();
+    CHECK(ring.reserve(700) == NULL);
+    CHECK_EQUAL(write, ring.writePosition());
+    CHECK_EQUAL(1, ring.packets());
+    CHECK(take(ring, expected));
+}
+
+/**
+ * Function that puts and takes random packets, and checks every packet that comes out. The ring has to take a packet
+ * whenever it is empty.
+ */
+void testRandom() {
+    SocketIoClient client;
+    SocketIoClientTest ring(client);
+    std::deque<ExpectedPacket> expected;
+    std::mt19937 random(1234);
+    uint32_t number = 0;
+    uint32_t refused = 0;
+    for (uint32_t i = 0; i < RANDOM_OPERATIONS; i++) {
+        if (random() % 2 == 0) {
+            size_t length = random() % 400;
+            bool empty = ring.packets() == 0;
+            if (put(ring, expected, number, length, random() % 4 == 0)) {
+                number++;
+            } else {
+                refused++;
+                if (!CHECK(!empty)) {
+                    return;
+                }
+            }
+        } else if (!expected.empty() && !take(ring, expected)) {
+            return;
+        }
+        if (!CHECK_EQUAL(expected.size(), ring.packets())) {
+            return;
+        }
+    }
+    while (!expected.empty() && take(ring, expected)) {
+    }
+    CHECK(refused > 0);
+    printf("random: %u packets, %u refused\n", (unsigned) number, (unsigned) refused);
+}
+
+/**
+ * Function that checks that a binary event is queued whole or not at all.
+ */
+void testBinaryAllOrNothing() {
+    SocketIoClient client;
+    SocketIoClientTest ring(client);
+    std::deque<ExpectedPacket> expected;
+    CHECK(put(ring, expected, 1, SOCKETIOCLIENT_TX_BUFFER_SIZE - 200));
+    uint8_t data[300] = {0};
+    // The placeholder fits, the data does not
+    client.emitBinary("sensorDataBinary", data, sizeof(data));
+    CHECK_EQUAL(1, ring.packets());
+    client.emitBinary("sensorDataBinary", data, 10);
+    CHECK_EQUAL(3, ring.packets());
+}
+
+/**
+ * Function that measures emit and the sending of the packet without the network, as the ring is emptied by loop().
+ */
+void benchmarkEmit() {
+    SocketIoClient client;
+    SocketIoClientTest ring(client);
+    const char * payload = "{\"SensorID\":\"001\",\"value\":21.40}";
+    allocations = 0;
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_EMITS; i++) {
+        client.emit("sensorData", payload);
+        size_t length;
+        bool binary;
+        if (ring.peek(&length, &binary) != NULL) {
+            ring.pop(length);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+    printf("emit: %.0f emits/s, %.3f allocations per emit\n", BENCHMARK_EMITS / seconds,
+           (double) allocations.load() / BENCHMARK_EMITS);
+#ifdef ALLOCATION_COUNTING
+    CHECK_EQUAL(0, allocations.load());
+#endif
+}
+
+int main() {
+    testFull();
+    testWrap();
+    testRandom();
+    testBinaryAllOrNothing();
+    benchmarkEmit();
+    return testResult("test_tx_ring");
+}
@@ -13,6 +13,32 @@ server.listen(serverPort, function(){ //Here we tell the server to start listeni
     console.log('listening on *:' + serverPort);
 });
 
+//Decodes the binary telemetry format of the ESP32 robot client (encodeTelemetryRecord in src/main.cpp)
+//Returns a list of readings like {type: "sensor", id: "001", time: 12345, value: 21.4}
+var TELEMETRY_TYPES = ["sensor", "output", "outputLevel"]; //Same order as DataType in main.cpp
+var TELEMETRY_SCALES = [10, 1, 1000]; //Sensor values are sent in tenths, output levels in thousandths
+
+function decodeTelemetry(buffer) {
+    var readings = [];
+    if (buffer.length < 6 || buffer.readUInt8(0) !== 1) { //Checks the size and version of the header
+        return readings;
+    }
+    var count = buffer.readUInt8(1);
+    var baseTime = buffer.readUInt32LE(2); //millis() on the robot when the first record was made
+
+    for (var i = 0; i < count && 6 + (i + 1) * 7 <= buffer.length; i++) { //Every record is 7 bytes after the header
+        var offset = 6 + i * 7;
+        var type = buffer.readUInt8(offset + 2);
+        readings.push({
+            type: TELEMETRY_TYPES[type],
+            id: ("00" + buffer.readUInt16LE(offset)).slice(-3), //The ID is sent as a number, "001" is 1
+            time: baseTime + buffer.readUInt16LE(offset + 3),
+            value: buffer.readInt16LE(offset + 5) / (TELEMETRY_SCALES[type] || 1)
+        });
+    }
+    return readings;
+}
+
 io.on('connection', function(socket){ //This is the server part of the "what happens when we first connect" function. Everytime a user connects a instance of this is set up for the user privatley
     console.log('a user connected'); //The server print this message
 
@@ -102,6 +128,43 @@ io.on('connection', function(socket){ //This is the server part of the "what hap
 
     });
 
+    socket.on('sensorDataBinary', function(buffer) { //Binary telemetry from a robot, decoded and sent on as "data"
+        var readings = decodeTelemetry(Buffer.from(buffer));
+        io.emit('data', readings);
+        console.log('user ' + clientID + ' sent ' + readings.length + ' binary readings');
+
+    });
+
+    socket.on('sensorData', function(data, ack) { //A reading or an output state change, output state changes come with an ack callback
+        io.emit('data', data);
+        if (typeof ack === 'function') {
+            ack(); //The robot sends the output state change again until it gets the ack, so it can arrive twice
+        }
+
+    });
+
+    socket.on('sensorDataBatch', function(readings) { //The readings of one tick from a robot built with TELEMETRY_BATCHING, sent on one by one as "data"
+        readings.forEach(function(data) {
+            io.emit('data', data);
+        });
+
+    });
+
+    socket.on('sensorDataReplay', function(readings, ack) { //Readings the robot kept in flash while it was offline, age in ms or null if from before a restart
+        io.emit('replayData', readings);
+        console.log('user ' + clientID + ' replayed ' + readings.length + ' readings');
+        if (typeof ack === 'function') {
+            ack(); //The robot only marks the readings as sent when it gets the ack, so they can arrive twice
+        }
+
+    });
+
+    socket.on('diagnostics', function(diagnostics) { //Timing and heap statistics from a robot built with ENABLE_DIAGNOSTICS
+        io.emit('diagnostics', diagnostics);
+        console.log('user ' + clientID + ' sent diagnostics: ' + JSON.stringify(diagnostics));
+
+    });
+
     socket.on('dataFromBoard', function(data) { //This is function that actually receives the data. The earlier one only starts the function.
 
         io.emit('data', data); //Everytime a "dataFromBoard" tag (with data) is sent to the server, "data" tag with the actual data is sent to all clients
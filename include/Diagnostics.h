@@ -0,0 +1,145 @@
+/***********************************************************************************************************************
+ * DIAGNOSTICS
+ * COUNTS THE CALLS AND THE TIME SPENT IN THE MAIN STAGES OF THE PROGRAM AND THE SOCKET.IO LIBRARY, AND THE LOWEST FREE
+ * HEAP. BUILT ONLY WITH THE BUILD FLAG ENABLE_DIAGNOSTICS, ELSE THE MACROS ARE EMPTY AND NOTHING IS MEASURED
+ ***********************************************************************************************************************/
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#ifdef ENABLE_DIAGNOSTICS
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdint.h>
+#ifndef ESP32
+#include <time.h>
+#endif
+
+// The measured parts of the program
+enum DiagnosticsStage : uint8_t {
+    STAGE_SAMPLE,             // Reading a sensor
+    STAGE_CONTROL,            // The control task, filtering and PID regulation
+    STAGE_FORMAT,             // Formatting a value for the server in sendDataToServer
+    STAGE_EMIT,               // Adding a Socket.IO packet to the send buffer
+    STAGE_FRAME_TX,           // Sending a WebSocket frame
+    STAGE_FRAME_RX,           // Reading a WebSocket frame, or the part that has arrived, and handling its event
+    STAGE_HANDSHAKE,          // From the TCP connection to the end of the WebSocket upgrade
+    STAGE_RECONNECT,          // From losing the server, or Wi-Fi coming up, to the Socket.IO connect
+    STAGE_COUNT
+};
+
+// Names of the stages in the "diagnostics" event
+const char * const DIAGNOSTICS_STAGE_NAMES[STAGE_COUNT] = {
+    "sample", "control", "format", "emit", "frameTx", "frameRx", "handshake", "reconnect"
+};
+
+// Ticks of diagnosticsTicks() per microsecond, the cycle counter of the core on the ESP32 and nanoseconds on a PC
+#ifdef ESP32
+const uint32_t DIAGNOSTICS_TICKS_PER_US = F_CPU / 1000000;
+#else
+const uint32_t DIAGNOSTICS_TICKS_PER_US = 1000;
+#endif
+
+/**
+ * Counters of a stage. They only count up and are allowed to wrap around, the reader takes the difference from its last
+ * read. Each stage is only measured by one task, so the counters are read and written without locks.
+ */
+struct DiagnosticsCounters {
+    std::atomic<uint32_t> calls;
+    std::atomic<uint32_t> totalMicros;
+    std::atomic<uint32_t> maxMicros;  // Longest call since the reader last set it to 0
+};
+
+// Free heap in bytes, with the lowest values since start
+struct DiagnosticsHeap {
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestBlock;    // Largest block that can be allocated
+    uint32_t minLargestBlock;
+};
+
+/**
+ * Function that returns the counters of all stages. A static in an inline function is the same in every file.
+ * @return array of STAGE_COUNT counters
+ */
+inline DiagnosticsCounters * diagnosticsCounters() {
+    static DiagnosticsCounters counters[STAGE_COUNT];
+    return counters;
+}
+
+/**
+ * Function that reads a fast clock. On the ESP32 it is the cycle counter of the core, so a stage has to start and end
+ * on the same core. A measurement can be at most 17 seconds at 240 MHz, and 4 seconds on a PC.
+ * @return ticks, DIAGNOSTICS_TICKS_PER_US per microsecond
+ */
+inline uint32_t diagnosticsTicks() {
+#ifdef ESP32
+    return ESP.getCycleCount();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+/**
+ * Function that adds a call of a stage to its counters.
+ * @param stage             the stage
+ * @param duration          duration of the call in microseconds
+ */
+inline void diagnosticsRecord(DiagnosticsStage stage, uint32_t duration) {
+    DiagnosticsCounters& counters = diagnosticsCounters()[stage];
+    counters.calls.store(counters.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    counters.totalMicros.store(counters.totalMicros.load(std::memory_order_relaxed) + duration,
+                               std::memory_order_relaxed);
+    if (duration > counters.maxMicros.load(std::memory_order_relaxed)) {
+        counters.maxMicros.store(duration, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Function that reads the free heap, and keeps the lowest largest block seen. Called from one task only.
+ * @param heap              is set to the values, all 0 on a PC
+ */
+inline void diagnosticsReadHeap(DiagnosticsHeap& heap) {
+#ifdef ESP32
+    static uint32_t minLargestBlock = UINT32_MAX;
+    heap.freeHeap = ESP.getFreeHeap();
+    heap.minFreeHeap = ESP.getMinFreeHeap();
+    heap.largestBlock = ESP.getMaxAllocHeap();
+    minLargestBlock = min(minLargestBlock, heap.largestBlock);
+    heap.minLargestBlock = minLargestBlock;
+#else
+    heap.freeHeap = 0;
+    heap.minFreeHeap = 0;
+    heap.largestBlock = 0;
+    heap.minLargestBlock = 0;
+#endif
+}
+
+/**
+ * Measures a stage from where it is made to the end of the scope.
+ */
+class DiagnosticsScope {
+public:
+    explicit DiagnosticsScope(DiagnosticsStage stage) : stage(stage), start(diagnosticsTicks()) {}
+    ~DiagnosticsScope() { diagnosticsRecord(stage, (diagnosticsTicks() - start) / DIAGNOSTICS_TICKS_PER_US); }
+
+private:
+    DiagnosticsStage stage;
+    uint32_t start;
+};
+
+// Measures the rest of the scope as one call of the stage
+#define DIAGNOSTICS_SCOPE(stage) DiagnosticsScope diagnosticsScope(stage)
+// Adds a call of the stage that was measured by the caller, for stages that last over several calls of loop
+#define DIAGNOSTICS_RECORD(stage, duration) diagnosticsRecord(stage, duration)
+
+#else
+
+#define DIAGNOSTICS_SCOPE(stage)
+#define DIAGNOSTICS_RECORD(stage, duration)
+
+#endif
+
+#endif
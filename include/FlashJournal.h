@@ -0,0 +1,410 @@
+/***********************************************************************************************************************
+ * FLASH JOURNAL
+ * APPEND-ONLY RING OF RECORDS IN A FLASH PARTITION, FOR KEEPING THE VALUES OF THE ROBOT WHILE IT IS OFFLINE SO THEY CAN
+ * BE SENT TO THE SERVER LATER, ALSO AFTER A RESTART
+ ***********************************************************************************************************************/
+#ifndef FLASH_JOURNAL_H
+#define FLASH_JOURNAL_H
+
+#include <esp_partition.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Size in bytes of the flash sectors, the smallest part of the flash that can be erased
+const uint32_t JOURNAL_SECTOR_SIZE = 4096;
+
+// Most sectors of the partition that are used, the sequence numbers of the sectors are kept in RAM
+const size_t JOURNAL_MAX_SECTORS = 64;
+
+// Written at the start of every sector in use, "JRNL"
+const uint32_t JOURNAL_MAGIC = 0x4C4E524A;
+
+// Type of the records that mark the records up to the sequence number in time as replayed
+const uint8_t JOURNAL_CHECKPOINT = 0xFE;
+
+// One value in the journal, as it is read
+struct JournalRecord {
+    uint32_t sequence;        // Counts up by one for every slot of the journal, also across restarts
+    uint32_t time;            // millis() when the value was taken, the replayed sequence number in a checkpoint
+    float value;
+    uint16_t id;              // The sensor / actuator ID as a number
+    uint8_t type;             // Type of the value, chosen by the program, or JOURNAL_CHECKPOINT
+};
+
+// A record as it is written in the flash. A slot that has not been written since the sector was erased has all bits set
+struct JournalSlot {
+    uint32_t time;
+    float value;
+    uint16_t id;
+    uint8_t type;
+    uint8_t reserved;
+    uint32_t crc;             // CRC-32 of the sequence number and the bytes before, so a cut off record is skipped
+};
+
+// First bytes of every sector, the records of the sector follow
+struct JournalSectorHeader {
+    uint32_t magic;           // JOURNAL_MAGIC
+    uint32_t sequence;        // Sequence number of the first slot of the sector, the others follow without gaps
+    uint32_t eraseCount;      // Number of times the sector has been erased, as far as the journal knows
+    uint32_t crc;             // CRC-32 of the bytes before
+};
+
+static_assert(sizeof(JournalSlot) == 16, "A journal slot has to be 16 bytes");
+static_assert(sizeof(JournalSectorHeader) == sizeof(JournalSlot), "The sector header takes the place of one slot");
+
+// Slots for records in each sector, after the header
+const size_t JOURNAL_SLOTS = JOURNAL_SECTOR_SIZE / sizeof(JournalSlot) - 1;
+
+/**
+ * Journal of records in a flash partition. Records are only appended, in the sectors of the partition in turn, so
+ * every sector is erased equally often and a sector is only erased when the journal has gone all the way around. A
+ * sector that is already erased is not erased again. When the journal is full the oldest sector is erased, and its
+ * records that were not replayed are counted as lost.
+ *
+ * Replayed records are marked by appending a checkpoint, nothing already written is changed. After a power loss the
+ * journal continues after the last slot that is not erased, so the records that were appended before are kept, a record
+ * that was cut off fails its CRC and is skipped, and the records since the last checkpoint are replayed again. The journal is used by one
+ * task only.
+ */
+class FlashJournal {
+public:
+    FlashJournal() : partition(NULL), sectorCount(0), headSector(0), nextSequence(1), readSequence(1),
+                     bootSequence(1), pendingRecords(0), lostRecords(0), maxEraseCount(0) {}
+
+    /**
+     * Function that reads the journal from the partition, and formats it if it has no valid sectors.
+     * @param journalPartition  the partition, NULL if it was not found
+     * @return false if the partition is missing, smaller than two sectors, or can not be read and written
+     */
+    bool begin(const esp_partition_t * journalPartition) {
+        partition = journalPartition;
+        if (partition == NULL || partition->size / JOURNAL_SECTOR_SIZE < 2) {
+            partition = NULL;
+            return false;
+        }
+        sectorCount = partition->size / JOURNAL_SECTOR_SIZE;
+        if (sectorCount > JOURNAL_MAX_SECTORS) {
+            sectorCount = JOURNAL_MAX_SECTORS;
+        }
+        pendingRecords = 0;
+        lostRecords = 0;
+        maxEraseCount = 0;
+
+        // The sector with the highest sequence number is the one records are appended to
+        bool found = false;
+        for (size_t sector = 0; sector < sectorCount; sector++) {
+            JournalSectorHeader header;
+            sectorSequences[sector] = 0;
+            if (readHeader(sector, header)) {
+                sectorSequences[sector] = header.sequence;
+                maxEraseCount = header.eraseCount > maxEraseCount ? header.eraseCount : maxEraseCount;
+                if (!found || header.sequence > sectorSequences[headSector]) {
+                    headSector = sector;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            nextSequence = 1;
+            readSequence = 1;
+            bootSequence = 1;
+            return openSector(0);
+        }
+
+        // Appending continues after the last slot that is not erased, also if that record was cut off
+        size_t writeSlot = JOURNAL_SLOTS;
+        while (writeSlot > 0 && slotErased(headSector, writeSlot - 1)) {
+            writeSlot--;
+        }
+        nextSequence = sectorSequences[headSector] + writeSlot;
+        bootSequence = nextSequence;
+
+        // Replaying continues after the last checkpoint, or from the oldest record that is left
+        uint32_t checkpoint = 0;
+        JournalRecord record;
+        for (size_t sector = 0; sector < sectorCount; sector++) {
+            for (size_t slot = 0; sectorSequences[sector] != 0 && slot < JOURNAL_SLOTS; slot++) {
+                if (readRecord(sector, sectorSequences[sector] + slot, record) && record.type == JOURNAL_CHECKPOINT &&
+                    record.time > checkpoint && record.time < record.sequence) {
+                    checkpoint = record.time;
+                }
+            }
+        }
+        readSequence = checkpoint + 1;
+        size_t sector;
+        if (!locate(readSequence, sector)) {
+            readSequence = nextSequence;
+        }
+        pendingRecords = countRecords(readSequence, nextSequence);
+        return true;
+    }
+
+    /**
+     * Function that appends a record to the journal. When the sector is full the next one is erased first, which takes
+     * tens of milliseconds.
+     * @param type          type of the value, anything but JOURNAL_CHECKPOINT
+     * @param id            the sensor / actuator ID as a number
+     * @param value         the value
+     * @param time          millis() when the value was taken
+     * @return false if the journal is not open or the flash could not be written
+     */
+    bool append(uint8_t type, uint16_t id, float value, uint32_t time) {
+        if (!appendRecord(type, id, value, time)) {
+            return false;
+        }
+        pendingRecords++;
+        return true;
+    }
+
+    /**
+     * Function that reads the oldest records that are not replayed yet, without marking them as replayed.
+     * @param records       where the records are written
+     * @param count         most records that are read
+     * @return number of records read
+     */
+    size_t read(JournalRecord * records, size_t count) {
+        size_t read = 0;
+        uint32_t sequence = readSequence;
+        size_t sector;
+        while (read < count && sequence < nextSequence && locate(sequence, sector)) {
+            if (readRecord(sector, sequence, records[read]) && records[read].type != JOURNAL_CHECKPOINT) {
+                read++;
+            }
+            sequence++;
+        }
+        return read;
+    }
+
+    /**
+     * Function that marks the records up to a sequence number as replayed, so they are not read again. A checkpoint is
+     * appended, if it can not be written the records are replayed again after a restart.
+     * @param sequence      sequence number of the last replayed record
+     * @return false if the checkpoint could not be written
+     */
+    bool commit(uint32_t sequence) {
+        if (partition == NULL || sequence < readSequence || sequence >= nextSequence) {
+            return false;
+        }
+        pendingRecords -= countRecords(readSequence, sequence + 1);
+        readSequence = sequence + 1;
+        return appendRecord(JOURNAL_CHECKPOINT, 0, 0.0, sequence);
+    }
+
+    /**
+     * @return number of records that are not replayed yet
+     */
+    uint32_t pending() const {
+        return pendingRecords;
+    }
+
+    /**
+     * @return number of records that were erased before they were replayed, since begin
+     */
+    uint32_t lost() const {
+        return lostRecords;
+    }
+
+    /**
+     * @return highest number of times a sector has been erased
+     */
+    uint32_t eraseCount() const {
+        return maxEraseCount;
+    }
+
+    /**
+     * Function that tells if a record was appended after begin, so its time can be compared with millis().
+     * @param record        the record
+     * @return false if the record is from before a restart
+     */
+    bool currentBoot(const JournalRecord& record) const {
+        return record.sequence >= bootSequence;
+    }
+
+private:
+    /**
+     * Function that continues a CRC-32 over more bytes. Half-programmed flash can hold any mix of the old and new bits,
+     * so 32 bits are used to make a cut off write that passes very unlikely.
+     */
+    static uint32_t crc32(uint32_t crc, const void * data, size_t length) {
+        const uint8_t * bytes = (const uint8_t *) data;
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= bytes[i];
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+
+    static uint32_t slotCrc(uint32_t sequence, const JournalSlot& slot) {
+        return crc32(crc32(0, &sequence, sizeof(sequence)), &slot, offsetof(JournalSlot, crc));
+    }
+
+    static size_t slotOffset(size_t sector, size_t slot) {
+        return sector * JOURNAL_SECTOR_SIZE + (slot + 1) * sizeof(JournalSlot);
+    }
+
+    bool readHeader(size_t sector, JournalSectorHeader& header) {
+        return esp_partition_read(partition, sector * JOURNAL_SECTOR_SIZE, &header, sizeof(header)) == ESP_OK &&
+               header.magic == JOURNAL_MAGIC && header.sequence != 0 &&
+               header.crc == crc32(0, &header, offsetof(JournalSectorHeader, crc));
+    }
+
+    /**
+     * Function that reads the record with a sequence number from its slot in a sector.
+     * @return false if the slot does not hold that record with a valid CRC
+     */
+    bool readRecord(size_t sector, uint32_t sequence, JournalRecord& record) {
+        JournalSlot slot;
+        if (esp_partition_read(partition, slotOffset(sector, sequence - sectorSequences[sector]), &slot,
+                               sizeof(slot)) != ESP_OK || slot.crc != slotCrc(sequence, slot)) {
+            return false;
+        }
+        record.sequence = sequence;
+        record.time = slot.time;
+        record.value = slot.value;
+        record.id = slot.id;
+        record.type = slot.type;
+        return true;
+    }
+
+    bool slotErased(size_t sector, size_t slot) {
+        uint8_t bytes[sizeof(JournalSlot)];
+        if (esp_partition_read(partition, slotOffset(sector, slot), bytes, sizeof(bytes)) != ESP_OK) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(bytes); i++) {
+            if (bytes[i] != 0xFF) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Function that finds the sector of a sequence number. If the record is in no sector, because its sector was
+     * erased, the sequence number is moved to the first record of the next sector.
+     * @param sequence      the sequence number, may be moved forward
+     * @param sector        is set to the sector
+     * @return false if there is no record at or after the sequence number
+     */
+    bool locate(uint32_t& sequence, size_t& sector) {
+        bool later = false;
+        for (size_t i = 0; i < sectorCount; i++) {
+            uint32_t first = sectorSequences[i];
+            if (first == 0) {
+                continue;
+            }
+            if (sequence >= first && sequence - first < JOURNAL_SLOTS) {
+                sector = i;
+                return sequence < nextSequence;
+            }
+            if (first > sequence && (!later || first < sectorSequences[sector])) {
+                sector = i;
+                later = true;
+            }
+        }
+        if (later) {
+            sequence = sectorSequences[sector];
+        }
+        return later && sequence < nextSequence;
+    }
+
+    // Number of records that are not checkpoints with sequence numbers from first to before last
+    uint32_t countRecords(uint32_t first, uint32_t last) {
+        uint32_t count = 0;
+        JournalRecord record;
+        size_t sector;
+        for (uint32_t sequence = first; sequence < last && locate(sequence, sector); sequence++) {
+            if (readRecord(sector, sequence, record) && record.type != JOURNAL_CHECKPOINT) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Function that starts appending in a sector, at nextSequence. The sector is erased if it is not erased already,
+     * and the records in it that were not replayed are counted as lost.
+     */
+    bool openSector(size_t sector) {
+        JournalSectorHeader header;
+        uint32_t eraseCount = maxEraseCount;
+        if (readHeader(sector, header)) {
+            eraseCount = header.eraseCount;
+            uint32_t end = header.sequence + JOURNAL_SLOTS;
+            if (readSequence < end) {
+                uint32_t lost = countRecords(readSequence, end);
+                pendingRecords -= lost;
+                lostRecords += lost;
+                readSequence = end;
+            }
+        }
+        sectorSequences[sector] = 0;
+
+        bool erased = true;
+        uint32_t words[64];
+        for (size_t offset = 0; offset < JOURNAL_SECTOR_SIZE && erased; offset += sizeof(words)) {
+            if (esp_partition_read(partition, sector * JOURNAL_SECTOR_SIZE + offset, words, sizeof(words)) != ESP_OK) {
+                return false;
+            }
+            for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                erased = erased && words[i] == 0xFFFFFFFF;
+            }
+        }
+        if (!erased) {
+            if (esp_partition_erase_range(partition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE) != ESP_OK) {
+                return false;
+            }
+            eraseCount++;
+        }
+
+        header.magic = JOURNAL_MAGIC;
+        header.sequence = nextSequence;
+        header.eraseCount = eraseCount;
+        header.crc = crc32(0, &header, offsetof(JournalSectorHeader, crc));
+        if (esp_partition_write(partition, sector * JOURNAL_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+            return false;
+        }
+        sectorSequences[sector] = nextSequence;
+        headSector = sector;
+        maxEraseCount = eraseCount > maxEraseCount ? eraseCount : maxEraseCount;
+        return true;
+    }
+
+    bool appendRecord(uint8_t type, uint16_t id, float value, uint32_t time) {
+        if (partition == NULL) {
+            return false;
+        }
+        if (nextSequence - sectorSequences[headSector] >= JOURNAL_SLOTS &&
+            !openSector((headSector + 1) % sectorCount)) {
+            return false;
+        }
+        JournalSlot slot;
+        slot.time = time;
+        slot.value = value;
+        slot.id = id;
+        slot.type = type;
+        slot.reserved = 0xFF;
+        slot.crc = slotCrc(nextSequence, slot);
+        // The slot is used also if the write fails, as it may be partly written
+        size_t offset = slotOffset(headSector, nextSequence - sectorSequences[headSector]);
+        nextSequence++;
+        return esp_partition_write(partition, offset, &slot, sizeof(slot)) == ESP_OK;
+    }
+
+    const esp_partition_t * partition;
+    size_t sectorCount;
+    uint32_t sectorSequences[JOURNAL_MAX_SECTORS]; // Sequence number of the first slot of each sector, 0 if not in use
+    size_t headSector;        // Sector records are appended to
+    uint32_t nextSequence;    // Sequence number of the next record
+    uint32_t readSequence;    // Sequence number of the oldest record that is not replayed
+    uint32_t bootSequence;    // Sequence number of the first record appended since begin
+    uint32_t pendingRecords;
+    uint32_t lostRecords;
+    uint32_t maxEraseCount;
+};
+
+#endif
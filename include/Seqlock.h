@@ -0,0 +1,85 @@
+/***********************************************************************************************************************
+ * SEQLOCK
+ * SHARES THE LATEST VALUE OF A STRUCT WRITTEN BY ONE TASK WITH TASKS ON THE OTHER CORE, WITHOUT LOCKS
+ ***********************************************************************************************************************/
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Holds a value of type T that one task writes and other tasks read. The writer never waits, a reader that is
+ * interrupted by a write copies the value again, so it always gets a whole value and never parts of two writes. The
+ * sequence number is odd while a write is in progress, and counts up by two for each write. The value is stored as
+ * atomic words, so the copying is not a data race. The words are written with release and read with acquire instead of
+ * using fences, so ThreadSanitizer can check the order.
+ * @tparam T        type of the value, has to be trivially copyable
+ */
+template <typename T>
+class Seqlock {
+public:
+    Seqlock() : sequenceNumber(0) {
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Function that stores a new value. Only one task can write.
+     * @param value     the new value
+     */
+    void write(const T& value) {
+        uint32_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint32_t sequence = sequenceNumber.load(std::memory_order_relaxed);
+        sequenceNumber.store(sequence + 1, std::memory_order_relaxed);
+        // A reader that gets a word of this write also sees the odd sequence number from before it
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(buffer[i], std::memory_order_release);
+        }
+        sequenceNumber.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * Function that copies the latest value.
+     * @param value     where the value is copied to
+     * @return the sequence number of the value, changes for every write
+     */
+    uint32_t read(T& value) const {
+        uint32_t buffer[WORDS];
+        uint32_t before;
+        uint32_t after;
+        do {
+            before = sequenceNumber.load(std::memory_order_acquire);
+            // The sequence number is read again after the words
+            for (size_t i = 0; i < WORDS; i++) {
+                buffer[i] = words[i].load(std::memory_order_acquire);
+            }
+            after = sequenceNumber.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+
+        memcpy(&value, buffer, sizeof(T));
+        return before;
+    }
+
+    /**
+     * Function that returns the sequence number of the latest value, so a reader can check if there is a new value
+     * without copying it.
+     * @return the sequence number
+     */
+    uint32_t sequence() const {
+        return sequenceNumber.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> sequenceNumber;
+    std::atomic<uint32_t> words[WORDS];
+};
+
+#endif
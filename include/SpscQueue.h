@@ -0,0 +1,70 @@
+/***********************************************************************************************************************
+ * SINGLE PRODUCER / SINGLE CONSUMER QUEUE
+ * LOCK-FREE QUEUE FOR PASSING MESSAGES FROM ONE TASK TO ANOTHER, LIKE FROM THE CONTROL CORE TO THE NETWORK CORE
+ ***********************************************************************************************************************/
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Queue with room for N items, where one task adds items and one other task takes them out, without locks. The items
+ * are written and read in place: the producer gets a free slot with beginPush, fills it and adds it with commitPush,
+ * and the consumer gets the oldest item with peek and frees it with pop when it is done with it.
+ * @tparam T        type of the items
+ * @tparam N        number of items, has to be a power of two
+ */
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "The size of the queue has to be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    /**
+     * Function that returns the free slot for the next item. Only used by the producer.
+     * @return the slot, or NULL if the queue is full
+     */
+    T * beginPush() {
+        uint32_t write = tail.load(std::memory_order_relaxed);
+        if (write - head.load(std::memory_order_acquire) >= N) {
+            return NULL;
+        }
+        return &items[write & (N - 1)];
+    }
+
+    /**
+     * Function that adds the item written to the slot from beginPush to the queue. Only used by the producer.
+     */
+    void commitPush() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Function that returns the oldest item without taking it out of the queue. Only used by the consumer.
+     * @return the item, or NULL if the queue is empty
+     */
+    T * peek() {
+        uint32_t read = head.load(std::memory_order_relaxed);
+        if (read == tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &items[read & (N - 1)];
+    }
+
+    /**
+     * Function that takes the item from peek out of the queue, so the slot can be used again. Only used by the consumer.
+     */
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    T items[N];
+    std::atomic<uint32_t> head;   // Number of items taken out, only changed by the consumer
+    std::atomic<uint32_t> tail;   // Number of items added, only changed by the producer
+};
+
+#endif
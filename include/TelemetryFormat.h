@@ -0,0 +1,86 @@
+/***********************************************************************************************************************
+ * BINARY TELEMETRY FORMAT
+ * THE COMPACT FORMAT OF EVENT "SENSORDATABINARY", DECODED BY DECODETELEMETRY IN SERVER_NO_ENCRYPT.JS
+ ***********************************************************************************************************************/
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Kinds of data sent to the server with event "sensorData", the values are also used in the binary format
+enum DataType : uint8_t {
+    DATA_SENSOR_VALUE,
+    DATA_OUTPUT_STATE,
+    DATA_OUTPUT_LEVEL
+};
+
+// Version of the format, the first byte of the header
+const uint8_t TELEMETRY_FORMAT_VERSION = 1;
+
+// Sizes in bytes of the binary telemetry format
+const size_t TELEMETRY_HEADER_SIZE = 6;
+const size_t TELEMETRY_RECORD_SIZE = 7;
+
+/**
+ * Function that writes a 16 bit number to a buffer, least significant byte first.
+ * @param buffer           where the number is written
+ * @param value            the number
+ */
+inline void writeUint16 (uint8_t * buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+/**
+ * Function that writes the header of the binary telemetry format. The format is little endian, and starts with a
+ * header of version (uint8, TELEMETRY_FORMAT_VERSION), number of records (uint8) and the millis() of the first record
+ * (uint32).
+ * @param header           where the TELEMETRY_HEADER_SIZE bytes of the header are written
+ * @param count            number of records after the header
+ * @param time             millis() when the first record was made
+ */
+inline void encodeTelemetryHeader (uint8_t * header, uint8_t count, uint32_t time) {
+    header[0] = TELEMETRY_FORMAT_VERSION;
+    header[1] = count;
+    writeUint16(&header[2], time & 0xFFFF);
+    writeUint16(&header[4], time >> 16);
+}
+
+/**
+ * Function that writes one record of the binary telemetry format. Each record is the ID of the sensor / actuator
+ * (uint16), the type of data (uint8, DataType), the time in ms since the first record (uint16) and the value (int16).
+ * Sensor values are sent in tenths, output states as 0 / 1, and output levels in thousandths. Values that do not fit
+ * are sent as the largest or smallest int16, and NaN as the smallest.
+ * @param record           where the TELEMETRY_RECORD_SIZE bytes of the record are written
+ * @param typeOfData       the type of data
+ * @param idKey            name of the sensor / actuator ID, a number
+ * @param delta            the time in ms since the first record of the batch
+ * @param value            the sensor value, output state or output level
+ */
+inline void encodeTelemetryRecord (uint8_t * record, DataType typeOfData, const char * idKey, uint16_t delta,
+                                   float value) {
+    float scale = 1.0;
+    if (typeOfData == DATA_SENSOR_VALUE) {
+        scale = 10.0;
+    } else if (typeOfData == DATA_OUTPUT_LEVEL) {
+        scale = 1000.0;
+    }
+    // Limited before it is converted, as a float outside the range of the integer is undefined, also for lroundf
+    float scaled = roundf(value * scale);
+    int16_t number = 32767;
+    if (!(scaled > -32768.0f)) {
+        number = -32768;
+    } else if (scaled < 32767.0f) {
+        number = (int16_t) scaled;
+    }
+
+    writeUint16(&record[0], (uint16_t) strtoul(idKey, NULL, 10));
+    record[2] = typeOfData;
+    writeUint16(&record[3], delta);
+    writeUint16(&record[5], (uint16_t) number);
+}
+
+#endif
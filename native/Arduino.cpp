@@ -0,0 +1,351 @@
+/***********************************************************************************************************************
+ * ARDUINO SHIM FOR THE NATIVE BUILD
+ ***********************************************************************************************************************/
+#include "Arduino.h"
+#include "Simulation.h"
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+/// Time ///
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+
+// Set by nativeClockStop, the time is then stoppedMicros
+static std::atomic<bool> clockStopped(false);
+static std::atomic<unsigned long> stoppedMicros(0);
+
+// Added to millis() by nativeClockSetOffset
+static std::atomic<uint32_t> millisOffset(0);
+
+unsigned long millis() {
+    // Wraps around after 49.7 days as on the ESP32, where unsigned long is 32 bits
+    return (uint32_t) (micros() / 1000 + millisOffset);
+}
+
+unsigned long micros() {
+    if (clockStopped) {
+        return stoppedMicros;
+    }
+    return (unsigned long) std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - START).count();
+}
+
+void delay(unsigned long ms) {
+    if (clockStopped) {
+        nativeClockAdvance(ms * 1000);
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    if (clockStopped) {
+        nativeClockAdvance(us);
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void nativeClockStop() {
+    stoppedMicros = micros();
+    clockStopped = true;
+}
+
+void nativeClockAdvance(unsigned long us) {
+    stoppedMicros += us;
+}
+
+void nativeClockSetOffset(uint32_t ms) {
+    millisOffset = ms;
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+/// Random numbers ///
+long random(long max) {
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    srand(seed);
+}
+
+/// Pins ///
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void) pin;
+    (void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    simulationSetOutput(pin, value ? 1.0 : 0.0);
+}
+
+int digitalRead(uint8_t pin) {
+    return simulationOutput(pin) >= 0.5 ? HIGH : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+    return simulationReadInput(pin);
+}
+
+/// String ///
+String::String(float value, unsigned int decimals) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int) decimals, value);
+    text = buffer;
+}
+
+String::String(double value, unsigned int decimals) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int) decimals, value);
+    text = buffer;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+    if (text.size() != other.text.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < text.size(); i++) {
+        if (tolower((unsigned char) text[i]) != tolower((unsigned char) other.text[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return text.size() >= suffix.text.size() &&
+           text.compare(text.size() - suffix.text.size(), suffix.text.size(), suffix.text) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t position = text.find(c, from);
+    return position == std::string::npos ? -1 : (int) position;
+}
+
+int String::indexOf(const String& other, unsigned int from) const {
+    size_t position = text.find(other.text, from);
+    return position == std::string::npos ? -1 : (int) position;
+}
+
+int String::lastIndexOf(char c) const {
+    size_t position = text.rfind(c);
+    return position == std::string::npos ? -1 : (int) position;
+}
+
+String String::substring(unsigned int from) const {
+    return from < text.size() ? String(text.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        std::swap(from, to);
+    }
+    if (from >= text.size()) {
+        return String();
+    }
+    return String(text.substr(from, to - from));
+}
+
+void String::trim() {
+    size_t start = 0;
+    size_t end = text.size();
+    while (start < end && isspace((unsigned char) text[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char) text[end - 1])) {
+        end--;
+    }
+    text = text.substr(start, end - start);
+}
+
+void String::toLowerCase() {
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = tolower((unsigned char) text[i]);
+    }
+}
+
+void String::toUpperCase() {
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = toupper((unsigned char) text[i]);
+    }
+}
+
+void String::replace(const String& find, const String& replacement) {
+    if (find.text.empty()) {
+        return;
+    }
+    size_t position = 0;
+    while ((position = text.find(find.text, position)) != std::string::npos) {
+        text.replace(position, find.text.size(), replacement.text);
+        position += replacement.text.size();
+    }
+}
+
+void String::remove(unsigned int index) {
+    if (index < text.size()) {
+        text.erase(index);
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index < text.size()) {
+        text.erase(index, count);
+    }
+}
+
+void String::toCharArray(char * buffer, unsigned int size, unsigned int index) const {
+    getBytes((unsigned char *) buffer, size, index);
+}
+
+void String::getBytes(unsigned char * buffer, unsigned int size, unsigned int index) const {
+    if (size == 0) {
+        return;
+    }
+    size_t length = index < text.size() ? std::min<size_t>(size - 1, text.size() - index) : 0;
+    memcpy(buffer, text.data() + std::min<size_t>(index, text.size()), length);
+    buffer[length] = '\0';
+}
+
+String operator+(const String& left, const String& right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, const char * right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const char * left, const String& right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, char right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, int right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, unsigned int right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, long right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String operator+(const String& left, unsigned long right) {
+    String result(left);
+    result += right;
+    return result;
+}
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buffer);
+}
+
+/// Serial ///
+size_t HardwareSerial::printf(const char * format, ...) {
+    if (ended) {
+        return 0;
+    }
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vprintf(format, arguments);
+    va_end(arguments);
+    return length > 0 ? length : 0;
+}
+
+size_t HardwareSerial::print(const String& text) {
+    return print(text.c_str());
+}
+
+size_t HardwareSerial::print(const char * text) {
+    if (ended) {
+        return 0;
+    }
+    return fputs(text, stdout) >= 0 ? strlen(text) : 0;
+}
+
+size_t HardwareSerial::print(char c) {
+    if (ended) {
+        return 0;
+    }
+    return fputc(c, stdout) != EOF ? 1 : 0;
+}
+
+size_t HardwareSerial::print(int value) {
+    return printf("%d", value);
+}
+
+size_t HardwareSerial::print(unsigned int value) {
+    return printf("%u", value);
+}
+
+size_t HardwareSerial::print(long value) {
+    return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value) {
+    return printf("%lu", value);
+}
+
+size_t HardwareSerial::print(double value, int decimals) {
+    return printf("%.*f", decimals, value);
+}
+
+size_t HardwareSerial::print(const IPAddress& address) {
+    return print(address.toString());
+}
+
+size_t HardwareSerial::println() {
+    return print("\r\n");
+}
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+}
+
+/// FreeRTOS ///
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stackSize, void * parameter,
+                                   UBaseType_t priority, TaskHandle_t * handle, BaseType_t core) {
+    (void) name;
+    (void) stackSize;
+    (void) priority;
+    (void) core;
+    std::thread(function, parameter).detach();
+    if (handle != NULL) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
@@ -0,0 +1,198 @@
+/***********************************************************************************************************************
+ * ARDUINO SHIM FOR THE NATIVE BUILD
+ * THE PARTS OF THE ARDUINO-ESP32 CORE USED BY THE ROBOT CLIENT AND THE SOCKET.IO LIBRARY, IMPLEMENTED FOR LINUX SO THE
+ * PROGRAM CAN BE PROFILED, FUZZED AND BENCHMARKED ON A PC
+ ***********************************************************************************************************************/
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <functional>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x01
+#define OUTPUT 0x02
+
+#define bit(b) (1UL << (b))
+#define F(string) (string)
+
+using std::min;
+using std::max;
+using std::isnan;
+using std::isinf;
+using std::round;
+
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+/// Time ///
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+/**
+ * Function that stops the clock of millis() and micros() for the tests. From then on the time only moves with
+ * nativeClockAdvance, delay and delayMicroseconds, which return at once, so a test can run hours of the simulated room
+ * in seconds.
+ */
+void nativeClockStop();
+
+/**
+ * Function that moves the stopped clock forward.
+ * @param us            time in microseconds
+ */
+void nativeClockAdvance(unsigned long us);
+
+/**
+ * Function that moves millis() by an offset, so a test can start the robot just before millis() wraps around. The
+ * offset is not added to micros().
+ * @param ms            offset in milliseconds
+ */
+void nativeClockSetOffset(uint32_t ms);
+
+/// Random numbers ///
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+/// Pins, see Simulation.h for how the values of the inputs are made ///
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+/**
+ * The Arduino String, kept as a std::string. Only the functions used by the client and the library are here.
+ */
+class String {
+public:
+    String() {}
+    String(const char * text) : text(text ? text : "") {}
+    String(const std::string& text) : text(text) {}
+    explicit String(char c) : text(1, c) {}
+    explicit String(int value) : text(std::to_string(value)) {}
+    explicit String(unsigned int value) : text(std::to_string(value)) {}
+    explicit String(long value) : text(std::to_string(value)) {}
+    explicit String(unsigned long value) : text(std::to_string(value)) {}
+    explicit String(float value, unsigned int decimals = 2);
+    explicit String(double value, unsigned int decimals = 2);
+
+    const char * c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.size(); }
+    bool reserve(unsigned int size) { text.reserve(size); return true; }
+    explicit operator bool() const { return !text.empty(); }
+
+    char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+    char& operator[](unsigned int index) { return text[index]; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    String& operator+=(const char * other) { text += other ? other : ""; return *this; }
+    String& operator+=(char c) { text += c; return *this; }
+    String& operator+=(int value) { text += std::to_string(value); return *this; }
+    String& operator+=(unsigned int value) { text += std::to_string(value); return *this; }
+    String& operator+=(long value) { text += std::to_string(value); return *this; }
+    String& operator+=(unsigned long value) { text += std::to_string(value); return *this; }
+    bool concat(const String& other) { text += other.text; return true; }
+    bool concat(const char * other) { text += other ? other : ""; return true; }
+    bool concat(char c) { text += c; return true; }
+
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator==(const char * other) const { return text == (other ? other : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char * other) const { return !(*this == other); }
+    bool equals(const String& other) const { return *this == other; }
+    bool equalsIgnoreCase(const String& other) const;
+    bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+    bool endsWith(const String& suffix) const;
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& other, unsigned int from = 0) const;
+    int lastIndexOf(char c) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    void replace(const String& find, const String& replacement);
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    long toInt() const { return atol(text.c_str()); }
+    float toFloat() const { return atof(text.c_str()); }
+    void toCharArray(char * buffer, unsigned int size, unsigned int index = 0) const;
+    void getBytes(unsigned char * buffer, unsigned int size, unsigned int index = 0) const;
+
+private:
+    std::string text;
+};
+
+String operator+(const String& left, const String& right);
+String operator+(const String& left, const char * right);
+String operator+(const char * left, const String& right);
+String operator+(const String& left, char right);
+String operator+(const String& left, int right);
+String operator+(const String& left, unsigned int right);
+String operator+(const String& left, long right);
+String operator+(const String& left, unsigned long right);
+
+#include "IPAddress.h"
+
+/**
+ * The serial port, written to stdout.
+ */
+class HardwareSerial {
+public:
+    HardwareSerial() : ended(false) {}
+    void begin(unsigned long baud) { (void) baud; ended = false; }
+    // Stops the output until begin is called, used by the tests that run hours of the program
+    void end() { ended = true; }
+    size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const String& text);
+    size_t print(const char * text);
+    size_t print(char c);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value, int decimals = 2);
+    size_t print(const IPAddress& address);
+    size_t println();
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+    size_t println(double value, int decimals) { return print(value, decimals) + println(); }
+    void flush();
+
+private:
+    bool ended;
+};
+
+extern HardwareSerial Serial;
+
+/// FreeRTOS, the tasks run as threads ///
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void * TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdPASS (1)
+#define pdFAIL (0)
+#define portTICK_PERIOD_MS (1)
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stackSize, void * parameter,
+                                   UBaseType_t priority, TaskHandle_t * handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+
+#endif
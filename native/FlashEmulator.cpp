@@ -0,0 +1,149 @@
+/***********************************************************************************************************************
+ * FLASH EMULATOR FOR THE NATIVE BUILD
+ ***********************************************************************************************************************/
+#include "FlashEmulator.h"
+#include "esp_partition.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+static int flashFd = -1;
+static esp_partition_t flashPartition;
+static long powerCutBytes = -1;       // Bytes left before the power is cut, -1 for never
+static bool poweredOff = false;
+static std::vector<uint32_t> eraseCounts;
+
+bool flashEmulatorOpen(const char * path, const char * label, uint32_t size) {
+    flashEmulatorClose();
+    if (size == 0 || size % FLASH_EMULATOR_SECTOR_SIZE != 0) {
+        return false;
+    }
+    flashFd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat status;
+    if (flashFd < 0 || fstat(flashFd, &status) != 0) {
+        flashEmulatorClose();
+        return false;
+    }
+    if ((uint32_t) status.st_size != size) {
+        std::vector<uint8_t> erased(size, 0xFF);
+        if (ftruncate(flashFd, 0) != 0 || pwrite(flashFd, erased.data(), size, 0) != (ssize_t) size) {
+            flashEmulatorClose();
+            return false;
+        }
+    }
+    memset(&flashPartition, 0, sizeof(flashPartition));
+    flashPartition.type = ESP_PARTITION_TYPE_DATA;
+    flashPartition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    flashPartition.size = size;
+    strncpy(flashPartition.label, label, sizeof(flashPartition.label) - 1);
+    eraseCounts.assign(size / FLASH_EMULATOR_SECTOR_SIZE, 0);
+    powerCutBytes = -1;
+    poweredOff = false;
+    return true;
+}
+
+void flashEmulatorClose() {
+    if (flashFd >= 0) {
+        close(flashFd);
+    }
+    flashFd = -1;
+}
+
+void flashEmulatorPowerCut(long bytes) {
+    powerCutBytes = bytes;
+    poweredOff = false;
+}
+
+bool flashEmulatorPoweredOff() {
+    return poweredOff;
+}
+
+uint32_t flashEmulatorEraseCount(uint32_t sector) {
+    return sector < eraseCounts.size() ? eraseCounts[sector] : 0;
+}
+
+/**
+ * Function that counts down the bytes before the power cut.
+ * @param size          bytes the write or erase wants to change
+ * @return bytes that are changed before the power is cut
+ */
+static size_t powerLeft(size_t size) {
+    if (powerCutBytes < 0) {
+        return size;
+    }
+    if ((size_t) powerCutBytes >= size) {
+        powerCutBytes -= size;
+        return size;
+    }
+    size = powerCutBytes;
+    powerCutBytes = 0;
+    poweredOff = true;
+    return size;
+}
+
+static bool validRange(const esp_partition_t * partition, size_t offset, size_t size) {
+    return flashFd >= 0 && partition == &flashPartition && !poweredOff && offset <= flashPartition.size &&
+           size <= flashPartition.size - offset;
+}
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                 const char * label) {
+    if (flashFd < 0 || type != ESP_PARTITION_TYPE_DATA ||
+        (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != flashPartition.subtype) ||
+        (label != NULL && strcmp(label, flashPartition.label) != 0)) {
+        return NULL;
+    }
+    return &flashPartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t * partition, size_t offset, void * destination, size_t size) {
+    if (!validRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return pread(flashFd, destination, size, offset) == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t * partition, size_t offset, const void * source, size_t size) {
+    if (!validRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // A write can only clear bits, the flash keeps the bits that are already cleared
+    std::vector<uint8_t> data(size);
+    if (pread(flashFd, data.data(), size, offset) != (ssize_t) size) {
+        return ESP_FAIL;
+    }
+    size_t written = powerLeft(size);
+    for (size_t i = 0; i < written; i++) {
+        data[i] &= ((const uint8_t *) source)[i];
+    }
+    if (written < size) {
+        // The byte being written when the power is cut only gets some of its bits cleared
+        data[written] &= ((const uint8_t *) source)[written] | 0x0F;
+        written++;
+    }
+    if (pwrite(flashFd, data.data(), written, offset) != (ssize_t) written) {
+        return ESP_FAIL;
+    }
+    return !poweredOff ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t * partition, size_t offset, size_t size) {
+    if (!validRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset % FLASH_EMULATOR_SECTOR_SIZE != 0 || size % FLASH_EMULATOR_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t sector = offset / FLASH_EMULATOR_SECTOR_SIZE; sector < (offset + size) / FLASH_EMULATOR_SECTOR_SIZE;
+         sector++) {
+        eraseCounts[sector]++;
+    }
+    size_t erased = powerLeft(size);
+    std::vector<uint8_t> data(erased, 0xFF);
+    if (pwrite(flashFd, data.data(), erased, offset) != (ssize_t) erased) {
+        return ESP_FAIL;
+    }
+    return erased == size ? ESP_OK : ESP_FAIL;
+}
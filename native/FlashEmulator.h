@@ -0,0 +1,48 @@
+/***********************************************************************************************************************
+ * FLASH EMULATOR FOR THE NATIVE BUILD
+ * ONE DATA PARTITION KEPT IN A FILE, WITH THE RULES OF NOR FLASH AND POWER LOSS AT A CHOSEN POINT FOR CRASH TESTS
+ ***********************************************************************************************************************/
+#ifndef NATIVE_FLASH_EMULATOR_H
+#define NATIVE_FLASH_EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size in bytes of the sectors that are erased
+const uint32_t FLASH_EMULATOR_SECTOR_SIZE = 4096;
+
+/**
+ * Function that opens the file as the data partition with the label, found with esp_partition_find_first. A file that
+ * does not exist, or has another size, is made as erased flash. As on the ESP32 an erase sets every bit of a sector,
+ * and a write can only clear bits.
+ * @param path          the file
+ * @param label         label of the partition
+ * @param size          size of the partition in bytes, a multiple of FLASH_EMULATOR_SECTOR_SIZE
+ * @return false if the file could not be opened
+ */
+bool flashEmulatorOpen(const char * path, const char * label, uint32_t size);
+
+/**
+ * Function that closes the file, the partition is no longer found.
+ */
+void flashEmulatorClose();
+
+/**
+ * Function that cuts the power after a number of bytes have been written or erased from now. The write or erase that
+ * is going on is left partly done, and every later read, write and erase fails until the power is turned on again.
+ * @param bytes         bytes that are written or erased before the power is cut, -1 to turn the power on
+ */
+void flashEmulatorPowerCut(long bytes);
+
+/**
+ * @return true if the power has been cut
+ */
+bool flashEmulatorPoweredOff();
+
+/**
+ * @param sector        number of the sector in the partition
+ * @return number of times the sector has been erased since the file was opened
+ */
+uint32_t flashEmulatorEraseCount(uint32_t sector);
+
+#endif
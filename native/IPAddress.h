@@ -0,0 +1,26 @@
+/***********************************************************************************************************************
+ * IPADDRESS SHIM FOR THE NATIVE BUILD
+ ***********************************************************************************************************************/
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include <stdint.h>
+
+class String;
+
+/**
+ * An IPv4 address, stored as four bytes in the order they are written.
+ */
+class IPAddress {
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth) : bytes{first, second, third, fourth} {}
+
+    uint8_t operator[](int index) const { return bytes[index]; }
+    String toString() const;
+
+private:
+    uint8_t bytes[4];
+};
+
+#endif
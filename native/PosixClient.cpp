@@ -0,0 +1,174 @@
+/***********************************************************************************************************************
+ * POSIX TCP CLIENT FOR THE NATIVE BUILD
+ ***********************************************************************************************************************/
+#include "PosixClient.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+PosixClient::PosixClient() : socketFd(-1), timeout(1000), writes(0) {}
+
+PosixClient::~PosixClient() {
+    stop();
+}
+
+/**
+ * Function that waits until the socket is ready or the time is up.
+ * @param socketFd      the socket
+ * @param events        POLLIN and/or POLLOUT
+ * @param timeout       milliseconds to wait
+ * @return true if the socket is ready
+ */
+static bool waitForSocket(int socketFd, short events, unsigned long timeout) {
+    struct pollfd descriptor = {socketFd, events, 0};
+    return poll(&descriptor, 1, (int) timeout) > 0 && (descriptor.revents & (events | POLLERR | POLLHUP));
+}
+
+/**
+ * Function that connects to the server. Every address of the host is tried until one answers within
+ * POSIX_CONNECT_TIMEOUT.
+ * @param host          name or address of the server
+ * @param port          port of the server
+ * @return 1 if connected, 0 if not
+ */
+int PosixClient::connect(const char * host, uint16_t port) {
+    stop();
+    writes = 0;
+
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo * addresses = NULL;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return 0;
+    }
+
+    for (struct addrinfo * address = addresses; address != NULL && socketFd < 0; address = address->ai_next) {
+        int candidate = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (candidate < 0) {
+            continue;
+        }
+        fcntl(candidate, F_SETFL, fcntl(candidate, F_GETFL, 0) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(candidate, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        bool ok = ::connect(candidate, address->ai_addr, address->ai_addrlen) == 0;
+        if (!ok && errno == EINPROGRESS && waitForSocket(candidate, POLLOUT, POSIX_CONNECT_TIMEOUT)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            ok = getsockopt(candidate, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+        }
+        if (ok) {
+            socketFd = candidate;
+        } else {
+            close(candidate);
+        }
+    }
+    freeaddrinfo(addresses);
+    return socketFd >= 0 ? 1 : 0;
+}
+
+/**
+ * Function that checks if the connection is open. A socket that is readable with nothing to read has been closed by
+ * the server.
+ * @return 1 if connected, 0 if not
+ */
+uint8_t PosixClient::connected() {
+    if (socketFd < 0) {
+        return 0;
+    }
+    char c;
+    ssize_t length = recv(socketFd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+int PosixClient::available() {
+    int length = 0;
+    if (socketFd < 0 || ioctl(socketFd, FIONREAD, &length) < 0) {
+        return 0;
+    }
+    return length;
+}
+
+int PosixClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int PosixClient::read(uint8_t * buffer, size_t size) {
+    if (socketFd < 0) {
+        return -1;
+    }
+    ssize_t length = recv(socketFd, buffer, size, MSG_DONTWAIT);
+    if (length == 0) {
+        stop();
+        return -1;
+    }
+    return length < 0 ? -1 : (int) length;
+}
+
+/**
+ * Function that sends the whole buffer. If the send buffer of the socket stays full for longer than the timeout the
+ * connection is closed, as the WiFiClient of the ESP32 does.
+ * @param buffer        data to send
+ * @param size          number of bytes
+ * @return number of bytes sent
+ */
+size_t PosixClient::write(const uint8_t * buffer, size_t size) {
+    writes++;
+    size_t sent = 0;
+    while (socketFd >= 0 && sent < size) {
+        ssize_t length = send(socketFd, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (length > 0) {
+            sent += length;
+        } else if (length < 0 && errno == EINTR) {
+            continue;
+        } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitForSocket(socketFd, POLLOUT, timeout)) {
+            continue;
+        } else {
+            stop();
+        }
+    }
+    return sent;
+}
+
+void PosixClient::flush() {
+    // Writes are not buffered
+}
+
+void PosixClient::stop() {
+    if (socketFd >= 0) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+void PosixClient::setTimeout(unsigned long timeout) {
+    this->timeout = timeout;
+}
+
+void PosixClient::setNoDelay(bool noDelay) {
+    int value = noDelay ? 1 : 0;
+    if (socketFd >= 0) {
+        setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+    }
+}
@@ -0,0 +1,46 @@
+/***********************************************************************************************************************
+ * POSIX TCP CLIENT FOR THE NATIVE BUILD
+ * THE NETWORK CLASS OF THE WEBSOCKETS LIBRARY ON LINUX, WITH THE SAME FUNCTIONS AS THE WIFICLIENT OF THE ESP32
+ ***********************************************************************************************************************/
+#ifndef NATIVE_POSIXCLIENT_H
+#define NATIVE_POSIXCLIENT_H
+
+#include "Arduino.h"
+
+// Time in milliseconds a connect may take before it fails
+const unsigned long POSIX_CONNECT_TIMEOUT = 5000;
+
+/**
+ * A TCP connection on a non-blocking socket. Reads return what has arrived, writes wait until everything is sent.
+ */
+class PosixClient {
+public:
+    PosixClient();
+    ~PosixClient();
+
+    int connect(const char * host, uint16_t port);
+    uint8_t connected();
+    int available();
+    int read();
+    int read(uint8_t * buffer, size_t size);
+    size_t write(const uint8_t * buffer, size_t size);
+    void flush();
+    void stop();
+    void setTimeout(unsigned long timeout);
+    void setNoDelay(bool noDelay);
+
+    /**
+     * @return number of calls of write since the connection was made, so the tests can count the writes of a request
+     */
+    uint32_t writeCount() const { return writes; }
+
+private:
+    PosixClient(const PosixClient&);
+    PosixClient& operator=(const PosixClient&);
+
+    int socketFd;
+    unsigned long timeout;      // Milliseconds a write may wait for room in the send buffer
+    uint32_t writes;            // Calls of write since connect
+};
+
+#endif
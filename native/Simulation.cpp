@@ -0,0 +1,85 @@
+/***********************************************************************************************************************
+ * SIMULATED ROOM FOR THE NATIVE BUILD
+ ***********************************************************************************************************************/
+#include "Simulation.h"
+#include "Arduino.h"
+
+static SimulatedInput inputs[SIMULATION_PINS];
+static bool inputUsed[SIMULATION_PINS];
+static float outputLevels[SIMULATION_PINS];
+static uint32_t lastUpdate = 0;
+static uint8_t internalTemperature = 122;
+
+void simulationAddInput(const SimulatedInput& input) {
+    if (input.inputPin < SIMULATION_PINS) {
+        inputs[input.inputPin] = input;
+        inputUsed[input.inputPin] = true;
+    }
+}
+
+void simulationSetInternalTemperature(uint8_t fahrenheit) {
+    internalTemperature = fahrenheit;
+}
+
+void simulationSetOutput(uint8_t pin, float level) {
+    if (pin < SIMULATION_PINS) {
+        outputLevels[pin] = constrain(level, 0.0f, 1.0f);
+    }
+}
+
+float simulationOutput(uint8_t pin) {
+    return pin < SIMULATION_PINS ? outputLevels[pin] : 0.0;
+}
+
+/**
+ * Function that moves every input forward in time. Each input moves towards its ambient value, and is changed by its
+ * output with the rate at the current level of the output.
+ * @param seconds       time since the last update
+ */
+static void simulationStep(float seconds) {
+    for (uint8_t pin = 0; pin < SIMULATION_PINS; pin++) {
+        if (!inputUsed[pin]) {
+            continue;
+        }
+        SimulatedInput& input = inputs[pin];
+        float change = 0.0;
+        if (input.timeConstant > 0) {
+            change += (input.ambient - input.value) / input.timeConstant;
+        }
+        if (input.outputPin >= 0) {
+            change += input.outputRate * simulationOutput(input.outputPin);
+        }
+        input.value = constrain(input.value + change * seconds, 0.0f, 4095.0f);
+    }
+}
+
+void simulationSetupRoom() {
+    SimulatedInput temperature = {35, TEMPERATURE_COUNTS(18.0), TEMPERATURE_COUNTS(15.0), 1800.0, 4,
+                                  TEMPERATURE_COUNTS(3.0) / 60.0, 2.0};
+    SimulatedInput co2 = {34, CO2_COUNTS(900.0), CO2_COUNTS(1200.0), 1800.0, 5, -CO2_COUNTS(20.0), 4.0};
+    simulationAddInput(temperature);
+    simulationAddInput(co2);
+    simulationSetInternalTemperature(122);
+    for (uint8_t pin = 0; pin < SIMULATION_PINS; pin++) {
+        outputLevels[pin] = 0.0;
+    }
+    lastUpdate = millis();
+}
+
+uint16_t simulationReadInput(uint8_t pin) {
+    if (pin >= SIMULATION_PINS || !inputUsed[pin]) {
+        return 0;
+    }
+    uint32_t now = millis();
+    if (now != lastUpdate) {
+        simulationStep((now - lastUpdate) / 1000.0);
+        lastUpdate = now;
+    }
+    const SimulatedInput& input = inputs[pin];
+    float noise = input.noise > 0 ? input.noise * (random(2001) - 1000) / 1000.0 : 0.0;
+    return (uint16_t) constrain(input.value + noise + 0.5f, 0.0f, 4095.0f);
+}
+
+extern "C" uint8_t temprature_sens_read() {
+    return internalTemperature;
+}
@@ -0,0 +1,68 @@
+/***********************************************************************************************************************
+ * SIMULATED ROOM FOR THE NATIVE BUILD
+ * GIVES THE ANALOG INPUTS VALUES THAT CHANGE WITH THE OUTPUTS, SO THE REGULATION CAN RUN WITHOUT A BOARD
+ ***********************************************************************************************************************/
+#ifndef NATIVE_SIMULATION_H
+#define NATIVE_SIMULATION_H
+
+#include <stdint.h>
+
+// Number of pins of the ESP32
+const uint8_t SIMULATION_PINS = 40;
+
+// Describes how the value of an analog input changes, all values are in ADC counts (0 - 4095)
+struct SimulatedInput {
+    uint8_t inputPin;         // The analog input
+    float value;              // Value at start
+    float ambient;            // Value the input moves towards when the output is off
+    float timeConstant;       // Time in seconds the input takes to move 63 % of the way towards ambient
+    int8_t outputPin;         // The output that changes the input, -1 for none
+    float outputRate;         // Change in counts per second with the output fully on, negative to lower the value
+    float noise;              // Largest random change of each reading
+};
+
+// Analog counts of a temperature in Celsius and a CO2 level in ppm, with the scales of the channel table in src/main.cpp
+#define TEMPERATURE_COUNTS(celsius) ((celsius) / 70.0 * 4095.0)
+#define CO2_COUNTS(ppm) ((ppm) / 2000.0 * 4095.0)
+
+/**
+ * Function that sets up the room of the robot client. The heater on pin 4 warms the temperature sensor on pin 35, the
+ * room cools towards 15 C. The people in the room raise the CO2 level on pin 34 towards 1200 ppm, the ventilation on
+ * pin 5 lowers it. Every output is turned off, so the room can be set up again between the runs of a test.
+ */
+void simulationSetupRoom();
+
+/**
+ * Function that adds an analog input to the simulation. Inputs that are not added read 0.
+ * @param input         how the input changes
+ */
+void simulationAddInput(const SimulatedInput& input);
+
+/**
+ * Function that sets the value returned by temprature_sens_read, the internal temperature sensor of the ESP32.
+ * @param fahrenheit    the temperature in Fahrenheit
+ */
+void simulationSetInternalTemperature(uint8_t fahrenheit);
+
+/**
+ * Function that sets the level of an output, called by digitalWrite and analogWrite.
+ * @param pin           the output pin
+ * @param level         0 (off) - 1 (fully on)
+ */
+void simulationSetOutput(uint8_t pin, float level);
+
+/**
+ * Function that returns the level of an output.
+ * @param pin           the output pin
+ * @return 0 (off) - 1 (fully on)
+ */
+float simulationOutput(uint8_t pin);
+
+/**
+ * Function that moves the simulation forward to millis() and reads an analog input.
+ * @param pin           the input pin
+ * @return the value of the input with noise, 0 - 4095
+ */
+uint16_t simulationReadInput(uint8_t pin);
+
+#endif
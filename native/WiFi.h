@@ -0,0 +1,28 @@
+/***********************************************************************************************************************
+ * WIFI SHIM FOR THE NATIVE BUILD
+ * THE PC IS ALREADY ON THE NETWORK, SO THE CONNECTION IS ALWAYS UP
+ ***********************************************************************************************************************/
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+#include "PosixClient.h"
+
+typedef PosixClient WiFiClient;
+
+enum wl_status_t {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+};
+
+class WiFiClass {
+public:
+    void begin(const char * ssid, const char * password) { (void) ssid; (void) password; }
+    wl_status_t status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,14 @@
+/***********************************************************************************************************************
+ * ANALOGWRITE SHIM FOR THE NATIVE BUILD
+ * THE PWM OUTPUT OF THE ESP32 ANALOGWRITE LIBRARY, THE DUTY CYCLE IS GIVEN TO THE SIMULATION AS THE OUTPUT LEVEL
+ ***********************************************************************************************************************/
+#ifndef NATIVE_ANALOGWRITE_H
+#define NATIVE_ANALOGWRITE_H
+
+#include "Simulation.h"
+
+inline void analogWrite(uint8_t pin, uint32_t value = 0, uint32_t valueMax = 255) {
+    simulationSetOutput(pin, valueMax > 0 ? (float) value / valueMax : 0.0f);
+}
+
+#endif
@@ -0,0 +1,42 @@
+/***********************************************************************************************************************
+ * PARTITION API SHIM FOR THE NATIVE BUILD
+ * THE PARTS OF THE ESP-IDF PARTITION API THE PROGRAM USES, ON THE FLASH EMULATOR IN FLASHEMULATOR.H
+ ***********************************************************************************************************************/
+#ifndef NATIVE_ESP_PARTITION_H
+#define NATIVE_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+enum esp_partition_type_t {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+};
+
+enum esp_partition_subtype_t {
+    ESP_PARTITION_SUBTYPE_ANY = 0xFF
+};
+
+struct esp_partition_t {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+};
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                 const char * label);
+esp_err_t esp_partition_read(const esp_partition_t * partition, size_t offset, void * destination, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t * partition, size_t offset, const void * source, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t * partition, size_t offset, size_t size);
+
+#endif
@@ -0,0 +1,39 @@
+/***********************************************************************************************************************
+ * ENTRY POINT OF THE NATIVE BUILD
+ * SETS UP THE SIMULATED ROOM AND RUNS SETUP AND LOOP OF THE ROBOT CLIENT AS THE ARDUINO CORE DOES
+ * THE SERVER CAN BE CHANGED WITH THE ENVIRONMENT VARIABLES ROBOT_HOST AND ROBOT_PORT, AND THE FILE THAT HOLDS THE
+ * JOURNAL PARTITION WITH ROBOT_FLASH
+ ***********************************************************************************************************************/
+#include "Arduino.h"
+#include "WiFi.h"
+#include "Simulation.h"
+#include "FlashEmulator.h"
+
+WiFiClass WiFi;
+
+// Defined in src/main.cpp
+extern const char* HOST;
+extern int PORT;
+extern const char* JOURNAL_PARTITION;
+void setup();
+void loop();
+
+int main() {
+    const char * host = getenv("ROBOT_HOST");
+    const char * port = getenv("ROBOT_PORT");
+    const char * flash = getenv("ROBOT_FLASH");
+    if (host != NULL) {
+        HOST = host;
+    }
+    if (port != NULL) {
+        PORT = atoi(port);
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    // Same size as the journal partition in partitions.csv
+    flashEmulatorOpen(flash != NULL ? flash : "robot_flash.bin", JOURNAL_PARTITION, 0x10000);
+    simulationSetupRoom();
+    setup();
+    for (;;) {
+        loop();
+    }
+}
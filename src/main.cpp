@@ -5,20 +5,25 @@
  ***********************************************************************************************************************/
 #include <WiFi.h>
 #include <SocketIoClient.h>
-#include <ArduinoJson.h>
+#include <analogWrite.h>
+#include <atomic>
+#include <limits.h>
+#include "SpscQueue.h"
+#include "Seqlock.h"
+#include "Diagnostics.h"
+#include "FlashJournal.h"
+#include "TelemetryFormat.h"
 
 /// Access-point Settings ///
 const char* SSID     = "Example-network-SSID";       // Name of access-point
 const char* PASSWORD = "password";                   // Password for access-point
 
 /// Socket.IO Settings ///
-char HOST[] = "192.168.137.105";                     // Socket.IO Server Address
+const char* HOST = "192.168.137.105";                // Socket.IO Server Address
 int PORT = 3000;                                     // Socket.IO Port Address
 char PATH[] = "/socket.io/?transport=websocket";     // Socket.IO Base Path
 String SERVER_PASSWORD = "\"123456789\"";            // Password sent to server for authentication
 
-StaticJsonBuffer<200> jsonBuffer;                    // Buffer storage for JSON values
-
 
 /// Internal temperature sensor initializing ///
 #ifdef __cplusplus
@@ -31,55 +36,253 @@ uint8_t temprature_sens_read();
 uint8_t temprature_sens_read();
 
 
-/// Pin Settings ///
-int TEMP_INPUT_PIN = 35;
-int CO2_INPUT_PIN = 34;
-
-int HEATER_OUTPUT_PIN = 4;
-int VENTILATION_OUTPUT_PIN = 5;
-
-
-/// Variables for algorithms, variables are grouped according to the same function but for different regulation pairs ///
-// The setpoints that the server emits to the robot
-float temperatureSetpoint;
-float co2Setpoint;
-
-// The most recent value of the senors
-float tempValue;
-float internalTempValue;
-float co2Value;
-
-// The sensor values from the last iteration
-float previousTempValue;
-float previousInternalTempValue;
-float previousCo2Value;
-
-// Bool that is evaluated true if server validated the robot
-bool authenticatedByServer = false;
-
-// Determines what kind of regulation method should be used
-bool tempActuatorReversed = false;
-bool co2ActuatorReversed = true;
-
-// The output states from the last iteration
-bool previousTempOutputState;
-bool previousCo2OutputState;
-
-// If true determines that the sensor should only be used for surveillance and no regulation
-bool surveillanceModeTemp;
-bool surveillanceModeCo2;
+/// Channel Settings ///
+// Kinds of sensors, decides how the value of a channel is read and scaled
+enum SensorType : uint8_t {
+    SENSOR_TEMPERATURE,
+    SENSOR_CO2,
+    SENSOR_INTERNAL_TEMP
+};
 
-// Stores the value of the time for the next timeout
-unsigned long nextTimeout = 0;
+// Filters that reduce the noise of the samples read between each regulation
+enum SensorFilter : uint8_t {
+    FILTER_NONE,              // The latest sample is used
+    FILTER_AVERAGE,           // The average of all samples since the last regulation
+    FILTER_EMA,               // Exponential moving average of all samples, weighted with EMA_WEIGHT
+    FILTER_MEDIAN             // The median of the latest MEDIAN_SIZE samples, removes single spikes
+};
 
-// Parameter that specifies how long before each timeout
-int timeout = 5000;
-
-// System identification and keys for JSON communication parameters
+// Weight of a new sample in the exponential moving average
+const float EMA_WEIGHT = 0.01;
+
+// Number of samples the median filter is taken of
+const uint8_t MEDIAN_SIZE = 9;
+
+// Largest number of samples in the average, older samples get less weight after this
+const uint16_t AVERAGE_MAX_SAMPLES = 10000;
+
+// Default limits for how often an actuator can switch, can be changed by the server with event "setpoints"
+const unsigned long DEFAULT_MIN_ON_TIME = 60000;      // Shortest time in ms an output stays on
+const unsigned long DEFAULT_MIN_OFF_TIME = 60000;     // Shortest time in ms an output stays off
+const float DEFAULT_MAX_SWITCHES_PER_HOUR = 20;       // Largest average number of switches per hour, 0 for no limit
+
+// Ways an actuator can be regulated, can be changed by the server with event "setpoints"
+enum ControlMode : uint8_t {
+    CONTROL_ON_OFF,           // On / off at the set-point, with hysteresis and minimum on / off times
+    CONTROL_PID_PWM,          // PID regulation of the PWM duty cycle of the output, with analogWrite
+    CONTROL_PID_RELAY         // PID regulation of the part of every TIME_PROPORTIONING_WINDOW the output is on
+};
+
+// Time in ms between each PID regulation, independent of the timer for sending values to the server
+const unsigned long CONTROL_PERIOD = 1000;
+
+// Time in ms of one period of the time proportioning for relays
+const unsigned long TIME_PROPORTIONING_WINDOW = 120000;
+
+// Shortest time in ms a relay is switched on or off in a window, shorter pulses are skipped
+const unsigned long TIME_PROPORTIONING_MIN_PULSE = 6000;
+
+// Largest value given to analogWrite, the default resolution of the analogWrite library is 13 bits
+const uint32_t PWM_MAX = 8191;
+
+// How much the output level has to change before it is sent to the server
+const float OUTPUT_LEVEL_DEADBAND = 0.1;
+
+// Time in ms between each time the output states are set and changed values are sent to the server
+const unsigned long REPORT_PERIOD = 5000;
+
+// Time in ms between each print of the task statistics to the console
+const unsigned long STATISTICS_PERIOD = 60000;
+
+// Time in ms between each "diagnostics" event, only sent when built with ENABLE_DIAGNOSTICS
+const unsigned long DIAGNOSTICS_PERIOD = 60000;
+
+// If true the data of a tick is sent as one array with event "sensorDataBatch", else each value with "sensorData". The
+// server has to handle "sensorDataBatch", as server_no_encrypt.js does
+const bool TELEMETRY_BATCHING = false;
+
+// If true the telemetry is sent in the compact binary format with event "sensorDataBinary", see encodeTelemetryRecord
+const bool TELEMETRY_BINARY = false;
+
+// If true output state changes are sent one by one with event "sensorData" and an ack id, and sent again until the
+// server acks them, also after a reconnect. Sensor values and output levels are sent without ack
+const bool TELEMETRY_RELIABLE_OUTPUTS = true;
+
+// Longest time in ms sensor values can wait in the batch for the values of later ticks, 0 sends the batch every tick.
+// Output changes are sent at the end of the tick they happen in
+const unsigned long TELEMETRY_MAX_LATENCY = 0;
+
+// Number of messages that can wait for the network core, has to be a power of two
+const size_t TELEMETRY_QUEUE_SIZE = 4;
+
+// Number of messages with an ack id the network core keeps while the ack window of webSocket is full, so the messages
+// without ack after them are still sent. The last place is kept for the replayed journal message
+const size_t TELEMETRY_HELD_SIZE = 4;
+
+/// Journal Settings ///
+// If true the values are kept in the flash journal while the robot is not authenticated, and sent to the server with
+// event "sensorDataReplay" when it is again. Once the server has sent set-points the regulation also keeps running
+// while the robot is offline
+const bool JOURNAL_ENABLED = true;
+
+// Label of the data partition of the journal, see partitions.csv
+const char* JOURNAL_PARTITION = "journal";
+
+// Time in ms between each replayed message, so the replay does not crowd out the values of the robot as it is now
+const unsigned long JOURNAL_REPLAY_PERIOD = 200;
+
+// Most records read from the journal for one replayed message, fewer are sent if the message would be too long
+const size_t JOURNAL_REPLAY_BATCH = 8;
+
+/// Network Task Settings ///
+// The connection with the server runs in its own task on the core of the Wi-Fi stack, so the regulation in loop() on
+// the other core keeps running when the network is slow
+const BaseType_t NETWORK_CORE = 0;
+const uint32_t NETWORK_TASK_STACK_SIZE = 8192;
+const UBaseType_t NETWORK_TASK_PRIORITY = 1;
+
+// Used as pin number for channels without an input or output pin
+const int8_t NO_PIN = -1;
+
+// Describes one sensor and the actuator that regulates it
+struct Channel {
+    const char * key;         // Sensor / actuator ID used in the JSON communication with the server
+    SensorType type;          // Kind of sensor connected to the input pin
+    int8_t inputPin;          // ESP32 pin the analog value is read from
+    SensorFilter filter;      // Filter used on the samples of the sensor
+    float scale;              // Sensor value in physical units at the largest analog value (4095)
+    float deadband;           // How much the value has to change before it is sent to the server
+    float hysteresis;         // Default width of the band around the set-point where the output is not switched
+    int8_t outputPin;         // ESP32 pin controlling the actuator, NO_PIN for sensors used for surveillance only
+    bool reversed;            // Determines what kind of regulation is used for the actuator (direct / reverse control)
+    ControlMode control;      // Default way the actuator is regulated
+    float kp;                 // Default proportional gain, output level (0 - 1) per unit of error
+    float ki;                 // Default integral gain, output level per unit of error and second
+    float kd;                 // Default derivative gain, output level per unit of change per second
+};
+
+// One line per sensor, add a line here to connect more sensors and actuators
+const Channel CHANNELS[] = {
+    // key   type                  input   filter          scale   deadband hysteresis output  reversed control         kp     ki       kd
+    { "001", SENSOR_TEMPERATURE,   35,     FILTER_AVERAGE, 70.0,   0.2,     0.5,       4,      false,   CONTROL_ON_OFF, 0.5,   0.002,   0.0 },
+    { "002", SENSOR_CO2,           34,     FILTER_MEDIAN,  2000.0, 1.0,     50.0,      5,      true,    CONTROL_ON_OFF, 0.002, 0.00002, 0.0 },
+    { "003", SENSOR_INTERNAL_TEMP, NO_PIN, FILTER_EMA,     0.0,    0.2,     0.0,       NO_PIN, false,   CONTROL_ON_OFF, 0.0,   0.0,     0.0 },
+};
+
+const size_t CHANNEL_COUNT = sizeof(CHANNELS) / sizeof(CHANNELS[0]);
+
+
+/// Variables for algorithms, one entry per channel in the same order as CHANNELS ///
+struct ChannelState {
+    float setpoint;           // The setpoint that the server emits to the robot
+    float value;              // The filtered value of the sensor used for regulation
+    float sampleAverage;      // Average or moving average of the samples, depending on the filter of the channel
+    uint16_t sampleCount;     // Number of samples in sampleAverage
+    float samples[MEDIAN_SIZE]; // The latest samples for the median filter
+    uint8_t sampleIndex;      // Position in samples for the next sample
+    float previousValue;      // The sensor value last sent to the server
+    bool previousOutputState; // The output state from the last iteration
+    bool surveillanceMode;    // If true the sensor is only used for surveillance and no regulation
+    float hysteresis;         // Width of the band around the set-point where the output is not switched
+    unsigned long minOnTime;  // Shortest time in ms the output stays on
+    unsigned long minOffTime; // Shortest time in ms the output stays off
+    float maxSwitchesPerHour; // Largest average number of switches per hour, 0 for no limit
+    float switchBudget;       // Switches left before the rate limit holds the output, refills with maxSwitchesPerHour
+    uint32_t lastSwitchTime;  // millis() of the last switch of the output
+    uint32_t lastBudgetTime;  // millis() of the last refill of switchBudget
+    ControlMode control;      // The way the actuator is regulated
+    float kp;                 // Proportional gain of the PID regulation
+    float ki;                 // Integral gain of the PID regulation
+    float kd;                 // Derivative gain of the PID regulation
+    float integral;           // Integral part of the PID output, kept within 0 - 1 so it can not wind up
+    float previousInput;      // Value at the last PID regulation, for the derivative part
+    float outputLevel;        // Output of the PID regulation, 0 - 1
+    float reportedLevel;      // Output level last sent to the server
+    bool pwmAttached;         // The output pin is driven by analogWrite
+    uint32_t windowStart;     // millis() when the current time proportioning window started
+    unsigned long windowOnTime; // Time in ms the output is on in the current window
+    uint32_t settingsRevision; // Revision of the settings from the server the channel uses
+};
+
+ChannelState channelStates[CHANNEL_COUNT];
+
+// Settings of a channel that the server changes with event "setpoints"
+struct ChannelSettings {
+    uint32_t revision;        // Counts up every time the channel is in the set-points
+    bool surveillanceMode;    // If true the sensor is only used for surveillance and no regulation
+    ControlMode control;      // The way the actuator is regulated
+    float setpoint;           // The setpoint that the server emits to the robot
+    float hysteresis;         // Width of the band around the set-point where the output is not switched
+    unsigned long minOnTime;  // Shortest time in ms the output stays on
+    unsigned long minOffTime; // Shortest time in ms the output stays off
+    float maxSwitchesPerHour; // Largest average number of switches per hour, 0 for no limit
+    float kp;                 // Proportional gain of the PID regulation
+    float ki;                 // Integral gain of the PID regulation
+    float kd;                 // Derivative gain of the PID regulation
+};
+
+// The settings of every channel, in the same order as CHANNELS
+struct ServerSettings {
+    ChannelSettings channels[CHANNEL_COUNT];
+};
+
+// Settings from the server, changed by the network core. They are shared with the control core through
+// serverSettingsLock, and the control core only uses its own copy in channelStates
+ServerSettings serverSettings;
+Seqlock<ServerSettings> serverSettingsLock;
+
+// Sequence number of the settings in serverSettingsLock that the channels were last checked against
+uint32_t appliedSettingsSequence = 0;
+
+// Bool that is evaluated true if server validated the robot, set by the network core
+std::atomic<bool> authenticatedByServer(false);
+
+// Set when the server has sent set-points since start, so the robot knows what to regulate towards while offline
+bool setpointsReceived = false;
+
+// Values taken while the robot was offline, used by the control core only
+FlashJournal journal;
+
+// Sequence number of the last journal record in the replayed message the server has acked, set by the network core
+std::atomic<uint32_t> replayAckedSequence(0);
+
+// Values waiting to be sent to the server as one JSON array, or as binary records
+char telemetryBatch[512];
+size_t telemetryBatchLength = 0;
+uint32_t telemetryBatchStart = 0;        // millis() when the first value was added to the batch
+bool telemetryBatchUrgent = false;       // The batch has an output change and should be sent this tick
+bool telemetryBatchBinary = false;       // The batch has binary records, else JSON objects
+
+// A message for the server, passed from the control core to the network core that sends it
+struct TelemetryMessage {
+    const char * event;       // Name of the event
+    bool binary;              // The data is sent as a binary event, else as a JSON string
+    bool reliable;            // The data is sent with an ack id until the server acks it
+    uint32_t journalSequence; // Sequence number of the last replayed journal record in the data, 0 if none
+    uint16_t length;          // Length of the data
+    char data[sizeof(telemetryBatch)]; // The data, null terminated if it is not binary
+};
+
+// Messages waiting for the network core, a message is dropped if the network core is so far behind that it is full
+SpscQueue<TelemetryMessage, TELEMETRY_QUEUE_SIZE> telemetryQueue;
+uint32_t telemetryDropped = 0;           // Number of messages dropped because the queue was full
+
+// Messages with an ack id taken from telemetryQueue while the ack window was full, oldest at heldHead. Used by the
+// network core only
+TelemetryMessage heldTelemetry[TELEMETRY_HELD_SIZE];
+size_t heldHead = 0;
+size_t heldCount = 0;
+std::atomic<uint32_t> heldDropped(0);    // Output changes dropped because the ack window and heldTelemetry were full
+
+
+// System identification for JSON communication parameters
 const String ROBOT_ID = "\"001\"";
-const String TEMP_SENSOR_KEY = "001";
-const String CO2_SENSOR_KEY = "002";
-const String INTERNAL_TEMP_SENSOR_KEY = "003";
+
+// Event IDs for the Socket.IO events the robot listens to, hashed at compile time
+constexpr uint32_t EVENT_CONNECT = socketIoEventId("connect");
+constexpr uint32_t EVENT_DISCONNECT = socketIoEventId("disconnect");
+constexpr uint32_t EVENT_AUTHENTICATION = socketIoEventId("authentication");
+constexpr uint32_t EVENT_SETPOINTS = socketIoEventId("setpoints");
 
 // Instances for communication and wifi.
 SocketIoClient webSocket;
@@ -92,6 +295,8 @@ WiFiClient client;
  * @param length      gives the size of the payload
  */
 void socketConnected(const char * payload, size_t length) {
+    (void) payload;
+    (void) length;
     // Prints information to the console for user information
     Serial.println("Socket.IO Connected!");
     Serial.println("Sending PASSWORD to server for authentication");
@@ -107,6 +312,8 @@ void socketConnected(const char * payload, size_t length) {
  * @param length      gives the size of the payload
  */
 void socketDisconnected(const char * payload, size_t length) {
+    (void) payload;
+    (void) length;
     Serial.println("Socket.IO Disconnected!");
     authenticatedByServer = false;
 }
@@ -121,6 +328,7 @@ void socketDisconnected(const char * payload, size_t length) {
  * @param length      gives the size of the payload
  */
 void authenticateFeedback (const char * payload, size_t length) {
+    (void) length;
     // Changes datatype of feedback to a string
     String feedback = payload;
 
@@ -138,220 +346,896 @@ void authenticateFeedback (const char * payload, size_t length) {
 }
 
 /**
- * Function that checks the value of each key that is received as set-points, has a float number or the value of none.
- * If the value is none, then surveillance-mode for that sensor and corresponding actuator is set. If a float for a
- * set-point is received, then that sensor and corresponding actuator is in normal regulation mode. The mode selected is
- * also printed to the console.
- * @param serverData     contains the server sensor keys and corresponding set-points sent from the server in JSON format
+ * Function that sets the output of the channel to a level between 0 (LOW) and 1 (HIGH). The output is written with
+ * analogWrite if the channel uses PWM regulation, or if the pin has been used with analogWrite before, as the pin can
+ * not be set with digitalWrite after that. Else the output is set HIGH for levels from 0.5.
+ * @param channel       the channel with the output pin of the ESP32 that is used to control the actuator
+ * @param state         the state of the channel, keeps track of the pin being used with analogWrite
+ * @param level         the value of what the output should be, 0 - 1
  */
-void determineMode (JsonObject& serverData) {
-    // Checks if the data associated with the key is equal to the string "none"
-    if (serverData[TEMP_SENSOR_KEY] == "none") {
-        surveillanceModeTemp = true;
-        Serial.println("Surveillance mode for temp is activated");
-        digitalWrite(HEATER_OUTPUT_PIN, LOW);
-        previousTempOutputState = false;
-    // If its not, it will be a numeric value and regulation should be started with this value
+void setOutput (const Channel& channel, ChannelState& state, float level) {
+    if (state.control == CONTROL_PID_PWM || state.pwmAttached) {
+        state.pwmAttached = true;
+        analogWrite(channel.outputPin, (uint32_t) (level * PWM_MAX + 0.5), PWM_MAX);
+    } else if (level >= 0.5) {
+        digitalWrite(channel.outputPin, HIGH);
     } else {
-        temperatureSetpoint = serverData[TEMP_SENSOR_KEY];
-        surveillanceModeTemp = false;
-        Serial.println("Normal regulation mode for temp is activated");
-    }
-    // Checks if the data associated with the key is equal to the string "none"
-    if (serverData[CO2_SENSOR_KEY] == "none") {
-        surveillanceModeCo2 = true;
-        Serial.println("Surveillance mode for co2 is activated");
-        digitalWrite(VENTILATION_OUTPUT_PIN, LOW);
-        previousCo2OutputState = false;
-    // If its not, it will be a numeric value and regulation should be started with this value
+        digitalWrite(channel.outputPin, LOW);
+    }
+}
+
+/**
+ * Function that changes the way the actuator of the channel is regulated. The output is turned off and the PID
+ * regulation starts again from zero, so the new mode does not start with the state of the old one.
+ * @param channel       the channel that is changed
+ * @param state         the state of the channel
+ * @param control       the new way of regulation
+ */
+void setControlMode (const Channel& channel, ChannelState& state, ControlMode control) {
+    if (control == state.control) {
+        return;
+    }
+    state.control = control;
+    state.integral = 0.0;
+    state.previousInput = state.value;
+    state.outputLevel = 0.0;
+    // The first regulation starts a new window
+    state.windowStart = millis() - TIME_PROPORTIONING_WINDOW;
+    setOutput(channel, state, 0.0);
+    if (state.previousOutputState) {
+        state.lastSwitchTime = millis();
+    }
+    state.previousOutputState = false;
+}
+
+// Numeric fields of a set-point object, in the same order as SETPOINT_FIELD_NAMES
+enum SetpointField : uint8_t {
+    FIELD_SETPOINT,
+    FIELD_HYSTERESIS,
+    FIELD_MIN_ON_TIME,
+    FIELD_MIN_OFF_TIME,
+    FIELD_MAX_SWITCHES_PER_HOUR,
+    FIELD_KP,
+    FIELD_KI,
+    FIELD_KD,
+    FIELD_COUNT
+};
+
+const char * const SETPOINT_FIELD_NAMES[FIELD_COUNT] = {
+    "setpoint", "hysteresis", "minOnTime", "minOffTime", "maxSwitchesPerHour", "kp", "ki", "kd"
+};
+
+// Longest string in the set-points that is compared with a key, field name or mode, longer strings match nothing
+const size_t SETPOINT_MAX_STRING = 24;
+
+// Deepest nesting of objects and arrays in values that are skipped, deeper set-points are rejected
+const uint8_t SETPOINT_MAX_DEPTH = 8;
+
+// The changes of one channel in the received set-points, only applied when all of the set-points could be parsed
+struct SetpointUpdate {
+    bool received;            // The key of the channel was in the set-points
+    bool surveillance;        // The value was "none"
+    bool hasMode;             // The way of regulation is changed to control
+    ControlMode control;      // The new way of regulation
+    uint16_t fields;          // Bit per SetpointField that was received
+    float values[FIELD_COUNT]; // The received values, in the units of the server
+};
+
+// Position while reading the set-points payload
+struct SetpointReader {
+    const char * position;
+    const char * end;
+};
+
+/**
+ * Function that returns the next character of the set-points without reading it. The set-points are sent as an escaped
+ * JSON string, so backslashes are skipped, and whitespace outside strings is skipped.
+ * @param reader        position in the payload
+ * @return the next character, or '\0' at the end of the payload
+ */
+char peekSetpointChar (SetpointReader& reader) {
+    while (reader.position < reader.end && (*reader.position == '\\' || isspace((unsigned char) *reader.position))) {
+        reader.position++;
+    }
+    return reader.position < reader.end ? *reader.position : '\0';
+}
+
+/**
+ * Function that reads the character c if it is the next character of the set-points.
+ * @param reader        position in the payload
+ * @param c             the expected character
+ * @return true if the character was read
+ */
+bool readSetpointChar (SetpointReader& reader, char c) {
+    if (peekSetpointChar(reader) != c) {
+        return false;
+    }
+    reader.position++;
+    return true;
+}
+
+/**
+ * Function that reads a string of the set-points into text. Strings that do not fit are read, but text is left empty.
+ * @param reader        position in the payload
+ * @param text          where the string is written, with null terminator
+ * @param size          size of text
+ * @return true if a complete string was read
+ */
+bool readSetpointString (SetpointReader& reader, char * text, size_t size) {
+    if (!readSetpointChar(reader, '"')) {
+        return false;
+    }
+    size_t length = 0;
+    bool tooLong = false;
+    while (reader.position < reader.end) {
+        char c = *reader.position++;
+        if (c == '\\') {
+            continue;
+        }
+        if (c == '"') {
+            text[tooLong ? 0 : length] = '\0';
+            return true;
+        }
+        if ((unsigned char) c < 0x20) {
+            return false;
+        }
+        if (length + 1 < size) {
+            text[length++] = c;
+        } else {
+            tooLong = true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Function that reads a number of the set-points, in the JSON number format.
+ * @param reader        position in the payload
+ * @param value         where the number is written
+ * @return true if a number was read
+ */
+bool readSetpointNumber (SetpointReader& reader, float& value) {
+    peekSetpointChar(reader);
+    const char * start = reader.position;
+    const char * p = start;
+    const char * end = reader.end;
+
+    if (p < end && *p == '-') {
+        p++;
+    }
+    const char * digits = p;
+    while (p < end && isdigit((unsigned char) *p)) {
+        p++;
+    }
+    if (p == digits) {
+        return false;
+    }
+    if (p < end && *p == '.') {
+        digits = ++p;
+        while (p < end && isdigit((unsigned char) *p)) {
+            p++;
+        }
+        if (p == digits) {
+            return false;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        digits = p;
+        while (p < end && isdigit((unsigned char) *p)) {
+            p++;
+        }
+        if (p == digits) {
+            return false;
+        }
+    }
+
+    // The payload does not end after the number, so it is copied before it is converted
+    char number[32];
+    if ((size_t) (p - start) >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, start, p - start);
+    number[p - start] = '\0';
+    value = strtof(number, NULL);
+    reader.position = p;
+    return !isinf(value);
+}
+
+/**
+ * Function that checks that a field of a set-point object can be used. The hysteresis and the switch limit can not be
+ * negative, and the shortest on and off times in seconds have to fit in an unsigned long in ms when they are converted
+ * in updateServerSettings.
+ * @param field         the field
+ * @param value         the received value
+ * @return false if the value is out of range, then the set-points are rejected
+ */
+bool setpointFieldInRange (size_t field, float value) {
+    switch (field) {
+        case FIELD_HYSTERESIS:
+        case FIELD_MAX_SWITCHES_PER_HOUR:
+            return value >= 0;
+        case FIELD_MIN_ON_TIME:
+        case FIELD_MIN_OFF_TIME:
+            // A float converts to an unsigned long only below ULONG_MAX + 1, which is what (float) ULONG_MAX rounds to
+            return value >= 0 && value * 1000 < (float) ULONG_MAX;
+        default:
+            return true;
+    }
+}
+
+/**
+ * Function that reads a JSON value of the set-points that is not used, like the set-point of an unknown sensor.
+ * @param reader        position in the payload
+ * @param depth         number of objects and arrays the value is inside of
+ * @return true if a complete value was read
+ */
+bool skipSetpointValue (SetpointReader& reader, uint8_t depth) {
+    char text[1];
+    char c = peekSetpointChar(reader);
+    if (c == '"') {
+        return readSetpointString(reader, text, sizeof(text));
+    }
+    if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        if (depth >= SETPOINT_MAX_DEPTH) {
+            return false;
+        }
+        reader.position++;
+        if (readSetpointChar(reader, close)) {
+            return true;
+        }
+        do {
+            if (c == '{' && !(readSetpointString(reader, text, sizeof(text)) && readSetpointChar(reader, ':'))) {
+                return false;
+            }
+            if (!skipSetpointValue(reader, depth + 1)) {
+                return false;
+            }
+        } while (readSetpointChar(reader, ','));
+        return readSetpointChar(reader, close);
+    }
+    const char * const LITERALS[] = {"true", "false", "null"};
+    for (size_t i = 0; i < sizeof(LITERALS) / sizeof(LITERALS[0]); i++) {
+        size_t length = strlen(LITERALS[i]);
+        if ((size_t) (reader.end - reader.position) >= length && strncmp(reader.position, LITERALS[i], length) == 0) {
+            reader.position += length;
+            return true;
+        }
+    }
+    float value;
+    return readSetpointNumber(reader, value);
+}
+
+/**
+ * Function that reads the value of one channel in the set-points. The value is a number, which is the set-point, the
+ * string "none", or an object with the set-point and the control limits that should be changed.
+ * @param reader        position in the payload
+ * @param update        where the changes of the channel are written
+ * @return true if a valid value was read
+ */
+bool readSetpointValue (SetpointReader& reader, SetpointUpdate& update) {
+    SetpointUpdate parsed = {};
+    parsed.received = true;
+    char text[SETPOINT_MAX_STRING];
+    char c = peekSetpointChar(reader);
+
+    if (c == '"') {
+        if (!readSetpointString(reader, text, sizeof(text)) || strcmp(text, "none") != 0) {
+            return false;
+        }
+        parsed.surveillance = true;
+    } else if (c == '{') {
+        reader.position++;
+        if (!readSetpointChar(reader, '}')) {
+            do {
+                if (!readSetpointString(reader, text, sizeof(text)) || !readSetpointChar(reader, ':')) {
+                    return false;
+                }
+                size_t field = 0;
+                while (field < FIELD_COUNT && strcmp(text, SETPOINT_FIELD_NAMES[field]) != 0) {
+                    field++;
+                }
+                if (field < FIELD_COUNT) {
+                    if (!readSetpointNumber(reader, parsed.values[field]) ||
+                        !setpointFieldInRange(field, parsed.values[field])) {
+                        return false;
+                    }
+                    parsed.fields |= 1 << field;
+                } else if (strcmp(text, "mode") == 0) {
+                    if (!readSetpointString(reader, text, sizeof(text))) {
+                        return false;
+                    }
+                    // Unknown modes keep the way of regulation
+                    parsed.hasMode = true;
+                    if (strcmp(text, "onoff") == 0) {
+                        parsed.control = CONTROL_ON_OFF;
+                    } else if (strcmp(text, "pwm") == 0) {
+                        parsed.control = CONTROL_PID_PWM;
+                    } else if (strcmp(text, "relay") == 0) {
+                        parsed.control = CONTROL_PID_RELAY;
+                    } else {
+                        parsed.hasMode = false;
+                    }
+                } else if (!skipSetpointValue(reader, 1)) {
+                    return false;
+                }
+            } while (readSetpointChar(reader, ','));
+            if (!readSetpointChar(reader, '}')) {
+                return false;
+            }
+        }
     } else {
-        co2Setpoint = serverData[CO2_SENSOR_KEY];
-        surveillanceModeCo2 = false;
-        Serial.println("Normal regulation mode for co2 is activated");
+        if (!readSetpointNumber(reader, parsed.values[FIELD_SETPOINT])) {
+            return false;
+        }
+        parsed.fields |= 1 << FIELD_SETPOINT;
+    }
+
+    update = parsed;
+    return true;
+}
 
+/**
+ * Function that parses the set-points from the server in one pass over the payload, without copying it. The changes
+ * for the channels with an actuator are written to updates, keys of other channels and unknown sensors are skipped.
+ * @param payload       the set-points, a JSON object that can be escaped
+ * @param length        size of the payload
+ * @param updates       one entry per channel, in the same order as CHANNELS
+ * @return true if the whole payload is a valid set-points object, else nothing should be changed
+ */
+bool parseSetpoints (const char * payload, size_t length, SetpointUpdate * updates) {
+    SetpointReader reader = { payload, payload + length };
+    if (!payload || !readSetpointChar(reader, '{')) {
+        return false;
+    }
+    if (!readSetpointChar(reader, '}')) {
+        do {
+            char key[SETPOINT_MAX_STRING];
+            if (!readSetpointString(reader, key, sizeof(key)) || !readSetpointChar(reader, ':')) {
+                return false;
+            }
+            size_t i = 0;
+            while (i < CHANNEL_COUNT && (CHANNELS[i].outputPin == NO_PIN || strcmp(key, CHANNELS[i].key) != 0)) {
+                i++;
+            }
+            if (i < CHANNEL_COUNT) {
+                if (!readSetpointValue(reader, updates[i])) {
+                    return false;
+                }
+            } else if (!skipSetpointValue(reader, 0)) {
+                return false;
+            }
+        } while (readSetpointChar(reader, ','));
+        if (!readSetpointChar(reader, '}')) {
+            return false;
+        }
     }
+    return peekSetpointChar(reader) == '\0';
 }
 
 /**
- * Function that manipulated the payload data into a string that can be formatted with ArduinoJSON methods. Saves the
- * unique keys and corresponding set-points and saves it in JSON format. Error checking if the formatting worked, if
- * not prints a status message to console for troubleshooting. Calls the function determineMode with the JSON object
- * for determining the operation mode of the sensors and corresponding actuators.
- * @param payload     contains the data sent from server with event "setpoints"
- * @param length      gives the size of the payload
+ * Function that changes the settings of the channels in the received set-points. If the value is none, then
+ * surveillance-mode for that sensor and corresponding actuator is set. If a float for a set-point is received, then
+ * that sensor and corresponding actuator is in normal regulation mode. An object gives the set-point in "setpoint" and
+ * can also change the control limits of the actuator with the optional keys "hysteresis", "minOnTime" and "minOffTime"
+ * in seconds, and "maxSwitchesPerHour". The way of regulation is changed with "mode", which is "onoff", "pwm" or
+ * "relay", and the gains of the PID regulation with "kp", "ki" and "kd". The parser has checked that the values are in
+ * range with setpointFieldInRange. Channels that are not in the set-points keep their settings. The new settings are
+ * then shared with the control core, which changes the mode in determineMode.
+ * @param updates       the changes of each channel parsed by parseSetpoints
  */
-void manageServerSetpoints(const char * payload, size_t length) {
-    // Changes the incoming data in the string datatype
-    String str_payload = payload;
-    // Because the set-points is not in proper JSON format, modulates the string to JSON
-    str_payload.replace("\\", "" );
+void updateServerSettings (const SetpointUpdate * updates) {
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelSettings& settings = serverSettings.channels[i];
+        const SetpointUpdate& update = updates[i];
+        if (!update.received) {
+            continue;
+        }
+        settings.revision++;
 
-    // Defines an array to store the data in JSON
-    char setpoints_array[100];
-    str_payload.toCharArray(setpoints_array, 100);
+        if (update.surveillance) {
+            settings.surveillanceMode = true;
+            continue;
+        }
 
-    // Stores the data as a JsonObject datatype
-    JsonObject& server_data = jsonBuffer.parseObject(setpoints_array);
+        if (update.fields & (1 << FIELD_SETPOINT)) {
+            settings.setpoint = update.values[FIELD_SETPOINT];
+        }
+        if (update.fields & (1 << FIELD_HYSTERESIS)) {
+            settings.hysteresis = update.values[FIELD_HYSTERESIS];
+        }
+        if (update.fields & (1 << FIELD_MIN_ON_TIME)) {
+            settings.minOnTime = update.values[FIELD_MIN_ON_TIME] * 1000;
+        }
+        if (update.fields & (1 << FIELD_MIN_OFF_TIME)) {
+            settings.minOffTime = update.values[FIELD_MIN_OFF_TIME] * 1000;
+        }
+        if (update.fields & (1 << FIELD_MAX_SWITCHES_PER_HOUR)) {
+            settings.maxSwitchesPerHour = update.values[FIELD_MAX_SWITCHES_PER_HOUR];
+        }
+        if (update.fields & (1 << FIELD_KP)) {
+            settings.kp = update.values[FIELD_KP];
+        }
+        if (update.fields & (1 << FIELD_KI)) {
+            settings.ki = update.values[FIELD_KI];
+        }
+        if (update.fields & (1 << FIELD_KD)) {
+            settings.kd = update.values[FIELD_KD];
+        }
+        if (update.hasMode) {
+            settings.control = update.control;
+        }
+        settings.surveillanceMode = false;
+    }
+    serverSettingsLock.write(serverSettings);
+}
 
-    // Control check if the JSON processing worked, if not prints error message to console
-    if(!server_data.success()) {
-        Serial.println("parseObject() from index.js set-points payload failed");
+/**
+ * Function that changes the mode of a channel to the settings from the server. In surveillance-mode the output is
+ * turned off. Else the set-point, control limits and the way of regulation of the channel are set. The mode selected
+ * is also printed to the console.
+ * @param channel       the channel that is changed
+ * @param state         the state of the channel
+ * @param settings      the settings of the channel from the server
+ */
+void determineMode (const Channel& channel, ChannelState& state, const ChannelSettings& settings) {
+    state.settingsRevision = settings.revision;
+
+    if (settings.surveillanceMode) {
+        state.surveillanceMode = true;
+        Serial.printf("Surveillance mode for %s is activated\n", channel.key);
+        setOutput(channel, state, 0.0);
+        if (state.previousOutputState) {
+            state.lastSwitchTime = millis();
+        }
+        state.previousOutputState = false;
+        state.integral = 0.0;
+        state.outputLevel = 0.0;
+        return;
     }
 
-    determineMode(server_data);
+    state.setpoint = settings.setpoint;
+    state.hysteresis = settings.hysteresis;
+    state.minOnTime = settings.minOnTime;
+    state.minOffTime = settings.minOffTime;
+    if (settings.maxSwitchesPerHour != state.maxSwitchesPerHour) {
+        state.maxSwitchesPerHour = settings.maxSwitchesPerHour;
+        state.switchBudget = state.maxSwitchesPerHour;
+    }
+    state.kp = settings.kp;
+    state.ki = settings.ki;
+    state.kd = settings.kd;
+    setControlMode(channel, state, settings.control);
+    state.surveillanceMode = false;
+    Serial.printf("Normal regulation mode for %s is activated\n", channel.key);
+}
 
-    // TODO - Remove troubleshooting console printing
-    Serial.println(temperatureSetpoint);
-    Serial.println(co2Setpoint);
+/**
+ * Function that is called when the server sends new set-points. The set-points are parsed directly from the payload,
+ * and only if all of them are valid the function updateServerSettings is called for changing the settings of the
+ * sensors and corresponding actuators. If not, prints a status message to console for troubleshooting and nothing is
+ * changed.
+ * @param payload     contains the data sent from server with event "setpoints"
+ * @param length      gives the size of the payload
+ */
+void manageServerSetpoints(const char * payload, size_t length) {
+    SetpointUpdate updates[CHANNEL_COUNT] = {};
+    if (!parseSetpoints(payload, length, updates)) {
+        Serial.println("Set-points payload from index.js is invalid, no set-points were changed");
+        return;
+    }
 
+    updateServerSettings(updates);
 }
 
 /**
- * Function that depending on if is called with sensor type as temperature or co2, and what ESP32 pin number, reads
- * the analog value of the relevant pin and scales the value appropriately. Then returns the value as a float number to
- * the global variable that holds the sensor value for the relevant sensor.
- * @param sensorType     specifies what type of sensor is connected to the inputPin
- * @param inputPin       specifies the ESP32 pin that the analog value is read from
+ * Function that depending on the sensor type of the channel, reads the analog value of the input pin and scales the
+ * value with the scale of the channel, or reads the internal temperature sensor of the ESP32. Then returns the value
+ * as a float number to be stored in the state of the channel.
+ * @param channel        the channel that is read
  * @return               The sensor value in proper physical units
  */
-float readSensorValue (String sensorType, int inputPin) {
-    // Defines local variables that are used to store the values read from ESP32 pins
-    float raw_co2;
-    float raw_temp;
-
-    if (sensorType == "temperature") {
-        raw_temp = analogRead(inputPin);
-        // Returns the value read scaled to reflect proper temperature value
-        return (raw_temp / 4095.0) * 70.0;
-    } else if (sensorType == "co2") {
-        raw_co2 = analogRead(inputPin);
-        // Returns the value read scaled to reflect proper CO2 value
-        return (raw_co2 / 4095.0) * 2000.0;
-    } else {
-        // If the sensor type is not defined according to a possible type
-        // Returns a value that symbolizes an error
-        return -1000.0;
+float readSensorValue (const Channel& channel) {
+    DIAGNOSTICS_SCOPE(STAGE_SAMPLE);
+    switch (channel.type) {
+        case SENSOR_TEMPERATURE:
+        case SENSOR_CO2:
+            // Returns the value read scaled to reflect proper temperature / CO2 value
+            return (analogRead(channel.inputPin) / 4095.0) * channel.scale;
+        case SENSOR_INTERNAL_TEMP:
+            // Reads the internal temperature and changes the value from fahrenheit to celsius
+            return ((temprature_sens_read() - 32) / 1.8);
+    }
+    return 0.0;
+}
+
+/**
+ * Function that adds a new sample to the filter of the channel. Is called with every sample read, also the samples
+ * that are read between each regulation.
+ * @param channel        the channel the sample is read from
+ * @param state          the filter state of the channel
+ * @param sample         the sensor value in proper physical units
+ */
+void addSample (const Channel& channel, ChannelState& state, float sample) {
+    switch (channel.filter) {
+        case FILTER_NONE:
+            state.sampleAverage = sample;
+            break;
+        case FILTER_AVERAGE:
+            // Running average, so the sum can not lose precision or overflow while no value is taken out
+            if (state.sampleCount < AVERAGE_MAX_SAMPLES) {
+                state.sampleCount++;
+            }
+            state.sampleAverage += (sample - state.sampleAverage) / state.sampleCount;
+            break;
+        case FILTER_EMA:
+            // The first sample starts the average, so it does not have to rise from zero
+            if (state.sampleCount == 0) {
+                state.sampleAverage = sample;
+                state.sampleCount = 1;
+            } else {
+                state.sampleAverage += (sample - state.sampleAverage) * EMA_WEIGHT;
+            }
+            break;
+        case FILTER_MEDIAN:
+            state.samples[state.sampleIndex] = sample;
+            state.sampleIndex = (state.sampleIndex + 1) % MEDIAN_SIZE;
+            if (state.sampleCount < MEDIAN_SIZE) {
+                state.sampleCount++;
+            }
+            break;
+    }
+}
+
+/**
+ * Function that returns the filtered value of the samples added since the last call, and starts the next average.
+ * The moving average and the median keep their samples between the calls.
+ * @param channel        the channel the value is taken of
+ * @param state          the filter state of the channel
+ * @return               the filtered sensor value in proper physical units
+ */
+float filteredValue (const Channel& channel, ChannelState& state) {
+    switch (channel.filter) {
+        case FILTER_AVERAGE:
+            // Keeps the last value if no samples has been read since the last call
+            if (state.sampleCount == 0) {
+                return state.value;
+            }
+            state.sampleCount = 0;
+            return state.sampleAverage;
+        case FILTER_MEDIAN: {
+            if (state.sampleCount == 0) {
+                return state.value;
+            }
+            // Sorts a copy of the samples by insertion, and returns the middle sample
+            float sorted[MEDIAN_SIZE];
+            for (uint8_t i = 0; i < state.sampleCount; i++) {
+                float sample = state.samples[i];
+                uint8_t j = i;
+                for (; j > 0 && sorted[j - 1] > sample; j--) {
+                    sorted[j] = sorted[j - 1];
+                }
+                sorted[j] = sample;
+            }
+            return sorted[state.sampleCount / 2];
+        }
+        default:
+            return state.sampleAverage;
     }
 }
 
 /**
  * Function that checks what kind of output actuator type is used for the regulation, and a logic statement that
  * checks depending on if the output actuator is reversed, if the current value of the sensor is lower / higher than
- * the set point. Returns either true or false, which respectively turns the output HIGH or LOW.
+ * the band of the hysteresis around the set point. Inside the band the output keeps its current state. Returns either
+ * true or false, which respectively turns the output HIGH or LOW.
  * @param setPoint             the value of the set-point given from the server
  * @param currentValue         the most recent process value of the sensor
  * @param outputReversed       determines what kind of regulation is used for the actuator (direct / reverse control)
+ * @param currentOutput        the output state now, kept while the value is inside the band
+ * @param hysteresis           the width of the band around the set-point
  * @return                     the bool value that is used to turn output HIGH or LOW
  */
-bool checkSensor (float setPoint, float currentValue, bool outputReversed) {
-    if (outputReversed) {
-        if (setPoint < currentValue) {
-            return true;
-        } else {
-            return false;
-        }
+bool checkSensor (float setPoint, float currentValue, bool outputReversed, bool currentOutput, float hysteresis) {
+    if (currentValue > setPoint + hysteresis / 2) {
+        return outputReversed;
+    } else if (currentValue < setPoint - hysteresis / 2) {
+        return !outputReversed;
     } else {
-        if (setPoint < currentValue) {
+        return currentOutput;
+    }
+}
+
+/**
+ * Function that checks if the actuator of the channel is allowed to switch now. The output has to stay in its current
+ * state for the minimum on / off time of the channel, and the number of switches is limited to the maximum number of
+ * switches per hour on average, with a burst of at most that many switches.
+ * @param state               the control limits and the switch history of the channel
+ * @return                    true if the output can be switched
+ */
+bool isSwitchAllowed (ChannelState& state) {
+    uint32_t now = millis();
+    unsigned long dwell = state.previousOutputState ? state.minOnTime : state.minOffTime;
+    if (now - state.lastSwitchTime < dwell) {
+        return false;
+    }
+
+    if (state.maxSwitchesPerHour > 0) {
+        // Refills the budget of switches with the time passed since the last refill
+        state.switchBudget += (now - state.lastBudgetTime) * state.maxSwitchesPerHour / 3600000.0;
+        if (state.switchBudget > state.maxSwitchesPerHour) {
+            state.switchBudget = state.maxSwitchesPerHour;
+        }
+        state.lastBudgetTime = now;
+        if (state.switchBudget < 1) {
             return false;
-        } else {
-            return true;
         }
     }
+    return true;
+}
+
+/**
+ * Function that passes a message for the server to the network core, which sends it. The message is dropped if the
+ * queue is full, so the control core never waits for the network.
+ * @param event            name of the event
+ * @param data             the JSON string or binary data
+ * @param length           length of the data, at most the size of telemetryBatch
+ * @param binary           if true the data is sent as a binary event
+ * @param reliable         if true the data is sent with an ack id until the server acks it, only for JSON strings
+ * @param journalSequence  sequence number of the last journal record in a replayed message, else 0
+ * @return false if the message was dropped
+ */
+bool queueTelemetry (const char * event, const char * data, size_t length, bool binary, bool reliable,
+                     uint32_t journalSequence = 0) {
+    TelemetryMessage * message = telemetryQueue.beginPush();
+    if (message == NULL || length >= sizeof(message->data)) {
+        telemetryDropped++;
+        return false;
+    }
+    message->event = event;
+    message->binary = binary;
+    message->reliable = reliable;
+    message->journalSequence = journalSequence;
+    message->length = length;
+    memcpy(message->data, data, length);
+    message->data[length] = '\0';
+    telemetryQueue.commitPush();
+    return true;
+}
+
+/**
+ * Function that sends the values in the telemetry batch to the server, as a JSON array with event "sensorDataBatch",
+ * or as binary records with event "sensorDataBinary", and empties the batch.
+ */
+void flushTelemetryBatch () {
+    if (telemetryBatchLength == 0) {
+        return;
+    }
+    if (telemetryBatchBinary) {
+        uint8_t * batch = (uint8_t *) telemetryBatch;
+        batch[1] = (telemetryBatchLength - TELEMETRY_HEADER_SIZE) / TELEMETRY_RECORD_SIZE;
+        queueTelemetry("sensorDataBinary", telemetryBatch, telemetryBatchLength, true, false);
+        telemetryBatchLength = 0;
+        telemetryBatchUrgent = false;
+        return;
+    }
+    telemetryBatch[telemetryBatchLength++] = ']';
+    queueTelemetry("sensorDataBatch", telemetryBatch, telemetryBatchLength, false, false);
+    telemetryBatchLength = 0;
+    telemetryBatchUrgent = false;
 }
 
 /**
- * Function that takes in a bool value for the output and the outputPin that should be controlled. Uses these values to
- * turn on or off the output. An input or true gives HIGH output, and input of false gives LOW output.
- * @param outputPin     specifies the output pin of the ESP32 that is used to control the actuator
- * @param output        the value of what the output should be in bool values
+ * Function that adds a JSON object to the telemetry batch. If the batch is full it is sent first.
+ * @param data             the JSON object that is added
+ * @param urgent           if true the batch is sent at the end of this tick, also if TELEMETRY_MAX_LATENCY is longer
  */
-void setOutput (int outputPin, bool output) {
-    if (output) {
-        digitalWrite(outputPin, HIGH);
+void addToTelemetryBatch (const char * data, bool urgent) {
+    size_t length = strlen(data);
+    // Needs room for the comma, the closing bracket and the null terminator
+    if (telemetryBatchLength + length + 3 > sizeof(telemetryBatch)) {
+        flushTelemetryBatch();
+    }
+    if (telemetryBatchLength == 0) {
+        telemetryBatch[telemetryBatchLength++] = '[';
+        telemetryBatchStart = millis();
+        telemetryBatchBinary = false;
     } else {
-        digitalWrite(outputPin, LOW);
+        telemetryBatch[telemetryBatchLength++] = ',';
     }
+    memcpy(&telemetryBatch[telemetryBatchLength], data, length);
+    telemetryBatchLength += length;
+    telemetryBatchUrgent = telemetryBatchUrgent || urgent;
 }
 
 /**
- * Function that takes in a value in milliseconds, and sets a time in the future based on that value.
- * @param timeout     specifies how long the timeouts should be
+ * Function that adds a binary record to the telemetry batch. If the batch is full, or the time since the first record
+ * does not fit in the record, the batch is sent first.
+ * @param typeOfData       the type of data
+ * @param idKey            name of the sensor / actuator ID
+ * @param value            the sensor value, output state or output level
+ * @param urgent           if true the batch is sent at the end of this tick, also if TELEMETRY_MAX_LATENCY is longer
  */
-void startTimer (int timeout) {
-    nextTimeout = millis() + timeout;
+void addBinaryToTelemetryBatch (DataType typeOfData, const char * idKey, float value, bool urgent) {
+    uint8_t * batch = (uint8_t *) telemetryBatch;
+    uint32_t now = millis();
+    if (telemetryBatchLength + TELEMETRY_RECORD_SIZE > sizeof(telemetryBatch) ||
+        (telemetryBatchLength > 0 && now - telemetryBatchStart > 0xFFFF)) {
+        flushTelemetryBatch();
+    }
+    if (telemetryBatchLength == 0) {
+        telemetryBatchStart = now;
+        telemetryBatchBinary = true;
+        // The number of records is set when the batch is sent
+        encodeTelemetryHeader(batch, 0, telemetryBatchStart);
+        telemetryBatchLength = TELEMETRY_HEADER_SIZE;
+    }
+    encodeTelemetryRecord(&batch[telemetryBatchLength], typeOfData, idKey, now - telemetryBatchStart, value);
+    telemetryBatchLength += TELEMETRY_RECORD_SIZE;
+    telemetryBatchUrgent = telemetryBatchUrgent || urgent;
 }
 
 /**
- * Function that checks if the current time is equal or has passed the timeout that was set
- * @return              value that returns true if timer has expired and false if not
+ * Function that sends the telemetry batch at the end of a tick, if it has an output change or the first value has
+ * waited for TELEMETRY_MAX_LATENCY.
  */
-bool isTimerExpired () {
-    return (millis() >= nextTimeout);
+void checkTelemetryBatch () {
+    uint32_t waited = millis() - telemetryBatchStart;
+    if (telemetryBatchLength > 0 && (telemetryBatchUrgent || waited >= TELEMETRY_MAX_LATENCY)) {
+        flushTelemetryBatch();
+    }
 }
 
 /**
- * Function that first checks what kind of data that should be sent, could be output states or sensor values, as this
- * function is used for all sending of data to server. Further formats the output data to JSON format, with sensor values
- * if the type of data is "sensorValues". Or sends the output state if type of data is "output". Then sends the values
- * with websockets using event "sensorData".
+ * Function that is used for all sending of data to server. Formats the output data to JSON format, with the sensor
+ * value if the type of data is DATA_SENSOR_VALUE. Or with the output state if the type of data is DATA_OUTPUT_STATE.
+ * Or with the output level between 0 and 1 of PID regulated outputs, in sensorValue, if the type of data is
+ * DATA_OUTPUT_LEVEL. Then sends the values with websockets using event "sensorData", or adds them to the telemetry
+ * batch if TELEMETRY_BATCHING is set. With TELEMETRY_BINARY the values are added to the batch as binary records instead,
+ * and the batch is sent at once if TELEMETRY_BATCHING is not set. With TELEMETRY_RELIABLE_OUTPUTS output states are
+ * always sent on their own with "sensorData" and an ack id, so they are not lost when the connection drops. With
+ * JOURNAL_ENABLED the values are appended to the journal instead while the robot is not authenticated.
  * @param typeOfData       argument that determines if the data should be sent as output states or sensor values
  * @param idKey            name of the sensor / actuator ID
- * @param sensorValue      the current value of the sensor [only used when this function is used for sending sensor values]
+ * @param sensorValue      the current value of the sensor or the output level [not used for sending output states]
  * @param outputState      the current value of the output [only used when this function is used for sending output states]
  */
-void sendDataToServer(String typeOfData, String idKey, float sensorValue, bool outputState) {
-    if (typeOfData == "output") {
-        // Formats the outgoing data as a JSON string and sends it to robot-server
-        String data = String("{\"ControlledItemID\":\"" + String(idKey) + "\",\"value\":" + String(outputState) + "}");
-        webSocket.emit("sensorData", data.c_str());
+void sendDataToServer(DataType typeOfData, const char * idKey, float sensorValue, bool outputState) {
+    DIAGNOSTICS_SCOPE(STAGE_FORMAT);
+    if (JOURNAL_ENABLED && !authenticatedByServer) {
+        float value = (typeOfData == DATA_OUTPUT_STATE) ? (outputState ? 1.0 : 0.0) : sensorValue;
+        journal.append(typeOfData, (uint16_t) strtoul(idKey, NULL, 10), value, millis());
+        return;
+    }
 
-    } else if (typeOfData == "sensorValues") {
-        // Formats the outgoing data as a JSON string and sends it to robot-server
-        String data = String("{\"SensorID\":\"" + String(idKey) + "\",\"value\":" + String(sensorValue) + "}");
-        webSocket.emit("sensorData", data.c_str());
+    char data[64];
+    if (TELEMETRY_RELIABLE_OUTPUTS && typeOfData == DATA_OUTPUT_STATE) {
+        snprintf(data, sizeof(data), "{\"ControlledItemID\":\"%s\",\"value\":%d}", idKey, outputState ? 1 : 0);
+        queueTelemetry("sensorData", data, strlen(data), false, true);
+        return;
+    }
 
+    if (TELEMETRY_BINARY) {
+        float value = (typeOfData == DATA_OUTPUT_STATE) ? (outputState ? 1.0 : 0.0) : sensorValue;
+        addBinaryToTelemetryBatch(typeOfData, idKey, value, typeOfData != DATA_SENSOR_VALUE);
+        if (!TELEMETRY_BATCHING) {
+            flushTelemetryBatch();
+        }
+        return;
+    }
+
+    // Formats the outgoing data as a JSON string and sends it to robot-server
+    if (typeOfData == DATA_OUTPUT_STATE) {
+        snprintf(data, sizeof(data), "{\"ControlledItemID\":\"%s\",\"value\":%d}", idKey, outputState ? 1 : 0);
+    } else if (typeOfData == DATA_OUTPUT_LEVEL) {
+        snprintf(data, sizeof(data), "{\"ControlledItemID\":\"%s\",\"value\":%.2f}", idKey, sensorValue);
     } else {
-        // Prints to console for error notification
-        Serial.println("Invalid type of data");
+        snprintf(data, sizeof(data), "{\"SensorID\":\"%s\",\"value\":%.2f}", idKey, sensorValue);
     }
 
+    if (TELEMETRY_BATCHING) {
+        addToTelemetryBatch(data, typeOfData != DATA_SENSOR_VALUE);
+    } else {
+        queueTelemetry("sensorData", data, strlen(data), false, false);
+    }
 }
 
 /**
- * Function that finds out what state the output should be in by calling the checkSensor functions with relevant
- * parameters. Depending on what kind of sensor / actuator pair of regulation is called with this function, goes into
- * the appropriate if statement condition. Then checks if the output state has changed since the last iteration, if the
- * output has changed the if statement is entered, and output is set. Further variables that holds the previous output
- * state is set again to that value, for future iterations to check against. Then this output state is sent to the server
- * using the function sendDataToServer.
- * @param typeOfData          argument that states the output actuator type
- * @param setpoint            the value of the set-point given from the server
- * @param currentValue        the most recent process value of the sensor
- * @param outputPin           specifies the output pin of the ESP32 that is used to control the actuator
- * @param outputReversed      determines what kind of regulation is used for the actuator (direct / reverse control)
- * @param idKey               name of the sensor / actuator ID
+ * Function that finds out what state the output should be in by calling the checkSensor function with the set-point
+ * and value of the channel. Then checks if the output state has changed since the last iteration, if the output has
+ * changed and the control limits of the channel allows a switch, the if statement is entered, and output is set.
+ * Further the previous output state of the channel is set again to that value, for future iterations to check against.
+ * Then this output state is sent to the server using the function sendDataToServer.
+ * @param channel             the sensor / actuator pair that is regulated
+ * @param state               the set-point, value and previous output state of the channel
  */
-void setOutputState (String typeOfData, float setpoint, float currentValue, int outputPin, bool outputReversed, String idKey) {
+void setOutputState (const Channel& channel, ChannelState& state) {
     // Calls function to check what state the output should be in and stores this value
-    bool output = checkSensor(setpoint, currentValue, outputReversed);
+    bool output = checkSensor(state.setpoint, state.value, channel.reversed, state.previousOutputState,
+                              state.hysteresis);
+
+    // If the output has changed since last iteration and the limits allows a switch, data is sent and output is
+    // changed to new state
+    if (output != state.previousOutputState && isSwitchAllowed(state)) {
+        setOutput(channel, state, output ? 1.0 : 0.0);
+        state.lastSwitchTime = millis();
+        state.switchBudget -= 1;
+        // Sets new previous output state to be used for next iteration of program
+        state.previousOutputState = output;
+        sendDataToServer(DATA_OUTPUT_STATE, channel.key, 0.0, output);
+    }
+}
 
-    //  Checks what type of data the sensor and corresponding actuator is, and goes into correct instruction set
-    if (typeOfData == "temperature") {
-        // If the output has changed since last iteration, data is sent and output is changed to new state
-        if (output != previousTempOutputState) {
-            setOutput(outputPin, output);
-            // Sets new previous output state to be used for next iteration of program
-            previousTempOutputState = output;
-            sendDataToServer("output", idKey, 0.0, output);
-        }
-    } else if (typeOfData == "co2") {
-        // If the output has changed since last iteration, data is sent and output is changed to new state
-        if (output != previousCo2OutputState) {
-            setOutput(outputPin, output);
-            // Sets new previous output state to be used for next iteration of program
-            previousCo2OutputState = output;
-            sendDataToServer("output", idKey, 0.0, output);
-        }
+/**
+ * Function that runs one PID regulation of the channel, and sets the output. Is called every CONTROL_PERIOD. The
+ * derivative part uses the change of the value instead of the error, so a new set-point does not give a spike in the
+ * output. The integral part is kept between 0 and 1, so it can not wind up while the output is saturated. With
+ * CONTROL_PID_PWM the output level is the duty cycle of the PWM output, with CONTROL_PID_RELAY it is the part of each
+ * TIME_PROPORTIONING_WINDOW the output is on.
+ * @param channel             the sensor / actuator pair that is regulated
+ * @param state               the set-point, value, gains and PID state of the channel
+ * @param dt                  the time since the last regulation in seconds
+ */
+void regulatePid (const Channel& channel, ChannelState& state, float dt) {
+    // A reversed actuator, like ventilation, has to be on when the value is above the set-point
+    float error = channel.reversed ? state.value - state.setpoint : state.setpoint - state.value;
+    // The first regulation has no previous value to find the change from
+    if (isnan(state.previousInput)) {
+        state.previousInput = state.value;
+    }
+    float change = (state.value - state.previousInput) / dt;
+    if (channel.reversed) {
+        change = -change;
+    }
+    state.previousInput = state.value;
+
+    state.integral = constrain(state.integral + state.ki * error * dt, 0.0, 1.0);
+    state.outputLevel = constrain(state.kp * error + state.integral - state.kd * change, 0.0, 1.0);
+
+    if (state.control == CONTROL_PID_PWM) {
+        setOutput(channel, state, state.outputLevel);
+        return;
+    }
+
+    // Time proportioning, the output is on for the first part of every window. The on time follows the output level
+    // through the window, so the output is turned off early when the value reaches the set-point. Once it is off it
+    // stays off until the next window, so the output is switched at most twice in a window
+    uint32_t now = millis();
+    bool windowStarted = now - state.windowStart >= TIME_PROPORTIONING_WINDOW;
+    if (windowStarted) {
+        state.windowStart = now;
+    }
+    state.windowOnTime = state.outputLevel * TIME_PROPORTIONING_WINDOW;
+    if (state.windowOnTime < TIME_PROPORTIONING_MIN_PULSE) {
+        // A pulse that has started is not cut shorter than the shortest pulse
+        state.windowOnTime = (state.previousOutputState && !windowStarted) ? TIME_PROPORTIONING_MIN_PULSE : 0;
+    } else if (TIME_PROPORTIONING_WINDOW - state.windowOnTime < TIME_PROPORTIONING_MIN_PULSE) {
+        state.windowOnTime = TIME_PROPORTIONING_WINDOW;
+    }
+    bool output = (windowStarted || state.previousOutputState) && (now - state.windowStart) < state.windowOnTime;
+    if (output != state.previousOutputState) {
+        setOutput(channel, state, output ? 1.0 : 0.0);
+        state.lastSwitchTime = now;
+        state.previousOutputState = output;
+    }
+}
+
+/**
+ * Function that sends the output level of a PID regulated channel to the server, if it has changed more than
+ * OUTPUT_LEVEL_DEADBAND since it was sent last, or has reached fully on or off.
+ * @param channel             the actuator that is checked
+ * @param state               the output level and the output level last sent of the channel
+ */
+void checkForOutputLevelChange (const Channel& channel, ChannelState& state) {
+    float level = state.outputLevel;
+    bool limitReached = (level == 0.0 || level == 1.0) && level != state.reportedLevel;
+    if (limitReached || fabs(level - state.reportedLevel) >= OUTPUT_LEVEL_DEADBAND) {
+        sendDataToServer(DATA_OUTPUT_LEVEL, channel.key, level, false);
+        state.reportedLevel = level;
     }
 }
 
@@ -368,67 +1252,447 @@ float decimalRound(float input, int decimals) {
 }
 
 /**
- * Function that first checks what kind of process value is being processed. Then finds the rounded value of the
- * process current value called with the function. Further uses this value to check if the process value has changed
- * enough to warrant a message sent with websockets to the server. The limits for how much the process value has to
- * change depends on what kind of type of sensor is called. When the data is sent, a new previous sensor value is set
- * for future iterations to check against.
- * @param typeOfData         argument that determines if the data should be sent as output states or sensor values
- * @param idKey              name of the sensor / actuator ID
- * @param currentValue       the most recent process value of the sensor
+ * Function that finds the rounded value of the most recent process value of the channel. Further uses this value to
+ * check if the process value has changed more than the deadband of the channel, which warrants a message sent with
+ * websockets to the server. When the data is sent, a new previous sensor value is set for future iterations to check
+ * against.
+ * @param channel            the sensor that is checked
+ * @param state              the value and previous value of the channel
+ */
+void checkForSensorChange (const Channel& channel, ChannelState& state) {
+    // Calls function to round the sensor value to one decimal point
+    float rounded_value = decimalRound(state.value, 1);
+
+    // Checks if the value has changed within the threshold values
+    if ((state.previousValue - channel.deadband) > rounded_value or (state.previousValue + channel.deadband) < rounded_value) {
+        // Sends the new value to server
+        sendDataToServer(DATA_SENSOR_VALUE, channel.key, rounded_value, false);
+        // Sets the new value for next iteration comparison
+        state.previousValue = rounded_value;
+    }
+}
+
+
+/**
+ * Task that reads the value of the the sensor of every channel, every sample is used by the filter of the channel.
+ */
+void sampleTask () {
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        addSample(CHANNELS[i], channelStates[i], readSensorValue(CHANNELS[i]));
+    }
+}
+
+/**
+ * Task that takes the filtered value of the samples read since the last regulation, and regulates the PID regulated
+ * outputs.
  */
-void checkForSensorChange (String typeOfData, String idKey, float currentValue) {
-    // Local variable that stores a local value of the sensor value
-    float rounded_value;
+void controlTask () {
+    DIAGNOSTICS_SCOPE(STAGE_CONTROL);
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        channelStates[i].value = filteredValue(CHANNELS[i], channelStates[i]);
+    }
 
-    if (typeOfData == "temperature") {
-        // Calls function to round the sensor value to one decimal point
-        rounded_value = decimalRound(currentValue, 1);
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        if (CHANNELS[i].outputPin != NO_PIN && !channelStates[i].surveillanceMode &&
+            channelStates[i].control != CONTROL_ON_OFF) {
+            regulatePid(CHANNELS[i], channelStates[i], CONTROL_PERIOD / 1000.0);
+        }
+    }
+}
 
-        // Checks if the temperature has changed within the threshold values
-        if ((previousTempValue - .2) > rounded_value or (previousTempValue + .2) < rounded_value) {
-            // Sends the new value to server
-            sendDataToServer("sensorValues", idKey, rounded_value, false);
-            // Sets the new temperature value for text iteration comparison
-            previousTempValue = rounded_value;
+/**
+ * Task that sets the on / off outputs, and sends the output levels and sensor values that have changed to the server.
+ */
+void reportTask () {
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        // If surveillance mode is deactivated, the robot knows that it is active regulation and outputs can be set
+        if (CHANNELS[i].outputPin != NO_PIN && !channelStates[i].surveillanceMode) {
+            if (channelStates[i].control == CONTROL_ON_OFF) {
+                setOutputState(CHANNELS[i], channelStates[i]);
+            } else {
+                checkForOutputLevelChange(CHANNELS[i], channelStates[i]);
+            }
         }
+    }
+
+    // Checks if the sensors has read a large enough chance to exceed the threshold to send the values to server
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        checkForSensorChange(CHANNELS[i], channelStates[i]);
+    }
 
-    } else if (typeOfData == "co2") {
-        // Calls function to round the sensor value to one decimal point
-        rounded_value = decimalRound(currentValue, 1);
+    // Sends the values of this tick as one message
+    checkTelemetryBatch();
+}
 
-        // Checks if the CO2 level has changed within the threshold values
-        if ((previousCo2Value - 1) > rounded_value or (previousCo2Value + 1) < rounded_value) {
-            // Sends the new value to server
-            sendDataToServer("sensorValues", idKey, rounded_value, false);
-            // Sets the new CO2 value for text iteration comparison
-            previousCo2Value = rounded_value;
+/**
+ * Task that changes the mode of the channels when the server has sent new settings. Only the channels that were in the
+ * set-points are changed.
+ */
+void settingsTask () {
+    if (serverSettingsLock.sequence() == appliedSettingsSequence) {
+        return;
+    }
+    static ServerSettings settings;
+    appliedSettingsSequence = serverSettingsLock.read(settings);
+    setpointsReceived = true;
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        if (settings.channels[i].revision != channelStates[i].settingsRevision) {
+            determineMode(CHANNELS[i], channelStates[i], settings.channels[i]);
         }
-    } else if (typeOfData == "internal-temp") {
-        // Reads the internal temperature and changes the value from fahrenheit to celsius
-        internalTempValue = ((temprature_sens_read() - 32) / 1.8);
-        // Rounds the internal temperature to a number with a one decimal place
-        rounded_value = decimalRound(internalTempValue, 1);
+    }
+}
 
-        // Check if the internal temperature level has changed within the threshold values
-        if ((previousInternalTempValue - .2) > rounded_value or (previousInternalTempValue + .2) < rounded_value) {
-            // Sends the new value to server
-            sendDataToServer("sensorValues", idKey, rounded_value, false);
-            // Sets the new internal temperature value for text iteration comparison
-            previousInternalTempValue = rounded_value;
+/**
+ * Task that sends the oldest values in the journal to the server with event "sensorDataReplay", as a JSON array like
+ * [{"SensorID":"001","value":21.40,"age":61000},{"ControlledItemID":"001","value":1,"age":null}]. The age is the time
+ * in ms since the value was taken, null if it was taken before the robot restarted. The message is sent with an ack id,
+ * and the records are only marked as replayed in the journal when the server has acked it, so the next message waits
+ * for that. Values that are taken while the journal is replayed are sent as usual.
+ */
+void replayTask () {
+    // Sequence number of the last record in the message waiting for its ack, 0 if none
+    static uint32_t replayingSequence = 0;
+    if (replayingSequence != 0) {
+        if (replayAckedSequence != replayingSequence) {
+            return;
         }
+        journal.commit(replayingSequence);
+        replayingSequence = 0;
+    }
+
+    JournalRecord records[JOURNAL_REPLAY_BATCH];
+    size_t count = journal.read(records, JOURNAL_REPLAY_BATCH);
+    if (count == 0) {
+        return;
     }
+
+    // Has to fit in a packet of the ack window with the event name and ack id
+    char data[SOCKETIOCLIENT_ACK_PACKET_SIZE - 48];
+    size_t length = 1;
+    size_t sent = 0;
+    data[0] = '[';
+    for (; sent < count; sent++) {
+        const JournalRecord& record = records[sent];
+        const char * idName = (record.type == DATA_SENSOR_VALUE) ? "SensorID" : "ControlledItemID";
+        const char * format = (record.type == DATA_OUTPUT_STATE) ? "%s{\"%s\":\"%03u\",\"value\":%.0f,\"age\":"
+                                                                 : "%s{\"%s\":\"%03u\",\"value\":%.2f,\"age\":";
+        char entry[128];
+        int entryLength = snprintf(entry, sizeof(entry), format, sent > 0 ? "," : "", idName, (unsigned) record.id,
+                                   record.value);
+        if (journal.currentBoot(record)) {
+            entryLength += snprintf(&entry[entryLength], sizeof(entry) - entryLength, "%lu}",
+                                    (unsigned long) (uint32_t) (millis() - record.time));
+        } else {
+            entryLength += snprintf(&entry[entryLength], sizeof(entry) - entryLength, "null}");
+        }
+        // Needs room for the closing bracket and the null terminator
+        if (entryLength >= (int) sizeof(entry) || length + entryLength + 2 > sizeof(data)) {
+            break;
+        }
+        memcpy(&data[length], entry, entryLength);
+        length += entryLength;
+    }
+    if (sent == 0) {
+        // A value that can never fit in a message is skipped, so the replay does not stop at it
+        journal.commit(records[0].sequence);
+        return;
+    }
+    data[length++] = ']';
+    data[length] = '\0';
+
+    uint32_t lastSequence = records[sent - 1].sequence;
+    if (queueTelemetry("sensorDataReplay", data, length, false, true, lastSequence)) {
+        replayingSequence = lastSequence;
+    }
+}
+
+/**
+ * Function that sends a message with an ack id, and keeps the ack id of a replayed journal message so the replay task
+ * can be told when the server has acked it.
+ * @param message          the message
+ * @param replayedSequence set to the sequence number of the last journal record of a replayed message
+ * @param replayedAckId    set to the ack id of a replayed message
+ * @return false if the ack window of webSocket is full
+ */
+bool sendReliableTelemetry (const TelemetryMessage& message, uint32_t& replayedSequence, uint32_t& replayedAckId) {
+    uint32_t ackId;
+    if (!webSocket.emitWithAck(message.event, message.data, &ackId)) {
+        return false;
+    }
+    if (message.journalSequence != 0) {
+        replayedSequence = message.journalSequence;
+        replayedAckId = ackId;
+    }
+    return true;
+}
+
+/**
+ * Function that sends the messages the control core has queued for the server. A message with an ack id that does not
+ * fit in the ack window of webSocket is moved to heldTelemetry, and sent when the server has acked older messages, so
+ * the messages without ack are never held up by a server that is slow to ack or never does. When heldTelemetry is full
+ * too, new output changes are dropped and counted in heldDropped. The replay task is told when the server has acked
+ * the replayed journal message, by the ack id of that message.
+ */
+void sendQueuedTelemetry () {
+    // Sequence number of the last journal record in the replayed message that waits for its ack, 0 if none
+    static uint32_t replayedSequence = 0;
+    static uint32_t replayedAckId = 0;
+    if (replayedSequence != 0 && webSocket.isAcked(replayedAckId)) {
+        replayAckedSequence = replayedSequence;
+        replayedSequence = 0;
+    }
+
+    // The held messages go first, in the order they were queued
+    while (heldCount > 0 && sendReliableTelemetry(heldTelemetry[heldHead], replayedSequence, replayedAckId)) {
+        heldHead = (heldHead + 1) % TELEMETRY_HELD_SIZE;
+        heldCount--;
+    }
+
+    TelemetryMessage * message;
+    while ((message = telemetryQueue.peek()) != NULL) {
+        if (message->reliable) {
+            if (heldCount > 0 || !sendReliableTelemetry(*message, replayedSequence, replayedAckId)) {
+                // The replay task waits for the ack of its message before it queues the next, so one place is enough
+                size_t room = (message->journalSequence != 0) ? TELEMETRY_HELD_SIZE : TELEMETRY_HELD_SIZE - 1;
+                if (heldCount < room) {
+                    memcpy(&heldTelemetry[(heldHead + heldCount) % TELEMETRY_HELD_SIZE], message, sizeof(*message));
+                    heldCount++;
+                } else {
+                    heldDropped++;
+                }
+            }
+        } else if (message->binary) {
+            webSocket.emitBinary(message->event, (const uint8_t *) message->data, message->length);
+        } else {
+            webSocket.emit(message->event, message->data);
+        }
+        telemetryQueue.pop();
+    }
+}
+
+/**
+ * FreeRTOS task on NETWORK_CORE that handles the connection with the server. Receives events, sends the queued
+ * messages, pings the server and reconnects when the connection is lost. Only this task uses webSocket after setup,
+ * so a slow network does not stop the regulation in loop().
+ * @param parameter       not used
+ */
+void networkTask (void * parameter) {
+    (void) parameter;
+    for (;;) {
+        webSocket.loop();
+        sendQueuedTelemetry();
+        // Lets the idle task of the core run, so its watchdog is not triggered
+        vTaskDelay(1);
+    }
+}
+
+#ifdef ENABLE_DIAGNOSTICS
+/**
+ * Task that sends event "diagnostics" to the server: the number of calls, the total time and the longest call in us of
+ * each stage since the last event, and the free heap and largest free block in bytes, with their lowest values since
+ * start. Stages that run inside other stages are counted in both. For example
+ * {"time":60000,"heap":[181000,176000,110000,108000],"stages":{"sample":[60000,41000,12],"control":[60,900,20],...}}
+ */
+void diagnosticsTask () {
+    static uint32_t lastCalls[STAGE_COUNT];
+    static uint32_t lastMicros[STAGE_COUNT];
+    DiagnosticsHeap heap;
+    diagnosticsReadHeap(heap);
+
+    // At most 460 characters with every number at its largest
+    char data[sizeof(TelemetryMessage::data)];
+    int length = snprintf(data, sizeof(data), "{\"time\":%lu,\"heap\":[%u,%u,%u,%u],\"stages\":{", millis(),
+                          (unsigned) heap.freeHeap, (unsigned) heap.minFreeHeap, (unsigned) heap.largestBlock,
+                          (unsigned) heap.minLargestBlock);
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        DiagnosticsCounters& counters = diagnosticsCounters()[i];
+        uint32_t calls = counters.calls.load(std::memory_order_relaxed);
+        uint32_t totalMicros = counters.totalMicros.load(std::memory_order_relaxed);
+        uint32_t maxMicros = counters.maxMicros.exchange(0, std::memory_order_relaxed);
+        length += snprintf(&data[length], sizeof(data) - length, "%s\"%s\":[%u,%u,%u]", i > 0 ? "," : "",
+                           DIAGNOSTICS_STAGE_NAMES[i], (unsigned) (calls - lastCalls[i]),
+                           (unsigned) (totalMicros - lastMicros[i]), (unsigned) maxMicros);
+        lastCalls[i] = calls;
+        lastMicros[i] = totalMicros;
+    }
+    length += snprintf(&data[length], sizeof(data) - length, "}}");
+    queueTelemetry("diagnostics", data, length, false, false);
 }
+#endif
+
+void statisticsTask ();
+
+// A function that is run by the scheduler in loop()
+struct Task {
+    const char * name;        // Name used when the statistics are printed
+    void (*run)();            // Function that is called when the task is due
+    unsigned long period;     // Time in ms between each run, 0 runs the task on every pass of loop()
+    bool authenticated;       // The task only runs when the robot is authenticated by the server
+    bool offline;             // With JOURNAL_ENABLED the task also runs when the robot is not authenticated, once the
+                              // server has sent set-points, and its values are kept in the journal
+};
+
+// The tasks of loop() in the order they run in when several are due in the same pass, the connection with the server
+// runs in networkTask on the other core
+const Task TASKS[] = {
+    // name          run              period                 authenticated offline
+    { "sample",      sampleTask,      0,                     false,        false },
+    { "settings",    settingsTask,    0,                     false,        false },
+    { "control",     controlTask,     CONTROL_PERIOD,        true,         true  },
+    { "report",      reportTask,      REPORT_PERIOD,         true,         true  },
+    { "replay",      replayTask,      JOURNAL_REPLAY_PERIOD, true,         false },
+    { "statistics",  statisticsTask,  STATISTICS_PERIOD,     false,        false },
+#ifdef ENABLE_DIAGNOSTICS
+    { "diagnostics", diagnosticsTask, DIAGNOSTICS_PERIOD,    true,         false },
+#endif
+};
 
+const size_t TASK_COUNT = sizeof(TASKS) / sizeof(TASKS[0]);
+
+// Timing of a task, and the statistics since they were last printed
+struct TaskState {
+    uint32_t lastRun;         // millis() the last run was scheduled for, the next run is due one period later
+    uint32_t runs;            // Number of runs
+    uint32_t overruns;        // Number of runs that started a whole period late, so a run was skipped
+    unsigned long totalJitter; // Sum of the delays in ms from when a run was due to when it started
+    unsigned long maxJitter;  // Longest delay in ms from when a run was due to when it started
+    unsigned long maxDuration; // Longest run in us
+};
+
+TaskState taskStates[TASK_COUNT];
+
+/**
+ * Task that prints how late the tasks have started and how long they have run since the last print, so it can be seen
+ * if a task runs so long that the control task is late, and how many messages were dropped because the network core
+ * was behind or the server did not ack the output changes. The statistics are then reset.
+ */
+void statisticsTask () {
+    Serial.printf("Telemetry: %u messages dropped, %u output changes dropped waiting for acks\n",
+                  (unsigned) telemetryDropped, (unsigned) heldDropped.exchange(0));
+    telemetryDropped = 0;
+    if (JOURNAL_ENABLED) {
+        Serial.printf("Journal: %u values waiting, %u lost, sectors erased up to %u times\n",
+                      (unsigned) journal.pending(), (unsigned) journal.lost(), (unsigned) journal.eraseCount());
+    }
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        TaskState& state = taskStates[i];
+        Serial.printf("Task %s: %u runs, %u overruns, jitter %lu ms average %lu ms max, longest run %lu us\n",
+                      TASKS[i].name, (unsigned) state.runs, (unsigned) state.overruns,
+                      state.runs > 0 ? state.totalJitter / state.runs : 0, state.maxJitter, state.maxDuration);
+        state.runs = 0;
+        state.overruns = 0;
+        state.totalJitter = 0;
+        state.maxJitter = 0;
+        state.maxDuration = 0;
+    }
+}
+
+/**
+ * Function that runs the tasks that are due. The time since the last run is compared, not the time of the next run, so
+ * the tasks keep running when millis() wraps around after 49.7 days. A task keeps its fixed rate when it is late,
+ * unless it is a whole period late. Then it starts again from now, and the skipped runs are counted as an overrun.
+ * Tasks that need authentication are kept due until the robot is authenticated, or until it has set-points if they
+ * can run offline.
+ */
+void runTasks () {
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        const Task& task = TASKS[i];
+        TaskState& state = taskStates[i];
+        uint32_t now = millis();
+        uint32_t elapsed = now - state.lastRun;
+        if (elapsed < task.period) {
+            continue;
+        }
+        bool runsOffline = JOURNAL_ENABLED && task.offline && setpointsReceived;
+        if (task.authenticated && !authenticatedByServer && !runsOffline) {
+            state.lastRun = now - task.period;
+            continue;
+        }
+
+        uint32_t jitter = elapsed - task.period;
+        if (jitter < task.period) {
+            state.lastRun += task.period;
+        } else {
+            // Tasks that run on every pass of loop() are always due again from now, their jitter is the time of a pass
+            state.lastRun = now;
+            if (task.period > 0) {
+                state.overruns++;
+            }
+        }
+        state.runs++;
+        state.totalJitter += jitter;
+        state.maxJitter = max(state.maxJitter, (unsigned long) jitter);
+
+        unsigned long start = micros();
+        task.run();
+        state.maxDuration = max(state.maxDuration, micros() - start);
+    }
+}
+
+/**
+ * Function that sets the outputs of the actuators, and the default settings of the channels. The server changes the
+ * settings from the same defaults.
+ */
+void setupChannels () {
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        if (CHANNELS[i].outputPin != NO_PIN) {
+            pinMode(CHANNELS[i].outputPin, OUTPUT);
+        }
+        channelStates[i].hysteresis = CHANNELS[i].hysteresis;
+        channelStates[i].minOnTime = DEFAULT_MIN_ON_TIME;
+        channelStates[i].minOffTime = DEFAULT_MIN_OFF_TIME;
+        channelStates[i].maxSwitchesPerHour = DEFAULT_MAX_SWITCHES_PER_HOUR;
+        channelStates[i].switchBudget = DEFAULT_MAX_SWITCHES_PER_HOUR;
+        channelStates[i].lastBudgetTime = millis();
+        channelStates[i].control = CHANNELS[i].control;
+        channelStates[i].kp = CHANNELS[i].kp;
+        channelStates[i].ki = CHANNELS[i].ki;
+        channelStates[i].kd = CHANNELS[i].kd;
+        channelStates[i].previousInput = NAN;
+        // The first switch after start is not delayed by the minimum on / off time
+        channelStates[i].lastSwitchTime = millis() - max(DEFAULT_MIN_ON_TIME, DEFAULT_MIN_OFF_TIME);
+
+        ChannelSettings& settings = serverSettings.channels[i];
+        settings.control = channelStates[i].control;
+        settings.hysteresis = channelStates[i].hysteresis;
+        settings.minOnTime = channelStates[i].minOnTime;
+        settings.minOffTime = channelStates[i].minOffTime;
+        settings.maxSwitchesPerHour = channelStates[i].maxSwitchesPerHour;
+        settings.kp = channelStates[i].kp;
+        settings.ki = channelStates[i].ki;
+        settings.kd = channelStates[i].kd;
+    }
+    serverSettingsLock.write(serverSettings);
+    appliedSettingsSequence = serverSettingsLock.sequence();
+}
+
+/**
+ * Function that sets the tasks of loop() due, so every task runs on the first pass of loop() and the regulation takes
+ * the values before anything is sent to the server. The statistics are first printed after one period.
+ */
+void setupTasks () {
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        taskStates[i].lastRun = (TASKS[i].run == statisticsTask) ? millis() : millis() - TASKS[i].period;
+    }
+}
 
 void setup() {
     // Starts the serial communication between the editor and the surveillance of the robot
     Serial.begin(9600);
     delay(10);
 
-    // Sets relevant outputs for the actuators
-    pinMode(HEATER_OUTPUT_PIN, OUTPUT);
-    pinMode(VENTILATION_OUTPUT_PIN, OUTPUT);
+    // Sets relevant outputs for the actuators, and the default control limits
+    setupChannels();
+
+    // Values from before a restart that were not sent yet are replayed when the robot is authenticated
+    if (JOURNAL_ENABLED) {
+        if (journal.begin(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                   JOURNAL_PARTITION))) {
+            Serial.printf("Journal: %u values to replay\n", (unsigned) journal.pending());
+        } else {
+            Serial.println("Journal: no partition, values taken offline are not kept");
+        }
+    }
 
     // We start by connecting to a WiFi network
     Serial.println();
@@ -449,52 +1713,20 @@ void setup() {
 
 
     // Listen events for all websockets events from raspberryPiServer
-    webSocket.on("connect", socketConnected);
-    webSocket.on("disconnect", socketDisconnected);
-    webSocket.on("authentication", authenticateFeedback);
-    webSocket.on("setpoints", manageServerSetpoints);
+    webSocket.on(EVENT_CONNECT, socketConnected);
+    webSocket.on(EVENT_DISCONNECT, socketDisconnected);
+    webSocket.on(EVENT_AUTHENTICATION, authenticateFeedback);
+    webSocket.on(EVENT_SETPOINTS, manageServerSetpoints);
 
 
-    // Setup Connection with raspberryPiServer
+    // Setup Connection with raspberryPiServer, handled by the network task from now on
     webSocket.begin(HOST, PORT, PATH);
+    xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK_SIZE, NULL, NETWORK_TASK_PRIORITY, NULL,
+                            NETWORK_CORE);
+
+    setupTasks();
 }
 
 void loop() {
-    // Reads the value of the the sensor connected to associated pin and saves the value in a global variable
-    tempValue = readSensorValue("temperature", TEMP_INPUT_PIN);
-    co2Value = readSensorValue("co2", CO2_INPUT_PIN);
-
-    // If the function over has returned -1000, this statements knows that an error has occurred and prints message
-    if (tempValue == -1000.0 or co2Value == -1000.0) {
-        Serial.println("Invalid sensor type argument given to readSensorValue function");
-    }
-
-    // If the robot has been authenticated regulation and regular communication can be established
-    if (authenticatedByServer) {
-        // If the timer that controls the update speed has expired, the robot can proceed with regulation and communication
-        if (isTimerExpired()) {
-            // If surveillance mode is deactivated, the robot knows that it is active regulation and outputs can be set
-            if (!surveillanceModeTemp) {
-                setOutputState("temperature", temperatureSetpoint, tempValue, HEATER_OUTPUT_PIN, tempActuatorReversed,
-                               TEMP_SENSOR_KEY);
-            }
-            // If surveillance mode is deactivated, the robot knows that it is active regulation and outputs can be set
-            if (!surveillanceModeCo2) {
-                setOutputState("co2", co2Setpoint, co2Value, VENTILATION_OUTPUT_PIN, co2ActuatorReversed,
-                               CO2_SENSOR_KEY);
-            }
-
-            // Checks if the sensors has read a large enough chance to exceed the threshold to send the values to server
-            checkForSensorChange("temperature", TEMP_SENSOR_KEY, tempValue);
-            checkForSensorChange("co2", CO2_SENSOR_KEY, co2Value);
-            checkForSensorChange("internal-temp", INTERNAL_TEMP_SENSOR_KEY, 0);
-
-            // Starts a timer for when the next time the robot can set output states and send current values to server
-            // This value is used in the statement that is evaluated to enter this part of the code
-            startTimer (timeout);
-        }
-
-    }
-
-    webSocket.loop();
+    runTasks();
 }
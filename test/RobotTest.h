@@ -0,0 +1,69 @@
+/***********************************************************************************************************************
+ * ROBOT CLIENT FOR THE NATIVE TESTS
+ * INCLUDES SRC/MAIN.CPP, SO A TEST CAN CALL THE FUNCTIONS OF THE CLIENT AND CHECK ITS STATE. THE CLIENT IS STARTED IN
+ * THE SIMULATED ROOM WITHOUT THE NETWORK TASK, AND THE TEST TAKES THE MESSAGES THE NETWORK CORE WOULD SEND
+ ***********************************************************************************************************************/
+#ifndef ROBOT_TEST_H
+#define ROBOT_TEST_H
+
+#include "../src/main.cpp"
+#include "Simulation.h"
+
+WiFiClass WiFi;
+
+/**
+ * Function that starts the client as setup() does, without the Wi-Fi, the journal and the network task. The robot
+ * counts as authenticated, so every task runs and the values are queued for the server.
+ */
+void startRobot() {
+    simulationSetupRoom();
+    memset(channelStates, 0, sizeof(channelStates));
+    memset(&serverSettings, 0, sizeof(serverSettings));
+    memset(taskStates, 0, sizeof(taskStates));
+    setupChannels();
+    setupTasks();
+    authenticatedByServer = true;
+}
+
+/**
+ * Function that gives the client set-points as the server does, and changes the channels at once.
+ * @param setpoints     the set-points, a JSON object
+ */
+void sendSetpoints(const char * setpoints) {
+    manageServerSetpoints(setpoints, strlen(setpoints));
+    settingsTask();
+}
+
+/**
+ * Function that takes the messages the control core has queued, as the network core does when it sends them.
+ * @return number of messages taken
+ */
+size_t takeTelemetry() {
+    size_t count = 0;
+    while (telemetryQueue.peek() != NULL) {
+        telemetryQueue.pop();
+        count++;
+    }
+    return count;
+}
+
+// Time in ms the stopped clock moves between the passes of loop() in runRobot
+const unsigned long ROBOT_STEP = 100;
+
+/**
+ * Function that runs the client on the stopped clock, see nativeClockStop. The clock moves ROBOT_STEP between the
+ * passes of loop(), the queued messages are taken after each pass and check is called.
+ * @param ms            time in ms to run
+ * @param check         called after every pass of loop()
+ */
+template<typename Check>
+void runRobot(unsigned long ms, Check check) {
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += ROBOT_STEP) {
+        loop();
+        takeTelemetry();
+        check();
+        nativeClockAdvance(ROBOT_STEP * 1000);
+    }
+}
+
+#endif
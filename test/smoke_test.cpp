@@ -0,0 +1,109 @@
+/***********************************************************************************************************************
+ * SMOKE TEST OF THE NATIVE BUILD
+ * STARTS ROBOT_CLIENT AGAINST A LOOPBACK STAND-IN OF SERVER_NO_ENCRYPT.JS, AND CHECKS THAT IT AUTHENTICATES, TAKES THE
+ * SET-POINTS AND SENDS TELEMETRY WITHOUT STOPPING. BUILT WITH NATIVE_SANITIZE THE CLIENT STOPS AT THE FIRST ERROR THE
+ * SANITIZERS FIND, WHICH FAILS THE TEST
+ *
+ * Run by ctest as: smoke_test <path of robot_client>
+ ***********************************************************************************************************************/
+#include <Arduino.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "LoopbackServer.h"
+#include "TestCheck.h"
+
+// Time in ms the client gets to authenticate and send its first values
+const unsigned long SMOKE_TIMEOUT = 15000;
+
+// Time in ms the client has to keep running after that
+const unsigned long SMOKE_RUN_TIME = 2000;
+
+/**
+ * Answers the authentication and the robot ID as the server does, and counts the telemetry.
+ */
+class RobotServer : public LoopbackServer {
+public:
+    RobotServer() : authentications(0), robotIds(0), telemetry(0) {}
+
+    std::atomic<uint32_t> authentications;
+    std::atomic<uint32_t> robotIds;
+    std::atomic<uint32_t> telemetry;
+
+protected:
+    void textReceived(const std::string& text) {
+        if (text.compare(0, 20, "42[\"authentication\",") == 0) {
+            authentications++;
+            push(text.find("\"123456789\"") != std::string::npos ? "42[\"authentication\",true]"
+                                                                 : "42[\"authentication\",false]");
+        } else if (text.compare(0, 13, "42[\"robotID\",") == 0) {
+            robotIds++;
+            push("42[\"setpoints\",{\"001\":{\"setpoint\":21.5,\"mode\":\"pwm\"},\"002\":\"none\"}]");
+        } else if (text.find("[\"sensorData") != std::string::npos) {
+            telemetry++;
+        }
+        LoopbackServer::textReceived(text);
+    }
+};
+
+/**
+ * @return true if the child has not stopped
+ */
+bool running(pid_t child, int& status) {
+    return waitpid(child, &status, WNOHANG) == 0;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: smoke_test <robot_client>\n");
+        return 2;
+    }
+    RobotServer server;
+    if (!CHECK(server.start())) {
+        return testResult("smoke_test");
+    }
+
+    char flash[] = "/tmp/robot_flash_XXXXXX";
+    int flashFd = mkstemp(flash);
+    CHECK(flashFd >= 0);
+    close(flashFd);
+
+    char port[8];
+    snprintf(port, sizeof(port), "%u", (unsigned) server.port);
+    pid_t child = fork();
+    if (child == 0) {
+        setenv("ROBOT_HOST", "127.0.0.1", 1);
+        setenv("ROBOT_PORT", port, 1);
+        setenv("ROBOT_FLASH", flash, 1);
+        execl(argv[1], argv[1], (char *) NULL);
+        _exit(127);
+    }
+    CHECK(child > 0);
+
+    int status = 0;
+    bool alive = true;
+    unsigned long start = millis();
+    while ((alive = running(child, status)) && millis() - start < SMOKE_TIMEOUT &&
+           (server.robotIds == 0 || server.telemetry == 0)) {
+        delay(10);
+    }
+    start = millis();
+    while (alive && millis() - start < SMOKE_RUN_TIME) {
+        delay(10);
+        alive = running(child, status);
+    }
+
+    CHECK(alive);
+    CHECK(server.connections >= 1);
+    CHECK(server.authentications >= 1);
+    CHECK(server.robotIds >= 1);
+    CHECK(server.telemetry >= 1);
+    if (alive) {
+        kill(child, SIGTERM);
+        waitpid(child, &status, 0);
+    } else {
+        fprintf(stderr, "robot_client stopped with status %d\n", status);
+    }
+    server.stop();
+    unlink(flash);
+    return testResult("smoke_test");
+}
@@ -0,0 +1,152 @@
+/***********************************************************************************************************************
+ * TEST OF THE SENSOR FILTERS
+ * FEEDS SYNTHETIC TRACES TO ADDSAMPLE AND CHECKS FILTEREDVALUE FOR EVERY FILTER: THE AVERAGE, ALSO PAST
+ * AVERAGE_MAX_SAMPLES, THE EXPONENTIAL MOVING AVERAGE, AND THE MEDIAN WITH SPIKES
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+
+/**
+ * @return a channel of the channel table with the given filter
+ */
+Channel channelWith(SensorFilter filter) {
+    Channel channel = CHANNELS[0];
+    channel.filter = filter;
+    return channel;
+}
+
+void testNone() {
+    Channel channel = channelWith(FILTER_NONE);
+    ChannelState state = {};
+    addSample(channel, state, 20.0);
+    addSample(channel, state, 21.5);
+    CHECK_NEAR(21.5, filteredValue(channel, state), 0.0);
+    CHECK_NEAR(21.5, filteredValue(channel, state), 0.0);
+}
+
+void testAverage() {
+    Channel channel = channelWith(FILTER_AVERAGE);
+    ChannelState state = {};
+
+    // A sine around 21 C over whole periods averages to 21
+    for (int i = 0; i < 1000; i++) {
+        addSample(channel, state, 21.0 + 0.5 * sin(i * 2 * M_PI / 100));
+    }
+    state.value = filteredValue(channel, state);
+    CHECK_NEAR(21.0, state.value, 0.001);
+
+    // The next average starts again, and only has the samples since the last call
+    addSample(channel, state, 30.0);
+    addSample(channel, state, 32.0);
+    state.value = filteredValue(channel, state);
+    CHECK_NEAR(31.0, state.value, 0.0001);
+
+    // Without new samples the last value is kept
+    CHECK_NEAR(31.0, filteredValue(channel, state), 0.0);
+
+    // The running average does not lose the small changes of a large value, as a float sum of the samples would
+    for (int i = 0; i < AVERAGE_MAX_SAMPLES; i++) {
+        addSample(channel, state, 1500.0 + (i % 2 ? 0.2 : -0.2));
+    }
+    CHECK_NEAR(1500.0, filteredValue(channel, state), 0.01);
+}
+
+void testAverageMaxSamples() {
+    Channel channel = channelWith(FILTER_AVERAGE);
+    ChannelState state = {};
+
+    // Up to AVERAGE_MAX_SAMPLES every sample has the same weight
+    for (int i = 0; i < AVERAGE_MAX_SAMPLES; i++) {
+        addSample(channel, state, i < AVERAGE_MAX_SAMPLES / 2 ? 0.0 : 1.0);
+    }
+    CHECK_EQUAL(AVERAGE_MAX_SAMPLES, state.sampleCount);
+    CHECK_NEAR(0.5, state.sampleAverage, 0.001);
+
+    // After that the count stays at the cap, so the samples are weighted as a moving average of 1 / AVERAGE_MAX_SAMPLES
+    // and the count never overflows
+    for (int i = 0; i < AVERAGE_MAX_SAMPLES; i++) {
+        addSample(channel, state, 1.0);
+    }
+    CHECK_EQUAL(AVERAGE_MAX_SAMPLES, state.sampleCount);
+    CHECK_NEAR(1.0 - 0.5 * exp(-1.0), filteredValue(channel, state), 0.001);
+
+    for (long i = 0; i < 70000; i++) {
+        addSample(channel, state, 2.0);
+    }
+    CHECK_EQUAL(AVERAGE_MAX_SAMPLES, state.sampleCount);
+    CHECK_NEAR(2.0, filteredValue(channel, state), 0.001);
+}
+
+void testEma() {
+    Channel channel = channelWith(FILTER_EMA);
+    ChannelState state = {};
+
+    // The first sample starts the average
+    addSample(channel, state, 20.0);
+    CHECK_NEAR(20.0, filteredValue(channel, state), 0.0);
+
+    // A step of 1 is followed by 1 - (1 - EMA_WEIGHT)^n after n samples
+    for (int n = 1; n <= 300; n++) {
+        addSample(channel, state, 21.0);
+        if (n == 1 || n == 100 || n == 300) {
+            CHECK_NEAR(21.0 - pow(1.0 - EMA_WEIGHT, n), filteredValue(channel, state), 0.001);
+        }
+    }
+
+    // The moving average keeps its samples between the calls, and smooths uniform noise of +-1 (0.58 rms) to an rms
+    // error of 0.58 * sqrt(EMA_WEIGHT / (2 - EMA_WEIGHT)) = 0.04
+    double squares = 0.0;
+    srand(12);
+    for (int i = 0; i < 5500; i++) {
+        addSample(channel, state, 21.0 + (random(2001) - 1000) / 1000.0);
+        if (i >= 500) {
+            squares += pow(filteredValue(channel, state) - 21.0, 2);
+        }
+    }
+    CHECK_NEAR(0.041, sqrt(squares / 5000), 0.015);
+}
+
+void testMedian() {
+    Channel channel = channelWith(FILTER_MEDIAN);
+    ChannelState state = {};
+
+    // With fewer than MEDIAN_SIZE samples the median is taken of those
+    addSample(channel, state, 5.0);
+    CHECK_NEAR(5.0, filteredValue(channel, state), 0.0);
+    addSample(channel, state, 1.0);
+    addSample(channel, state, 3.0);
+    CHECK_NEAR(3.0, filteredValue(channel, state), 0.0);
+
+    // Single spikes of a slow ramp are removed, while the average would follow them
+    Channel averageChannel = channelWith(FILTER_AVERAGE);
+    ChannelState averageState = {};
+    float largestMedianError = 0.0;
+    float largestAverageError = 0.0;
+    for (int i = 0; i < 1000; i++) {
+        float ramp = 800.0 + i * 0.1;
+        float sample = (i % 5 == 0) ? 2000.0 : ramp;
+        addSample(channel, state, sample);
+        addSample(averageChannel, averageState, sample);
+        if (i >= MEDIAN_SIZE) {
+            largestMedianError = max(largestMedianError, (float) fabs(filteredValue(channel, state) - ramp));
+            largestAverageError = max(largestAverageError,
+                                      (float) fabs(filteredValue(averageChannel, averageState) - ramp));
+        }
+    }
+    CHECK(largestMedianError <= MEDIAN_SIZE * 0.1);
+    CHECK(largestAverageError > 100.0);
+
+    // The median keeps its samples, so without new samples it gives the same value
+    float median = filteredValue(channel, state);
+    CHECK_NEAR(median, filteredValue(channel, state), 0.0);
+    CHECK_EQUAL(MEDIAN_SIZE, state.sampleCount);
+}
+
+int main() {
+    testNone();
+    testAverage();
+    testAverageMaxSamples();
+    testEma();
+    testMedian();
+    return testResult("test_filters");
+}
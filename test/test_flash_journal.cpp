@@ -0,0 +1,455 @@
+/***********************************************************************************************************************
+ * CRASH TEST OF THE FLASH JOURNAL
+ * CUTS THE POWER OF THE FLASH EMULATOR AT EVERY BYTE OF AN APPEND, A CHECKPOINT, THE ERASE OF A SECTOR WHEN THE JOURNAL
+ * WRAPS AROUND AND THE FORMAT IN BEGIN, AND CHECKS AFTER EACH THAT THE JOURNAL MOUNTS AGAIN WITH THE RECORDS FROM BEFORE
+ * OR AFTER THE OPERATION AND NOTHING ELSE: A CUT OFF RECORD IS SKIPPED, A RECORD THAT WAS MARKED AS REPLAYED IS NOT READ
+ * AGAIN, AND THE RECORDS OF AN ERASED SECTOR ARE COUNTED AS LOST. THEN CUTS THE POWER AT RANDOM WHILE RECORDS ARE
+ * APPENDED AND REPLAYED, AND CHECKS THAT THE SECTORS WEAR EVENLY
+ ***********************************************************************************************************************/
+#include <FlashJournal.h>
+#include "FlashEmulator.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/// Test Settings ///
+const char * FLASH_FILE = "test_flash_journal.bin";
+const char * JOURNAL_LABEL = "journal";
+const uint32_t TEST_SECTORS = 3;
+const uint32_t BASE_RECORDS = 100;             // Records appended before the operation that is cut
+const uint32_t BASE_REPLAYED = 40;             // Of those, records marked as replayed
+const uint32_t RANDOM_ROUNDS = 3000;
+const uint32_t WEAR_ROUNDS = 12;               // Times the journal goes all the way around in testWear
+
+// The records a test expects to read, by their time. A record is appended with time t, ID t and value t / 2
+typedef std::vector<uint32_t> Times;
+
+const esp_partition_t * journalPartition() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_LABEL);
+}
+
+/**
+ * Function that starts on a new flash file, with every byte erased and the erase counts at 0.
+ */
+void eraseFlash() {
+    flashEmulatorClose();
+    remove(FLASH_FILE);
+    CHECK(flashEmulatorOpen(FLASH_FILE, JOURNAL_LABEL, TEST_SECTORS * FLASH_EMULATOR_SECTOR_SIZE));
+}
+
+/**
+ * @return the bytes of the flash
+ */
+std::vector<uint8_t> saveFlash() {
+    std::vector<uint8_t> image(TEST_SECTORS * FLASH_EMULATOR_SECTOR_SIZE);
+    FILE * file = fopen(FLASH_FILE, "rb");
+    CHECK(file != NULL && fread(image.data(), 1, image.size(), file) == image.size());
+    if (file != NULL) {
+        fclose(file);
+    }
+    return image;
+}
+
+/**
+ * Function that writes bytes saved with saveFlash back to the flash, as they were. The erase counts are kept.
+ */
+void restoreFlash(const std::vector<uint8_t>& image) {
+    FILE * file = fopen(FLASH_FILE, "r+b");
+    CHECK(file != NULL && fwrite(image.data(), 1, image.size(), file) == image.size());
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/**
+ * Function that turns the power on and reads the journal from the flash, as after a restart.
+ * @return the result of begin
+ */
+bool mount(FlashJournal& journal) {
+    flashEmulatorPowerCut(-1);
+    journal = FlashJournal();
+    return journal.begin(journalPartition());
+}
+
+bool append(FlashJournal& journal, uint32_t time) {
+    return journal.append(1, (uint16_t) time, time / 2.0f, time);
+}
+
+/**
+ * Function that reads every record that is not replayed, and checks that each holds what was appended.
+ * @param records       set to the records, if not NULL
+ * @return the times of the records
+ */
+Times readAll(FlashJournal& journal, std::vector<JournalRecord> * records = NULL) {
+    std::vector<JournalRecord> read(TEST_SECTORS * JOURNAL_SLOTS);
+    read.resize(journal.read(read.data(), read.size()));
+    Times times;
+    for (size_t i = 0; i < read.size(); i++) {
+        if (!CHECK(read[i].id == (uint16_t) read[i].time && read[i].value == read[i].time / 2.0f)) {
+            fprintf(stderr, "    record %u holds ID %u and value %g\n", (unsigned) read[i].sequence,
+                    (unsigned) read[i].id, read[i].value);
+        }
+        times.push_back(read[i].time);
+    }
+    if (records != NULL) {
+        *records = read;
+    }
+    return times;
+}
+
+/**
+ * @return the times from first to last
+ */
+Times range(uint32_t first, uint32_t last) {
+    Times times;
+    for (uint32_t time = first; time <= last; time++) {
+        times.push_back(time);
+    }
+    return times;
+}
+
+Times operator+(Times times, uint32_t time) {
+    times.push_back(time);
+    return times;
+}
+
+/**
+ * Function that mounts the journal after a power cut and checks that it holds one of the outcomes of the operation
+ * that was cut, and pending() agrees. A record is then appended and the journal mounted again, to check that it goes on
+ * after what the cut left, also a cut off record.
+ * @param outcomes      records the journal can hold, the state before the operation first and the state after it last
+ * @param completed     the operation was not cut, so only the last outcome is right
+ * @param next          time of the record that is appended
+ * @return index of the outcome the journal holds, outcomes.size() if none
+ */
+size_t checkRecovery(const std::vector<Times>& outcomes, bool completed, uint32_t next) {
+    FlashJournal journal;
+    if (!CHECK(mount(journal))) {
+        return outcomes.size();
+    }
+    Times times = readAll(journal);
+    CHECK_EQUAL(times.size(), journal.pending());
+    size_t outcome = 0;
+    while (outcome < outcomes.size() && times != outcomes[outcome]) {
+        outcome++;
+    }
+    if (!CHECK(outcome < outcomes.size()) || (completed && !CHECK_EQUAL(outcomes.size() - 1, outcome))) {
+        fprintf(stderr, "    the journal holds %u records\n", (unsigned) times.size());
+        return outcomes.size();
+    }
+
+    // A record is only lost from the front, when the append wraps around and erases the oldest sector
+    CHECK(append(journal, next));
+    CHECK(mount(journal));
+    Times after = readAll(journal);
+    CHECK_EQUAL(after.size(), journal.pending());
+    if (!CHECK(!after.empty() && after.back() == next && after.size() <= times.size() + 1) ||
+        !CHECK(std::equal(after.begin(), after.end() - 1, times.end() - (after.size() - 1)))) {
+        fprintf(stderr, "    after a record was appended the journal holds %u records\n", (unsigned) after.size());
+    }
+    return outcome;
+}
+
+/**
+ * Function that runs an operation on the journal from the same flash with the power cut after 0, 1, 2 ... bytes,
+ * until it is done without the cut, and checks the journal after each cut with checkRecovery.
+ * @param name          name of the operation, printed with the outcomes
+ * @param image         the flash before the operation
+ * @param operation     called with the mounted journal, returns false if it failed
+ * @param outcomes      see checkRecovery
+ * @param check         called with the journal after the operation, cut or not, with the power on again
+ */
+template <typename Operation, typename Check>
+void cutEveryByte(const char * name, const std::vector<uint8_t>& image, Operation operation,
+                  const std::vector<Times>& outcomes, Check check) {
+    std::vector<uint32_t> counts(outcomes.size() + 1, 0);
+    long cut = 0;
+    for (;; cut++) {
+        restoreFlash(image);
+        FlashJournal journal;
+        if (!CHECK(mount(journal))) {
+            return;
+        }
+        flashEmulatorPowerCut(cut);
+        bool done = operation(journal);
+        bool completed = !flashEmulatorPoweredOff();
+        CHECK(done == completed);
+        flashEmulatorPowerCut(-1);
+        check(journal);
+        counts[checkRecovery(outcomes, completed, 100000 + cut)]++;
+        if (completed) {
+            break;
+        }
+    }
+    printf("%s: power cut at %ld bytes, journal as before %u times, as after %u times", name, cut,
+           (unsigned) counts[0], (unsigned) counts[outcomes.size() - 1]);
+    for (size_t i = 1; i + 1 < outcomes.size(); i++) {
+        printf(", outcome %u %u times", (unsigned) i, (unsigned) counts[i]);
+    }
+    printf("\n");
+}
+
+/**
+ * Function that makes the flash of the tests of append and commit: BASE_RECORDS records, of which the first
+ * BASE_REPLAYED are marked as replayed.
+ * @return the sequence number of the last record
+ */
+uint32_t makeBase() {
+    eraseFlash();
+    FlashJournal journal;
+    CHECK(mount(journal));
+    for (uint32_t time = 1; time <= BASE_RECORDS; time++) {
+        CHECK(append(journal, time));
+    }
+    std::vector<JournalRecord> records;
+    readAll(journal, &records);
+    CHECK(journal.commit(records[BASE_REPLAYED - 1].sequence));
+    return records.back().sequence;
+}
+
+void testAppendCut() {
+    makeBase();
+    std::vector<uint8_t> image = saveFlash();
+    Times before = range(BASE_REPLAYED + 1, BASE_RECORDS);
+    cutEveryByte("append", image, [](FlashJournal& journal) {
+        return append(journal, 1000);
+    }, {before, before + 1000}, [](FlashJournal&) {});
+}
+
+void testCommitCut() {
+    makeBase();
+    std::vector<uint8_t> image = saveFlash();
+    const uint32_t replayed = 70;
+    uint32_t sequence = 0;
+    {
+        FlashJournal journal;
+        CHECK(mount(journal));
+        std::vector<JournalRecord> records;
+        readAll(journal, &records);
+        sequence = records[replayed - BASE_REPLAYED - 1].sequence;
+    }
+    // The records up to the checkpoint are not read again from the journal that wrote it, whether it reached the flash
+    // or not. After the restart they are read again only if the checkpoint was cut off
+    cutEveryByte("commit", image, [&](FlashJournal& journal) {
+        return journal.commit(sequence);
+    }, {range(BASE_REPLAYED + 1, BASE_RECORDS), range(replayed + 1, BASE_RECORDS)}, [&](FlashJournal& journal) {
+        CHECK(readAll(journal) == range(replayed + 1, BASE_RECORDS));
+        CHECK_EQUAL(BASE_RECORDS - replayed, journal.pending());
+    });
+}
+
+/**
+ * Function that fills every slot of the journal, so the next record erases the oldest sector. The first sector has
+ * BASE_RECORDS records, a checkpoint after BASE_REPLAYED of them and then more records.
+ * @return the times of the records of the first sector that are not replayed
+ */
+Times makeFull(Times& before) {
+    makeBase();
+    FlashJournal journal;
+    CHECK(mount(journal));
+    uint32_t slots = BASE_RECORDS + 1;
+    uint32_t time = BASE_RECORDS;
+    while (slots < TEST_SECTORS * JOURNAL_SLOTS) {
+        CHECK(append(journal, ++time));
+        slots++;
+    }
+    before = range(BASE_REPLAYED + 1, time);
+    // The first sector ends with the record before the one in the first slot of the second sector
+    return range(BASE_REPLAYED + 1, JOURNAL_SLOTS - 1);
+}
+
+void testEraseCut() {
+    Times before;
+    Times lost = makeFull(before);
+    std::vector<uint8_t> image = saveFlash();
+    Times after(before.begin() + lost.size(), before.end());
+    uint32_t erases = flashEmulatorEraseCount(0);
+    // The sector is erased and its header written before the record, so the records of the sector are gone as soon as
+    // the first byte of it is erased
+    cutEveryByte("erase", image, [](FlashJournal& journal) {
+        return append(journal, 1000000);
+    }, {before, after, after + 1000000}, [&](FlashJournal& journal) {
+        // The records are counted as lost before the sector is erased
+        CHECK_EQUAL(lost.size(), journal.lost());
+    });
+    // Every cut made one erase of the first sector, the others none
+    CHECK(flashEmulatorEraseCount(0) > erases + FLASH_EMULATOR_SECTOR_SIZE);
+    CHECK_EQUAL(0, flashEmulatorEraseCount(1));
+    CHECK_EQUAL(0, flashEmulatorEraseCount(2));
+
+    // Without the cut, the records that are lost and the ones that are left add up to the ones before
+    restoreFlash(image);
+    FlashJournal journal;
+    CHECK(mount(journal));
+    CHECK_EQUAL(before.size(), journal.pending());
+    CHECK(append(journal, 1000000));
+    CHECK_EQUAL(lost.size(), journal.lost());
+    CHECK_EQUAL(after.size() + 1, journal.pending());
+    CHECK_EQUAL(1, journal.eraseCount());
+}
+
+/**
+ * Function that cuts the power while begin formats a flash that holds no journal, and checks that it is formatted
+ * when it is mounted again. Then checks that begin does not write a flash that holds a journal, so a cut can not harm
+ * it.
+ */
+void testMountCut() {
+    eraseFlash();
+    std::vector<uint8_t> image(TEST_SECTORS * FLASH_EMULATOR_SECTOR_SIZE, 0x00);
+    long cut = 0;
+    for (;; cut++) {
+        restoreFlash(image);
+        flashEmulatorPowerCut(cut);
+        FlashJournal journal;
+        bool done = journal.begin(journalPartition());
+        bool completed = !flashEmulatorPoweredOff();
+        CHECK(done == completed);
+        CHECK(checkRecovery({Times()}, completed, 100000 + cut) == 0);
+        if (completed) {
+            break;
+        }
+    }
+    printf("format: power cut at %ld bytes\n", cut);
+
+    makeBase();
+    image = saveFlash();
+    flashEmulatorPowerCut(0);
+    FlashJournal journal;
+    CHECK(journal.begin(journalPartition()));
+    CHECK(!flashEmulatorPoweredOff());
+    CHECK(saveFlash() == image);
+    CHECK_EQUAL(BASE_RECORDS - BASE_REPLAYED, journal.pending());
+    flashEmulatorPowerCut(-1);
+}
+
+/**
+ * Function that appends and replays records as the robot does, and cuts the power at random in between. After each cut
+ * the journal is mounted, and checked against what was appended and replayed before: a record that was marked as
+ * replayed is not read again unless that checkpoint was cut off, and a record that was appended is read unless it was
+ * marked as replayed or its append was cut off. The records stay in order.
+ */
+void testRandomCuts() {
+    eraseFlash();
+    FlashJournal journal;
+    CHECK(mount(journal));
+    std::mt19937 random(25);
+    Times appended;           // Not marked as replayed, by the journal that is mounted
+    Times mayRepeat;          // Marked as replayed, but that checkpoint was cut off
+    uint32_t cutAppend = 0;   // Time of the record whose append was cut off, 0 if none
+    uint32_t replayed = 0;    // Time of the last record marked as replayed in a checkpoint that was written
+    uint32_t time = 0;
+    uint32_t cuts = 0;
+    uint32_t repeated = 0;
+    for (uint32_t round = 0; round < RANDOM_ROUNDS; round++) {
+        if (random() % 8 == 0) {
+            flashEmulatorPowerCut(random() % (2 * sizeof(JournalSlot)));
+        }
+        // A few records are appended, and the oldest are replayed when enough have gathered
+        for (uint32_t i = random() % 5; i > 0 && !flashEmulatorPoweredOff(); i--) {
+            if (append(journal, ++time)) {
+                appended.push_back(time);
+            } else {
+                cutAppend = time;
+            }
+        }
+        if (appended.size() > 20 && !flashEmulatorPoweredOff()) {
+            std::vector<JournalRecord> records;
+            readAll(journal, &records);
+            size_t count = std::min<size_t>(records.size(), 8);
+            if (journal.commit(records[count - 1].sequence)) {
+                replayed = records[count - 1].time;
+                mayRepeat.clear();
+            } else {
+                mayRepeat.insert(mayRepeat.end(), appended.begin(), appended.begin() + count);
+            }
+            appended.erase(appended.begin(), appended.begin() + count);
+        }
+        if (!flashEmulatorPoweredOff()) {
+            flashEmulatorPowerCut(-1);
+            continue;
+        }
+
+        cuts++;
+        CHECK(mount(journal));
+        Times times = readAll(journal);
+        CHECK_EQUAL(times.size(), journal.pending());
+        uint32_t wrong = 0;
+        for (size_t i = 0; i < times.size(); i++) {
+            bool repeat = std::find(mayRepeat.begin(), mayRepeat.end(), times[i]) != mayRepeat.end();
+            repeated += repeat;
+            wrong += times[i] <= replayed || (i > 0 && times[i] <= times[i - 1]) ||
+                     (!repeat && times[i] != cutAppend &&
+                      std::find(appended.begin(), appended.end(), times[i]) == appended.end());
+        }
+        uint32_t missing = 0;
+        for (size_t i = 0; i < appended.size(); i++) {
+            missing += std::find(times.begin(), times.end(), appended[i]) == times.end();
+        }
+        if (!CHECK_EQUAL(0, wrong) || !CHECK_EQUAL(0, missing)) {
+            fprintf(stderr, "    after the cut in round %u\n", (unsigned) round);
+            break;
+        }
+        appended = times;
+        mayRepeat.clear();
+        cutAppend = 0;
+    }
+    CHECK(cuts > 0);
+    CHECK_EQUAL(0, journal.lost());
+    printf("random cuts: %u records, %u power cuts, %u replayed records read again\n", (unsigned) time,
+           (unsigned) cuts, (unsigned) repeated);
+}
+
+/**
+ * Function that runs the journal all the way around WEAR_ROUNDS times, replaying as it goes, and checks that every
+ * sector is erased as often as the others, only when the journal comes back to it, and that the journal counts the
+ * erases as the flash does, also after it is mounted again.
+ */
+void testWear() {
+    eraseFlash();
+    FlashJournal journal;
+    CHECK(mount(journal));
+    uint32_t slots = 0;
+    uint32_t time = 0;
+    while (slots < WEAR_ROUNDS * TEST_SECTORS * JOURNAL_SLOTS) {
+        CHECK(append(journal, ++time));
+        slots++;
+        if (time % 10 == 0) {
+            std::vector<JournalRecord> records;
+            readAll(journal, &records);
+            CHECK(journal.commit(records.back().sequence));
+            slots++;
+        }
+    }
+    // Each sector is opened when the slots before it are used, and erased unless it is opened the first time
+    uint32_t erases = (slots - 1) / JOURNAL_SLOTS + 1 - TEST_SECTORS;
+    uint32_t total = 0;
+    uint32_t least = flashEmulatorEraseCount(0);
+    uint32_t most = 0;
+    for (uint32_t sector = 0; sector < TEST_SECTORS; sector++) {
+        total += flashEmulatorEraseCount(sector);
+        least = std::min(least, flashEmulatorEraseCount(sector));
+        most = std::max(most, flashEmulatorEraseCount(sector));
+    }
+    CHECK_EQUAL(erases, total);
+    CHECK(most - least <= 1);
+    CHECK(most >= WEAR_ROUNDS - 1);
+    CHECK_EQUAL(most, journal.eraseCount());
+    CHECK_EQUAL(0, journal.lost());
+    CHECK(mount(journal));
+    CHECK_EQUAL(most, journal.eraseCount());
+    printf("wear: %u slots written, sectors erased %u to %u times\n", (unsigned) slots, (unsigned) least,
+           (unsigned) most);
+}
+
+int main() {
+    testAppendCut();
+    testCommitCut();
+    testEraseCut();
+    testMountCut();
+    testRandomCuts();
+    testWear();
+    flashEmulatorClose();
+    remove(FLASH_FILE);
+    return testResult("test_flash_journal");
+}
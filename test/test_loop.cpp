@@ -0,0 +1,62 @@
+/***********************************************************************************************************************
+ * TEST OF LOOP() WITH THE CHANNEL TABLE
+ * CHECKS THAT EVERY CHANNEL OF CHANNELS IS READ AND SCALED FROM THE SIMULATED ROOM, THEN MEASURES HOW MANY TIMES PER
+ * SECOND LOOP() RUNS WITH THE CHANNEL TABLE, AND HOW OFTEN EACH TASK RAN IN THAT TIME
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const unsigned long LOOP_BENCHMARK_TIME = 2000;    // Time in ms loop() is measured for
+
+void testChannelTable() {
+    startRobot();
+    // The room starts at 18 C and 900 ppm, the internal temperature sensor reads 122 F
+    CHECK_NEAR(18.0, readSensorValue(CHANNELS[0]), 0.1);
+    CHECK_NEAR(900.0, readSensorValue(CHANNELS[1]), 5.0);
+    CHECK_NEAR(50.0, readSensorValue(CHANNELS[2]), 0.01);
+
+    // The first pass runs every task, so each channel has its filtered value and sends it
+    loop();
+    CHECK_NEAR(18.0, channelStates[0].value, 0.1);
+    CHECK_NEAR(900.0, channelStates[1].value, 5.0);
+    CHECK_NEAR(50.0, channelStates[2].value, 0.01);
+    CHECK(takeTelemetry() > 0);
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        CHECK_NEAR(decimalRound(channelStates[i].value, 1), channelStates[i].previousValue, 0.001);
+    }
+}
+
+void benchmarkLoop() {
+    startRobot();
+    uint32_t iterations = 0;
+    unsigned long start = micros();
+    unsigned long end = millis() + LOOP_BENCHMARK_TIME;
+    while (millis() < end) {
+        loop();
+        // Stands in for the network core, so the queue never drops values
+        if (telemetryQueue.peek() != NULL) {
+            takeTelemetry();
+        }
+        iterations++;
+    }
+    float seconds = (micros() - start) / 1000000.0;
+
+    CHECK_EQUAL(iterations, taskStates[0].runs);
+    // Both the control and the report task run at their rate while loop() runs this fast
+    CHECK(taskStates[2].runs >= LOOP_BENCHMARK_TIME / CONTROL_PERIOD);
+    CHECK(taskStates[3].runs >= 1);
+    CHECK_EQUAL(0, telemetryDropped);
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        CHECK_EQUAL(0, taskStates[i].overruns);
+    }
+    printf("loop: %u channels, %.0f iterations/s, %.2f us per iteration, longest sample task %lu us\n",
+           (unsigned) CHANNEL_COUNT, iterations / seconds, seconds * 1000000.0 / iterations,
+           taskStates[0].maxDuration);
+}
+
+int main() {
+    testChannelTable();
+    benchmarkLoop();
+    return testResult("test_loop");
+}
@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+ * TEST OF THE TASKS WHEN MILLIS() WRAPS AROUND
+ * STARTS THE ROBOT 150 S BEFORE MILLIS() WRAPS AROUND AFTER 49.7 DAYS, AND CHECKS THAT EVERY TASK RUNS AT THE SAME RATE
+ * BEFORE AND AFTER THE WRAP AND NEVER TWICE IN A ROW. THEN CHECKS THAT A STALL OVER THE WRAP COUNTS EXACTLY ONE OVERRUN
+ * FOR EACH TASK IT MADE A WHOLE PERIOD LATE, AND THAT THE TASKS KEEP THEIR RATE AFTER IT
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+#include <vector>
+
+/// Test Settings ///
+const uint32_t TIME_BEFORE_WRAP = 150000;      // Time in ms from the start of the robot until millis() wraps around
+const unsigned long STALL_TIME = 2500;         // Time in ms loop() is held up over the wrap
+
+/**
+ * Function that moves millis() with nativeClockSetOffset, so it wraps around after the given time.
+ * @param ms            time in ms until millis() wraps around
+ */
+void setTimeBeforeWrap(uint32_t ms) {
+    nativeClockSetOffset(0);
+    nativeClockSetOffset((uint32_t) (0 - ms - (uint32_t) millis()));
+}
+
+/**
+ * @return the index of the task in TASKS
+ */
+size_t taskIndex(const char * name) {
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        if (strcmp(TASKS[i].name, name) == 0) {
+            return i;
+        }
+    }
+    CHECK(false);
+    return 0;
+}
+
+void testRatesOverWrap() {
+    setTimeBeforeWrap(TIME_BEFORE_WRAP);
+    startRobot();
+    sendSetpoints("{\"001\":21,\"002\":1000}");
+    uint32_t start = millis();
+
+    // millis() of every run of the tasks with a period, a run is seen as a change of lastRun
+    std::vector<uint32_t> runs[TASK_COUNT];
+    uint32_t lastRun[TASK_COUNT];
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        lastRun[i] = taskStates[i].lastRun;
+    }
+    runRobot(2 * TIME_BEFORE_WRAP, [&] {
+        for (size_t i = 0; i < TASK_COUNT; i++) {
+            if (taskStates[i].lastRun != lastRun[i]) {
+                lastRun[i] = taskStates[i].lastRun;
+                runs[i].push_back(millis());
+            }
+        }
+    });
+    // millis() has wrapped around
+    CHECK_EQUAL(TIME_BEFORE_WRAP, (uint32_t) millis());
+
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        unsigned long period = TASKS[i].period;
+        if (period == 0) {
+            continue;
+        }
+        uint32_t beforeWrap = 0;
+        uint32_t afterWrap = 0;
+        for (size_t run = 0; run < runs[i].size(); run++) {
+            if (runs[i][run] - start < TIME_BEFORE_WRAP) {
+                beforeWrap++;
+            } else {
+                afterWrap++;
+            }
+            // Every run is one period after the last, also over the wrap
+            if (run > 0 && !CHECK_EQUAL(period, (unsigned long) (uint32_t) (runs[i][run] - runs[i][run - 1]))) {
+                fprintf(stderr, "    task %s at millis() %u\n", TASKS[i].name, (unsigned) runs[i][run]);
+            }
+        }
+        if (!CHECK(beforeWrap + 1 >= afterWrap && afterWrap + 1 >= beforeWrap) ||
+            !CHECK(afterWrap >= TIME_BEFORE_WRAP / period)) {
+            fprintf(stderr, "    task %s ran %u times before the wrap and %u after\n", TASKS[i].name,
+                    (unsigned) beforeWrap, (unsigned) afterWrap);
+        }
+    }
+
+    // The room is still regulated
+    CHECK(fabs(channelStates[0].value - 18.0) > 0.1);
+}
+
+void testStallOverWrap() {
+    setTimeBeforeWrap(TIME_BEFORE_WRAP);
+    startRobot();
+    sendSetpoints("{\"001\":21,\"002\":1000}");
+    // Runs until 1 s before the wrap, the statistics last ran at 120 s and are next due 30 s after the wrap, so they do
+    // not reset the counts
+    runRobot(TIME_BEFORE_WRAP - 1000, [] {});
+    size_t control = taskIndex("control");
+    size_t report = taskIndex("report");
+    size_t replay = taskIndex("replay");
+    TaskState before[TASK_COUNT];
+    memcpy(before, taskStates, sizeof(before));
+
+    nativeClockAdvance(STALL_TIME * 1000);
+    loop();
+    // Control and replay were more than a whole period late, the report was not
+    CHECK_EQUAL(before[control].overruns + 1, taskStates[control].overruns);
+    CHECK_EQUAL(before[replay].overruns + 1, taskStates[replay].overruns);
+    CHECK_EQUAL(before[report].overruns, taskStates[report].overruns);
+    CHECK(taskStates[control].maxJitter >= STALL_TIME - CONTROL_PERIOD);
+
+    // The tasks start again from the end of the stall, at their rate and without more overruns
+    runRobot(10000, [] {});
+    CHECK_EQUAL(before[control].overruns + 1, taskStates[control].overruns);
+    CHECK_EQUAL(before[replay].overruns + 1, taskStates[replay].overruns);
+    CHECK_EQUAL(before[report].overruns, taskStates[report].overruns);
+    CHECK_EQUAL(before[control].runs + 10000 / CONTROL_PERIOD, taskStates[control].runs);
+    CHECK((uint32_t) millis() < 20000);
+}
+
+int main() {
+    Serial.end();
+    nativeClockStop();
+    testRatesOverWrap();
+    testStallOverWrap();
+    return testResult("test_millis_wrap");
+}
@@ -0,0 +1,127 @@
+/***********************************************************************************************************************
+ * TEST OF THE PID REGULATION
+ * STEPS THE SET-POINT OF THE HEATER OF THE SIMULATED ROOM FROM 18 C TO 21 C, AND CHECKS THE OVERSHOOT AND THE SETTLING
+ * TIME WITH PWM AND WITH TIME PROPORTIONING OF A RELAY, AND THAT THE RELAY SWITCHES AT MOST TWICE IN A WINDOW. THEN
+ * CHECKS THAT A NEW SET-POINT DOES NOT GIVE A DERIVATIVE KICK
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const float STEP_SETPOINT = 21.0;              // The room starts at 18 C
+const unsigned long STEP_RUN_TIME = 7200000;   // Time in ms the step response is followed for
+
+/**
+ * The step response of the heater: the largest value above the set-point, and the time from the step until the value
+ * stays within the band around the set-point.
+ */
+struct StepResponse {
+    float overshoot;
+    unsigned long settlingTime;
+    uint32_t switches;               // Switches of the heater
+    uint32_t maxWindowSwitches;      // Most switches of the heater in one time proportioning window
+};
+
+/**
+ * Function that steps the set-point of the heater to STEP_SETPOINT with the given mode, and follows the value.
+ * @param mode          the way of regulation, "pwm" or "relay"
+ * @param band          half the width of the band the value has to settle in
+ * @return the step response
+ */
+StepResponse stepResponse(const char * mode, float band) {
+    startRobot();
+    char setpoints[96];
+    snprintf(setpoints, sizeof(setpoints), "{\"001\":{\"setpoint\":%.1f,\"mode\":\"%s\"},\"002\":\"none\"}",
+             STEP_SETPOINT, mode);
+    sendSetpoints(setpoints);
+
+    StepResponse response = {0.0, 0, 0, 0};
+    ChannelState& state = channelStates[0];
+    unsigned long start = millis();
+    bool on = simulationOutput(CHANNELS[0].outputPin) >= 0.5;
+    unsigned long windowStart = state.windowStart;
+    uint32_t windowSwitches = 0;
+    runRobot(STEP_RUN_TIME, [&] {
+        float error = state.value - STEP_SETPOINT;
+        response.overshoot = max(response.overshoot, error);
+        if (fabs(error) > band) {
+            response.settlingTime = millis() - start;
+        }
+        if (state.windowStart != windowStart) {
+            windowStart = state.windowStart;
+            windowSwitches = 0;
+        }
+        bool output = simulationOutput(CHANNELS[0].outputPin) >= 0.5;
+        if (output != on) {
+            on = output;
+            response.switches++;
+            windowSwitches++;
+            response.maxWindowSwitches = max(response.maxWindowSwitches, windowSwitches);
+        }
+    });
+    printf("pid: %s overshoot %.2f C, settled within +-%.1f C in %lu s\n", mode, response.overshoot, band,
+           response.settlingTime / 1000);
+    return response;
+}
+
+void testPwmStep() {
+    StepResponse response = stepResponse("pwm", 0.1);
+    CHECK(response.overshoot < 0.5);
+    CHECK(response.settlingTime < 900000);
+}
+
+void testRelayStep() {
+    StepResponse response = stepResponse("relay", 0.4);
+    CHECK(response.overshoot < 0.5);
+    CHECK(response.settlingTime < 900000);
+    // The relay is switched on and off in most windows, but never more than twice in one
+    CHECK(response.switches > STEP_RUN_TIME / TIME_PROPORTIONING_WINDOW);
+    CHECK(response.maxWindowSwitches <= 2);
+}
+
+void testNoDerivativeKick() {
+    ChannelState state = {};
+    state.control = CONTROL_PID_PWM;
+    state.kp = 0.1;
+    state.kd = 0.5;
+    state.previousInput = NAN;
+    state.value = 20.0;
+    state.setpoint = 20.0;
+    regulatePid(CHANNELS[0], state, 1.0);
+    CHECK_NEAR(0.0, state.outputLevel, 0.0001);
+
+    // A step of the set-point only changes the proportional part, a derivative of the error would add kd * 2 / 1 s
+    state.setpoint = 22.0;
+    regulatePid(CHANNELS[0], state, 1.0);
+    CHECK_NEAR(0.2, state.outputLevel, 0.0001);
+
+    // The derivative part works against a change of the value
+    state.value = 20.1;
+    regulatePid(CHANNELS[0], state, 1.0);
+    CHECK_NEAR(0.1 * 1.9 - 0.5 * 0.1, state.outputLevel, 0.0001);
+
+    // For a reversed actuator a rising value is an increasing error, so the derivative part adds to the output
+    ChannelState reversed = {};
+    reversed.control = CONTROL_PID_PWM;
+    reversed.kp = 0.002;
+    reversed.kd = 0.01;
+    reversed.previousInput = NAN;
+    reversed.value = 1000.0;
+    reversed.setpoint = 1000.0;
+    regulatePid(CHANNELS[1], reversed, 1.0);
+    reversed.setpoint = 900.0;
+    regulatePid(CHANNELS[1], reversed, 1.0);
+    CHECK_NEAR(0.2, reversed.outputLevel, 0.0001);
+    reversed.value = 1010.0;
+    regulatePid(CHANNELS[1], reversed, 1.0);
+    CHECK_NEAR(0.002 * 110 + 0.01 * 10, reversed.outputLevel, 0.0001);
+}
+
+int main() {
+    Serial.end();
+    nativeClockStop();
+    testPwmStep();
+    testRelayStep();
+    testNoDerivativeKick();
+    return testResult("test_pid");
+}
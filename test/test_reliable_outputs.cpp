@@ -0,0 +1,115 @@
+/***********************************************************************************************************************
+ * TEST OF THE OUTPUT CHANGES SENT WITH AN ACK ID
+ * CONNECTS WEBSOCKET OF THE ROBOT CLIENT TO A LOOPBACK SERVER THAT NEVER ACKS, AS SERVER_NO_ENCRYPT.JS WHICH HAS NO
+ * HANDLER FOR "SENSORDATA", AND SENDS MORE OUTPUT CHANGES THAN THE ACK WINDOW HOLDS. CHECKS THAT THE SENSOR VALUES
+ * WITHOUT ACK STILL ARRIVE, THAT THE OUTPUT CHANGES THAT DO NOT FIT ARE HELD OR COUNTED AS DROPPED, AND THAT THE HELD
+ * ONES ARE SENT WHEN THE SERVER STARTS TO ACK. BUILT WITH SOCKETIOCLIENT_ACK_TIMEOUT OF 200 MS
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "LoopbackServer.h"
+#include "TestCheck.h"
+#include <set>
+
+/// Test Settings ///
+const uint32_t OUTPUT_CHANGES = 20;
+
+/**
+ * Loopback server that records the ack ids of the output changes, and only acks them when told to.
+ */
+class NoAckServer : public LoopbackServer {
+public:
+    NoAckServer() : acking(false), readings(0) {}
+
+    ~NoAckServer() {
+        stop();
+    }
+
+    /**
+     * @return the ack ids of the output changes received, each once
+     */
+    std::set<uint32_t> outputChanges() {
+        std::lock_guard<std::mutex> lock(idMutex);
+        return ackIds;
+    }
+
+    std::atomic<bool> acking;                 // The output changes are acked
+    std::atomic<uint32_t> readings;           // Sensor values received, they have no ack id
+
+protected:
+    void textReceived(const std::string& text) {
+        unsigned ackId;
+        if (sscanf(text.c_str(), "42%u[\"sensorData\",{\"ControlledItemID\"", &ackId) == 1) {
+            {
+                std::lock_guard<std::mutex> lock(idMutex);
+                ackIds.insert(ackId);
+            }
+            if (acking) {
+                char ack[24];
+                snprintf(ack, sizeof(ack), "43%u[]", ackId);
+                push(ack);
+            }
+            return;
+        }
+        if (text.compare(0, 27, "42[\"sensorData\",{\"SensorID\"") == 0) {
+            readings++;
+        }
+        LoopbackServer::textReceived(text);
+    }
+
+private:
+    std::mutex idMutex;
+    std::set<uint32_t> ackIds;
+};
+
+/**
+ * Function that runs the network core as networkTask does, until the condition is true.
+ * @return true if it was within 5 s
+ */
+template <typename Condition>
+bool runNetwork(Condition condition) {
+    unsigned long start = millis();
+    while (!condition()) {
+        if (millis() - start > 5000) {
+            return false;
+        }
+        webSocket.loop();
+        sendQueuedTelemetry();
+    }
+    return true;
+}
+
+int main() {
+    Serial.end();
+    startRobot();
+    NoAckServer server;
+    CHECK(server.start());
+    webSocket.begin("127.0.0.1", server.port);
+    if (!CHECK(runNetwork([] { return webSocket.getConnectCount() == 1; }))) {
+        return testResult("test_reliable_outputs");
+    }
+
+    // Each output change is followed by a sensor value, which has to arrive also when the ack window is full
+    for (uint32_t i = 1; i <= OUTPUT_CHANGES; i++) {
+        sendDataToServer(DATA_OUTPUT_STATE, "001", 0.0, i % 2 == 1);
+        sendDataToServer(DATA_SENSOR_VALUE, "001", 20.0 + i, false);
+        if (!CHECK(runNetwork([&] { return server.readings == i; }))) {
+            fprintf(stderr, "    the sensor value after output change %u did not arrive\n", (unsigned) i);
+            break;
+        }
+    }
+    CHECK_EQUAL(0, telemetryDropped);
+    CHECK_EQUAL(SOCKETIOCLIENT_MAX_PENDING_ACKS, webSocket.getPendingAcks());
+    CHECK_EQUAL(TELEMETRY_HELD_SIZE - 1, heldCount);
+    CHECK_EQUAL(OUTPUT_CHANGES - SOCKETIOCLIENT_MAX_PENDING_ACKS - (TELEMETRY_HELD_SIZE - 1), heldDropped.load());
+    CHECK(runNetwork([&] { return server.outputChanges().size() == SOCKETIOCLIENT_MAX_PENDING_ACKS; }));
+
+    // The held output changes are sent when the server acks the ones in the window
+    server.acking = true;
+    CHECK(runNetwork([] { return heldCount == 0 && webSocket.getPendingAcks() == 0; }));
+    CHECK_EQUAL(SOCKETIOCLIENT_MAX_PENDING_ACKS + TELEMETRY_HELD_SIZE - 1, server.outputChanges().size());
+    printf("reliable outputs: %u output changes, %u sensor values received, %u output changes dropped\n",
+           (unsigned) OUTPUT_CHANGES, (unsigned) server.readings, (unsigned) heldDropped);
+    webSocket.disconnect();
+    server.stop();
+    return testResult("test_reliable_outputs");
+}
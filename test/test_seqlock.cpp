@@ -0,0 +1,145 @@
+/***********************************************************************************************************************
+ * TEST OF THE SEQLOCK
+ * RUNS A WRITER THREAD AS THE NETWORK CORE AND READER THREADS AS THE CONTROL CORE, AND CHECKS THAT A READER NEVER GETS
+ * PARTS OF TWO WRITES, AND THAT THE SEQUENCE NUMBERS AND VALUES IT SEES NEVER GO BACK. THEN DOES THE SAME WITH THE
+ * SETTINGS OF THE ROBOT CLIENT. BUILD WITH NATIVE_TSAN TO HAVE THREADSANITIZER CHECK THE MEMORY ORDER
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+#include <thread>
+#include <vector>
+
+/// Test Settings ///
+const uint32_t WRITES = 500000;
+const size_t READERS = 2;
+
+// A value larger than a word, so a reader interrupted by a write would see parts of both
+struct Sample {
+    uint32_t count;
+    uint32_t words[31];
+};
+
+/**
+ * @return true if every word of the sample was written by the same write
+ */
+bool whole(const Sample& sample) {
+    for (size_t i = 0; i < sizeof(sample.words) / sizeof(sample.words[0]); i++) {
+        if (sample.words[i] != sample.count * 2654435761u + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testSingleThread() {
+    Seqlock<Sample> lock;
+    Sample sample = {};
+    CHECK_EQUAL(0, lock.read(sample));
+    CHECK_EQUAL(0, sample.count);
+
+    Sample written = {};
+    written.count = 7;
+    lock.write(written);
+    CHECK_EQUAL(2, lock.sequence());
+    CHECK_EQUAL(2, lock.read(sample));
+    CHECK_EQUAL(7, sample.count);
+}
+
+void testNoTornReads() {
+    static Seqlock<Sample> lock;
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> backwards(0);
+    std::atomic<uint32_t> reads(0);
+
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < READERS; r++) {
+        readers.push_back(std::thread([&] {
+            uint32_t lastSequence = 0;
+            uint32_t lastCount = 0;
+            uint32_t count = 0;
+            while (!done) {
+                Sample sample;
+                uint32_t sequence = lock.read(sample);
+                if (sequence != 0 && !whole(sample)) {
+                    torn++;
+                }
+                if ((sequence & 1) != 0 || sequence < lastSequence || sample.count < lastCount) {
+                    backwards++;
+                }
+                lastSequence = sequence;
+                lastCount = sample.count;
+                count++;
+            }
+            reads += count;
+        }));
+    }
+
+    Sample sample;
+    for (uint32_t write = 1; write <= WRITES; write++) {
+        sample.count = write;
+        for (size_t i = 0; i < sizeof(sample.words) / sizeof(sample.words[0]); i++) {
+            sample.words[i] = write * 2654435761u + i;
+        }
+        lock.write(sample);
+    }
+    done = true;
+    for (size_t r = 0; r < readers.size(); r++) {
+        readers[r].join();
+    }
+
+    CHECK_EQUAL(0, torn);
+    CHECK_EQUAL(0, backwards);
+    CHECK_EQUAL(2 * WRITES, lock.sequence());
+    printf("seqlock: %u writes, %u reads, none torn\n", (unsigned) WRITES, (unsigned) reads);
+}
+
+void testServerSettings() {
+    startRobot();
+    std::atomic<bool> done(false);
+    uint32_t torn = 0;
+    // The settings from setupChannels are not checked
+    uint32_t initialSequence = serverSettingsLock.sequence();
+
+    // The network core writes set-points where every field of a channel holds the same number
+    std::thread network([&] {
+        for (uint32_t i = 1; i <= WRITES / 10; i++) {
+            for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+                ChannelSettings& settings = serverSettings.channels[c];
+                settings.revision = i;
+                settings.setpoint = i;
+                settings.hysteresis = i;
+                settings.minOnTime = i;
+                settings.minOffTime = i;
+                settings.kp = i;
+            }
+            serverSettingsLock.write(serverSettings);
+        }
+        done = true;
+    });
+
+    while (!done) {
+        ServerSettings settings;
+        if (serverSettingsLock.read(settings) == initialSequence) {
+            continue;
+        }
+        uint32_t revision = settings.channels[0].revision;
+        for (size_t c = 0; c < CHANNEL_COUNT; c++) {
+            const ChannelSettings& channel = settings.channels[c];
+            if (channel.revision != revision || channel.setpoint != revision || channel.hysteresis != revision ||
+                channel.minOnTime != revision || channel.minOffTime != revision || channel.kp != revision) {
+                torn++;
+            }
+        }
+    }
+    network.join();
+    CHECK_EQUAL(0, torn);
+}
+
+int main() {
+    Serial.end();
+    testSingleThread();
+    testNoTornReads();
+    testServerSettings();
+    return testResult("test_seqlock");
+}
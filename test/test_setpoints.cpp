@@ -0,0 +1,321 @@
+/***********************************************************************************************************************
+ * TEST OF THE SET-POINT PARSER
+ * CHECKS KNOWN SET-POINTS AND THE LIMITS OF THE PARSER, THEN RUNS THE CORPUS IN TEST/CORPUS/SETPOINTS, WHERE THE FILES
+ * NAMED VALID_* HAVE TO BE ACCEPTED AND INVALID_* REJECTED, AND RANDOM MUTATIONS OF IT. EVERY INPUT IS COPIED TO A
+ * BUFFER OF ITS EXACT SIZE, SO WITH NATIVE_SANITIZE A READ OUTSIDE THE PAYLOAD STOPS THE TEST. A REJECTED PAYLOAD MAY NOT
+ * CHANGE THE SETTINGS. LAST IT MEASURES THE PARSER
+ *
+ * Run by ctest as: test_setpoints <corpus directory>
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+#include <chrono>
+#include <dirent.h>
+#include <random>
+#include <string>
+#include <vector>
+
+/// Test Settings ///
+const uint32_t FUZZ_MUTATIONS = 200000;
+const uint32_t BENCHMARK_PAYLOADS = 1000000;
+
+// A file of the corpus
+struct CorpusEntry {
+    std::string name;
+    std::string content;
+};
+
+/**
+ * Function that parses a copy of the set-points in a buffer of their exact size.
+ * @param text          the set-points
+ * @param updates       one entry per channel
+ * @return the result of parseSetpoints
+ */
+bool parse(const std::string& text, SetpointUpdate * updates) {
+    std::vector<char> copy(text.begin(), text.end());
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        updates[i] = SetpointUpdate();
+    }
+    return parseSetpoints(copy.empty() ? NULL : copy.data(), copy.size(), updates);
+}
+
+/**
+ * @return true if the set-points are valid
+ */
+bool valid(const std::string& text) {
+    SetpointUpdate updates[CHANNEL_COUNT];
+    return parse(text, updates);
+}
+
+void testKnownSetpoints() {
+    SetpointUpdate updates[CHANNEL_COUNT];
+
+    CHECK(parse("{\"001\":21.5}", updates));
+    CHECK(updates[0].received);
+    CHECK_EQUAL(1 << FIELD_SETPOINT, updates[0].fields);
+    CHECK_NEAR(21.5, updates[0].values[FIELD_SETPOINT], 0.0001);
+    CHECK(!updates[1].received);
+
+    // The set-points can come as an escaped JSON string
+    CHECK(parse("{\\\"001\\\":{\\\"setpoint\\\":22,\\\"mode\\\":\\\"relay\\\",\\\"minOnTime\\\":30},\\\"002\\\":\\\"none\\\"}",
+                updates));
+    CHECK_NEAR(22.0, updates[0].values[FIELD_SETPOINT], 0.0001);
+    CHECK_NEAR(30.0, updates[0].values[FIELD_MIN_ON_TIME], 0.0001);
+    CHECK(updates[0].hasMode);
+    CHECK_EQUAL(CONTROL_PID_RELAY, updates[0].control);
+    CHECK(updates[1].surveillance);
+
+    // Unknown keys and sensors without an actuator are skipped, also when they hold nested values
+    CHECK(parse("{\"001\":{\"setpoint\":20,\"extra\":{\"a\":[1,{\"b\":null}]}},\"999\":[true],\"003\":21}", updates));
+    CHECK_NEAR(20.0, updates[0].values[FIELD_SETPOINT], 0.0001);
+    CHECK(!updates[2].received);
+
+    // An unknown mode keeps the way of regulation
+    CHECK(parse("{\"001\":{\"mode\":\"fast\"}}", updates));
+    CHECK(updates[0].received);
+    CHECK(!updates[0].hasMode);
+
+    CHECK(parse("{}", updates));
+    CHECK(!parse("", updates));
+    CHECK(!parse("{\"001\":\"on\"}", updates));
+    CHECK(!parse("{\"001\":21}}", updates));
+}
+
+void testLimits() {
+    // Values nested SETPOINT_MAX_DEPTH deep are skipped, deeper set-points are rejected
+    std::string nested = "1";
+    for (uint8_t depth = 0; depth < SETPOINT_MAX_DEPTH; depth++) {
+        nested = "[" + nested + "]";
+    }
+    CHECK(valid("{\"999\":" + nested + "}"));
+    CHECK(!valid("{\"999\":[" + nested + "]}"));
+    CHECK(!valid("{\"999\":" + std::string(10000, '[') + "}"));
+
+    // Numbers of up to 31 characters are read, longer numbers and numbers a float can not hold are rejected
+    CHECK(valid("{\"001\":" + std::string("21.") + std::string(28, '0') + "}"));
+    CHECK(!valid("{\"001\":" + std::string("21.") + std::string(29, '0') + "}"));
+    CHECK(!valid("{\"001\":1e39}"));
+    CHECK(!valid("{\"001\":-}"));
+    CHECK(!valid("{\"001\":1.}"));
+    CHECK(!valid("{\"001\":1e}"));
+
+    // The control limits can not be negative, and the times have to fit in an unsigned long in ms. A value out of range
+    // rejects the whole set-points
+    const char * const LIMITS[] = {"hysteresis", "minOnTime", "minOffTime", "maxSwitchesPerHour"};
+    for (size_t i = 0; i < sizeof(LIMITS) / sizeof(LIMITS[0]); i++) {
+        std::string field = std::string("\"") + LIMITS[i] + "\":";
+        CHECK(valid("{\"001\":{" + field + "0}}"));
+        CHECK(valid("{\"001\":{" + field + "86400}}"));
+        if (!CHECK(!valid("{\"001\":{" + field + "-5}}")) || !CHECK(!valid("{\"001\":{" + field + "-0.001}}")) ||
+            !CHECK(!valid("{\"001\":21,\"002\":{\"setpoint\":900," + field + "-1e30}}"))) {
+            fprintf(stderr, "    negative %s accepted\n", LIMITS[i]);
+        }
+    }
+    CHECK(!valid("{\"001\":{\"minOnTime\":1e30}}"));
+    CHECK(!valid("{\"001\":{\"minOffTime\":1e30}}"));
+    // The hysteresis is kept as a float, so any finite size is taken
+    CHECK(valid("{\"001\":{\"hysteresis\":1e30}}"));
+    CHECK(!valid("{\"001\":{\"hysteresis\":1e39}}"));
+    // The limit of the times is where the value in ms reaches ULONG_MAX + 1
+    float limit = (float) ULONG_MAX / 1000;
+    CHECK(setpointFieldInRange(FIELD_MIN_ON_TIME, limit * 0.999f));
+    CHECK(!setpointFieldInRange(FIELD_MIN_OFF_TIME, limit * 1.001f));
+    CHECK(setpointFieldInRange(FIELD_KP, -1.0f));
+
+    // Strings longer than SETPOINT_MAX_STRING are read but match nothing
+    std::string longKey(SETPOINT_MAX_STRING, 'k');
+    CHECK(valid("{\"" + longKey + "\":{\"setpoint\":1},\"001\":2}"));
+    SetpointUpdate updates[CHANNEL_COUNT];
+    CHECK(parse("{\"001" + std::string(SETPOINT_MAX_STRING, ' ') + "\":2}", updates));
+    CHECK(!updates[0].received);
+    CHECK(!valid("{\"001\":\"" + std::string(100000, 'n') + "\"}"));
+
+    // Every shorter part of a valid payload is rejected
+    std::string full = "{\"001\":{\"setpoint\":21.5,\"mode\":\"pwm\",\"kp\":0.5},\"002\":\"none\"}";
+    for (size_t length = 0; length < full.size(); length++) {
+        if (!CHECK(!valid(full.substr(0, length)))) {
+            fprintf(stderr, "accepted: %s\n", full.substr(0, length).c_str());
+        }
+    }
+    CHECK(valid(full));
+}
+
+void testSettingsUnchangedWhenRejected() {
+    startRobot();
+    sendSetpoints("{\"001\":{\"setpoint\":21,\"mode\":\"pwm\"},\"002\":900}");
+    CHECK_NEAR(21.0, serverSettings.channels[0].setpoint, 0.0001);
+    CHECK_EQUAL(CONTROL_PID_PWM, channelStates[0].control);
+    uint32_t sequence = serverSettingsLock.sequence();
+
+    // The first channel is valid, but the payload is not, so nothing is changed
+    const char * invalid = "{\"001\":{\"setpoint\":25,\"mode\":\"onoff\"},\"002\":\"nonee\"}";
+    ServerSettings before = serverSettings;
+    manageServerSetpoints(invalid, strlen(invalid));
+    CHECK(memcmp(&before, &serverSettings, sizeof(before)) == 0);
+    CHECK_EQUAL(sequence, serverSettingsLock.sequence());
+
+    // A time out of range in one channel also leaves the other unchanged
+    const char * outOfRange = "{\"001\":{\"setpoint\":25,\"minOnTime\":-5},\"002\":{\"minOffTime\":1e30}}";
+    manageServerSetpoints(outOfRange, strlen(outOfRange));
+    CHECK(memcmp(&before, &serverSettings, sizeof(before)) == 0);
+    CHECK_EQUAL(sequence, serverSettingsLock.sequence());
+
+    // A time in range is converted to ms
+    sendSetpoints("{\"001\":{\"minOnTime\":86400,\"minOffTime\":0.5}}");
+    CHECK_EQUAL(86400000UL, serverSettings.channels[0].minOnTime);
+    CHECK_EQUAL(500UL, serverSettings.channels[0].minOffTime);
+}
+
+/**
+ * Function that reads every file of the corpus directory.
+ * @return the names and contents of the files
+ */
+std::vector<CorpusEntry> readCorpus(const char * directory) {
+    std::vector<CorpusEntry> corpus;
+    DIR * dir = opendir(directory);
+    if (dir == NULL) {
+        return corpus;
+    }
+    while (struct dirent * entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = std::string(directory) + "/" + entry->d_name;
+        FILE * file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            continue;
+        }
+        CorpusEntry corpusEntry;
+        corpusEntry.name = entry->d_name;
+        char chunk[256];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            corpusEntry.content.append(chunk, read);
+        }
+        fclose(file);
+        corpus.push_back(corpusEntry);
+    }
+    closedir(dir);
+    return corpus;
+}
+
+/**
+ * Function that checks that each file of the corpus is accepted or rejected as its name says.
+ */
+void testCorpus(const std::vector<CorpusEntry>& corpus) {
+    for (size_t i = 0; i < corpus.size(); i++) {
+        bool expected = corpus[i].name.compare(0, 6, "valid_") == 0;
+        if (!CHECK(expected || corpus[i].name.compare(0, 8, "invalid_") == 0) ||
+            !CHECK(valid(corpus[i].content) == expected)) {
+            fprintf(stderr, "    in corpus file %s\n", corpus[i].name.c_str());
+        }
+    }
+}
+
+/**
+ * Function that gives the client one input, and checks that a rejected input does not change the settings and that an
+ * accepted input only gives finite numbers.
+ */
+void fuzzOne(const std::string& input) {
+    std::vector<char> copy(input.begin(), input.end());
+    ServerSettings before = serverSettings;
+    SetpointUpdate updates[CHANNEL_COUNT] = {};
+    bool accepted = parseSetpoints(copy.empty() ? NULL : copy.data(), copy.size(), updates);
+    manageServerSetpoints(copy.empty() ? NULL : copy.data(), copy.size());
+    if (!accepted) {
+        CHECK(memcmp(&before, &serverSettings, sizeof(before)) == 0);
+        return;
+    }
+    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+        for (size_t field = 0; field < FIELD_COUNT; field++) {
+            CHECK(!(updates[i].fields & (1 << field)) || isfinite(updates[i].values[field]));
+        }
+    }
+}
+
+/**
+ * Function that mutates the corpus the way a fuzzer does: flips, inserts, removes and splices bytes, with a bias to
+ * the characters the parser looks at.
+ */
+void testFuzz(const std::vector<CorpusEntry>& corpus) {
+    static const char interesting[] = "0123456789{}[]\":,.-+eE\\ n";
+    std::mt19937 random(17);
+    startRobot();
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < FUZZ_MUTATIONS; i++) {
+        std::string input = corpus[random() % corpus.size()].content;
+        uint32_t mutations = 1 + random() % 4;
+        for (uint32_t m = 0; m < mutations; m++) {
+            size_t position = input.empty() ? 0 : random() % (input.size() + 1);
+            switch (random() % 5) {
+                case 0:
+                    if (position < input.size()) {
+                        input[position] ^= (char) (1 << (random() % 8));
+                    }
+                    break;
+                case 1:
+                    input.insert(position, 1, interesting[random() % (sizeof(interesting) - 1)]);
+                    break;
+                case 2:
+                    if (position < input.size()) {
+                        input.erase(position, 1 + random() % 8);
+                    }
+                    break;
+                case 3:
+                    input.insert(position, std::string(1 + random() % 40, random() % 2 ? '9' : '['));
+                    break;
+                default: {
+                    const std::string& other = corpus[random() % corpus.size()].content;
+                    input = input.substr(0, position) + other.substr(random() % (other.size() + 1));
+                    break;
+                }
+            }
+        }
+        fuzzOne(input);
+        accepted += valid(input);
+        if (testFailures() > 0) {
+            fprintf(stderr, "failed on input: %s\n", input.c_str());
+            return;
+        }
+    }
+    printf("fuzz: %u seeds, %u mutations, %u accepted\n", (unsigned) corpus.size(), (unsigned) FUZZ_MUTATIONS,
+           (unsigned) accepted);
+}
+
+/**
+ * Function that measures the parser on the set-points the server sends.
+ */
+void benchmarkParse() {
+    const char * payload = "{\"001\":{\"setpoint\":21.5,\"mode\":\"pwm\",\"kp\":0.5,\"ki\":0.002},\"002\":\"none\"}";
+    size_t length = strlen(payload);
+    SetpointUpdate updates[CHANNEL_COUNT];
+    uint32_t accepted = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_PAYLOADS; i++) {
+        memset(updates, 0, sizeof(updates));
+        accepted += parseSetpoints(payload, length, updates);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQUAL(BENCHMARK_PAYLOADS, accepted);
+    printf("parse: %.0f set-points/s, %.2f us per payload of %u bytes\n", BENCHMARK_PAYLOADS / seconds,
+           seconds * 1e6 / BENCHMARK_PAYLOADS, (unsigned) length);
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: test_setpoints <corpus directory>\n");
+        return 2;
+    }
+    Serial.end();
+    std::vector<CorpusEntry> corpus = readCorpus(argv[1]);
+    if (!CHECK(!corpus.empty())) {
+        return testResult("test_setpoints");
+    }
+    testKnownSetpoints();
+    testLimits();
+    testSettingsUnchangedWhenRejected();
+    testCorpus(corpus);
+    testFuzz(corpus);
+    benchmarkParse();
+    return testResult("test_setpoints");
+}
@@ -0,0 +1,140 @@
+/***********************************************************************************************************************
+ * TEST OF THE SINGLE PRODUCER / SINGLE CONSUMER QUEUE
+ * RUNS A PRODUCER AND A CONSUMER THREAD AS THE CONTROL CORE AND THE NETWORK CORE, AND CHECKS THAT THE ITEMS COME OUT IN
+ * THE ORDER THEY WENT IN. THEN CHECKS THAT QUEUETELEMETRY DROPS MESSAGES WHEN THE QUEUE IS FULL, THAT EVERY MESSAGE IS
+ * EITHER DELIVERED WHOLE OR COUNTED IN TELEMETRYDROPPED, AND THAT THE DROPS DO NOT CHANGE THE ORDER. BUILD WITH
+ * NATIVE_TSAN TO HAVE THREADSANITIZER CHECK THE MEMORY ORDER
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+#include <thread>
+
+/// Test Settings ///
+const uint32_t FIFO_ITEMS = 2000000;
+const uint32_t TELEMETRY_MESSAGES = 200000;
+
+void testFull() {
+    SpscQueue<uint32_t, 4> queue;
+    CHECK(queue.peek() == NULL);
+    for (uint32_t i = 0; i < 4; i++) {
+        uint32_t * slot = queue.beginPush();
+        if (!CHECK(slot != NULL)) {
+            return;
+        }
+        *slot = i;
+        queue.commitPush();
+    }
+    CHECK(queue.beginPush() == NULL);
+
+    // A slot is free again once the oldest item is taken out
+    CHECK_EQUAL(0, *queue.peek());
+    queue.pop();
+    uint32_t * slot = queue.beginPush();
+    if (CHECK(slot != NULL)) {
+        *slot = 4;
+        queue.commitPush();
+    }
+    for (uint32_t i = 1; i <= 4; i++) {
+        CHECK_EQUAL(i, *queue.peek());
+        queue.pop();
+    }
+    CHECK(queue.peek() == NULL);
+}
+
+void testFifoThreads() {
+    static SpscQueue<uint32_t, 64> queue;
+    std::thread producer([] {
+        for (uint32_t i = 1; i <= FIFO_ITEMS; i++) {
+            uint32_t * slot;
+            while ((slot = queue.beginPush()) == NULL) {
+                std::this_thread::yield();
+            }
+            *slot = i;
+            queue.commitPush();
+        }
+    });
+
+    uint32_t expected = 1;
+    uint32_t outOfOrder = 0;
+    while (expected <= FIFO_ITEMS) {
+        uint32_t * item = queue.peek();
+        if (item == NULL) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (*item != expected) {
+            outOfOrder++;
+        }
+        expected++;
+        queue.pop();
+    }
+    producer.join();
+    CHECK_EQUAL(0, outOfOrder);
+    CHECK(queue.peek() == NULL);
+}
+
+void testTelemetryDrops() {
+    startRobot();
+    telemetryDropped = 0;
+    std::atomic<bool> done(false);
+
+    // The producer does not wait for the consumer, as the control core does not wait for the network core
+    std::thread producer([&] {
+        char data[64];
+        for (uint32_t i = 1; i <= TELEMETRY_MESSAGES; i++) {
+            int length = snprintf(data, sizeof(data), "{\"SensorID\":\"001\",\"value\":%u}", (unsigned) i);
+            queueTelemetry("sensorData", data, length, false, false);
+            // A tick of the control core queues a burst of messages, more than the queue has room for
+            if (i % (2 * TELEMETRY_QUEUE_SIZE) == 0) {
+                std::this_thread::yield();
+            }
+        }
+        done = true;
+    });
+
+    uint32_t delivered = 0;
+    uint32_t last = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t torn = 0;
+    for (;;) {
+        bool finished = done;
+        TelemetryMessage * message = telemetryQueue.peek();
+        if (message == NULL) {
+            if (finished) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        unsigned value = 0;
+        char expected[64];
+        if (sscanf(message->data, "{\"SensorID\":\"001\",\"value\":%u}", &value) != 1 ||
+            snprintf(expected, sizeof(expected), "{\"SensorID\":\"001\",\"value\":%u}", value) != message->length ||
+            strcmp(expected, message->data) != 0 || strcmp(message->event, "sensorData") != 0) {
+            torn++;
+        }
+        if (value <= last) {
+            outOfOrder++;
+        }
+        last = value;
+        delivered++;
+        telemetryQueue.pop();
+    }
+    producer.join();
+
+    CHECK_EQUAL(TELEMETRY_MESSAGES, delivered + telemetryDropped);
+    CHECK(telemetryDropped > 0);
+    CHECK(delivered >= TELEMETRY_QUEUE_SIZE);
+    CHECK_EQUAL(0, outOfOrder);
+    CHECK_EQUAL(0, torn);
+    printf("spsc queue: %u of %u messages delivered, %u dropped\n", (unsigned) delivered,
+           (unsigned) TELEMETRY_MESSAGES, (unsigned) telemetryDropped);
+}
+
+int main() {
+    Serial.end();
+    testFull();
+    testFifoThreads();
+    testTelemetryDrops();
+    return testResult("test_spsc_queue");
+}
@@ -0,0 +1,129 @@
+/***********************************************************************************************************************
+ * TEST OF THE SWITCHING LIMITS OF THE ON / OFF REGULATION
+ * RUNS HOURS OF THE SIMULATED ROOM ON THE STOPPED CLOCK, AND CHECKS THAT THE OUTPUTS SWITCH AT MOST
+ * MAXSWITCHESPERHOUR TIMES PER HOUR AND STAY ON AND OFF FOR THE MINIMUM ON / OFF TIME. LAST IT PRINTS THE SWITCHES PER
+ * HOUR WITHOUT LIMITS AND WITH THE DEFAULT LIMITS
+ ***********************************************************************************************************************/
+#include <limits.h>
+#include "RobotTest.h"
+#include "TestCheck.h"
+
+/// Test Settings ///
+const unsigned long HOUR = 3600000;
+const uint8_t RATE_TEST_HOURS = 10;
+
+/**
+ * Keeps track of the switches of an output, and of the shortest time it stayed on and off. The first period is not
+ * counted, as the output may have been off for any time before the test.
+ */
+class OutputWatcher {
+public:
+    explicit OutputWatcher(int8_t pin)
+        : pin(pin), on(simulationOutput(pin) >= 0.5), lastChange(0), switches(0), shortestOn(ULONG_MAX),
+          shortestOff(ULONG_MAX) {}
+
+    int8_t pin;
+    bool on;
+    unsigned long lastChange;   // millis() of the last switch, 0 before the first
+    uint32_t switches;
+    unsigned long shortestOn;
+    unsigned long shortestOff;
+
+    void check() {
+        bool output = simulationOutput(pin) >= 0.5;
+        if (output == on) {
+            return;
+        }
+        unsigned long now = millis();
+        if (lastChange != 0) {
+            unsigned long& shortest = on ? shortestOn : shortestOff;
+            shortest = min(shortest, now - lastChange);
+        }
+        on = output;
+        lastChange = now;
+        switches++;
+    }
+};
+
+void testSwitchRate() {
+    startRobot();
+    // Without hysteresis and with short dwell times the heater would switch every few seconds, so only the rate
+    // limit holds it
+    sendSetpoints("{\"001\":{\"setpoint\":21,\"mode\":\"onoff\",\"hysteresis\":0,\"minOnTime\":10,\"minOffTime\":10,"
+                  "\"maxSwitchesPerHour\":20},\"002\":\"none\"}");
+    OutputWatcher heater(CHANNELS[0].outputPin);
+    uint32_t total = 0;
+    for (uint8_t hour = 0; hour < RATE_TEST_HOURS; hour++) {
+        heater.switches = 0;
+        runRobot(HOUR, [&] { heater.check(); });
+        // The budget starts full, so an hour can have a burst of 20 on top of the 20 that refill in it
+        CHECK(heater.switches <= 40);
+        total += heater.switches;
+    }
+    // On average at most 20 switches per hour after the first burst, and the limit is reached
+    CHECK(total <= 20 * RATE_TEST_HOURS + 20);
+    CHECK(total >= 20 * RATE_TEST_HOURS - 20);
+    CHECK(heater.shortestOn >= 10000);
+    CHECK(heater.shortestOff >= 10000);
+}
+
+void testMinOnOffTime() {
+    startRobot();
+    sendSetpoints("{\"001\":{\"setpoint\":21,\"mode\":\"onoff\",\"hysteresis\":0,\"minOnTime\":60,\"minOffTime\":90,"
+                  "\"maxSwitchesPerHour\":0},\"002\":{\"setpoint\":1000,\"mode\":\"onoff\",\"hysteresis\":0,"
+                  "\"minOnTime\":30,\"minOffTime\":45,\"maxSwitchesPerHour\":0}}");
+    OutputWatcher heater(CHANNELS[0].outputPin);
+    OutputWatcher ventilation(CHANNELS[1].outputPin);
+    runRobot(4 * HOUR, [&] {
+        heater.check();
+        ventilation.check();
+    });
+
+    // The heater switches often enough that the dwell times are what holds it. The ventilation lowers the CO2 level
+    // in seconds and the room takes long to raise it again, so it switches less often
+    CHECK(heater.switches > 20);
+    CHECK(ventilation.switches > 5);
+    CHECK(heater.shortestOn >= 60000);
+    CHECK(heater.shortestOff >= 90000);
+    CHECK(ventilation.shortestOn >= 30000);
+    CHECK(ventilation.shortestOff >= 45000);
+    // The outputs are set every REPORT_PERIOD, so they switch at the first report after the dwell time
+    CHECK(heater.shortestOn < 60000 + REPORT_PERIOD);
+    CHECK(heater.shortestOff < 90000 + REPORT_PERIOD);
+}
+
+/**
+ * Function that runs the room for some hours with the given set-points.
+ * @return switches per hour of the heater and the ventilation together
+ */
+float switchesPerHour(const char * setpoints, uint8_t hours) {
+    startRobot();
+    sendSetpoints(setpoints);
+    OutputWatcher heater(CHANNELS[0].outputPin);
+    OutputWatcher ventilation(CHANNELS[1].outputPin);
+    runRobot(hours * HOUR, [&] {
+        heater.check();
+        ventilation.check();
+    });
+    return (float) (heater.switches + ventilation.switches) / hours;
+}
+
+void testLimitsAgainstNone() {
+    float unlimited = switchesPerHour("{\"001\":{\"setpoint\":21,\"hysteresis\":0,\"minOnTime\":0,\"minOffTime\":0,"
+                                      "\"maxSwitchesPerHour\":0},\"002\":{\"setpoint\":1000,\"hysteresis\":0,"
+                                      "\"minOnTime\":0,\"minOffTime\":0,\"maxSwitchesPerHour\":0}}", 4);
+    float limited = switchesPerHour("{\"001\":21,\"002\":1000}", 4);
+    // The default limits allow DEFAULT_MAX_SWITCHES_PER_HOUR per output, with a burst of as many at start
+    CHECK(limited <= 2 * DEFAULT_MAX_SWITCHES_PER_HOUR * 1.25);
+    CHECK(unlimited > 4 * limited);
+    printf("switching: %.0f switches/hour without limits, %.0f with the default limits\n", unlimited, limited);
+}
+
+int main() {
+    Serial.end();
+    nativeClockStop();
+    testSwitchRate();
+    testMinOnOffTime();
+    testLimitsAgainstNone();
+    return testResult("test_switching");
+}
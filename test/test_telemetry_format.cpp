@@ -0,0 +1,208 @@
+/***********************************************************************************************************************
+ * TEST OF THE BINARY TELEMETRY FORMAT
+ * FIRST MEASURES THE ENCODER AND THE BYTES PER READING. THEN DECODES THE 6 BYTE HEADER AND 7 BYTE RECORDS THE CLIENT
+ * SENDS WITH EVENT "SENSORDATABINARY" AS DECODETELEMETRY IN SERVER_NO_ENCRYPT.JS DOES, AND CHECKS THE SCALING AND LIMITS
+ * OF THE VALUES, A BATCH THAT IS FULL, AND A BATCH THAT IS SENT BEFORE THE TIME SINCE ITS FIRST RECORD OVERFLOWS THE
+ * DELTA
+ ***********************************************************************************************************************/
+#include "RobotTest.h"
+#include "TestCheck.h"
+#include <vector>
+
+/// Test Settings ///
+const uint32_t ENCODE_RECORDS = 5000000;
+
+// A record decoded from the binary format
+struct Reading {
+    uint16_t id;
+    uint8_t type;
+    uint32_t time;
+    float value;
+};
+
+uint16_t readUint16(const uint8_t * buffer) {
+    return buffer[0] | (buffer[1] << 8);
+}
+
+/**
+ * Function that decodes a batch of the binary format as decodeTelemetry in server_no_encrypt.js does.
+ * @param data          the batch
+ * @param length        length of the batch
+ * @param readings      where the readings are written
+ * @return false if the header or the length is wrong
+ */
+bool decodeBatch(const uint8_t * data, size_t length, std::vector<Reading>& readings) {
+    readings.clear();
+    if (length < TELEMETRY_HEADER_SIZE || data[0] != TELEMETRY_FORMAT_VERSION ||
+        length != TELEMETRY_HEADER_SIZE + data[1] * TELEMETRY_RECORD_SIZE) {
+        return false;
+    }
+    uint32_t time = readUint16(&data[2]) | ((uint32_t) readUint16(&data[4]) << 16);
+    for (uint8_t i = 0; i < data[1]; i++) {
+        const uint8_t * record = &data[TELEMETRY_HEADER_SIZE + i * TELEMETRY_RECORD_SIZE];
+        Reading reading;
+        reading.id = readUint16(&record[0]);
+        reading.type = record[2];
+        reading.time = time + readUint16(&record[3]);
+        int16_t value = (int16_t) readUint16(&record[5]);
+        float scale = (reading.type == DATA_SENSOR_VALUE) ? 10.0 : (reading.type == DATA_OUTPUT_LEVEL) ? 1000.0 : 1.0;
+        reading.value = value / scale;
+        readings.push_back(reading);
+    }
+    return true;
+}
+
+/**
+ * Function that takes the next binary batch the client has queued for the server, and decodes it.
+ * @param readings      where the readings are written
+ * @return false if there was no valid batch
+ */
+bool takeBatch(std::vector<Reading>& readings) {
+    TelemetryMessage * message = telemetryQueue.peek();
+    if (!CHECK(message != NULL)) {
+        return false;
+    }
+    CHECK(message->binary);
+    CHECK(strcmp(message->event, "sensorDataBinary") == 0);
+    bool ok = decodeBatch((const uint8_t *) message->data, message->length, readings);
+    telemetryQueue.pop();
+    return CHECK(ok);
+}
+
+/**
+ * @return the value of a single record after it is encoded and decoded
+ */
+float roundTrip(DataType type, float value) {
+    uint8_t batch[TELEMETRY_HEADER_SIZE + TELEMETRY_RECORD_SIZE];
+    encodeTelemetryHeader(batch, 1, 0);
+    encodeTelemetryRecord(&batch[TELEMETRY_HEADER_SIZE], type, "001", 0, value);
+    std::vector<Reading> readings;
+    if (!CHECK(decodeBatch(batch, sizeof(batch), readings))) {
+        return NAN;
+    }
+    return readings[0].value;
+}
+
+void testValues() {
+    CHECK_NEAR(21.4, roundTrip(DATA_SENSOR_VALUE, 21.44), 0.0001);
+    CHECK_NEAR(-5.1, roundTrip(DATA_SENSOR_VALUE, -5.06), 0.0001);
+    CHECK_NEAR(1.0, roundTrip(DATA_OUTPUT_STATE, 1.0), 0.0);
+    CHECK_NEAR(0.0, roundTrip(DATA_OUTPUT_STATE, 0.0), 0.0);
+    CHECK_NEAR(0.457, roundTrip(DATA_OUTPUT_LEVEL, 0.4567), 0.0001);
+
+    // The limits of int16, sensor values up to 3276.7 and output levels up to 32.767 fit
+    CHECK_NEAR(3276.7, roundTrip(DATA_SENSOR_VALUE, 3276.7), 0.01);
+    CHECK_NEAR(-3276.8, roundTrip(DATA_SENSOR_VALUE, -3276.8), 0.01);
+    // Larger values are sent as the limit, not wrapped around to the other sign
+    CHECK_NEAR(3276.7, roundTrip(DATA_SENSOR_VALUE, 5000.0), 0.01);
+    CHECK_NEAR(-3276.8, roundTrip(DATA_SENSOR_VALUE, -100000.0), 0.01);
+    CHECK_NEAR(32.767, roundTrip(DATA_OUTPUT_LEVEL, 40.0), 0.0001);
+    CHECK_NEAR(3276.7, roundTrip(DATA_SENSOR_VALUE, 1e30), 0.01);
+    CHECK_NEAR(-3276.8, roundTrip(DATA_SENSOR_VALUE, NAN), 0.01);
+
+    // The ID is sent as a number
+    uint8_t record[TELEMETRY_RECORD_SIZE];
+    encodeTelemetryRecord(record, DATA_SENSOR_VALUE, "065", 513, 1.0);
+    CHECK_EQUAL(65, readUint16(&record[0]));
+    CHECK_EQUAL(DATA_SENSOR_VALUE, record[2]);
+    CHECK_EQUAL(513, readUint16(&record[3]));
+}
+
+void testBatch() {
+    startRobot();
+    unsigned long start = millis();
+    addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "001", 21.4, false);
+    nativeClockAdvance(250000);
+    addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "002", 912.3, false);
+    addBinaryToTelemetryBatch(DATA_OUTPUT_LEVEL, "001", 0.42, true);
+    CHECK(telemetryBatchUrgent);
+    flushTelemetryBatch();
+
+    std::vector<Reading> readings;
+    if (takeBatch(readings) && CHECK_EQUAL(3, readings.size())) {
+        CHECK_EQUAL(1, readings[0].id);
+        CHECK_EQUAL((uint32_t) start, readings[0].time);
+        CHECK_NEAR(21.4, readings[0].value, 0.0001);
+        CHECK_EQUAL(2, readings[1].id);
+        CHECK_EQUAL((uint32_t) start + 250, readings[1].time);
+        CHECK_NEAR(912.3, readings[1].value, 0.0001);
+        CHECK_EQUAL(DATA_OUTPUT_LEVEL, readings[2].type);
+        CHECK_NEAR(0.42, readings[2].value, 0.0001);
+    }
+    CHECK_EQUAL(0, telemetryBatchLength);
+}
+
+void testFullBatch() {
+    startRobot();
+    // The batch holds as many records as fit in telemetryBatch, the next one is sent in a new batch
+    const size_t RECORDS = (sizeof(telemetryBatch) - TELEMETRY_HEADER_SIZE) / TELEMETRY_RECORD_SIZE;
+    for (size_t i = 0; i <= RECORDS; i++) {
+        addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "001", i / 10.0, false);
+    }
+    std::vector<Reading> readings;
+    if (takeBatch(readings) && CHECK_EQUAL(RECORDS, readings.size())) {
+        CHECK_NEAR((RECORDS - 1) / 10.0, readings[RECORDS - 1].value, 0.0001);
+    }
+    flushTelemetryBatch();
+    if (takeBatch(readings) && CHECK_EQUAL(1, readings.size())) {
+        CHECK_NEAR(RECORDS / 10.0, readings[0].value, 0.0001);
+    }
+}
+
+void testDeltaOverflow() {
+    startRobot();
+    unsigned long start = millis();
+    addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "001", 20.0, false);
+    // The largest delta still fits in the batch
+    nativeClockAdvance(0xFFFF * 1000UL);
+    addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "001", 20.1, false);
+    CHECK(telemetryQueue.peek() == NULL);
+    // One ms later the batch is sent first, and the record starts a new batch
+    nativeClockAdvance(1000);
+    addBinaryToTelemetryBatch(DATA_SENSOR_VALUE, "001", 20.2, false);
+
+    std::vector<Reading> readings;
+    if (takeBatch(readings) && CHECK_EQUAL(2, readings.size())) {
+        CHECK_EQUAL((uint32_t) start, readings[0].time);
+        CHECK_EQUAL((uint32_t) start + 0xFFFF, readings[1].time);
+    }
+    flushTelemetryBatch();
+    if (takeBatch(readings) && CHECK_EQUAL(1, readings.size())) {
+        CHECK_EQUAL((uint32_t) start + 0x10000, readings[0].time);
+        CHECK_NEAR(20.2, readings[0].value, 0.0001);
+    }
+}
+
+void benchmarkEncoder() {
+    uint8_t batch[sizeof(telemetryBatch)];
+    const size_t RECORDS = (sizeof(batch) - TELEMETRY_HEADER_SIZE) / TELEMETRY_RECORD_SIZE;
+    uint32_t checksum = 0;
+    unsigned long start = micros();
+    for (uint32_t i = 0; i < ENCODE_RECORDS; i++) {
+        size_t slot = i % RECORDS;
+        encodeTelemetryRecord(&batch[TELEMETRY_HEADER_SIZE + slot * TELEMETRY_RECORD_SIZE], DATA_SENSOR_VALUE, "001",
+                              slot, 21.0 + (i & 0xFF) / 10.0);
+        checksum += batch[TELEMETRY_HEADER_SIZE + slot * TELEMETRY_RECORD_SIZE + 5];
+    }
+    float seconds = (micros() - start) / 1000000.0;
+    CHECK(checksum > 0);
+
+    // Bytes of a tick of three readings in the binary format, and as the JSON of "sensorDataBatch"
+    const char * json = "[{\"ControlledItemID\":\"001\",\"value\":0.42},{\"SensorID\":\"001\",\"value\":21.40},"
+                        "{\"SensorID\":\"002\",\"value\":912.30}]";
+    printf("binary telemetry: %.1f M records/s encoded, %.1f bytes per reading in a tick of 3 (JSON %.1f), "
+           "%.2f bytes per reading in a full batch\n",
+           ENCODE_RECORDS / seconds / 1e6, (TELEMETRY_HEADER_SIZE + 3 * TELEMETRY_RECORD_SIZE) / 3.0,
+           strlen(json) / 3.0, (float) (TELEMETRY_HEADER_SIZE + RECORDS * TELEMETRY_RECORD_SIZE) / RECORDS);
+}
+
+int main() {
+    Serial.end();
+    benchmarkEncoder();
+    nativeClockStop();
+    testValues();
+    testBatch();
+    testFullBatch();
+    testDeltaOverflow();
+    return testResult("test_telemetry_format");
+}